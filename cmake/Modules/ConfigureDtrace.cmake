@@ -23,6 +23,7 @@ IF(DTRACE)
     ENDIF()
 
     ADD_DEFINITIONS(-DHAVE_DTRACE)
+    SET(LCB_HAVE_DTRACE ON)
     IF(NOT APPLE)
         SET(LCB_DTRACE_OBJECT "${LCB_GENSRCDIR}/probes.o")
         # Generate probes.o
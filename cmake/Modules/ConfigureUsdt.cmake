@@ -0,0 +1,10 @@
+# Without DTrace, Linux builds define the request lifecycle probes of
+# src/trace.h with <sys/sdt.h> (from systemtap-sdt-dev or systemtap-sdt-devel),
+# which needs no generated code
+INCLUDE(CheckIncludeFiles)
+CHECK_INCLUDE_FILES(sys/sdt.h HAVE_SYS_SDT_H)
+IF(HAVE_SYS_SDT_H)
+    ADD_DEFINITIONS(-DHAVE_USDT)
+ELSE()
+    MESSAGE(STATUS "sys/sdt.h not found. USDT probes will not be built")
+ENDIF()
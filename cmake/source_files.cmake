@@ -65,6 +65,10 @@ SET(LCB_CORE_CXXSRC
     src/http/http.cc
     src/http/http_io.cc
     src/lcbht/lcbht.cc
+    src/nearcache.cc
+    src/opcapture.cc
+    src/slowops.cc
+    src/metrics.cc
     src/newconfig.cc
     src/n1ql/params.cc
     src/n1ql/n1ql.cc
@@ -244,6 +244,11 @@ typedef struct lcb_cntl_vbinfo_st {
  * This is the time the client will wait between repeated probes to
  * a given server.
  *
+ * When polling using sequence numbers (@ref LCB_DURABILITY_MODE_SEQNO), the
+ * client starts with a shorter interval and backs off based on how long
+ * items have previously taken to be persisted or replicated. In this mode
+ * this value is the maximum interval between probes.
+ *
  * @cntl_arg_both{lcb_U32*}
  * @committed*/
 #define LCB_CNTL_DURABILITY_INTERVAL    0x0e
@@ -1005,8 +1010,537 @@ typedef const char *lcb_BUCKETCRED[2];
  */
 #define LCB_CNTL_SEND_HELLO 0x47
 
+/**
+ * Maximum number of concurrent document fetches for a view query using
+ * @ref LCB_CMDVIEWQUERY_F_INCLUDE_DOCS.
+ *
+ * The library starts with a small window and grows it for as long as the
+ * latency of each fetch remains flat, shrinking it again when fetches time
+ * out. This setting is the upper bound for that window. It may be overridden
+ * per-query via lcb_CMDVIEWQUERY::docs_concurrent_max.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @uncommitted
+ *
+ * You can also use `views_docs_window` in the connection string.
+ */
+#define LCB_CNTL_VIEW_DOCS_WINDOW 0x48
+
+/**@brief Create a per-service HTTP pool setting value
+ * @param type the service to modify, as an @ref lcb_http_type_t. Only
+ * `LCB_HTTP_TYPE_VIEW`, `LCB_HTTP_TYPE_MANAGEMENT`, `LCB_HTTP_TYPE_N1QL`
+ * and `LCB_HTTP_TYPE_FTS` are accepted
+ * @param value the value for the setting (at most 0xffff)
+ * @return a value which can be assigned to an `lcb_U32` and passed to
+ * @ref LCB_CNTL_HTTP_SVC_POOLSIZE or @ref LCB_CNTL_HTTP_PRECONNECT
+ */
+#define LCB_HTTPPOOLOPT_CREATE(type, value) (((type) << 16) | (value))
+#define LCB_HTTPPOOLOPT_GETTYPE(u) ((u) >> 16)
+#define LCB_HTTPPOOLOPT_GETVALUE(u) ((u) & 0xffff)
+
+/**
+ * Value for @ref LCB_CNTL_HTTP_SVC_POOLSIZE indicating that the service
+ * uses the pool size of @ref LCB_CNTL_HTTP_POOLSIZE. Management requests are
+ * never pooled in this case.
+ */
+#define LCB_HTTPPOOL_INHERIT 0xffff
+
+/**
+ * Set the maximum number of idle pooled sockets kept per node for a single
+ * HTTP service. This overrides @ref LCB_CNTL_HTTP_POOLSIZE for that service.
+ *
+ * The argument is an `lcb_U32` created with LCB_HTTPPOOLOPT_CREATE(). When
+ * getting the value, the type must be filled in and the value is returned
+ * in the lower 16 bits.
+ *
+ * @code{.c}
+ * lcb_U32 val = LCB_HTTPPOOLOPT_CREATE(LCB_HTTP_TYPE_N1QL, 8);
+ * lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_HTTP_SVC_POOLSIZE, &val);
+ * @endcode
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @uncommitted
+ *
+ * You can also use `http_svc_poolsize` in the connection string, in the form
+ * of `service:count` where `service` is one of `views`, `mgmt`, `query` or
+ * `search`, e.g. `http_svc_poolsize=query:8`. The option may be repeated.
+ */
+#define LCB_CNTL_HTTP_SVC_POOLSIZE 0x49
+
+/**
+ * Number of sockets to open eagerly towards a node's HTTP service when the
+ * node first appears in the cluster configuration (including the initial
+ * configuration). This avoids paying connection setup costs on the first
+ * requests sent to a node. The count is capped by the pool size of the
+ * service, and pre-connected sockets are exempt from the idle timeout.
+ *
+ * The argument format is the same as for @ref LCB_CNTL_HTTP_SVC_POOLSIZE.
+ * The default is 0 for all services.
+ *
+ * @note Only the TCP connection is established in advance. When SSL is
+ * enabled the handshake happens when the socket is first used.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @uncommitted
+ *
+ * You can also use `http_preconnect` in the connection string, e.g.
+ * `http_preconnect=query:4`
+ */
+#define LCB_CNTL_HTTP_PRECONNECT 0x4A
+
+/**
+ * Interval at which idle pooled HTTP sockets are checked for having been
+ * closed by the server. Closed sockets are dropped from the pool (and
+ * replaced, if pre-connected) rather than being handed to a request, where
+ * they would fail. Setting this to 0 disables probing; sockets are then only
+ * checked when taken from the pool.
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ * @uncommitted
+ *
+ * You can also use `http_pool_probe_interval` in the connection string.
+ */
+#define LCB_CNTL_HTTP_POOL_PROBE_INTERVAL 0x4B
+
+/** Statistics for the HTTP socket pool. See @ref LCB_CNTL_HTTP_POOL_STATS */
+typedef struct lcb_cntl_httppoolstats_st {
+    /** Requests which were given an idle pooled socket */
+    lcb_U64 hits;
+    /** Requests which had to wait for a new socket to be connected */
+    lcb_U64 misses;
+    /** Sockets opened in advance because of @ref LCB_CNTL_HTTP_PRECONNECT */
+    lcb_U64 preconnects;
+    /** Idle sockets which were found to be closed by the server */
+    lcb_U64 dead;
+} lcb_cntl_httppoolstats;
+
+/**
+ * Retrieve counters describing the reuse of pooled HTTP sockets.
+ *
+ * @cntl_arg_getonly{lcb_cntl_httppoolstats*}
+ * @uncommitted
+ */
+#define LCB_CNTL_HTTP_POOL_STATS 0x4C
+
+/**
+ * How long the result of a successful hostname lookup is reused for new
+ * connections. Lookup results are shared by all instances in the process;
+ * this setting determines whether a cached result is fresh enough for this
+ * instance. A cached result is also discarded if connecting to it fails.
+ * Setting this to 0 causes every connection to perform its own lookup.
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ * @uncommitted
+ *
+ * You can also use `dns_cache_ttl` in the connection string.
+ */
+#define LCB_CNTL_DNS_CACHE_TTL 0x4D
+
+/**
+ * Like @ref LCB_CNTL_DNS_CACHE_TTL, but for failed lookups. This prevents
+ * repeated reconnect attempts to an unresolvable host from querying the
+ * system resolver each time.
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ * @uncommitted
+ *
+ * You can also use `dns_negative_ttl` in the connection string.
+ */
+#define LCB_CNTL_DNS_NEGATIVE_TTL 0x4E
+
+/** Hostname resolution counters. See @ref LCB_CNTL_DNS_STATS */
+typedef struct lcb_cntl_dnsstats_st {
+    /** Number of hostname lookups requested */
+    lcb_U64 lookups;
+    /** Lookups answered from the cache with a successful result */
+    lcb_U64 hits;
+    /** Lookups answered from the cache with a failed result */
+    lcb_U64 negative_hits;
+    /** Lookups which were passed to the system resolver */
+    lcb_U64 misses;
+    /** Lookups performed by a background thread, off the event loop */
+    lcb_U64 async;
+    /** System resolver lookups which failed */
+    lcb_U64 failures;
+    /** Total time spent in the system resolver, in microseconds */
+    lcb_U64 total_us;
+    /** Longest time spent in the system resolver, in microseconds */
+    lcb_U64 max_us;
+    /** Lookups which waited for a background lookup of the same host that
+     * was already in progress, rather than starting their own */
+    lcb_U64 coalesced;
+} lcb_cntl_dnsstats;
+
+/**
+ * Retrieve hostname resolution counters. These are shared by all the
+ * instances in the process.
+ *
+ * @cntl_arg_getonly{lcb_cntl_dnsstats*}
+ * @uncommitted
+ */
+#define LCB_CNTL_DNS_STATS 0x4F
+
+/**
+ * When the IPv6 policy is `LCB_IPV6_ALLOW` and a host resolves to several
+ * addresses, connection attempts to those addresses are raced, with IPv6 and
+ * IPv4 addresses alternating (see RFC 8305). A new
+ * attempt is started whenever the previous one fails, or has not completed
+ * within this delay. The first attempt to succeed is used and the others are
+ * closed.
+ *
+ * Setting this to 0 disables racing, and addresses are tried one at a time.
+ * Racing is only performed with event based I/O plugins.
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ * @uncommitted
+ *
+ * You can also use `connect_attempt_delay` in the connection string.
+ */
+#define LCB_CNTL_CONNECT_ATTEMPT_DELAY 0x50
+
+/** TLS handshake counters. See @ref LCB_CNTL_SSL_SESSION_STATS */
+typedef struct lcb_cntl_sslstats_st {
+    /** Handshakes which negotiated a new session */
+    lcb_U64 full_handshakes;
+    /** Handshakes which resumed a cached session */
+    lcb_U64 resumed_handshakes;
+    /** Number of hosts for which a session is currently cached */
+    lcb_U64 cached_sessions;
+    /** Handshakes after which encryption was offloaded to the kernel.
+     * See @ref LCB_CNTL_SSL_KTLS */
+    lcb_U64 ktls_handshakes;
+} lcb_cntl_sslstats;
+
+/**
+ * Retrieve TLS handshake counters for the instance.
+ *
+ * When SSL is enabled, the session (or session ticket) received from each
+ * `host:port` is cached, and used to resume the handshake of subsequent
+ * connections to that endpoint, saving a round trip and the key exchange.
+ * All counters are zero if SSL is not in use.
+ *
+ * @cntl_arg_getonly{lcb_cntl_sslstats*}
+ * @uncommitted
+ */
+#define LCB_CNTL_SSL_SESSION_STATS 0x51
+
+/**
+ * Offload TLS encryption of outgoing data to the kernel (kTLS).
+ *
+ * Once the handshake completes, OpenSSL installs the session keys on the
+ * socket, and data is then written to the socket directly, without passing
+ * through OpenSSL. Incoming data is also decrypted by the kernel where
+ * supported. If the kernel, the negotiated cipher or the OpenSSL build do not
+ * support this, encryption silently remains in userspace; see
+ * lcb_cntl_sslstats::ktls_handshakes.
+ *
+ * This is only available on Linux, with event based I/O plugins, and only
+ * affects connections made after it is set. It is off by default.
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @uncommitted
+ *
+ * You can also use `ktls` in the connection string.
+ */
+#define LCB_CNTL_SSL_KTLS 0x52
+
+/**
+ * Coalesce concurrent GETs for the same key.
+ *
+ * When enabled, a plain lcb_get3() (one which neither locks nor touches the
+ * item) for a key which already has such a GET in flight to the same server
+ * is not sent. Instead it waits for the response to the pending request, and
+ * its callback receives the same response (with its own cookie). GETs which
+ * lock or touch the item, and replica reads, are always sent.
+ *
+ * Note that a coalesced GET completes, or times out, together with the
+ * request it was attached to, and is therefore not cancelled by a subsequent
+ * lcb_sched_fail() if that request was scheduled earlier.
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @uncommitted
+ *
+ * You can also use `get_coalesce` in the connection string.
+ */
+#define LCB_CNTL_GET_COALESCE 0x53
+
+/** GET coalescing counters. See @ref LCB_CNTL_GET_COALESCE_STATS */
+typedef struct lcb_cntl_coalescestats_st {
+    /** GETs which were sent to the server while coalescing was enabled */
+    lcb_U64 requests;
+    /** GETs which were attached to a request already in flight */
+    lcb_U64 coalesced;
+} lcb_cntl_coalescestats;
+
+/**
+ * Retrieve the counters for @ref LCB_CNTL_GET_COALESCE.
+ *
+ * @cntl_arg_getonly{lcb_cntl_coalescestats*}
+ * @uncommitted
+ */
+#define LCB_CNTL_GET_COALESCE_STATS 0x54
+
+/**
+ * Maximum size, in bytes, of the near cache. 0 (the default) disables it.
+ *
+ * The near cache keeps the values returned by plain GETs (see
+ * @ref LCB_CNTL_GET_COALESCE) for @ref LCB_CNTL_NEAR_CACHE_TTL, and answers
+ * subsequent GETs for the same key without contacting the server. Entries
+ * for keys which are requested more often are preferred when the cache is
+ * full. An entry is dropped as soon as a response to a store, remove,
+ * counter or subdoc mutation of its key is received by this instance;
+ * mutations made by other clients are only observed once the entry expires.
+ *
+ * Responses served from the cache are delivered from the event loop as
+ * usual, but their lcb_RESPGET::bufh is NULL. GETs with the
+ * `LCB_CMDGET_F_NOCACHE` flag always go to the server.
+ *
+ * @cntl_arg_both{lcb_SIZE*}
+ * @uncommitted
+ *
+ * You can also use `near_cache_size` in the connection string.
+ */
+#define LCB_CNTL_NEAR_CACHE_SIZE 0x55
+
+/**
+ * How long a value may be served from the near cache after it was read
+ * from the server. The default is 500 milliseconds.
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ * @uncommitted
+ *
+ * You can also use `near_cache_ttl` in the connection string.
+ */
+#define LCB_CNTL_NEAR_CACHE_TTL 0x56
+
+/**
+ * Revalidate expired near cache entries instead of discarding them.
+ *
+ * When a GET finds an expired entry, the item's CAS is retrieved from its
+ * master using OBSERVE. If it is unchanged, the cached value is returned
+ * and its lifetime is extended; otherwise the item is fetched again. This
+ * saves bandwidth for large values which change rarely.
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @uncommitted
+ *
+ * You can also use `near_cache_revalidate` in the connection string.
+ */
+#define LCB_CNTL_NEAR_CACHE_REVALIDATE 0x57
+
+/** Near cache counters. See @ref LCB_CNTL_NEAR_CACHE_STATS */
+typedef struct lcb_cntl_nearcachestats_st {
+    /** GETs answered from the cache (including revalidated entries) */
+    lcb_U64 hits;
+    /** GETs which had to be sent to the server */
+    lcb_U64 misses;
+    /** Expired entries whose CAS was checked with the server */
+    lcb_U64 revalidations;
+    /** Entries removed to make room for new ones */
+    lcb_U64 evictions;
+    /** Values not cached because they were accessed less often than the
+     * entries they would have replaced, or were too large */
+    lcb_U64 rejections;
+    /** Entries removed because their key was modified */
+    lcb_U64 invalidations;
+    /** Number of entries currently cached */
+    lcb_U64 items;
+    /** Approximate memory used by the cached entries */
+    lcb_U64 bytes;
+} lcb_cntl_nearcachestats;
+
+/**
+ * Retrieve the counters for the near cache. See @ref LCB_CNTL_NEAR_CACHE_SIZE
+ *
+ * @cntl_arg_getonly{lcb_cntl_nearcachestats*}
+ * @uncommitted
+ */
+#define LCB_CNTL_NEAR_CACHE_STATS 0x58
+
+/**
+ * Defer network writes to the end of the current event loop iteration.
+ *
+ * Normally each lcb_sched_leave() prepares the affected connections for
+ * writing immediately. An application which schedules a single operation for
+ * each event it handles therefore causes (at least) one system call per
+ * operation. With this setting, the first lcb_sched_leave() for a server
+ * arms a zero-delay timer (or one for @ref LCB_CNTL_AUTOCORK_WINDOW), and all
+ * operations scheduled for that server until it fires are written together.
+ *
+ * This adds a small amount of latency to each operation, and is of little
+ * use to applications which already schedule operations in batches.
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @uncommitted
+ *
+ * You can also use `autocork` in the connection string.
+ */
+#define LCB_CNTL_AUTOCORK 0x59
+
+/**
+ * How long writes are deferred for when @ref LCB_CNTL_AUTOCORK is enabled.
+ * The default of 0 flushes at the end of the current event loop iteration.
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ * @uncommitted
+ *
+ * You can also use `autocork_window` in the connection string.
+ */
+#define LCB_CNTL_AUTOCORK_WINDOW 0x5A
+
+/**
+ * Send buffers of at least this many bytes without copying them into the
+ * kernel. The default of 0 disables zero-copy sends.
+ *
+ * Values stored with `LCB_KV_CONTIG` and without copying (see
+ * lcb_set_pktflushed_callback()) which are this large are sent with
+ * `MSG_ZEROCOPY`, and the lcb_pktflushed_callback for them is only invoked
+ * once the kernel has finished transmitting them, i.e. after the server has
+ * acknowledged the data. Values copied by the library also benefit, as the
+ * kernel does not copy them a second time.
+ *
+ * Pinning pages is more expensive than copying small buffers, so this
+ * should be set to at least several tens of kilobytes. Zero-copy sends are
+ * only available on Linux 4.14 and later, for event based I/O plugins and
+ * for connections without SSL. Otherwise (and over loopback, where the kernel
+ * copies the data anyway) buffers are copied as usual.
+ *
+ * @cntl_arg_both{lcb_SIZE*}
+ * @uncommitted
+ *
+ * You can also use `zerocopy_threshold` in the connection string.
+ */
+#define LCB_CNTL_ZEROCOPY_THRESHOLD 0x5B
+
+/**
+ * File to which a record of every completed KV operation is written.
+ *
+ * Each record holds the time the operation was scheduled, its opcode, a
+ * hash of its key, the size of its value, its vBucket, the status received
+ * and its latency. Records are buffered in memory and written in 64KB
+ * chunks (or at least once a second), and the file is complete once the
+ * instance is destroyed or the capture is stopped by setting this to NULL or
+ * an empty string. Setting
+ * it opens a new file, truncating any existing one. The file can be
+ * replayed with `cbc-pillowfight --replay`; see `src/opcapture.h` for the
+ * format.
+ *
+ * @cntl_arg_get_and_set{const char**, const char*}
+ * @uncommitted
+ *
+ * You can also use `opcapture_file` in the connection string.
+ */
+#define LCB_CNTL_OPCAPTURE_FILE 0x5C
+
+/**
+ * Whether the records written to @ref LCB_CNTL_OPCAPTURE_FILE include the
+ * keys of the operations. By default only a hash of each key is written,
+ * so that captures can be shared without revealing the keys, and replays
+ * access a different key for each distinct key captured.
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @uncommitted
+ *
+ * You can also use `opcapture_keys` in the connection string.
+ */
+#define LCB_CNTL_OPCAPTURE_KEYS 0x5D
+
+/**
+ * Number of slow operations kept for each opcode. The default of 0
+ * disables slow operation tracing.
+ *
+ * When enabled, the operations of each opcode which took longer than
+ * @ref LCB_CNTL_SLOWOP_THRESHOLD are counted, and the slowest of them are
+ * logged every @ref LCB_CNTL_SLOWOP_INTERVAL as a single JSON object, at the
+ * `INFO` level and under the `slowops` subsystem. Each entry holds a hash
+ * of the key (the same as in @ref LCB_CNTL_OPCAPTURE_FILE), the node, the
+ * vBucket, the status and error, the number of retries and the
+ * NOT_MY_VBUCKET and error map decisions made for the operation, as well
+ * as the number of microseconds after it was scheduled at which it was
+ * enqueued for writing, completely written, at which the response header
+ * was read, at which the callback was invoked and at which it returned. The
+ * latency of an operation includes the time spent in its callback. Phases
+ * which were not reached are left out, as are those of operations issued
+ * while more than 4096 others were in flight.
+ *
+ * Changing this setting logs and discards the operations kept so far.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @uncommitted
+ *
+ * You can also use `slowop_count` in the connection string.
+ */
+#define LCB_CNTL_SLOWOP_COUNT 0x5E
+
+/**
+ * Latency above which operations are considered by
+ * @ref LCB_CNTL_SLOWOP_COUNT. The default of 0 considers all operations.
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ * @uncommitted
+ *
+ * You can also use `slowop_threshold` in the connection string.
+ */
+#define LCB_CNTL_SLOWOP_THRESHOLD 0x5F
+
+/**
+ * How often the operations kept by @ref LCB_CNTL_SLOWOP_COUNT are logged.
+ * Nothing is logged for intervals without slow operations. The default is
+ * 10 seconds.
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ * @uncommitted
+ *
+ * You can also use `slowop_interval` in the connection string.
+ */
+#define LCB_CNTL_SLOWOP_INTERVAL 0x60
+
+/**
+ * Pipeline the negotiation of new KV connections.
+ *
+ * Each new connection normally sends HELLO, then GET_ERROR_MAP and
+ * SASL_LIST_MECHS, then SASL_AUTH (and SASL_STEP) and finally
+ * SELECT_BUCKET, waiting for the responses to each before sending the next.
+ * With this setting, the features and mechanism negotiated with each node
+ * are remembered, and later connections to the node send all of these
+ * requests at once (with `PLAIN`; `CRAM-MD5` still needs one more round trip
+ * for SASL_STEP, before SELECT_BUCKET). If a response differs from the one
+ * expected, negotiation continues step by step, and the node is negotiated
+ * from scratch the next time.
+ *
+ * This reduces the time taken to reconnect to distant nodes, e.g. after a
+ * failover. It has no effect on the first connection to each node.
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @uncommitted
+ *
+ * You can also use `optimistic_negotiation` in the connection string.
+ */
+#define LCB_CNTL_OPTIMISTIC_NEGOTIATION 0x61
+
+/**
+ * Connect to every data node as soon as it becomes known.
+ *
+ * Connections to data nodes are normally established when the first
+ * operation is scheduled to each of them, so that operation also waits for
+ * the connection to be established and negotiated. With this setting, all
+ * data nodes are connected to in parallel once the instance has
+ * bootstrapped, as are the nodes added by later configurations.
+ *
+ * lcb_wait() does not return until these connections have completed (or
+ * failed), so that after the usual lcb_connect() and lcb_wait() sequence
+ * the first operations do not wait for connections. Asynchronous
+ * applications can use lcb_set_nodes_ready_callback() instead.
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @uncommitted
+ *
+ * You can also use `kv_preconnect` in the connection string.
+ */
+#define LCB_CNTL_KV_PRECONNECT 0x62
+
 /** This is not a command, but rather an indicator of the last item */
-#define LCB_CNTL__MAX                    0x48
+#define LCB_CNTL__MAX                    0x63
 /**@}*/
 
 #ifdef __cplusplus
@@ -399,6 +399,40 @@ LIBCOUCHBASE_API
 lcb_error_t
 lcb_get_bootstrap_status(lcb_t instance);
 
+/**
+ * Callback invoked once the connections opened by @ref LCB_CNTL_KV_PRECONNECT
+ * are ready to be used.
+ *
+ * @param instance The instance
+ * @param err LCB_SUCCESS if every node was connected to (and negotiated
+ * with), or the error received for the first node which could not be. The
+ * failed nodes are connected to again once operations are scheduled to them.
+ * A node removed from the cluster configuration before its connection
+ * completed is reported as `LCB_MAP_CHANGED`.
+ * @uncommitted
+ */
+typedef void (*lcb_nodes_ready_callback)(lcb_t instance, lcb_error_t err);
+
+/**
+ * @brief Set the callback for notification that the data nodes have been
+ * connected to.
+ *
+ * When @ref LCB_CNTL_KV_PRECONNECT is enabled, the instance connects to all
+ * data nodes once it has bootstrapped, and to the nodes added by each new
+ * configuration. The callback is invoked once all connections started
+ * together have completed (or failed). It is not invoked for configurations
+ * which do not add any nodes, nor for connections still pending when the
+ * instance is destroyed.
+ *
+ * @param instance the instance
+ * @param callback the callback to set. If `NULL`, return the existing callback
+ * @return The existing (and previous) callback.
+ * @uncommitted
+ */
+LIBCOUCHBASE_API
+lcb_nodes_ready_callback
+lcb_set_nodes_ready_callback(lcb_t instance, lcb_nodes_ready_callback callback);
+
 /**
  * Sets the authenticator object for the instance. This may be done anytime, but
  * should probably be done before calling `lcb_connect()` for best effect.
@@ -773,6 +807,13 @@ lcb_strcbtype(int cbtype);
  */
 #define LCB_CMDGET_F_CLEAREXP (1<<16)
 
+/**
+ * If this bit is set in lcb_CMDGET::cmdflags then the item is always
+ * retrieved from the server, even if it is present in the near cache
+ * (see @ref LCB_CNTL_NEAR_CACHE_SIZE).
+ */
+#define LCB_CMDGET_F_NOCACHE (1<<17)
+
 /**@brief Command for retrieving a single item
  *
  * @see lcb_get3()
@@ -2421,6 +2462,18 @@ typedef enum {
  */
 #define LCB_CMDHTTP_F_NOUPASS 1<<18
 
+/**
+ * @uncommitted
+ * Command flag for HTTP to indicate that the response body should not be
+ * copied into a single buffer. Instead, the final callback receives the body
+ * as a list of the network buffers it was read into, via
+ * lcb_RESPHTTP::body_iovs. This avoids repeated reallocation and copying for
+ * very large responses.
+ *
+ * This flag has no effect if @ref LCB_CMDHTTP_F_STREAM is also set.
+ */
+#define LCB_CMDHTTP_F_BODYIOV 1<<19
+
 /**
  * Structure for performing an HTTP request.
  * Note that the key and nkey fields indicate the _path_ for the API
@@ -2487,6 +2540,14 @@ typedef struct {
     lcb_SIZE nbody;
     /**@private*/
     lcb_http_request_t _htreq;
+
+    /**If @ref LCB_CMDHTTP_F_BODYIOV was set, contains the response body as
+     * an ordered array of buffers. In this case #body is NULL and #nbody
+     * contains the total length of the body. The buffers are only valid for
+     * the duration of the callback. */
+    const lcb_IOV *body_iovs;
+    /** Number of items in #body_iovs */
+    lcb_SIZE nbody_iovs;
 } lcb_RESPHTTP;
 
 /**
@@ -2737,6 +2798,74 @@ typedef enum {
 LIBCOUCHBASE_API
 void lcb_wait3(lcb_t instance, lcb_WAITFLAGS flags);
 
+/**@brief Conditions for lcb_wait_cookies() */
+typedef struct {
+    /**Cookies of the operations to wait for. Each element stands for a
+     * single operation, so a cookie which was passed to several operations
+     * should be repeated once per operation. If NULL, completions of any
+     * operation are counted. */
+    const void * const *cookies;
+
+    /** Number of elements in #cookies */
+    lcb_SIZE ncookies;
+
+    /**Return once this many matching operations have completed, even if
+     * some of those listed in #cookies are still pending. If 0, wait for all
+     * of the operations listed in #cookies (or for all pending operations if
+     * #cookies is NULL) */
+    lcb_SIZE threshold;
+
+    /** Maximum amount of time to wait, in microseconds. 0 means no deadline */
+    lcb_U32 timeout;
+
+    /** [out] Number of operations which completed during the call */
+    lcb_SIZE ncompleted;
+} lcb_WAITCOOKIES;
+
+/**
+ * @uncommitted
+ * @brief Wait for completion of some of the scheduled operations.
+ *
+ * Unlike lcb_wait(), this returns as soon as one of the following happens:
+ *
+ * - All the operations listed in lcb_WAITCOOKIES::cookies have completed
+ * - lcb_WAITCOOKIES::threshold operations have completed
+ * - lcb_WAITCOOKIES::timeout has elapsed
+ * - No operations remain pending on the instance
+ *
+ * Operations which have not completed are left in flight, and their callbacks
+ * are invoked by a subsequent call to lcb_wait() or lcb_wait_cookies(). This
+ * allows several logical requests to share one instance while each
+ * bounds its own latency.
+ *
+ * An operation is considered complete once the callback installed via
+ * lcb_install_callback3() has been invoked for its final response. Only
+ * completions which happen during this call are counted.
+ *
+ * @param instance the instance
+ * @param params conditions for returning
+ * @return LCB_SUCCESS if the wait completed because the conditions were met
+ * or nothing remains pending, LCB_ETIMEDOUT if the deadline elapsed first,
+ * or LCB_EINVAL if the instance is already waiting.
+ *
+ * @code{.c}
+ * // Ten operations were scheduled with `req` as their cookie
+ * const void *cookies[10];
+ * for (int ii = 0; ii < 10; ii++) {
+ *     cookies[ii] = req;
+ * }
+ * lcb_WAITCOOKIES wc = { 0 };
+ * wc.cookies = cookies;
+ * wc.ncookies = 10;
+ * wc.timeout = 50000; // 50ms
+ * if (lcb_wait_cookies(instance, &wc) == LCB_ETIMEDOUT) {
+ *     printf("Only %d operations completed in time\n", (int)wc.ncompleted);
+ * }
+ * @endcode
+ */
+LIBCOUCHBASE_API
+lcb_error_t lcb_wait_cookies(lcb_t instance, lcb_WAITCOOKIES *params);
+
 /**
  * @brief Forcefully break from the event loop.
  *
@@ -3213,6 +3342,38 @@ const char *const *lcb_get_server_list(lcb_t instance);
 LIBCOUCHBASE_API
 void
 lcb_dump(lcb_t instance, FILE *fp, lcb_U32 flags);
+
+/**
+ * @volatile
+ * @brief Render the instance's metrics in the OpenMetrics text format.
+ *
+ * Unlike lcb_dump(), this is cheap enough to be called every few seconds,
+ * for example to serve a Prometheus scrape. The output contains counters for
+ * each KV node the instance has used (responses, failures, timeouts,
+ * NOT_MY_VBUCKET responses, bytes written and read, connections), gauges
+ * for each node in the current configuration (queued operations, unflushed
+ * bytes, connection state), the retry queue, configuration updates,
+ * compression, and the connection pools. Every sample is labelled with the
+ * bucket name.
+ *
+ * Like `snprintf()`, the output is truncated to fit `nbuf` (including the
+ * terminating NUL), and the return value is the length of the full output;
+ * calling with a `nbuf` of 0 returns the size needed.
+ *
+ * @param instance the handle
+ * @param buf the buffer to write to
+ * @param nbuf the size of the buffer
+ * @return the length of the output, excluding the terminating NUL
+ *
+ * @code{.c}
+ * lcb_SIZE n = lcb_metrics_snapshot(instance, NULL, 0);
+ * char *text = malloc(n + 1);
+ * lcb_metrics_snapshot(instance, text, n + 1);
+ * @endcode
+ */
+LIBCOUCHBASE_API
+lcb_SIZE
+lcb_metrics_snapshot(lcb_t instance, char *buf, lcb_SIZE nbuf);
 /**@} (Group: Cluster Info) */
 
 /**
@@ -108,6 +108,10 @@ typedef struct {
      * Setting this value will attempt to throttle the number of get requests,
      * so that no more than this number of requests will be in progress at any
      * given time.
+     *
+     * The library adjusts the number of concurrent requests based on their
+     * observed latency; this value is the upper bound for that window. If
+     * unset, the value of @ref LCB_CNTL_VIEW_DOCS_WINDOW is used.
      */
     unsigned docs_concurrent_max;
 
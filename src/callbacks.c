@@ -53,6 +53,9 @@ static void dummy_pktfwd_callback(lcb_t instance, const void *cookie,
 static void dummy_pktflushed_callback(lcb_t instance, const void *cookie) {
     (void)instance;(void)cookie;
 }
+static void dummy_nodes_ready_callback(lcb_t instance, lcb_error_t err) {
+    (void)instance; (void)err;
+}
 
 DEFINE_DUMMY_CALLBACK(dummy_stat_callback, lcb_server_stat_resp_t)
 DEFINE_DUMMY_CALLBACK(dummy_version_callback, lcb_server_version_resp_t)
@@ -242,6 +245,7 @@ void lcb_initialize_packet_handlers(lcb_t instance)
     instance->callbacks.bootstrap = dummy_bootstrap_callback;
     instance->callbacks.pktflushed = dummy_pktflushed_callback;
     instance->callbacks.pktfwd = dummy_pktfwd_callback;
+    instance->callbacks.nodes_ready = dummy_nodes_ready_callback;
     instance->callbacks.v3callbacks[LCB_CALLBACK_DEFAULT] = compat_default_callback;
 }
 
@@ -286,6 +290,7 @@ CALLBACK_ACCESSOR(lcb_set_errmap_callback, lcb_errmap_callback, errmap)
 CALLBACK_ACCESSOR(lcb_set_bootstrap_callback, lcb_bootstrap_callback, bootstrap)
 CALLBACK_ACCESSOR(lcb_set_pktfwd_callback, lcb_pktfwd_callback, pktfwd)
 CALLBACK_ACCESSOR(lcb_set_pktflushed_callback, lcb_pktflushed_callback, pktflushed)
+CALLBACK_ACCESSOR(lcb_set_nodes_ready_callback, lcb_nodes_ready_callback, nodes_ready)
 
 LIBCOUCHBASE_API
 lcb_RESPCALLBACK
@@ -366,6 +371,15 @@ nocb_fallback(lcb_t instance, int type, const lcb_RESPBASE *response)
 }
 lcb_RESPCALLBACK
 lcb_find_callback(lcb_t instance, lcb_CALLBACKTYPE cbtype)
+{
+    if (instance->waitset) {
+        return lcb_waitset_callback;
+    }
+    return lcb_find_user_callback(instance, cbtype);
+}
+
+lcb_RESPCALLBACK
+lcb_find_user_callback(lcb_t instance, lcb_CALLBACKTYPE cbtype)
 {
     lcb_RESPCALLBACK ret = instance->callbacks.v3callbacks[cbtype];
     if (!ret) {
@@ -20,6 +20,10 @@
 #include <lcbio/iotable.h>
 #include <mcserver/negotiate.h>
 #include <lcbio/ssl.h>
+#include <lcbio/resolver.h>
+#include "nearcache.h"
+#include "opcapture.h"
+#include "slowops.h"
 
 #define CNTL__MODE_SETSTRING 0x1000
 
@@ -80,6 +84,13 @@ static lcb_uint32_t *get_timeout_field(lcb_t instance, int cmd)
     case LCB_CNTL_RETRY_INTERVAL: return &settings->retry_interval;
     case LCB_CNTL_RETRY_NMV_INTERVAL: return &settings->retry_nmv_interval;
     case LCB_CNTL_CONFIG_POLL_INTERVAL: return &settings->config_poll_interval;
+    case LCB_CNTL_DNS_CACHE_TTL: return &settings->dns_cache_ttl;
+    case LCB_CNTL_DNS_NEGATIVE_TTL: return &settings->dns_negative_ttl;
+    case LCB_CNTL_CONNECT_ATTEMPT_DELAY: return &settings->connect_attempt_delay;
+    case LCB_CNTL_NEAR_CACHE_TTL: return &settings->near_cache_ttl;
+    case LCB_CNTL_AUTOCORK_WINDOW: return &settings->autocork_window;
+    case LCB_CNTL_SLOWOP_THRESHOLD: return &settings->slowop_threshold;
+    case LCB_CNTL_SLOWOP_INTERVAL: return &settings->slowop_interval;
     default: return NULL;
     }
 }
@@ -175,6 +186,33 @@ HANDLER(nmv_imm_retry_handler) {
 HANDLER(tcp_nodelay_handler) {
     RETURN_GET_SET(int, LCBT_SETTING(instance, tcp_nodelay));
 }
+HANDLER(ssl_ktls_handler) {
+    RETURN_GET_SET(int, LCBT_SETTING(instance, ssl_ktls));
+}
+HANDLER(get_coalesce_handler) {
+    RETURN_GET_SET(int, LCBT_SETTING(instance, get_coalesce));
+}
+HANDLER(near_cache_size_handler) {
+    RETURN_GET_SET(lcb_SIZE, LCBT_SETTING(instance, near_cache_size));
+}
+HANDLER(near_cache_revalidate_handler) {
+    RETURN_GET_SET(int, LCBT_SETTING(instance, near_cache_revalidate));
+}
+HANDLER(autocork_handler) {
+    RETURN_GET_SET(int, LCBT_SETTING(instance, autocork));
+}
+HANDLER(zerocopy_threshold_handler) {
+    RETURN_GET_SET(lcb_SIZE, LCBT_SETTING(instance, zerocopy_threshold));
+}
+HANDLER(opcapture_keys_handler) {
+    RETURN_GET_SET(int, LCBT_SETTING(instance, opcapture_keys));
+}
+HANDLER(optimistic_negotiation_handler) {
+    RETURN_GET_SET(int, LCBT_SETTING(instance, optimistic_negotiation));
+}
+HANDLER(kv_preconnect_handler) {
+    RETURN_GET_SET(int, LCBT_SETTING(instance, kv_preconnect));
+}
 HANDLER(tcp_keepalive_handler) {
     RETURN_GET_SET(int, LCBT_SETTING(instance, tcp_keepalive));
 }
@@ -196,6 +234,91 @@ HANDLER(select_bucket_handler) {
 HANDLER(send_hello_handler) {
     RETURN_GET_SET(int, LCBT_SETTING(instance, send_hello));
 }
+HANDLER(views_docs_window_handler) {
+    if (mode == LCB_CNTL_SET && *reinterpret_cast<lcb_U32*>(arg) == 0) {
+        return LCB_ECTL_BADARG;
+    }
+    RETURN_GET_SET(lcb_U32, LCBT_SETTING(instance, views_docs_window));
+}
+HANDLER(http_svc_pool_handler) {
+    lcb_U32 *val = reinterpret_cast<lcb_U32*>(arg);
+    lcb_U32 type = LCB_HTTPPOOLOPT_GETTYPE(*val);
+    lcb_U16 *p;
+
+    if (type >= LCB_HTTP_TYPE_MAX || type == LCB_HTTP_TYPE_RAW) {
+        return LCB_ECTL_BADARG;
+    }
+    if (cmd == LCB_CNTL_HTTP_SVC_POOLSIZE) {
+        p = &(LCBT_SETTING(instance, http_svc_poolsize)[type]);
+    } else {
+        p = &(LCBT_SETTING(instance, http_preconnect)[type]);
+    }
+    if (mode == LCB_CNTL_SET) {
+        *p = LCB_HTTPPOOLOPT_GETVALUE(*val);
+    } else {
+        *val = LCB_HTTPPOOLOPT_CREATE(type, *p);
+    }
+    return LCB_SUCCESS;
+}
+HANDLER(http_pool_probe_handler) {
+    RETURN_GET_SET(lcb_U32, instance->http_sockpool->get_options().tmoprobe)
+}
+HANDLER(http_pool_stats_handler) {
+    const lcb::io::Pool::Stats& stats = instance->http_sockpool->get_stats();
+    lcb_cntl_httppoolstats *out = reinterpret_cast<lcb_cntl_httppoolstats*>(arg);
+    if (mode != LCB_CNTL_GET) {
+        return LCB_ECTL_UNSUPPMODE;
+    }
+    out->hits = stats.hits;
+    out->misses = stats.misses;
+    out->preconnects = stats.preconnects;
+    out->dead = stats.dead;
+    (void)cmd;
+    return LCB_SUCCESS;
+}
+HANDLER(dns_stats_handler) {
+    if (mode != LCB_CNTL_GET) {
+        return LCB_ECTL_UNSUPPMODE;
+    }
+    lcb::io::resolver_stats(reinterpret_cast<lcb_cntl_dnsstats*>(arg));
+    (void)cmd; (void)instance;
+    return LCB_SUCCESS;
+}
+HANDLER(ssl_stats_handler) {
+    if (mode != LCB_CNTL_GET) {
+        return LCB_ECTL_UNSUPPMODE;
+    }
+    lcb_cntl_sslstats *stats = reinterpret_cast<lcb_cntl_sslstats*>(arg);
+    if (LCBT_SETTING(instance, ssl_ctx)) {
+        lcbio_ssl_get_stats(LCBT_SETTING(instance, ssl_ctx), stats);
+    } else {
+        memset(stats, 0, sizeof(*stats));
+    }
+    (void)cmd;
+    return LCB_SUCCESS;
+}
+HANDLER(coalesce_stats_handler) {
+    if (mode != LCB_CNTL_GET) {
+        return LCB_ECTL_UNSUPPMODE;
+    }
+    lcb_getcoalescer_stats(instance,
+        reinterpret_cast<lcb_cntl_coalescestats*>(arg));
+    (void)cmd;
+    return LCB_SUCCESS;
+}
+HANDLER(near_cache_stats_handler) {
+    if (mode != LCB_CNTL_GET) {
+        return LCB_ECTL_UNSUPPMODE;
+    }
+    lcb_cntl_nearcachestats *stats = reinterpret_cast<lcb_cntl_nearcachestats*>(arg);
+    if (instance->near_cache) {
+        instance->near_cache->get_stats(stats);
+    } else {
+        memset(stats, 0, sizeof(*stats));
+    }
+    (void)cmd;
+    return LCB_SUCCESS;
+}
 HANDLER(config_poll_interval_handler) {
     lcb_error_t rv = timeout_common(mode, instance, cmd, arg);
     if (rv == LCB_SUCCESS &&
@@ -371,6 +494,43 @@ HANDLER(config_cache_handler) {
     }
 }
 
+HANDLER(opcapture_file_handler) {
+    if (mode == LCB_CNTL_SET) {
+        const char *path = reinterpret_cast<const char*>(arg);
+        delete instance->opcapture;
+        instance->opcapture = NULL;
+        if (path && *path) {
+            instance->opcapture = lcb::OpCapture::open(instance, path);
+            if (!instance->opcapture) {
+                return LCB_ERROR;
+            }
+        }
+    } else {
+        *(const char **)arg = instance->opcapture ? instance->opcapture->path() : NULL;
+    }
+    (void)cmd;
+    return LCB_SUCCESS;
+}
+
+HANDLER(slowop_count_handler) {
+    if (mode == LCB_CNTL_SET) {
+        lcb_U32 count = *reinterpret_cast<lcb_U32*>(arg);
+        if (count != LCBT_SETTING(instance, slowop_count)) {
+            /* The operations kept so far are logged when the tracer is deleted */
+            delete instance->slowops;
+            instance->slowops = NULL;
+            LCBT_SETTING(instance, slowop_count) = count;
+            if (count) {
+                instance->slowops = new lcb::SlowOpTracer(instance);
+            }
+        }
+    } else {
+        *reinterpret_cast<lcb_U32*>(arg) = LCBT_SETTING(instance, slowop_count);
+    }
+    (void)cmd;
+    return LCB_SUCCESS;
+}
+
 HANDLER(retrymode_handler) {
     lcb_U32 *val = reinterpret_cast<lcb_U32*>(arg);
     lcb_U32 rmode = LCB_RETRYOPT_GETMODE(*val);
@@ -614,7 +774,34 @@ static ctl_handler handlers[] = {
     select_bucket_handler, /* LCB_CNTL_SELECT_BUCKET */
     tcp_keepalive_handler, /* LCB_CNTL_TCP_KEEPALIVE */
     config_poll_interval_handler, /* LCB_CNTL_CONFIG_POLL_INTERVAL */
-    send_hello_handler /* LCB_CNTL_SEND_HELLO */
+    send_hello_handler, /* LCB_CNTL_SEND_HELLO */
+    views_docs_window_handler, /* LCB_CNTL_VIEW_DOCS_WINDOW */
+    http_svc_pool_handler, /* LCB_CNTL_HTTP_SVC_POOLSIZE */
+    http_svc_pool_handler, /* LCB_CNTL_HTTP_PRECONNECT */
+    http_pool_probe_handler, /* LCB_CNTL_HTTP_POOL_PROBE_INTERVAL */
+    http_pool_stats_handler, /* LCB_CNTL_HTTP_POOL_STATS */
+    timeout_common, /* LCB_CNTL_DNS_CACHE_TTL */
+    timeout_common, /* LCB_CNTL_DNS_NEGATIVE_TTL */
+    dns_stats_handler, /* LCB_CNTL_DNS_STATS */
+    timeout_common, /* LCB_CNTL_CONNECT_ATTEMPT_DELAY */
+    ssl_stats_handler, /* LCB_CNTL_SSL_SESSION_STATS */
+    ssl_ktls_handler, /* LCB_CNTL_SSL_KTLS */
+    get_coalesce_handler, /* LCB_CNTL_GET_COALESCE */
+    coalesce_stats_handler, /* LCB_CNTL_GET_COALESCE_STATS */
+    near_cache_size_handler, /* LCB_CNTL_NEAR_CACHE_SIZE */
+    timeout_common, /* LCB_CNTL_NEAR_CACHE_TTL */
+    near_cache_revalidate_handler, /* LCB_CNTL_NEAR_CACHE_REVALIDATE */
+    near_cache_stats_handler, /* LCB_CNTL_NEAR_CACHE_STATS */
+    autocork_handler, /* LCB_CNTL_AUTOCORK */
+    timeout_common, /* LCB_CNTL_AUTOCORK_WINDOW */
+    zerocopy_threshold_handler, /* LCB_CNTL_ZEROCOPY_THRESHOLD */
+    opcapture_file_handler, /* LCB_CNTL_OPCAPTURE_FILE */
+    opcapture_keys_handler, /* LCB_CNTL_OPCAPTURE_KEYS */
+    slowop_count_handler, /* LCB_CNTL_SLOWOP_COUNT */
+    timeout_common, /* LCB_CNTL_SLOWOP_THRESHOLD */
+    timeout_common, /* LCB_CNTL_SLOWOP_INTERVAL */
+    optimistic_negotiation_handler, /* LCB_CNTL_OPTIMISTIC_NEGOTIATION */
+    kv_preconnect_handler /* LCB_CNTL_KV_PRECONNECT */
 };
 
 /* Union used for conversion to/from string functions */
@@ -728,6 +915,27 @@ static lcb_error_t convert_retrymode(const char *arg, u_STRCONVERT *u) {
     return LCB_SUCCESS;
 }
 
+static lcb_error_t convert_httppool(const char *arg, u_STRCONVERT *u) {
+    static const STR_u32MAP svcmap[] = {
+        { "views", LCB_HTTP_TYPE_VIEW },
+        { "mgmt", LCB_HTTP_TYPE_MANAGEMENT },
+        { "query", LCB_HTTP_TYPE_N1QL },
+        { "search", LCB_HTTP_TYPE_FTS }, { NULL }
+    };
+
+    lcb_U32 svcval;
+    unsigned count;
+    const char *countstr = strchr(arg, ':');
+    if (!countstr) { return LCB_ECTL_BADARG; }
+    countstr++;
+    DO_CONVERT_STR2NUM(arg, svcmap, svcval);
+    if (sscanf(countstr, "%u", &count) != 1 || count > 0xffff) {
+        return LCB_ECTL_BADARG;
+    }
+    u->u32 = LCB_HTTPPOOLOPT_CREATE(svcval, count);
+    return LCB_SUCCESS;
+}
+
 static cntl_OPCODESTRS stropcode_map[] = {
         {"operation_timeout", LCB_CNTL_OP_TIMEOUT, convert_timeout},
         {"timeout", LCB_CNTL_OP_TIMEOUT, convert_timeout},
@@ -771,6 +979,28 @@ static cntl_OPCODESTRS stropcode_map[] = {
         {"tcp_keepalive", LCB_CNTL_TCP_KEEPALIVE, convert_intbool},
         {"config_poll_interval", LCB_CNTL_CONFIG_POLL_INTERVAL, convert_timeout},
         {"send_hello", LCB_CNTL_SEND_HELLO, convert_intbool},
+        {"views_docs_window", LCB_CNTL_VIEW_DOCS_WINDOW, convert_int},
+        {"http_svc_poolsize", LCB_CNTL_HTTP_SVC_POOLSIZE, convert_httppool},
+        {"http_preconnect", LCB_CNTL_HTTP_PRECONNECT, convert_httppool},
+        {"http_pool_probe_interval", LCB_CNTL_HTTP_POOL_PROBE_INTERVAL, convert_timeout},
+        {"dns_cache_ttl", LCB_CNTL_DNS_CACHE_TTL, convert_timeout},
+        {"dns_negative_ttl", LCB_CNTL_DNS_NEGATIVE_TTL, convert_timeout},
+        {"connect_attempt_delay", LCB_CNTL_CONNECT_ATTEMPT_DELAY, convert_timeout},
+        {"ktls", LCB_CNTL_SSL_KTLS, convert_intbool},
+        {"get_coalesce", LCB_CNTL_GET_COALESCE, convert_intbool},
+        {"near_cache_size", LCB_CNTL_NEAR_CACHE_SIZE, convert_SIZE},
+        {"near_cache_ttl", LCB_CNTL_NEAR_CACHE_TTL, convert_timeout},
+        {"near_cache_revalidate", LCB_CNTL_NEAR_CACHE_REVALIDATE, convert_intbool},
+        {"autocork", LCB_CNTL_AUTOCORK, convert_intbool},
+        {"autocork_window", LCB_CNTL_AUTOCORK_WINDOW, convert_timeout},
+        {"zerocopy_threshold", LCB_CNTL_ZEROCOPY_THRESHOLD, convert_SIZE},
+        {"opcapture_file", LCB_CNTL_OPCAPTURE_FILE, convert_passthru},
+        {"opcapture_keys", LCB_CNTL_OPCAPTURE_KEYS, convert_intbool},
+        {"slowop_count", LCB_CNTL_SLOWOP_COUNT, convert_int},
+        {"slowop_threshold", LCB_CNTL_SLOWOP_THRESHOLD, convert_timeout},
+        {"slowop_interval", LCB_CNTL_SLOWOP_INTERVAL, convert_timeout},
+        {"optimistic_negotiation", LCB_CNTL_OPTIMISTIC_NEGOTIATION, convert_intbool},
+        {"kv_preconnect", LCB_CNTL_KV_PRECONNECT, convert_intbool},
         {NULL, -1}
 };
 
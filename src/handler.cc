@@ -20,6 +20,9 @@
 #include "mc/mcreq.h"
 #include "mc/compress.h"
 #include "trace.h"
+#include "nearcache.h"
+#include "opcapture.h"
+#include "slowops.h"
 
 #define LOGARGS(obj, lvl) (obj)->settings, "handler", LCB_LOG_##lvl, __FILE__, __LINE__
 
@@ -177,11 +180,13 @@ map_error(lcb_t instance, int in)
 static lcb_RESPCALLBACK
 find_callback(lcb_t instance, lcb_CALLBACKTYPE type)
 {
-    lcb_RESPCALLBACK cb = instance->callbacks.v3callbacks[type];
-    if (!cb) {
-        cb = lcb_find_callback(instance, type);
+    if (!instance->waitset) {
+        lcb_RESPCALLBACK cb = instance->callbacks.v3callbacks[type];
+        if (cb) {
+            return cb;
+        }
     }
-    return cb;
+    return lcb_find_callback(instance, type);
 }
 
 
@@ -289,6 +294,44 @@ static lcb_t get_instance(mc_PIPELINE *pipeline) {
     return reinterpret_cast<lcb_t>(pipeline->parent->cqdata);
 }
 
+/** Drop the near cache entry for a key which may have been modified */
+static void
+invalidate_near_cache(lcb_t instance, const mc_PACKET *request)
+{
+    if (instance->near_cache) {
+        const void *key;
+        lcb_size_t nkey;
+        mcreq_get_key(request, &key, &nkey);
+        instance->near_cache->invalidate(key, nkey);
+    }
+}
+
+/**
+ * Pass the response to a GET to the near cache, unless the request was
+ * routed using a custom hashkey (and may therefore be for another document)
+ */
+static void
+update_near_cache(lcb_t instance, const mc_PACKET *request,
+                  MemcachedResponse *response, const lcb_RESPGET *resp)
+{
+    if (response->opcode() == PROTOCOL_BINARY_CMD_GET_LOCKED) {
+        invalidate_near_cache(instance, request);
+        return;
+    } else if (response->opcode() != PROTOCOL_BINARY_CMD_GET) {
+        return;
+    }
+
+    lcbvb_CONFIG *vbc = instance->cmdq.config;
+    if (vbc && LCBVB_DISTTYPE(vbc) == LCBVB_DIST_VBUCKET) {
+        protocol_binary_request_header hdr;
+        mcreq_read_hdr(request, &hdr);
+        if (ntohs(hdr.request.vbucket) != lcbvb_k2vb(vbc, resp->key, resp->nkey)) {
+            return;
+        }
+    }
+    instance->near_cache->update(resp);
+}
+
 template <typename T>
 void invoke_callback(const mc_PACKET *pkt,
     lcb_t instance, T* resp, lcb_CALLBACKTYPE cbtype)
@@ -374,8 +417,15 @@ H_get(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedResponse* response,
 
     void *freeptr = NULL;
     maybe_decompress(o, response, &resp, &freeptr);
+    if (o->near_cache) {
+        update_near_cache(o, request, response, &resp);
+    }
     TRACE_GET_END(response, &resp);
-    invoke_callback(request, o, &resp, LCB_CALLBACK_GET);
+    if (request->flags & MCREQ_F_REQEXT) {
+        request->u_rdata.exdata->procs->handler(pipeline, request, immerr, &resp);
+    } else {
+        invoke_callback(request, o, &resp, LCB_CALLBACK_GET);
+    }
     free(freeptr);
 }
 
@@ -428,6 +478,7 @@ H_subdoc(mc_PIPELINE *pipeline, mc_PACKET *request,
 
     default:
         handle_mutation_token(o, response, request, &w.mt);
+        invalidate_near_cache(o, request);
         w.resp.rflags |= LCB_RESP_F_EXTDATA;
         cbtype = LCB_CALLBACK_SDMUTATE;
         break;
@@ -581,6 +632,7 @@ H_delete(mc_PIPELINE *pipeline, mc_PACKET *packet, MemcachedResponse *response,
     init_resp(root, response, packet, immerr, &w.resp);
     handle_error_info(response, &w);
     handle_mutation_token(root, response, packet, &w.mt);
+    invalidate_near_cache(root, packet);
     TRACE_REMOVE_END(response, &w.resp);
     invoke_callback(packet, root, &w.resp, LCB_CALLBACK_REMOVE);
 }
@@ -718,6 +770,7 @@ H_store(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedResponse *response,
     }
     w.resp.rflags |= LCB_RESP_F_EXTDATA | LCB_RESP_F_FINAL;
     handle_mutation_token(root, response, request, &w.mt);
+    invalidate_near_cache(root, request);
     TRACE_STORE_END(response, &w.resp);
     if (request->flags & MCREQ_F_REQEXT) {
         request->u_rdata.exdata->procs->handler(pipeline, request, immerr, &w.resp);
@@ -744,6 +797,7 @@ H_arithmetic(mc_PIPELINE *pipeline, mc_PACKET *request,
     }
     w.resp.rflags |= LCB_RESP_F_FINAL;
     w.resp.cas = response->cas();
+    invalidate_near_cache(root, request);
     TRACE_ARITHMETIC_END(response, &w.resp);
     invoke_callback(request, root, &w.resp, LCB_CALLBACK_COUNTER);
 }
@@ -860,13 +914,20 @@ H_config(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedResponse *response,
 }
 
 static void
-record_metrics(mc_PIPELINE *pipeline, mc_PACKET *req, MemcachedResponse *)
+record_metrics(mc_PIPELINE *pipeline, mc_PACKET *req, MemcachedResponse *res,
+               lcb_error_t immerr)
 {
     lcb_t instance = get_instance(pipeline);
     if (instance->kv_timings) {
         lcb_histogram_record(instance->kv_timings,
             gethrtime() - MCREQ_PKT_RDATA(req)->start);
     }
+    if (instance->opcapture) {
+        instance->opcapture->record(req, res, immerr);
+    }
+    if (instance->slowops) {
+        instance->slowops->dispatched(req->opaque);
+    }
 }
 
 static void
@@ -879,13 +940,11 @@ dispatch_ufwd_error(mc_PIPELINE *pipeline, mc_PACKET *req, lcb_error_t immerr)
     instance->callbacks.pktfwd(instance, MCREQ_PKT_COOKIE(req), immerr, &resp);
 }
 
-int
-mcreq_dispatch_response(
+static int
+dispatch_response(
         mc_PIPELINE *pipeline, mc_PACKET *req, MemcachedResponse *res,
         lcb_error_t immerr)
 {
-    record_metrics(pipeline, req, res);
-
     if (req->flags & MCREQ_F_UFWD) {
         dispatch_ufwd_error(pipeline, req, immerr);
         return 0;
@@ -974,6 +1033,22 @@ mcreq_dispatch_response(
     }
 }
 
+int
+mcreq_dispatch_response(
+        mc_PIPELINE *pipeline, mc_PACKET *req, MemcachedResponse *res,
+        lcb_error_t immerr)
+{
+    record_metrics(pipeline, req, res, immerr);
+    int rv = dispatch_response(pipeline, req, res, immerr);
+
+    /* The packet is only released by the caller, once this returns */
+    lcb_t instance = get_instance(pipeline);
+    if (instance->slowops) {
+        instance->slowops->completed(pipeline, req, res, immerr);
+    }
+    return rv;
+}
+
 const lcb_MUTATION_TOKEN *
 lcb_resp_get_mutation_token(int cbtype, const lcb_RESPBASE *rb)
 {
@@ -19,6 +19,7 @@
 #define LCB_HTTPPRIV_H
 
 #include <libcouchbase/couchbase.h>
+#include <libcouchbase/vbucket.h>
 #include <lcbio/lcbio.h>
 #include <lcbio/timer-ng.h>
 #include <lcbio/timer-cxx.h>
@@ -81,6 +82,13 @@ struct Request {
                 reqtype == LCB_HTTP_TYPE_FTS;
     }
 
+    /**
+     * @return the number of idle sockets which may be kept for this request's
+     * service (see LCB_CNTL_HTTP_SVC_POOLSIZE). If 0, the connection is not
+     * reused.
+     */
+    unsigned idle_quota() const;
+
     /**
      * @return If this request is in an ONGOING state, meaning no I/O errors
      * and is not finished.
@@ -157,7 +165,7 @@ struct Request {
     void close_io();
 
     // Helper functions for parsing response data from network
-    inline int handle_parse_chunked(const char *buf, unsigned nbuf);
+    inline int handle_parse_chunked(const char *buf, unsigned nbuf, rdb_ROPESEG *seg);
     inline void assign_response_headers(const lcb::htparse::Response&);
 
     /**
@@ -200,6 +208,13 @@ struct Request {
         callback = callback_;
     }
 
+    /**
+     * @return the callback set with set_callback(), or the instance's HTTP
+     * callback. The latter is looked up on each call, as it may be replaced
+     * during lcb_wait_cookies()
+     */
+    lcb_RESPCALLBACK get_callback() const;
+
     /**
      * Let the request finish its normal course, suppressing any callbacks.
      * Unlike cancel(), this does not dispatch to finish. Finish is called
@@ -231,6 +246,7 @@ struct Request {
     struct http_parser_url url_info; /**< Parser info for the URL */
     const lcb_http_method_t method; /**< Request method constant */
     const bool chunked; /**< Whether to invoke callback for each data chunk */
+    const bool body_iov; /**< Keep the body inside the network buffers */
     bool paused; /**< See pause() and resume() */
     const void * const command_cookie; /** User context for callback */
     size_t refcount; /** Initialized to 1. See incref() and decref() */
@@ -296,7 +312,7 @@ struct Request {
     /** Backing buffers for response headers */
     std::vector<lcb::htparse::MimeHeader> response_headers;
 
-    /** Callback to invoke */
+    /** Callback to invoke. If NULL, the instance's HTTP callback is used */
     lcb_RESPCALLBACK callback;
 
     // IO variables
@@ -312,6 +328,13 @@ struct Request {
     const uint32_t user_timeout;
 };
 
+/**
+ * Eagerly open pooled connections (see LCB_CNTL_HTTP_PRECONNECT) to the HTTP
+ * services of nodes which are present in @p newconfig but not in
+ * @p oldconfig. If @p oldconfig is NULL, all nodes are considered new.
+ */
+void preconnect(lcb_t instance, lcbvb_CONFIG *oldconfig, lcbvb_CONFIG *newconfig);
+
 } // namespace: http
 } // namespace: lcb
 
@@ -25,6 +25,7 @@ using namespace lcb::http;
 #define LOGFMT "<%s:%s> "
 #define LOGID(req) (req)->host.c_str(), (req)->port.c_str()
 #define LOGARGS(req, lvl) req->instance->settings, "http-io", LCB_LOG_##lvl, __FILE__, __LINE__
+#define LOGARGS_I(instance, lvl) (instance)->settings, "http-io", LCB_LOG_##lvl, __FILE__, __LINE__
 
 static const char *method_strings[] = {
     "GET ",    /* LCB_HTTP_METHOD_GET */
@@ -158,7 +159,7 @@ Request::finish(lcb_error_t error)
         resp.rc = error;
 
         status |= CBINVOKED;
-        callback(instance, LCB_CALLBACK_HTTP, (lcb_RESPBASE*)&resp);
+        get_callback()(instance, LCB_CALLBACK_HTTP, (lcb_RESPBASE*)&resp);
     }
 
     if (status & FINISHED) {
@@ -406,6 +407,100 @@ Request::get_api_node(lcb_error_t &rc)
     return lcbvb_get_resturl(vbc, ix, svc, mode);
 }
 
+unsigned
+Request::idle_quota() const
+{
+    if (reqtype == LCB_HTTP_TYPE_RAW) {
+        return 0;
+    }
+    lcb_U16 svcsize = LCBT_SETTING(instance, http_svc_poolsize)[reqtype];
+    if (svcsize != LCB_HTTPPOOL_INHERIT) {
+        return svcsize;
+    }
+    if (is_data_request()) {
+        return instance->http_sockpool->get_options().maxidle;
+    }
+    return 0;
+}
+
+/** Whether `config` has `hoststr` for the service */
+static bool
+has_service_host(lcbvb_CONFIG *config, lcbvb_SVCTYPE svc, lcbvb_SVCMODE mode,
+                 const char *hoststr)
+{
+    for (unsigned ii = 0; config && ii < LCBVB_NSERVERS(config); ii++) {
+        const char *cur = lcbvb_get_hostport(config, ii, svc, mode);
+        if (cur && strcmp(cur, hoststr) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+lcb::http::preconnect(lcb_t instance, lcbvb_CONFIG *oldconfig, lcbvb_CONFIG *newconfig)
+{
+    static const lcb_http_type_t types[] = {
+        LCB_HTTP_TYPE_VIEW, LCB_HTTP_TYPE_MANAGEMENT,
+        LCB_HTTP_TYPE_N1QL, LCB_HTTP_TYPE_FTS
+    };
+    const lcbvb_SVCMODE mode = LCBT_SETTING(instance, sslopts) ?
+            LCBVB_SVCMODE_SSL : LCBVB_SVCMODE_PLAIN;
+    lcbio_MGR *pool = instance->http_sockpool;
+
+    for (size_t ii = 0; ii < sizeof(types) / sizeof(types[0]); ii++) {
+        lcb_http_type_t type = types[ii];
+        lcbvb_SVCTYPE svc = type == LCB_HTTP_TYPE_MANAGEMENT ?
+                LCBVB_SVCTYPE_MGMT : httype2svctype(type);
+
+        /* Stop maintaining connections to hosts which left the cluster, so
+         * that their idle connections can expire */
+        for (unsigned jj = 0; oldconfig && jj < LCBVB_NSERVERS(oldconfig); jj++) {
+            const char *hoststr = lcbvb_get_hostport(oldconfig, jj, svc, mode);
+            lcb_host_t host;
+            if (!hoststr || has_service_host(newconfig, svc, mode, hoststr)) {
+                continue;
+            }
+            if (lcb_host_parsez(&host, hoststr, 80) == LCB_SUCCESS) {
+                pool->clear_warm(host);
+            }
+        }
+
+        unsigned count = LCBT_SETTING(instance, http_preconnect)[type];
+        if (!count) {
+            continue;
+        }
+
+        lcb_U16 svcsize = LCBT_SETTING(instance, http_svc_poolsize)[type];
+        unsigned quota;
+        if (svcsize != LCB_HTTPPOOL_INHERIT) {
+            quota = svcsize;
+        } else if (type == LCB_HTTP_TYPE_MANAGEMENT) {
+            quota = 0;
+        } else {
+            quota = pool->get_options().maxidle;
+        }
+        if (!quota) {
+            continue;
+        }
+
+        for (unsigned jj = 0; jj < LCBVB_NSERVERS(newconfig); jj++) {
+            const char *hoststr = lcbvb_get_hostport(newconfig, jj, svc, mode);
+            if (!hoststr || has_service_host(oldconfig, svc, mode, hoststr)) {
+                continue;
+            }
+
+            lcb_host_t host;
+            if (lcb_host_parsez(&host, hoststr, 80) != LCB_SUCCESS) {
+                continue;
+            }
+            lcb_log(LOGARGS_I(instance, DEBUG), "Pre-connecting %u socket(s) to %s", count, hoststr);
+            pool->set_host_maxidle(host, quota);
+            pool->preconnect(host, count, LCBT_SETTING(instance, http_timeout));
+        }
+    }
+}
+
 static bool is_nonempty(const char *s) {
     return s != NULL && *s != '\0';
 }
@@ -472,7 +567,7 @@ Request::setup_inputs(const lcb_CMDHTTP *cmd)
     }
     add_header("User-Agent", ua);
 
-    if (instance->http_sockpool->get_options().maxidle == 0 || !is_data_request()) {
+    if (idle_quota() == 0) {
         add_header("Connection", "close");
     }
 
@@ -504,6 +599,7 @@ Request::Request(lcb_t instance_, const void *cookie, const lcb_CMDHTTP* cmd)
   body(cmd->body, cmd->body + cmd->nbody),
   method(cmd->method),
   chunked(cmd->cmdflags & LCB_CMDHTTP_F_STREAM),
+  body_iov(cmd->cmdflags & LCB_CMDHTTP_F_BODYIOV),
   paused(false),
   command_cookie(cookie),
   refcount(1),
@@ -512,7 +608,7 @@ Request::Request(lcb_t instance_, const void *cookie, const lcb_CMDHTTP* cmd)
   last_vbcrev(-1),
   reqtype(cmd->type),
   status(ONGOING),
-  callback(lcb_find_callback(instance, LCB_CALLBACK_HTTP)),
+  callback(NULL),
   io(instance->iotable),
   ioctx(NULL),
   timer(NULL),
@@ -522,6 +618,15 @@ Request::Request(lcb_t instance_, const void *cookie, const lcb_CMDHTTP* cmd)
     memset(&creq, 0, sizeof creq);
 }
 
+lcb_RESPCALLBACK
+Request::get_callback() const
+{
+    if (callback) {
+        return callback;
+    }
+    return lcb_find_callback(instance, LCB_CALLBACK_HTTP);
+}
+
 uint32_t
 Request::timeout() const
 {
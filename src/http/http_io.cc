@@ -44,7 +44,7 @@ Request::assign_response_headers(const lcb::htparse::Response& resp)
 }
 
 int
-Request::handle_parse_chunked(const char *buf, unsigned nbuf)
+Request::handle_parse_chunked(const char *buf, unsigned nbuf, rdb_ROPESEG *seg)
 {
     int parse_state, oldstate, diff;
     using lcb::htparse::Parser;
@@ -61,6 +61,9 @@ Request::handle_parse_chunked(const char *buf, unsigned nbuf)
         /* Got headers now for the first time */
         if (diff & Parser::S_HEADER) {
             assign_response_headers(res);
+            if (!chunked && !body_iov) {
+                res.reserve_body();
+            }
             if (res.status >=  300 && res.status <= 400) {
                 const char *redir = res.get_header_value("Location");
                 if (redir != NULL) {
@@ -83,8 +86,10 @@ Request::handle_parse_chunked(const char *buf, unsigned nbuf)
                 htresp.nbody = nbody;
                 htresp.rc = LCB_SUCCESS;
                 passed_data = true;
-                callback(instance, LCB_CALLBACK_HTTP, (const lcb_RESPBASE *)&htresp);
+                get_callback()(instance, LCB_CALLBACK_HTTP, (const lcb_RESPBASE *)&htresp);
 
+            } else if (body_iov) {
+                res.append_body_ref(rbody, nbody, seg);
             } else {
                 res.body.append(rbody, nbody);
             }
@@ -96,21 +101,37 @@ Request::handle_parse_chunked(const char *buf, unsigned nbuf)
 
     if ( (parse_state & Parser::S_DONE) && is_ongoing()) {
         lcb_RESPHTTP resp = { 0 };
+        std::vector<lcb_IOV> iovs;
+        size_t nbody = 0;
+
         if (chunked) {
             buf = NULL;
-            nbuf = 0;
+        } else if (body_iov) {
+            buf = NULL;
+            std::vector<lcb::htparse::BodySegment>::const_iterator ii;
+            for (ii = res.body_segments.begin(); ii != res.body_segments.end(); ++ii) {
+                lcb_IOV iov;
+                iov.iov_base = const_cast<char*>(ii->buf);
+                iov.iov_len = ii->nbuf;
+                iovs.push_back(iov);
+                nbody += ii->nbuf;
+            }
         } else {
             buf = res.body.c_str();
-            nbuf = res.body.size();
+            nbody = res.body.size();
         }
 
         init_resp(&resp);
         resp.rflags = LCB_RESP_F_FINAL;
         resp.rc = LCB_SUCCESS;
         resp.body = buf;
-        resp.nbody = nbuf;
+        resp.nbody = nbody;
+        if (body_iov && !chunked) {
+            resp.body_iovs = iovs.empty() ? NULL : &iovs[0];
+            resp.nbody_iovs = iovs.size();
+        }
         passed_data = true;
-        callback(instance, LCB_CALLBACK_HTTP, (const lcb_RESPBASE*)&resp);
+        get_callback()(instance, LCB_CALLBACK_HTTP, (const lcb_RESPBASE*)&resp);
         status |= Request::CBINVOKED;
     }
     return parse_state;
@@ -136,7 +157,8 @@ io_read(lcbio_CTX *ctx, unsigned nr)
 
         buf = reinterpret_cast<char*>(lcbio_ctx_ribuf(&iter));
         nbuf = lcbio_ctx_risize(&iter);
-        parse_state = req->handle_parse_chunked(buf, nbuf);
+        parse_state = req->handle_parse_chunked(buf, nbuf,
+            rdb_get_first_segment(&ctx->ior));
 
         if ((parse_state & lcb::htparse::Parser::S_ERROR) ||
                 req->has_pending_redirect()) {
@@ -248,6 +270,10 @@ Request::start_io(lcb_host_t& dest)
 {
     lcbio_MGR *pool = instance->http_sockpool;
 
+    if (reqtype != LCB_HTTP_TYPE_RAW &&
+            LCBT_SETTING(instance, http_svc_poolsize)[reqtype] != LCB_HTTPPOOL_INHERIT) {
+        pool->set_host_maxidle(dest, idle_quota());
+    }
     creq = pool->get(dest, timeout(), on_connected, this);
     if (!creq) {
         return LCB_CONNECT_ERROR;
@@ -288,7 +314,7 @@ Request::close_io()
 
     int can_ka;
 
-    if (parser && is_data_request()) {
+    if (parser && idle_quota()) {
         can_ka = parser->can_keepalive();
     } else {
         can_ka = 0;
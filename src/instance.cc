@@ -23,6 +23,10 @@
 #include "bucketconfig/clconfig.h"
 #include <lcbio/iotable.h>
 #include <lcbio/ssl.h>
+#include "nearcache.h"
+#include "opcapture.h"
+#include "slowops.h"
+#include "metrics.h"
 #define LOGARGS(obj,lvl) (obj)->settings, "instance", LCB_LOG_##lvl, __FILE__, __LINE__
 
 static volatile unsigned int lcb_instance_index = 0;
@@ -440,6 +444,7 @@ lcb_error_t lcb_create(lcb_t *instance,
         pool_opts.maxidle = 1;
         pool_opts.tmoidle = LCB_MS2US(10000); // 10 seconds
         obj->memd_sockpool->set_options(pool_opts);
+        pool_opts.tmoprobe = LCB_DEFAULT_HTTP_POOL_PROBE_INTERVAL;
         obj->http_sockpool->set_options(pool_opts);
     }
 
@@ -447,6 +452,7 @@ lcb_error_t lcb_create(lcb_t *instance,
     obj->ht_nodes = new Hostlist();
     obj->mc_nodes = new Hostlist();
     obj->retryq = new RetryQueue(&obj->cmdq, obj->iotable, obj->settings);
+    obj->metrics = new Metrics();
     obj->n1ql_cache = lcb_n1qlcache_create();
     lcb_initialize_packet_handlers(obj);
     lcb_aspend_init(&obj->pendops);
@@ -506,6 +512,7 @@ sync_dtor_cb(void *arg)
 
 extern "C" {
 void lcbdur_destroy(void*);
+void lcbdur_poller_destroy(void*);
 }
 
 static void do_pool_shutdown(io::Pool *pool) { pool->shutdown(); }
@@ -541,10 +548,13 @@ void lcb_destroy(lcb_t instance)
         }
         pendq->clear();
     }
+    DESTROY(lcbdur_poller_destroy, dur_poller);
+    DESTROY(delete, near_cache);
 
     for (size_t ii = 0; ii < LCBT_NSERVERS(instance); ++ii) {
         instance->get_server(ii)->close();
     }
+    DESTROY(lcb_getcoalescer_destroy, get_coalescer);
 
     if ((pendq = po->items[LCB_PENDTYPE_HTTP])) {
         for (it = pendq->begin(); it != pendq->end(); ++it) {
@@ -555,6 +565,9 @@ void lcb_destroy(lcb_t instance)
     }
 
     DESTROY(delete, retryq);
+    DESTROY(delete, opcapture);
+    DESTROY(delete, slowops);
+    DESTROY(delete, metrics);
     DESTROY(delete, confmon);
     DESTROY(do_pool_shutdown, memd_sockpool);
     DESTROY(do_pool_shutdown, http_sockpool);
@@ -708,12 +721,24 @@ LIBCOUCHBASE_API
 void
 lcb_sched_leave(lcb_t instance)
 {
+    if (instance->get_coalescer) {
+        lcb_getcoalescer_ctxdone(instance->get_coalescer, 1);
+    }
+    if (instance->near_cache) {
+        instance->near_cache->ctxdone(true);
+    }
     mcreq_sched_leave(&instance->cmdq, LCBT_SETTING(instance, sched_implicit_flush));
 }
 LIBCOUCHBASE_API
 void
 lcb_sched_fail(lcb_t instance)
 {
+    if (instance->get_coalescer) {
+        lcb_getcoalescer_ctxdone(instance->get_coalescer, 0);
+    }
+    if (instance->near_cache) {
+        instance->near_cache->ctxdone(false);
+    }
     mcreq_sched_fail(&instance->cmdq);
 }
 
@@ -63,6 +63,15 @@ namespace clconfig {
 struct Confmon;
 class ConfigInfo;
 }
+namespace durability {
+class SeqnoPoller;
+}
+struct WaitSet;
+struct GetCoalescer;
+class NearCache;
+class OpCapture;
+class SlowOpTracer;
+class Metrics;
 }
 extern "C" {
 #endif
@@ -89,6 +98,7 @@ struct lcb_callback_st {
     lcb_bootstrap_callback bootstrap;
     lcb_pktfwd_callback pktfwd;
     lcb_pktflushed_callback pktflushed;
+    lcb_nodes_ready_callback nodes_ready;
 };
 
 struct lcb_GUESSVB_st;
@@ -100,12 +110,26 @@ typedef lcb::RetryQueue lcb_RETRYQ;
 typedef lcb::clconfig::Confmon* lcb_pCONFMON;
 typedef lcb::clconfig::ConfigInfo *lcb_pCONFIGINFO;
 typedef lcb::Bootstrap lcb_BOOTSTRAP;
+typedef lcb::durability::SeqnoPoller lcb_DURPOLLER;
+typedef lcb::WaitSet lcb_WAITSET;
+typedef lcb::GetCoalescer lcb_GETCOALESCER;
+typedef lcb::NearCache lcb_NEARCACHE;
+typedef lcb::OpCapture lcb_OPCAPTURE;
+typedef lcb::SlowOpTracer lcb_SLOWOPS;
+typedef lcb::Metrics lcb_METRICS;
 #else
 typedef struct lcb_SCRATCHBUF* lcb_pSCRATCHBUF;
 typedef struct lcb_RETRYQ_st lcb_RETRYQ;
 typedef struct lcb_CONFMON_st* lcb_pCONFMON;
 typedef struct lcb_CONFIGINFO_st* lcb_pCONFIGINFO;
 typedef struct lcb_BOOTSTRAP_st lcb_BOOTSTRAP;
+typedef struct lcb_DURPOLLER_st lcb_DURPOLLER;
+typedef struct lcb_WAITSET_st lcb_WAITSET;
+typedef struct lcb_GETCOALESCER_st lcb_GETCOALESCER;
+typedef struct lcb_NEARCACHE_st lcb_NEARCACHE;
+typedef struct lcb_OPCAPTURE_st lcb_OPCAPTURE;
+typedef struct lcb_SLOWOPS_st lcb_SLOWOPS;
+typedef struct lcb_METRICS_st lcb_METRICS;
 #endif
 
 struct lcb_st {
@@ -120,6 +144,7 @@ struct lcb_st {
     lcb_HISTOGRAM *kv_timings; /**< Histogram object (for timing) */
     lcb_ASPEND pendops; /**< Pending asynchronous requests */
     int wait; /**< Are we in lcb_wait() ?*/
+    lcb_WAITSET *waitset; /**< Conditions for lcb_wait_cookies(), if active */
     lcbio_MGR *memd_sockpool; /**< Connection pool for memcached connections */
     lcbio_MGR *http_sockpool; /**< Connection pool for capi connections */
     lcb_error_t last_error; /**< Seldom used. Mainly for bootstrap */
@@ -130,6 +155,14 @@ struct lcb_st {
     struct lcb_GUESSVB_st *vbguess; /**< Heuristic masters for vbuckets */
     lcb_N1QLCACHE *n1ql_cache;
     lcb_MUTATION_TOKEN *dcpinfo; /**< Mapping of known vbucket to {uuid,seqno} info */
+    lcb_DURPOLLER *dur_poller; /**< Shared OBSERVE_SEQNO probes for durability */
+    lcb_GETCOALESCER *get_coalescer; /**< In-flight GETs, if coalescing */
+    lcb_NEARCACHE *near_cache; /**< Recently read values, if enabled */
+    lcb_OPCAPTURE *opcapture; /**< Trace of completed operations, if enabled */
+    lcb_SLOWOPS *slowops; /**< Slowest recent operations, if enabled */
+    lcb_METRICS *metrics; /**< Counters for lcb_metrics_snapshot() */
+    unsigned npreconnects; /**< Connections started by LCB_CNTL_KV_PRECONNECT */
+    lcb_error_t preconnect_err; /**< First error for the current preconnects */
     lcbio_pTIMER dtor_timer; /**< Asynchronous destruction timer */
     int type; /**< Type of connection */
 
@@ -238,9 +271,22 @@ lcb_should_retry(const lcb_settings *settings, const mc_PACKET *pkt, lcb_error_t
 lcb_error_t
 lcb__synchandler_return(lcb_t instance);
 
+/**
+ * Get the callback to invoke for a given response type. While inside
+ * lcb_wait_cookies() this returns a wrapper which invokes the user's callback
+ * and then checks whether the wait is complete.
+ */
 lcb_RESPCALLBACK
 lcb_find_callback(lcb_t instance, lcb_CALLBACKTYPE cbtype);
 
+/** Like lcb_find_callback(), but always returns the user's callback */
+lcb_RESPCALLBACK
+lcb_find_user_callback(lcb_t instance, lcb_CALLBACKTYPE cbtype);
+
+/** Callback returned by lcb_find_callback() within lcb_wait_cookies() */
+void
+lcb_waitset_callback(lcb_t instance, int cbtype, const lcb_RESPBASE *rb);
+
 /* These two functions exist to allow the tests to keep the loop alive while
  * scheduling other operations asynchronously */
 
@@ -271,6 +317,11 @@ void lcb_vbguess_newconfig(lcb_t instance, lcbvb_CONFIG *cfg, struct lcb_GUESSVB
 int lcb_vbguess_remap(lcb_t instance, int vbid, int bad);
 #define lcb_vbguess_destroy(p) free(p)
 
+void lcb_getcoalescer_destroy(lcb_GETCOALESCER *gc);
+void lcb_getcoalescer_stats(lcb_t instance, lcb_cntl_coalescestats *stats);
+/** Keep (or, if `success` is false, drop) the waiters of the scheduling context */
+void lcb_getcoalescer_ctxdone(lcb_GETCOALESCER *gc, int success);
+
 #ifdef __cplusplus
 }
 #endif
@@ -66,6 +66,14 @@ int Parser::on_hdr_done() {
 
     /* extract the status */
     resp.status = http_parser::status_code;
+
+    /* content_length counts down as the body is parsed, so save it now */
+    if (http_parser::content_length != (uint64_t)-1) {
+        resp.content_length = (size_t)http_parser::content_length;
+    }
+    if (!is_ex) {
+        resp.reserve_body();
+    }
     lastcall = CB_HDR_DONE;
     return 0;
 }
@@ -166,6 +174,37 @@ void Parser::reset() {
     _lcb_http_parser_init(this, HTTP_RESPONSE);
 }
 
+// Don't trust the server with more than this
+#define BODY_PREALLOC_MAX (32 * 1024 * 1024)
+
+void Response::reserve_body() {
+    if (content_length) {
+        body.reserve(content_length < BODY_PREALLOC_MAX ?
+            content_length : BODY_PREALLOC_MAX);
+    }
+}
+
+void Response::append_body_ref(const char *s, size_t n, rdb_ROPESEG *seg) {
+    if (!body_segments.empty()) {
+        BodySegment& last = body_segments.back();
+        if (last.seg == seg && last.buf + last.nbuf == s) {
+            last.nbuf += n;
+            return;
+        }
+    }
+    BodySegment bs = { s, n, seg };
+    rdb_seg_ref(seg);
+    body_segments.push_back(bs);
+}
+
+void Response::clear_segments() {
+    std::vector<BodySegment>::iterator ii;
+    for (ii = body_segments.begin(); ii != body_segments.end(); ++ii) {
+        rdb_seg_unref(ii->seg);
+    }
+    body_segments.clear();
+}
+
 const MimeHeader* Response::get_header(const std::string& key) const {
     std::list<MimeHeader>::const_iterator it;
     for (it = headers.begin(); it != headers.end(); ++it) {
@@ -20,8 +20,10 @@
 
 #include <libcouchbase/couchbase.h>
 #include "contrib/http_parser/http_parser.h"
+#include "rdb/rope.h"
 #include <list>
 #include <string>
+#include <vector>
 
 struct lcb_settings_st;
 
@@ -33,7 +35,8 @@ struct lcb_settings_st;
  * the Content-Length header.
  *
  * Specifically this may be used to parse incoming HTTP streams into a single
- * body.
+ * body, either copied into a contiguous buffer or kept as a list of references
+ * to the network buffers it was received in.
  */
 
 namespace lcb {
@@ -45,14 +48,48 @@ struct MimeHeader {
     std::string value;
 };
 
+/** A piece of a response body which lives inside a network buffer */
+struct BodySegment {
+    const char *buf;
+    size_t nbuf;
+    rdb_ROPESEG *seg; /**< Referenced until the response is cleared */
+};
+
 struct Response {
+    Response() : status(0), state(0), content_length(0) {
+    }
+
+    ~Response() {
+        clear_segments();
+    }
+
     void clear() {
         status = 0;
         state = 0;
+        content_length = 0;
         headers.clear();
         body.clear();
+        clear_segments();
     }
 
+    /**
+     * Append a chunk of the body by reference rather than by copying it to
+     * #body. A reference is held on the segment until the response is cleared.
+     * Chunks which are adjacent within the same segment are merged.
+     *
+     * @param s the data; must be located within `seg`
+     * @param n length of the data
+     * @param seg the segment containing the data
+     */
+    void append_body_ref(const char *s, size_t n, rdb_ROPESEG *seg);
+
+    /**
+     * Reserve space in #body for the entire body, based on the Content-Length
+     * of the response. Should be called once the headers are received, and only
+     * if the body will actually be copied into #body.
+     */
+    void reserve_body();
+
     /**
      * Get a header value for a key
      * @param response The response
@@ -83,6 +120,17 @@ struct Response {
     typedef std::list<MimeHeader> HeaderList;
     HeaderList headers;
     std::string body; /**< Body */
+
+    /** Body chunks added via append_body_ref() */
+    std::vector<BodySegment> body_segments;
+
+    /** Value of the Content-Length header, or 0 if unknown */
+    size_t content_length;
+
+private:
+    void clear_segments();
+    Response(const Response&);
+    Response& operator=(const Response&);
 };
 
 class Parser : private http_parser {
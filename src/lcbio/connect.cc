@@ -22,7 +22,9 @@
 #include "settings.h"
 #include "timer-ng.h"
 #include "timer-cxx.h"
+#include "resolver.h"
 #include <errno.h>
+#include <vector>
 
 using namespace lcb::io;
 
@@ -47,6 +49,16 @@ static const lcb_host_t *get_loghost(lcbio_SOCKET *s) {
 
 namespace lcb {
 namespace io {
+struct Connstart;
+
+/** A single connection attempt, when racing several addresses */
+struct RaceAttempt {
+    Connstart *parent;
+    const addrinfo *ai;
+    lcb_socket_t fd;
+    void *event;
+};
+
 struct Connstart : ConnectionRequest {
     Connstart(lcbio_TABLE*, lcb_settings*, const lcb_host_t*,
               uint32_t, lcbio_CONNDONE_cb, void*);
@@ -56,6 +68,18 @@ struct Connstart : ConnectionRequest {
     void handler();
     void cancel();
     void C_connect();
+    void on_resolved(AddrList *res, lcb_U32 duration, bool cached);
+    static void on_async_resolved(void *arg, AddrList *res, lcb_U32 duration);
+
+    enum RaceStatus {
+        RACE_PENDING, RACE_WON, RACE_FAILED
+    };
+    void race_start();
+    void race_next();
+    RaceStatus race_connect(RaceAttempt *attempt);
+    void race_drop(RaceAttempt *attempt, int err);
+    void race_win(RaceAttempt *attempt);
+    void race_clear();
 
     enum State {
         CS_PENDING, CS_CANCELLED, CS_CONNECTED, CS_ERROR
@@ -75,11 +99,18 @@ struct Connstart : ConnectionRequest {
     void *event;
     bool ev_active; /* whether the event pointer is active (Event only) */
     bool in_uhandler; /* Whether we're inside the user-defined handler */
-    addrinfo *ai_root;
+    AddrList *addrs; /* Resolved addresses for the host */
+    Resolution *resolving; /* Pending background lookup, if any */
     addrinfo *ai;
     State state;
     lcb_error_t last_error;
     Timer<Connstart, &Connstart::handler> timer;
+
+    /* Addresses to race, in the order in which they are tried */
+    std::vector<const addrinfo*> candidates;
+    size_t next_candidate;
+    std::vector<RaceAttempt*> attempts; /* In-flight attempts */
+    Timer<Connstart, &Connstart::race_next> race_timer;
 };
 }
 }
@@ -109,6 +140,7 @@ static void try_enable_sockopt(lcbio_SOCKET *sock, int cntl) {
 void Connstart::handler() {
     lcb_error_t err;
 
+    race_clear();
     if (sock && event) {
         unwatch();
         sock->io->E_event_destroy(event);
@@ -146,6 +178,10 @@ void Connstart::handler() {
             }
         } else {
             lcb_log(LOGARGS_T(ERR), CSLOGFMT "Failed to establish connection: %s, os errno=%u", CSLOGID_T(), lcb_strerror_short(err), syserr);
+            if (addrs && addrs->error == 0) {
+                /* The host may have moved. Don't reuse these addresses */
+                resolve_invalidate(sock->settings, &sock->info->ep);
+            }
         }
     }
 
@@ -159,12 +195,17 @@ void Connstart::handler() {
 }
 
 Connstart::~Connstart() {
+    race_clear();
     timer.release();
+    race_timer.release();
+    if (resolving) {
+        resolve_cancel(resolving);
+    }
     if (sock) {
         lcbio_unref(sock);
     }
-    if (ai_root) {
-        freeaddrinfo(ai_root);
+    if (addrs) {
+        addrlist_unref(addrs);
     }
 }
 
@@ -437,11 +478,9 @@ Connstart::Connstart(lcbio_TABLE* iot_, lcb_settings* settings_,
                     lcbio_CONNDONE_cb handler, void *arg)
     : user_handler(handler), user_arg(arg), sock(NULL), syserr(0),
       event(NULL), ev_active(false), in_uhandler(false),
-      ai_root(NULL), ai(NULL), state(CS_PENDING), last_error(LCB_SUCCESS),
-      timer(iot_, this) {
-
-    addrinfo hints;
-    int rv;
+      addrs(NULL), resolving(NULL), ai(NULL), state(CS_PENDING),
+      last_error(LCB_SUCCESS), timer(iot_, this), next_candidate(0),
+      race_timer(iot_, this) {
 
     sock = reinterpret_cast<lcbio_SOCKET*>(calloc(1, sizeof(*sock)));
 
@@ -465,31 +504,231 @@ Connstart::Connstart(lcbio_TABLE* iot_, lcb_settings* settings_,
     lcb_log(LOGARGS_T(INFO), CSLOGFMT "Starting. Timeout=%uus", CSLOGID_T(), timeout);
 
     /** Hostname lookup: */
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_flags = AI_PASSIVE;
-    hints.ai_socktype = SOCK_STREAM;
-    if (settings_->ipv6 == LCB_IPV6_DISABLED) {
-        hints.ai_family = AF_INET;
-    } else if (settings_->ipv6 == LCB_IPV6_ONLY) {
-        hints.ai_family = AF_INET6;
+    lcb_U32 duration;
+    bool cached;
+    AddrList *res = resolve(iot_, settings_, dest, on_async_resolved, this,
+        &resolving, &duration, &cached);
+    if (res) {
+        on_resolved(res, duration, cached);
     } else {
-        hints.ai_family = AF_UNSPEC;
+        lcb_log(LOGARGS_T(DEBUG), CSLOGFMT "Resolving %s in the background", CSLOGID_T(), dest->host);
     }
+}
 
-    if ((rv = getaddrinfo(dest->host, dest->port, &hints, &ai_root))) {
+void Connstart::on_async_resolved(void *arg, AddrList *res, lcb_U32 duration)
+{
+    Connstart *cs = reinterpret_cast<Connstart*>(arg);
+    cs->resolving = NULL;
+    cs->on_resolved(res, duration, false);
+}
+
+void Connstart::on_resolved(AddrList *res, lcb_U32 duration, bool cached)
+{
+    const lcb_host_t *dest = &sock->info->ep;
+    int rv = res->error;
+    addrs = res;
+
+    if (rv) {
         const char *errstr = rv != EAI_SYSTEM ? gai_strerror(rv) : "";
-        lcb_log(LOGARGS_T(ERR), CSLOGFMT "Couldn't look up %s (%s) [EAI=%d]", CSLOGID_T(), dest->host, errstr, rv);
+        lcb_log(LOGARGS_T(ERR), CSLOGFMT "Couldn't look up %s (%s) [EAI=%d]%s", CSLOGID_T(), dest->host, errstr, rv, cached ? " (cached)" : "");
         notify_error(LCB_UNKNOWN_HOST);
+        return;
+    }
+
+    if (cached) {
+        lcb_log(LOGARGS_T(DEBUG), CSLOGFMT "Using cached addresses for %s", CSLOGID_T(), dest->host);
     } else {
-        ai = ai_root;
+        lcb_log(LOGARGS_T(DEBUG), CSLOGFMT "Resolved %s in %uus", CSLOGID_T(), dest->host, duration);
+    }
+    ai = addrs->root;
 
-        /** Figure out how to connect */
-        if (iot_->is_E()) {
-            E_conncb(-1, LCB_WRITE_EVENT, this);
+    /** Figure out how to connect */
+    if (sock->io->is_E() && sock->settings->ipv6 == LCB_IPV6_ALLOW &&
+            sock->settings->connect_attempt_delay && ai->ai_next) {
+        race_start();
+    } else if (sock->io->is_E()) {
+        E_conncb(-1, LCB_WRITE_EVENT, this);
+    } else {
+        C_connect();
+    }
+}
+
+/**
+ * Begin racing connection attempts to the resolved addresses. Addresses are
+ * reordered so that the two address families alternate, starting with the
+ * family of the first (most preferred) address.
+ */
+void Connstart::race_start()
+{
+    std::vector<const addrinfo*> preferred, other;
+    for (const addrinfo *cur = ai; cur; cur = cur->ai_next) {
+        if (cur->ai_family == ai->ai_family) {
+            preferred.push_back(cur);
         } else {
-            C_connect();
+            other.push_back(cur);
+        }
+    }
+    for (size_t ii = 0; ii < preferred.size() || ii < other.size(); ii++) {
+        if (ii < preferred.size()) {
+            candidates.push_back(preferred[ii]);
+        }
+        if (ii < other.size()) {
+            candidates.push_back(other[ii]);
+        }
+    }
+    lcb_log(LOGARGS_T(DEBUG), CSLOGFMT "Racing connections to %u addresses", CSLOGID_T(), (unsigned)candidates.size());
+    race_next();
+}
+
+/**
+ * Start a connection attempt to the next address. Invoked initially, when an
+ * attempt fails, and when the attempt delay elapses without a connection.
+ */
+void Connstart::race_next()
+{
+    lcbio_TABLE *io = sock->io;
+
+    while (next_candidate < candidates.size()) {
+        const addrinfo *cur = candidates[next_candidate++];
+        lcb_socket_t fd = io->E_socket(cur);
+        if (fd == INVALID_SOCKET) {
+            lcbio_mksyserr(io->get_errno(), &syserr);
+            continue;
+        }
+
+        RaceAttempt *attempt = new RaceAttempt();
+        attempt->parent = this;
+        attempt->ai = cur;
+        attempt->fd = fd;
+        attempt->event = io->E_event_create();
+        attempts.push_back(attempt);
+        lcb_log(LOGARGS_T(TRACE), CSLOGFMT "Starting connection attempt %u with FD=%d", CSLOGID_T(), (unsigned)next_candidate, fd);
+
+        RaceStatus status = race_connect(attempt);
+        if (status == RACE_PENDING) {
+            if (next_candidate < candidates.size()) {
+                race_timer.rearm(sock->settings->connect_attempt_delay);
+            }
+            return;
+        } else if (status == RACE_WON) {
+            return;
         }
     }
+
+    if (attempts.empty()) {
+        notify_error(LCB_CONNECT_ERROR);
+    }
+}
+
+static void
+E_race_conncb(lcb_socket_t, short events, void *arg)
+{
+    RaceAttempt *attempt = reinterpret_cast<RaceAttempt*>(arg);
+    Connstart *cs = attempt->parent;
+
+    if (events & LCB_ERROR_EVENT) {
+        socklen_t errlen = sizeof(int);
+        int sockerr = 0;
+        getsockopt(attempt->fd, SOL_SOCKET, SO_ERROR, (char *)&sockerr, &errlen);
+        cs->race_drop(attempt, sockerr);
+        cs->race_next();
+    } else if (cs->race_connect(attempt) == Connstart::RACE_FAILED) {
+        cs->race_next();
+    }
+}
+
+Connstart::RaceStatus Connstart::race_connect(RaceAttempt *attempt)
+{
+    lcbio_TABLE *io = sock->io;
+    bool retry_once = false;
+
+    for (;;) {
+        if (io->E_connect(attempt->fd, attempt->ai->ai_addr,
+                          attempt->ai->ai_addrlen) == 0) {
+            race_win(attempt);
+            return RACE_WON;
+        }
+
+        switch (lcbio_mkcserr(io->get_errno())) {
+        case LCBIO_CSERR_INTR:
+            continue;
+
+        case LCBIO_CSERR_CONNECTED:
+            race_win(attempt);
+            return RACE_WON;
+
+        case LCBIO_CSERR_BUSY:
+            io->E_event_watch(attempt->fd, attempt->event, LCB_WRITE_EVENT,
+                              attempt, E_race_conncb);
+            return RACE_PENDING;
+
+        case LCBIO_CSERR_EINVAL:
+            if (!retry_once) {
+                retry_once = true;
+                continue;
+            }
+            /* fallthrough */
+
+        case LCBIO_CSERR_EFAIL:
+        default:
+            race_drop(attempt, io->get_errno());
+            return RACE_FAILED;
+        }
+    }
+}
+
+/** Close a failed attempt */
+void Connstart::race_drop(RaceAttempt *attempt, int err)
+{
+    lcbio_TABLE *io = sock->io;
+
+    lcbio_mksyserr(err, &syserr);
+    lcb_log(LOGARGS_T(TRACE), CSLOGFMT "Connection attempt with FD=%d failed. errno=%d [%s]", CSLOGID_T(), attempt->fd, err, strerror(err));
+    io->E_event_cancel(attempt->fd, attempt->event);
+    io->E_event_destroy(attempt->event);
+    io->E_close(attempt->fd);
+    for (size_t ii = 0; ii < attempts.size(); ii++) {
+        if (attempts[ii] == attempt) {
+            attempts.erase(attempts.begin() + ii);
+            break;
+        }
+    }
+    delete attempt;
+}
+
+/** Adopt the descriptor of the winning attempt and close all others */
+void Connstart::race_win(RaceAttempt *attempt)
+{
+    lcbio_TABLE *io = sock->io;
+
+    io->E_event_cancel(attempt->fd, attempt->event);
+    io->E_event_destroy(attempt->event);
+    sock->u.fd = attempt->fd;
+    for (size_t ii = 0; ii < attempts.size(); ii++) {
+        if (attempts[ii] == attempt) {
+            attempts.erase(attempts.begin() + ii);
+            break;
+        }
+    }
+    delete attempt;
+
+    lcb_log(LOGARGS_T(DEBUG), CSLOGFMT "Connection attempt with FD=%d won. Closing %u other attempts", CSLOGID_T(), sock->u.fd, (unsigned)attempts.size());
+    race_clear();
+    notify_success();
+}
+
+/** Close all in-flight attempts */
+void Connstart::race_clear()
+{
+    for (size_t ii = 0; ii < attempts.size(); ii++) {
+        RaceAttempt *attempt = attempts[ii];
+        sock->io->E_event_cancel(attempt->fd, attempt->event);
+        sock->io->E_event_destroy(attempt->event);
+        sock->io->E_close(attempt->fd);
+        delete attempt;
+    }
+    attempts.clear();
+    race_timer.cancel();
 }
 
 ConnectionRequest *
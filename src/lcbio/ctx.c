@@ -102,10 +102,25 @@ lcbio_ctx_new(lcbio_SOCKET *sock, void *data, const lcbio_CTXPROCS *procs)
     return ctx;
 }
 
+static void
+free_zc(lcbio_CTX *ctx)
+{
+    if (ctx->zc) {
+        if (ctx->zc->drain) {
+            lcbio_timer_destroy(ctx->zc->drain);
+        }
+        free(ctx->zc->sends);
+        free(ctx->zc->rest);
+        free(ctx->zc);
+        ctx->zc = NULL;
+    }
+}
+
 static void
 free_ctx(lcbio_CTX *ctx)
 {
     rdb_cleanup(&ctx->ior);
+    free_zc(ctx);
     lcbio_unref(ctx->sock);
     if (ctx->output) {
         ringbuffer_destruct(&ctx->output->rb);
@@ -156,7 +171,8 @@ lcbio_ctx_close_ex(lcbio_CTX *ctx, lcbio_CTXCLOSE_cb cb, void *arg,
                 ctx->err == LCB_SUCCESS && /* no socket errors */
                 ctx->rdwant == 0 && /* no expected input */
                 ctx->wwant == 0 && /* no expected output */
-                (ctx->output == NULL || ctx->output->rb.nbytes == 0);
+                (ctx->output == NULL || ctx->output->rb.nbytes == 0) &&
+                ctx->zc == NULL; /* no zerocopy notifications to come */
         cb(ctx->sock, reusable, arg);
     }
 
@@ -170,6 +186,10 @@ lcbio_ctx_close_ex(lcbio_CTX *ctx, lcbio_CTXCLOSE_cb cb, void *arg,
         ctx->output = NULL;
     }
 
+    /* Owners use lcbio_ctx_zcdrain() before closing. Anything still
+     * outstanding here is abandoned */
+    free_zc(ctx);
+
     ctx->fd = INVALID_SOCKET;
     ctx->sd = NULL;
 
@@ -274,6 +294,9 @@ invoke_read_cb(lcbio_CTX *ctx, unsigned nb)
     ctx->entered--;
 }
 
+static int E_zc_reap(lcbio_CTX *ctx);
+static int E_zc_write(lcbio_CTX *ctx);
+
 static void
 E_handler(lcb_socket_t sock, short which, void *arg)
 {
@@ -281,7 +304,21 @@ E_handler(lcb_socket_t sock, short which, void *arg)
     lcbio_IOSTATUS status;
     (void)sock;
 
-    if (which & LCB_READ_EVENT) {
+    if (lcbio_ctx_zcpending(ctx) && E_zc_reap(ctx)) {
+        return;
+    }
+
+    if ((which & LCB_READ_EVENT) && !ctx->rdwant && ctx->zc) {
+        /* The socket is only watched for zerocopy notifications. Anything
+         * else which makes it readable must be consumed here, or the event
+         * would fire again right away. Input is kept for the next read, and
+         * a closed or failed connection is reported */
+        status = lcbio_E_rdb_slurp(ctx, &ctx->ior);
+        if (!LCBIO_IS_OK(status)) {
+            lcbio_ctx_senderr(ctx, convert_lcberr(ctx, status));
+            return;
+        }
+    } else if (which & LCB_READ_EVENT) {
         unsigned nb;
         status = lcbio_E_rdb_slurp(ctx, &ctx->ior);
         nb = rdb_get_nused(&ctx->ior);
@@ -300,7 +337,9 @@ E_handler(lcb_socket_t sock, short which, void *arg)
     }
 
     if (which & LCB_WRITE_EVENT) {
-        if (ctx->wwant) {
+        if (ctx->zc && !E_zc_write(ctx)) {
+            /* Data from the last lcbio_ctx_put_ex() remains to be written */
+        } else if (ctx->wwant) {
             ctx->wwant = 0;
             ctx->procs.cb_flush_ready(ctx);
             if (ctx->err) {
@@ -444,10 +483,16 @@ E_schedule(lcbio_CTX *ctx)
     lcbio_TABLE *io = ctx->io;
     short which = 0;
 
-    if (ctx->rdwant) {
+    if (ctx->zc && ctx->zc->drain) {
+        /* Notifications are polled by lcbio_ctx_zcdrain() */
+        deactivate_watcher(ctx);
+        return;
+    }
+    if (ctx->rdwant || lcbio_ctx_zcpending(ctx)) {
         which |= LCB_READ_EVENT;
     }
-    if (ctx->wwant || (ctx->output && ctx->output->rb.nbytes)) {
+    if (ctx->wwant || (ctx->output && ctx->output->rb.nbytes) ||
+            (ctx->zc && ctx->zc->nrest)) {
         which |= LCB_WRITE_EVENT;
     }
 
@@ -474,6 +519,265 @@ lcbio_ctx_schedule(lcbio_CTX *ctx)
     }
 }
 
+/**
+ * Zerocopy sends
+ *
+ * Once an lcbio_ctx_put_ex() call is to be sent with MSG_ZEROCOPY, the data
+ * passed to it and to any following call is written in full (as with the
+ * completion model), and each write is recorded. cb_flush_done() is only
+ * invoked for the leading writes which the kernel no longer references, so
+ * that the owner sees flushes in order and never needs to rewind.
+ */
+
+static int
+zc_wanted(const lcbio__ZEROCOPY *zc, const lcb_IOV *iov, unsigned niov)
+{
+    unsigned ii;
+    if (!zc->threshold) {
+        return 0;
+    }
+    for (ii = 0; ii < niov; ii++) {
+        if (iov[ii].iov_len >= zc->threshold) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int
+zc_reserve(lcbio__ZEROCOPY *zc)
+{
+    if (zc->nsends == zc->sendcap) {
+        unsigned newcap = zc->sendcap ? zc->sendcap * 2 : 16;
+        lcbio__ZCSEND *sends = realloc(zc->sends, newcap * sizeof(*sends));
+        if (!sends) {
+            return 0;
+        }
+        zc->sends = sends;
+        zc->sendcap = newcap;
+    }
+    return 1;
+}
+
+static void
+zc_record(lcbio__ZEROCOPY *zc, unsigned nb, int zerocopy)
+{
+    lcbio__ZCSEND *send;
+
+    if (zc->nsends) {
+        send = zc->sends + zc->nsends - 1;
+        if (!zerocopy && !send->zerocopy) {
+            send->nb += nb;
+            return;
+        }
+    }
+
+    send = zc->sends + zc->nsends++;
+    send->nb = nb;
+    send->zerocopy = zerocopy;
+    send->done = !zerocopy;
+    send->seq = zerocopy ? zc->nextseq++ : 0;
+}
+
+static void
+zc_consume(lcbio__ZEROCOPY *zc, unsigned nw)
+{
+    unsigned nused = 0;
+    while (nused < zc->nrest && nw >= zc->rest[nused].iov_len) {
+        nw -= zc->rest[nused++].iov_len;
+    }
+    if (nused < zc->nrest) {
+        zc->rest[nused].iov_base = (char *)zc->rest[nused].iov_base + nw;
+        zc->rest[nused].iov_len -= nw;
+    }
+    zc->nrest -= nused;
+    memmove(zc->rest, zc->rest + nused, zc->nrest * sizeof(*zc->rest));
+}
+
+/**
+ * Write the remaining data from the last lcbio_ctx_put_ex()
+ * @return nonzero once everything has been written
+ */
+static int
+E_zc_write(lcbio_CTX *ctx)
+{
+    lcbio__ZEROCOPY *zc = ctx->zc;
+    lcbio_TABLE *iot = ctx->io;
+
+    while (zc->nrest) {
+        unsigned niov = zc->nrest <= RWINL_IOVSIZE ? zc->nrest : RWINL_IOVSIZE;
+        int zerocopy = zc_wanted(zc, zc->rest, niov);
+        lcbio_OSERR err = 0;
+        lcb_ssize_t nw = -1;
+
+        if (!zc_reserve(zc)) {
+            lcbio_ctx_senderr(ctx, LCB_CLIENT_ENOMEM);
+            return 0;
+        }
+
+        if (zerocopy) {
+            nw = lcbio_E_zc_sendv(CTX_FD(ctx), zc->rest, niov);
+            err = lcbio_syserrno;
+            if (nw == -1 && err == ENOBUFS) {
+                /* Too many pages are pinned already. Copy this one */
+                zerocopy = 0;
+            }
+        }
+        if (!zerocopy) {
+            nw = IOT_V0IO(iot).sendv(IOT_ARG(iot), CTX_FD(ctx), zc->rest, niov);
+            err = IOT_ERRNO(iot);
+        }
+
+        if (nw > 0) {
+            zc_record(zc, nw, zerocopy);
+            zc_consume(zc, nw);
+        } else if (nw == -1 && err == EINTR) {
+            continue;
+        } else if (nw == -1 && (err == C_EAGAIN || err == EWOULDBLOCK)) {
+            return 0;
+        } else {
+            IOT_ERRNO(iot) = err;
+            lcbio_ctx_senderr(ctx,
+                convert_lcberr(ctx, nw ? LCBIO_IOERR : LCBIO_SHUTDOWN));
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/** Invoke cb_flush_done() for the leading writes which have completed */
+static void
+E_zc_release(lcbio_CTX *ctx)
+{
+    lcbio__ZEROCOPY *zc = ctx->zc;
+    unsigned ndone = 0, nb = 0;
+
+    while (ndone < zc->nsends && zc->sends[ndone].done) {
+        nb += zc->sends[ndone++].nb;
+    }
+    if (!ndone) {
+        return;
+    }
+    zc->nsends -= ndone;
+    memmove(zc->sends, zc->sends + ndone, zc->nsends * sizeof(*zc->sends));
+    ctx->procs.cb_flush_done(ctx, nb, nb);
+}
+
+/**
+ * Read completion notifications from the socket's error queue
+ * @return nonzero if the context was destroyed by the flush callback
+ */
+static int
+E_zc_reap(lcbio_CTX *ctx)
+{
+    lcbio__ZEROCOPY *zc = ctx->zc;
+    lcb_U32 lo, hi;
+    int copied;
+
+    while (lcbio_E_zc_reap(CTX_FD(ctx), &lo, &hi, &copied)) {
+        unsigned ii;
+        for (ii = 0; ii < zc->nsends; ii++) {
+            lcbio__ZCSEND *send = zc->sends + ii;
+            if (send->zerocopy && (lcb_U32)(send->seq - lo) <= (lcb_U32)(hi - lo)) {
+                send->done = 1;
+            }
+        }
+        if (copied && zc->threshold) {
+            /* The kernel could not send from our pages (e.g. loopback) and
+             * copied them after pinning them. Copy up front from now on */
+            lcb_log(LOGARGS(ctx, DEBUG), CTX_LOGFMT "Kernel copied zerocopy send. Disabling zerocopy", CTX_LOGID(ctx));
+            zc->threshold = 0;
+        }
+    }
+
+    ctx->entered++;
+    E_zc_release(ctx);
+    ctx->entered--;
+    return E_free_detached(ctx);
+}
+
+static int
+E_zc_put(lcbio_CTX *ctx, lcb_IOV *iov, unsigned niov)
+{
+    lcbio__ZEROCOPY *zc = ctx->zc;
+    int ready;
+
+    assert(zc->nrest == 0);
+    if (niov > zc->restcap) {
+        lcb_IOV *rest = realloc(zc->rest, niov * sizeof(*rest));
+        if (!rest) {
+            lcbio_ctx_senderr(ctx, LCB_CLIENT_ENOMEM);
+            return 0;
+        }
+        zc->rest = rest;
+        zc->restcap = niov;
+    }
+    memcpy(zc->rest, iov, niov * sizeof(*iov));
+    zc->nrest = niov;
+
+    ready = E_zc_write(ctx);
+    E_zc_release(ctx);
+    return ready;
+}
+
+/**
+ * Once aborted, the socket is always readable, so the error queue is polled
+ * instead. Most notifications are queued as soon as the connection is
+ * aborted; the rest follow once the NIC has finished sending.
+ */
+#define ZC_DRAIN_INTERVAL LCB_MS2US(10)
+
+static void
+E_zc_drain(void *arg)
+{
+    lcbio_CTX *ctx = arg;
+    if (E_zc_reap(ctx)) {
+        return;
+    }
+    if (lcbio_ctx_zcpending(ctx)) {
+        lcbio_timer_rearm(ctx->zc->drain, ZC_DRAIN_INTERVAL);
+    }
+}
+
+void
+lcbio_ctx_zcdrain(lcbio_CTX *ctx)
+{
+    lcbio__ZEROCOPY *zc = ctx->zc;
+
+    if (!lcbio_ctx_zcpending(ctx) || zc->drain) {
+        return;
+    }
+    lcb_log(LOGARGS(ctx, DEBUG), CTX_LOGFMT "Waiting for %u zerocopy write(s) to complete", CTX_LOGID(ctx), zc->nsends);
+
+    zc->threshold = 0;
+    zc->nrest = 0;
+    ctx->rdwant = 0;
+    ctx->wwant = 0;
+    deactivate_watcher(ctx);
+    lcbio_E_zc_abort(CTX_FD(ctx));
+
+    zc->drain = lcbio_timer_new(ctx->io, ctx, E_zc_drain);
+    lcbio_async_signal(zc->drain);
+}
+
+int
+lcbio_ctx_zerocopy(lcbio_CTX *ctx, unsigned threshold)
+{
+    if (!threshold || !IOT_IS_EVENT(ctx->io) || lcbio_ssl_check(ctx->sock)) {
+        return 0;
+    }
+    if (!ctx->zc) {
+        if (lcbio_E_zc_enable(CTX_FD(ctx)) != 0) {
+            return 0;
+        }
+        if (!(ctx->zc = calloc(1, sizeof(*ctx->zc)))) {
+            return 0;
+        }
+    }
+    ctx->zc->threshold = threshold;
+    return 1;
+}
+
 /** Extended function used for write-on-callback mode */
 static int
 E_put_ex(lcbio_CTX *ctx, lcb_IOV *iov, unsigned niov, unsigned nb)
@@ -482,6 +786,10 @@ E_put_ex(lcbio_CTX *ctx, lcb_IOV *iov, unsigned niov, unsigned nb)
     lcbio_TABLE *iot = ctx->io;
     lcb_socket_t fd = CTX_FD(ctx);
 
+    if (ctx->zc && (ctx->zc->nsends || zc_wanted(ctx->zc, iov, niov))) {
+        return E_zc_put(ctx, iov, niov);
+    }
+
     GT_WRITE_AGAIN:
     nw = IOT_V0IO(iot).sendv(IOT_ARG(iot), fd, iov,
         niov <= RWINL_IOVSIZE ? niov : RWINL_IOVSIZE);
@@ -596,6 +904,9 @@ lcbio_ctx_dump(lcbio_CTX *ctx, FILE *fp)
     fprintf(fp, "  ReqRead=%d\n", ctx->rdwant);
     fprintf(fp, "  WantWrite=%d\n", ctx->wwant);
     fprintf(fp, "  Entered=%d\n", ctx->entered);
+    if (ctx->zc) {
+        fprintf(fp, "  ZerocopyWrites=%u\n", ctx->zc->nsends);
+    }
     fprintf(fp, "  Active=%d\n", ctx->state == ES_ACTIVE);
     fprintf(fp, "  SOCKET=%p\n", (void*)ctx->sock);
     fprintf(fp, "    Model=%s\n", ctx->io->model == LCB_IOMODEL_EVENT ? "Event" : "Completion");
@@ -123,6 +123,33 @@ typedef struct {
     lcbio_pCTX parent;
 } lcbio__EASYRB;
 
+/**
+ * A write made while zero-copy writes are awaiting completion
+ * @private
+ */
+typedef struct {
+    lcb_U32 seq; /**< number of the zero-copy send */
+    unsigned nb; /**< bytes written */
+    char zerocopy; /**< sent with MSG_ZEROCOPY */
+    char done; /**< the kernel no longer references the data */
+} lcbio__ZCSEND;
+
+/**
+ * State for lcbio_ctx_zerocopy()
+ * @private
+ */
+typedef struct {
+    unsigned threshold; /**< minimum IOV size sent in place, 0 to copy all */
+    lcb_U32 nextseq; /**< number of the next zero-copy send */
+    lcbio__ZCSEND *sends; /**< writes not yet passed to cb_flush_done */
+    unsigned nsends;
+    unsigned sendcap;
+    lcb_IOV *rest; /**< unwritten part of the last lcbio_ctx_put_ex() */
+    unsigned nrest;
+    unsigned restcap;
+    lcbio_pTIMER drain; /**< polls for notifications after lcbio_ctx_zcdrain() */
+} lcbio__ZEROCOPY;
+
 /**
  * @brief Context for socket I/O
  *
@@ -149,6 +176,7 @@ typedef struct lcbio_CTX {
     lcbio_pASYNC as_err; /**< async error handler */
     lcbio_CTXPROCS procs; /**< callbacks */
     const char *subsys; /**< Informational description of connection */
+    lcbio__ZEROCOPY *zc; /**< for lcbio_ctx_zerocopy() */
 } lcbio_CTX;
 
 /**@name Creating and Closing
@@ -323,6 +351,52 @@ lcbio_ctx_wwant(lcbio_CTX *ctx);
 int
 lcbio_ctx_put_ex(lcbio_CTX *ctx, lcb_IOV *iov, unsigned niov, unsigned nb);
 
+/**
+ * @brief Send large buffers passed to lcbio_ctx_put_ex() without copying them
+ *
+ * Data passed to lcbio_ctx_put_ex() which contains an IOV of at least
+ * `threshold` bytes is sent with `MSG_ZEROCOPY`. The kernel then references
+ * the application's pages rather than copying them into the socket buffer,
+ * and the lcbio_CTXPROCS#cb_flush_done() callback for the data is deferred
+ * until the kernel reports (via the socket's error queue) that it no longer
+ * needs them. Flush notifications are always delivered in order, so data
+ * written after a zero-copy send is reported once that send completes.
+ *
+ * If the kernel reports that it had to copy the data anyway (for example,
+ * over loopback), subsequent writes are copied as usual.
+ *
+ * Zero-copy sends are only available for plain (non-SSL) sockets of
+ * event-based I/O plugins on Linux. The ctx must not be closed while
+ * lcbio_ctx_zcpending() is true, since the kernel may still be sending the
+ * data; use lcbio_ctx_zcdrain() to wait for it instead. Data passed to
+ * lcbio_ctx_put_ex() but not yet written when the ctx is closed or drained
+ * is not reported as flushed at all, and the owner must reset its flush
+ * cursor (see netbuf_reset_flush()).
+ *
+ * @param ctx the context
+ * @param threshold the minimum size of an IOV to send in place
+ * @return nonzero if zero-copy sends were enabled
+ */
+int
+lcbio_ctx_zerocopy(lcbio_CTX *ctx, unsigned threshold);
+
+/** Whether zero-copy writes are awaiting completion */
+#define lcbio_ctx_zcpending(ctx) ((ctx)->zc && (ctx)->zc->nsends)
+
+/**
+ * @brief Stop I/O on a ctx and wait for its zero-copy writes to complete
+ *
+ * The connection is aborted, unwritten data is discarded, and the socket is
+ * no longer watched for I/O. It is kept open until the kernel reports that
+ * it no longer references the data of outstanding zero-copy writes, and
+ * lcbio_CTXPROCS#cb_flush_done() is invoked for them as usual. Once
+ * lcbio_ctx_zcpending() is false, the ctx may be closed.
+ *
+ * @param ctx the context, with lcbio_ctx_zcpending() true
+ */
+void
+lcbio_ctx_zcdrain(lcbio_CTX *ctx);
+
 /**
  * Require that the read callback not be invoked until at least `n`
  * bytes are available within the buffer.
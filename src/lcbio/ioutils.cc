@@ -290,6 +290,97 @@ lcbio_strsockopt(int cntl) {
     }
 }
 
+#ifdef __linux__
+#include <linux/errqueue.h>
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
+int
+lcbio_E_zc_enable(lcb_socket_t fd) {
+    int value = 1;
+    return setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &value, sizeof value);
+}
+
+lcb_ssize_t
+lcbio_E_zc_sendv(lcb_socket_t fd, lcb_IOV *iov, unsigned niov) {
+    struct msghdr mh;
+    memset(&mh, 0, sizeof mh);
+    mh.msg_iov = (struct iovec *)iov;
+    mh.msg_iovlen = niov;
+    return sendmsg(fd, &mh, MSG_ZEROCOPY | MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+int
+lcbio_E_zc_reap(lcb_socket_t fd, lcb_U32 *lo, lcb_U32 *hi, int *copied) {
+    char control[128];
+    struct msghdr mh;
+
+    memset(&mh, 0, sizeof mh);
+    mh.msg_control = control;
+    mh.msg_controllen = sizeof control;
+
+    while (recvmsg(fd, &mh, MSG_ERRQUEUE | MSG_DONTWAIT) != -1) {
+        struct cmsghdr *cm;
+        for (cm = CMSG_FIRSTHDR(&mh); cm; cm = CMSG_NXTHDR(&mh, cm)) {
+            const struct sock_extended_err *ee;
+            if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+                    !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+            ee = (const struct sock_extended_err *)CMSG_DATA(cm);
+            if (ee->ee_errno != 0 || ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            *lo = ee->ee_info;
+            *hi = ee->ee_data;
+            *copied = ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED;
+            return 1;
+        }
+        /* Not a zerocopy notification */
+        mh.msg_controllen = sizeof control;
+    }
+    return 0;
+}
+
+void
+lcbio_E_zc_abort(lcb_socket_t fd) {
+    /* Disconnecting a TCP socket purges its send queue */
+    struct sockaddr sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_family = AF_UNSPEC;
+    connect(fd, &sa, sizeof sa);
+}
+#else
+int
+lcbio_E_zc_enable(lcb_socket_t) {
+    return -1;
+}
+
+lcb_ssize_t
+lcbio_E_zc_sendv(lcb_socket_t, lcb_IOV *, unsigned) {
+    return -1;
+}
+
+int
+lcbio_E_zc_reap(lcb_socket_t, lcb_U32 *, lcb_U32 *, int *) {
+    return 0;
+}
+
+void
+lcbio_E_zc_abort(lcb_socket_t) {
+}
+#endif
+
 int
 lcbio_ssl_supported(void)
 {
@@ -323,6 +414,9 @@ lcb_error_t lcbio_ssl_get_error(lcbio_SOCKET *) {
 }
 void lcbio_ssl_global_init(void) {
 }
+void lcbio_ssl_get_stats(lcbio_pSSLCTX, lcb_cntl_sslstats *stats) {
+    memset(stats, 0, sizeof(*stats));
+}
 lcb_error_t lcbio_sslify_if_needed(lcbio_SOCKET *, lcb_settings *) {
     return LCB_SUCCESS;
 }
@@ -104,6 +104,47 @@ lcbio_enable_sockopt(lcbio_SOCKET *sock, int cntl);
 const char *
 lcbio_strsockopt(int cntl);
 
+/**
+ * Enable MSG_ZEROCOPY transmission on a socket.
+ * @param fd the socket
+ * @return 0 on success, or -1 if neither the platform nor the kernel support it
+ */
+int
+lcbio_E_zc_enable(lcb_socket_t fd);
+
+/**
+ * Like sendmsg(), but the kernel sends the buffers in place rather than
+ * copying them. The buffers must not be modified or released until
+ * lcbio_E_zc_reap() reports this call as complete.
+ * @return the number of bytes sent, or -1 with the error in `errno`
+ */
+lcb_ssize_t
+lcbio_E_zc_sendv(lcb_socket_t fd, lcb_IOV *iov, unsigned niov);
+
+/**
+ * Read a completion notification from the socket's error queue.
+ *
+ * Each lcbio_E_zc_sendv() call which sent data is numbered, starting at 0
+ * for the socket. A notification covers a range of these calls.
+ *
+ * @param fd the socket
+ * @param[out] lo the number of the first completed call
+ * @param[out] hi the number of the last completed call
+ * @param[out] copied set to nonzero if the kernel copied the data anyway
+ * @return 1 if a notification was read, 0 otherwise
+ */
+int
+lcbio_E_zc_reap(lcb_socket_t fd, lcb_U32 *lo, lcb_U32 *hi, int *copied);
+
+/**
+ * Abort the connection (with a reset) but keep the socket open. The kernel
+ * discards the data it has queued, so that the completion notifications for
+ * outstanding lcbio_E_zc_sendv() calls can still be read.
+ * @param fd the socket
+ */
+void
+lcbio_E_zc_abort(lcb_socket_t fd);
+
 void
 lcbio__load_socknames(lcbio_SOCKET *sock);
 
@@ -32,6 +32,8 @@ struct PoolHost {
     inline PoolHost(Pool*, const std::string&);
     inline void connection_available();
     inline void start_new_connection(uint32_t timeout);
+    inline void probe_idle();
+    inline void schedule_probe();
 
     void ref() {
         refcount++;
@@ -64,6 +66,9 @@ struct PoolHost {
     size_t num_leased() const {
         return n_total - (num_idle() + num_pending());
     }
+    unsigned idle_quota() const {
+        return maxidle < 0 ? parent->options.maxidle : maxidle;
+    }
 
     lcb_clist_t ll_idle; /* idle connections */
     lcb_clist_t ll_pending; /* pending cinfo */
@@ -71,7 +76,11 @@ struct PoolHost {
     const std::string key; /* host:port */
     Pool *parent;
     lcb::io::Timer<PoolHost, &PoolHost::connection_available> async;
+    lcb::io::Timer<PoolHost, &PoolHost::probe_idle> probe;
     unsigned n_total; /* number of total connections */
+    unsigned n_warm; /* connections requested via preconnect() */
+    uint32_t warm_tmo; /* connect timeout for preconnect() */
+    int maxidle; /* per-host override of Options::maxidle, or -1 */
     unsigned refcount;
 };
 }
@@ -228,10 +237,14 @@ void Pool::shutdown() {
         hes.push_back(he);
     }
 
+    // Don't probe hosts which outlive the pool because of leased connections
+    options.tmoprobe = 0;
+
     for (HeList::iterator it = hes.begin(); it != hes.end(); ++it) {
         PoolHost *he = *it;
         ht.erase(he->key);
         he->async.release();
+        he->probe.release();
         he->unref();
     }
 
@@ -305,7 +318,8 @@ void PoolConnInfo::on_connected(lcbio_SOCKET *sock_, lcb_error_t err) {
         lcbio_protoctx_add(sock, this);
 
         lcb_clist_append(&parent->ll_idle, this);
-        idle_timer.rearm(parent->parent->options.maxidle);
+        idle_timer.rearm(parent->parent->options.tmoidle);
+        parent->schedule_probe();
         parent->connection_available();
     }
 }
@@ -354,9 +368,45 @@ void PoolRequest::timer_handler() {
     }
 }
 
+/**
+ * Periodically invoked while idle connections exist. Removes connections
+ * which were closed by the peer (e.g. because of a server-side keepalive
+ * timeout) so that they are not handed out to requests, and restores the
+ * number of connections requested via Pool::preconnect().
+ */
+void
+PoolHost::probe_idle() {
+    lcb_list_t *cur, *next;
+    LCB_LIST_SAFE_FOR(cur, next, (lcb_list_t *)&ll_idle) {
+        PoolConnInfo *info = PoolConnInfo::from_llnode(cur);
+        int clstatus = lcbio_is_netclosed(info->sock, LCB_IO_SOCKCHECK_PEND_IS_ERROR);
+        if (clstatus == LCB_IO_SOCKCHECK_STATUS_CLOSED) {
+            lcb_log(LOGARGS(parent, DEBUG), HE_LOGFMT "Idle connection I=%p was closed by peer", HE_LOGID(this), (void*)info);
+            parent->stats.dead++;
+            delete info;
+        }
+    }
+
+    while (n_total < n_warm) {
+        start_new_connection(warm_tmo);
+        parent->stats.preconnects++;
+    }
+    if (num_idle() || n_warm) {
+        schedule_probe();
+    }
+}
+
+void
+PoolHost::schedule_probe() {
+    if (parent->options.tmoprobe) {
+        probe.arm_if_disarmed(parent->options.tmoprobe);
+    }
+}
+
 PoolHost::PoolHost(Pool *parent_, const std::string& key_)
     : key(key_), parent(parent_), async(parent->io, this),
-      n_total(0), refcount(1) {
+      probe(parent->io, this), n_total(0), n_warm(0), warm_tmo(0),
+      maxidle(-1), refcount(1) {
 
     lcb_clist_init(&ll_idle);
     lcb_clist_init(&ll_pending);
@@ -364,24 +414,27 @@ PoolHost::PoolHost(Pool *parent_, const std::string& key_)
     parent->ref();
 }
 
-ConnectionRequest*
-Pool::get(const lcb_host_t& dest, uint32_t timeout, lcbio_CONNDONE_cb cb,
-               void *cbarg)
+PoolHost *
+Pool::get_host(const lcb_host_t& dest)
 {
-    PoolHost *he;
-    lcb_list_t *cur;
-
     std::string key(dest.host);
     key.append(":").append(dest.port);
 
     HostMap::iterator m = ht.find(key);
-    if (m == ht.end()) {
-        he = new PoolHost(this, key);
-        ht.insert(std::make_pair(key, he));
-    } else {
-        he = m->second;
+    if (m != ht.end()) {
+        return m->second;
     }
+    PoolHost *he = new PoolHost(this, key);
+    ht.insert(std::make_pair(key, he));
+    return he;
+}
 
+ConnectionRequest*
+Pool::get(const lcb_host_t& dest, uint32_t timeout, lcbio_CONNDONE_cb cb,
+               void *cbarg)
+{
+    lcb_list_t *cur;
+    PoolHost *he = get_host(dest);
     PoolRequest *req = new PoolRequest(he, cb, cbarg);
 
     GT_POPAGAIN:
@@ -398,14 +451,17 @@ Pool::get(const lcb_host_t& dest, uint32_t timeout, lcbio_CONNDONE_cb cb,
 
             /* Set to LEASED, since it's not inside any of our lists */
             info->state = PoolConnInfo::LEASED;
+            stats.dead++;
             delete info;
             goto GT_POPAGAIN;
         }
 
+        stats.hits++;
         req->set_ready(info);
         lcb_log(LOGARGS(this, INFO), HE_LOGFMT "Found ready connection in pool. Reusing socket and not creating new connection", HE_LOGID(he));
 
     } else {
+        stats.misses++;
         req->set_pending(timeout);
 
         lcb_clist_append(&he->requests, req);
@@ -420,6 +476,46 @@ Pool::get(const lcb_host_t& dest, uint32_t timeout, lcbio_CONNDONE_cb cb,
     return req;
 }
 
+void
+Pool::preconnect(const lcb_host_t& dest, unsigned count, uint32_t timeout)
+{
+    PoolHost *he = get_host(dest);
+
+    if (count > he->idle_quota()) {
+        count = he->idle_quota();
+    }
+    he->n_warm = count;
+    he->warm_tmo = timeout;
+
+    if (he->n_total < count) {
+        lcb_log(LOGARGS(this, DEBUG), HE_LOGFMT "Pre-connecting %u new connection(s)", HE_LOGID(he), count - he->n_total);
+    }
+    while (he->n_total < count) {
+        he->start_new_connection(timeout);
+        stats.preconnects++;
+    }
+}
+
+void
+Pool::clear_warm(const lcb_host_t& dest)
+{
+    std::string key(dest.host);
+    key.append(":").append(dest.port);
+
+    HostMap::iterator m = ht.find(key);
+    if (m == ht.end() || !m->second->n_warm) {
+        return;
+    }
+    lcb_log(LOGARGS(this, DEBUG), HE_LOGFMT "No longer keeping %u connection(s) ready", HE_LOGID(m->second), m->second->n_warm);
+    m->second->n_warm = 0;
+}
+
+void
+Pool::set_host_maxidle(const lcb_host_t& dest, unsigned maxidle)
+{
+    get_host(dest)->maxidle = maxidle;
+}
+
 void PoolRequest::cancel() {
     Pool *mgr = host->parent;
 
@@ -435,6 +531,14 @@ void PoolRequest::cancel() {
 }
 
 void PoolConnInfo::on_idle_timeout() {
+    if (parent->num_idle() <= parent->n_warm) {
+        // Pre-connected connections are kept for as long as they're needed
+        // to maintain the requested number of ready connections
+        if (parent->parent->options.tmoidle) {
+            idle_timer.rearm(parent->parent->options.tmoidle);
+        }
+        return;
+    }
     lcb_log(LOGARGS(parent->parent, DEBUG), HE_LOGFMT "Idle connection expired", HE_LOGID(parent));
     lcbio_unref(sock);
 }
@@ -454,7 +558,7 @@ void Pool::put(lcbio_SOCKET *sock)
     he = info->parent;
     mgr = he->parent;
 
-    if (he->num_idle() >= mgr->options.maxidle) {
+    if (he->num_idle() >= he->idle_quota()) {
         lcb_log(LOGARGS(mgr, INFO), HE_LOGFMT "Closing idle connection. Too many in quota", HE_LOGID(he));
         lcbio_unref(info->sock);
         return;
@@ -464,6 +568,7 @@ void Pool::put(lcbio_SOCKET *sock)
     info->idle_timer.rearm(mgr->options.tmoidle);
     lcb_clist_append(&he->ll_idle, info);
     info->state = PoolConnInfo::IDLE;
+    he->schedule_probe();
 }
 
 void Pool::discard(lcbio_SOCKET *sock) {
@@ -505,8 +610,8 @@ void
 PoolHost::dump(FILE *out) const {
     lcb_list_t *llcur;
     fprintf(out, "HOST=%s", key.c_str());
-    fprintf(out, "Requests=%lu, Idle=%lu, Pending=%lu, Leased=%lu\n",
-            num_requests(), num_idle(), num_pending(), num_leased());
+    fprintf(out, "Requests=%lu, Idle=%lu, Pending=%lu, Leased=%lu, Warm=%u\n",
+            num_requests(), num_idle(), num_pending(), num_leased(), n_warm);
 
     fprintf(out, CONN_INDENT "Idle Connections:\n");
     write_he_list(&ll_idle, out);
@@ -532,10 +637,26 @@ PoolHost::dump(FILE *out) const {
 
 }
 
+Pool::Usage Pool::get_usage() const {
+    Usage usage;
+    HostMap::const_iterator ii;
+    for (ii = ht.begin(); ii != ht.end(); ++ii) {
+        const PoolHost *h = ii->second;
+        usage.idle += h->num_idle();
+        usage.leased += h->num_leased();
+        usage.pending += h->num_pending();
+        usage.requests += h->num_requests();
+    }
+    return usage;
+}
+
 void Pool::dump(FILE *out) const {
     if (out == NULL) {
         out = stderr;
     }
+    fprintf(out, "Hits=%llu, Misses=%llu, Preconnects=%llu, Dead=%llu\n",
+            (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+            (unsigned long long)stats.preconnects, (unsigned long long)stats.dead);
     HostMap::const_iterator ii;
     for (ii = ht.begin(); ii != ht.end(); ++ii) {
         ii->second->dump(out);
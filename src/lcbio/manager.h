@@ -135,6 +135,34 @@ public:
 
     static bool is_from_pool(const lcbio_SOCKET *sock);
 
+    /**
+     * Eagerly open connections to a host, so that later calls to get() can
+     * be satisfied from the idle list. Connections already open (idle, leased
+     * or pending) towards the host count against `count`, and the total is
+     * further capped by the host's idle quota (see set_host_maxidle()).
+     *
+     * Opened connections are kept alive past Options::tmoidle for as long as
+     * they are the last `count` idle connections for the host.
+     *
+     * @param dest the host to connect to
+     * @param count the number of connections to keep ready
+     * @param timeout the connection timeout, in microseconds
+     */
+    void preconnect(const lcb_host_t& dest, unsigned count, uint32_t timeout);
+
+    /**
+     * Stop maintaining the connections requested by preconnect(), e.g.
+     * because the host is no longer part of the cluster. Its idle connections
+     * then expire as usual.
+     */
+    void clear_warm(const lcb_host_t& dest);
+
+    /**
+     * Override Options::maxidle for a single host. This is useful when the
+     * pool is shared by several services, each with their own quota.
+     */
+    void set_host_maxidle(const lcb_host_t& dest, unsigned maxidle);
+
     /**
      * Dumps the connection manager state to stderr
      */
@@ -144,7 +172,7 @@ public:
     inline void unref();
 
     struct Options {
-        Options() : maxtotal(0), maxidle(0), tmoidle(0) {
+        Options() : maxtotal(0), maxidle(0), tmoidle(0), tmoprobe(0) {
         }
 
         /** Maximum *total* number of connections opened by the pool. If this
@@ -163,6 +191,31 @@ public:
          * connections. In microseconds
          */
         uint32_t tmoidle;
+
+        /**
+         * Interval at which idle connections are checked for having been
+         * closed by the peer. Dead connections are removed and, if the host
+         * was pre-connected, replaced. In microseconds; 0 disables probing
+         */
+        uint32_t tmoprobe;
+    };
+
+    /** Counters describing how well the pool is being reused */
+    struct Stats {
+        Stats() : hits(0), misses(0), preconnects(0), dead(0) {
+        }
+
+        /** Requests satisfied immediately with an idle connection */
+        uint64_t hits;
+
+        /** Requests which had to wait for a new or pending connection */
+        uint64_t misses;
+
+        /** Connections opened by preconnect() */
+        uint64_t preconnects;
+
+        /** Idle connections found to have been closed by the peer */
+        uint64_t dead;
     };
 
     void set_options(const Options& opts) {
@@ -173,7 +226,33 @@ public:
         return options;
     }
 
+    const Stats& get_stats() const {
+        return stats;
+    }
+
+    /** Connections currently held by the pool, across all hosts */
+    struct Usage {
+        Usage() : idle(0), leased(0), pending(0), requests(0) {
+        }
+
+        /** Connected and available for reuse */
+        size_t idle;
+
+        /** Handed out to a user */
+        size_t leased;
+
+        /** Being connected */
+        size_t pending;
+
+        /** Requests waiting for a connection */
+        size_t requests;
+    };
+
+    Usage get_usage() const;
+
 private:
+    PoolHost *get_host(const lcb_host_t&);
+
     friend struct PoolRequest;
     friend struct PoolConnInfo;
     friend struct PoolHost;
@@ -183,6 +262,7 @@ private:
     lcb_settings *settings;
     lcbio_pTABLE io;
     Options options;
+    Stats stats;
     unsigned refcount;
 };
 } // namespace io
@@ -0,0 +1,645 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "resolver.h"
+#include <map>
+#include <deque>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <errno.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+#if defined(_POSIX_THREADS)
+#include <pthread.h>
+#define LCB_RESOLVER_THREADS
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+using namespace lcb::io;
+
+/* Upper bound on the number of distinct cached hosts */
+#define MAX_CACHE_ENTRIES 512
+
+/* Upper bound on the number of concurrent background lookups */
+#define MAX_RESOLVER_THREADS 4
+
+/* How long an idle resolver thread waits for more work before exiting */
+#define RESOLVER_IDLE_SECS 5
+
+namespace {
+#if defined(LCB_RESOLVER_THREADS)
+class Mutex {
+public:
+    Mutex() { pthread_mutex_init(&m, NULL); }
+    void lock() { pthread_mutex_lock(&m); }
+    void unlock() { pthread_mutex_unlock(&m); }
+    pthread_mutex_t m;
+};
+#elif defined(_WIN32)
+class Mutex {
+public:
+    Mutex() { InitializeCriticalSection(&m); }
+    void lock() { EnterCriticalSection(&m); }
+    void unlock() { LeaveCriticalSection(&m); }
+    CRITICAL_SECTION m;
+};
+#else
+class Mutex {
+public:
+    void lock() {}
+    void unlock() {}
+};
+#endif
+
+class LockGuard {
+public:
+    LockGuard(Mutex& m_) : m(m_) { m.lock(); }
+    ~LockGuard() { m.unlock(); }
+private:
+    Mutex& m;
+};
+
+typedef std::map<std::string, AddrList*> CacheMap;
+struct Lookup;
+typedef std::map<std::string, Lookup*> LookupMap;
+
+/**
+ * Process-wide state, protected by 'lock'. It is allocated once and never
+ * destroyed: resolver threads are detached and may still be running while
+ * static objects are destroyed at exit.
+ */
+struct Shared {
+    Shared() {
+        memset(&stats, 0, sizeof stats);
+#if defined(LCB_RESOLVER_THREADS)
+        nthreads = nidle = 0;
+        pool_pid = 0;
+        pthread_cond_init(&queue_cond, NULL);
+#endif
+    }
+
+    Mutex lock;
+    CacheMap cache;
+    lcb_cntl_dnsstats stats;
+#if defined(LCB_RESOLVER_THREADS)
+    /** Lookups which are queued or in progress, by key */
+    LookupMap inflight;
+    std::deque<Lookup*> queue;
+    unsigned nthreads;
+    unsigned nidle;
+    pid_t pool_pid;
+    pthread_cond_t queue_cond;
+#endif
+};
+
+Shared& shared = *new Shared();
+}
+
+static void
+addrlist_unref_locked(AddrList *al)
+{
+    if (--al->refcount) {
+        return;
+    }
+    addrinfo *cur = al->root;
+    while (cur) {
+        addrinfo *next = cur->ai_next;
+        free(cur);
+        cur = next;
+    }
+    delete al;
+}
+
+/**
+ * Append copies of the entries in `src` to the list ending at `*tailp`. Each
+ * copy is a single allocation holding both the addrinfo and its address.
+ */
+static void
+append_addrinfo(addrinfo ***tailp, const addrinfo *src)
+{
+    for (; src; src = src->ai_next) {
+        addrinfo *dst = reinterpret_cast<addrinfo*>(
+            calloc(1, sizeof(*dst) + src->ai_addrlen));
+        dst->ai_flags = src->ai_flags;
+        dst->ai_family = src->ai_family;
+        dst->ai_socktype = src->ai_socktype;
+        dst->ai_protocol = src->ai_protocol;
+        dst->ai_addrlen = src->ai_addrlen;
+        dst->ai_addr = reinterpret_cast<sockaddr*>(dst + 1);
+        memcpy(dst->ai_addr, src->ai_addr, src->ai_addrlen);
+        **tailp = dst;
+        *tailp = &dst->ai_next;
+    }
+}
+
+void
+lcb::io::addrlist_unref(AddrList *al)
+{
+    LockGuard lg(shared.lock);
+    addrlist_unref_locked(al);
+}
+
+static int
+get_family(const lcb_settings *settings)
+{
+    if (settings->ipv6 == LCB_IPV6_DISABLED) {
+        return AF_INET;
+    } else if (settings->ipv6 == LCB_IPV6_ONLY) {
+        return AF_INET6;
+    } else {
+        return AF_UNSPEC;
+    }
+}
+
+static std::string
+make_key(const lcb_host_t *host, int family)
+{
+    std::string key(host->host);
+    key += ':';
+    key += host->port;
+    key += '/';
+    key += static_cast<char>('0' + family);
+    return key;
+}
+
+/** Perform the actual lookup. Does not touch any shared state */
+static AddrList *
+do_lookup(const char *host, const char *port, int family, lcb_U32 *duration)
+{
+    addrinfo hints, *res = NULL;
+    AddrList *al = new AddrList();
+    hrtime_t begin = gethrtime();
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_flags = AI_PASSIVE;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_family = family;
+
+    al->root = NULL;
+    al->refcount = 1;
+    al->error = getaddrinfo(host, port, &hints, &res);
+    if (al->error == 0) {
+        addrinfo **tail = &al->root;
+        append_addrinfo(&tail, res);
+        freeaddrinfo(res);
+    }
+    al->created = gethrtime();
+    *duration = static_cast<lcb_U32>((al->created - begin) / 1000);
+    return al;
+}
+
+/** Get a fresh cached entry, returning a new reference. Lock must be held */
+static AddrList *
+cache_get(const std::string& key, lcb_U32 ttl, lcb_U32 negative_ttl)
+{
+    CacheMap::iterator it = shared.cache.find(key);
+    if (it == shared.cache.end()) {
+        return NULL;
+    }
+    AddrList *al = it->second;
+    lcb_U32 maxage = al->error ? negative_ttl : ttl;
+    if ((gethrtime() - al->created) / 1000 >= maxage) {
+        return NULL;
+    }
+    al->refcount++;
+    return al;
+}
+
+/** Store a lookup result and update counters. Lock must be held */
+static void
+cache_put(const std::string& key, AddrList *al, lcb_U32 duration)
+{
+    shared.stats.misses++;
+    shared.stats.total_us += duration;
+    if (duration > shared.stats.max_us) {
+        shared.stats.max_us = duration;
+    }
+    if (al->error) {
+        shared.stats.failures++;
+    }
+
+    CacheMap::iterator it = shared.cache.find(key);
+    if (it != shared.cache.end()) {
+        addrlist_unref_locked(it->second);
+        it->second = al;
+    } else {
+        if (shared.cache.size() >= MAX_CACHE_ENTRIES) {
+            CacheMap::iterator oldest = shared.cache.begin();
+            for (it = shared.cache.begin(); it != shared.cache.end(); ++it) {
+                if (it->second->created < oldest->second->created) {
+                    oldest = it;
+                }
+            }
+            addrlist_unref_locked(oldest->second);
+            shared.cache.erase(oldest);
+        }
+        shared.cache[key] = al;
+    }
+    al->refcount++;
+}
+
+#if defined(LCB_RESOLVER_THREADS)
+class lcb::io::Resolution {
+public:
+    Resolution(lcbio_TABLE *iot_, ResolveHandler handler_, void *arg_)
+        : iot(iot_), event(NULL), handler(handler_), arg(arg_), lookup(NULL),
+          result(NULL), duration(0), refcount(2) {
+        fds[0] = fds[1] = -1;
+    }
+
+    bool init();
+    void detach();
+    void teardown();
+    static void on_ready(lcb_socket_t, short, void *arg);
+
+    lcbio_TABLE *iot;
+    void *event;
+    int fds[2];
+    ResolveHandler handler;
+    void *arg;
+
+    /* Fields below are protected by the lock */
+    Lookup *lookup; /**< Lookup being waited for, if not yet complete */
+    AddrList *result;
+    lcb_U32 duration;
+    unsigned refcount; /**< One for the requester, one for the lookup */
+};
+
+namespace {
+/**
+ * A lookup performed by a resolver thread. Requests for the same host made
+ * while it is queued or in progress wait for it, rather than starting
+ * lookups of their own.
+ */
+struct Lookup {
+    Lookup(const std::string& key_, const lcb_host_t *host_, int family_)
+        : key(key_), host(host_->host), port(host_->port), family(family_) {
+    }
+    std::string key;
+    std::string host;
+    std::string port;
+    int family;
+    std::vector<Resolution*> waiters;
+};
+}
+
+static void
+unref_resolution_locked(Resolution *r)
+{
+    if (--r->refcount) {
+        return;
+    }
+    if (r->result) {
+        addrlist_unref_locked(r->result);
+    }
+    delete r;
+}
+
+static void
+set_pipe_flags(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+}
+
+bool
+Resolution::init()
+{
+    if (pipe(fds) != 0) {
+        fds[0] = fds[1] = -1;
+        return false;
+    }
+    set_pipe_flags(fds[0]);
+    set_pipe_flags(fds[1]);
+    event = iot->E_event_create();
+    iot->E_event_watch(fds[0], event, LCB_READ_EVENT, this, on_ready);
+    return true;
+}
+
+/** Stop watching for the result. Called on the event loop thread */
+void
+Resolution::detach()
+{
+    {
+        LockGuard lg(shared.lock);
+        if (lookup) {
+            std::vector<Resolution*>& waiters = lookup->waiters;
+            waiters.erase(std::find(waiters.begin(), waiters.end(), this));
+            lookup = NULL;
+            unref_resolution_locked(this);
+        }
+    }
+    teardown();
+}
+
+void
+Resolution::teardown()
+{
+    if (event) {
+        iot->E_event_cancel(fds[0], event);
+        iot->E_event_destroy(event);
+        event = NULL;
+    }
+    if (fds[0] != -1) {
+        close(fds[0]);
+        close(fds[1]);
+        fds[0] = fds[1] = -1;
+    }
+}
+
+void
+Resolution::on_ready(lcb_socket_t, short, void *arg)
+{
+    Resolution *r = reinterpret_cast<Resolution*>(arg);
+    char c;
+    AddrList *res;
+    lcb_U32 duration;
+    ResolveHandler handler;
+    void *harg;
+
+    if (read(r->fds[0], &c, 1) != 1) {
+        return;
+    }
+
+    {
+        LockGuard lg(shared.lock);
+        res = r->result;
+        r->result = NULL;
+        duration = r->duration;
+    }
+    if (res == NULL) {
+        return;
+    }
+
+    handler = r->handler;
+    harg = r->arg;
+    r->detach();
+    {
+        LockGuard lg(shared.lock);
+        unref_resolution_locked(r);
+    }
+    handler(harg, res, duration);
+}
+
+static void *
+resolver_thread(void *)
+{
+    LockGuard lg(shared.lock);
+    for (;;) {
+        if (shared.queue.empty()) {
+            timespec ts;
+            ts.tv_sec = time(NULL) + RESOLVER_IDLE_SECS;
+            ts.tv_nsec = 0;
+            shared.nidle++;
+            pthread_cond_timedwait(&shared.queue_cond, &shared.lock.m, &ts);
+            shared.nidle--;
+            if (shared.queue.empty()) {
+                shared.nthreads--;
+                return NULL;
+            }
+        }
+
+        Lookup *lk = shared.queue.front();
+        shared.queue.pop_front();
+        if (lk->waiters.empty()) {
+            /* Every requester cancelled */
+            shared.inflight.erase(lk->key);
+            delete lk;
+            continue;
+        }
+
+        lcb_U32 duration;
+        shared.lock.unlock();
+        AddrList *al = do_lookup(
+            lk->host.c_str(), lk->port.c_str(), lk->family, &duration);
+        shared.lock.lock();
+
+        shared.stats.async++;
+        cache_put(lk->key, al, duration);
+        shared.inflight.erase(lk->key);
+
+        /* Each waiter is still attached; detaching removes it from the list */
+        for (size_t ii = 0; ii < lk->waiters.size(); ii++) {
+            Resolution *r = lk->waiters[ii];
+            char c = 0;
+            al->refcount++;
+            r->lookup = NULL;
+            r->result = al;
+            r->duration = duration;
+            if (write(r->fds[1], &c, 1) != 1) {
+                /* Can't happen with an empty pipe. The requester will time
+                 * out eventually */
+            }
+            unref_resolution_locked(r);
+        }
+        addrlist_unref_locked(al);
+        delete lk;
+    }
+}
+
+/** Start a resolver thread if none is idle. Lock must be held */
+static bool
+spawn_locked()
+{
+    if (shared.nidle == 0 && shared.nthreads < MAX_RESOLVER_THREADS) {
+        pthread_t thr;
+        pthread_attr_t attr;
+        int rv;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        rv = pthread_create(&thr, &attr, resolver_thread, NULL);
+        pthread_attr_destroy(&attr);
+        if (rv == 0) {
+            shared.nthreads++;
+        }
+    }
+    return shared.nthreads != 0;
+}
+
+/** Schedule a lookup on a resolver thread. Lock must be held */
+static bool
+schedule_locked(Resolution *r, const std::string& key, const lcb_host_t *host,
+                int family)
+{
+    if (shared.pool_pid != getpid()) {
+        /* Threads don't survive fork(). Lookups which were queued or in
+         * progress in the parent are performed again by new threads */
+        shared.pool_pid = getpid();
+        shared.nthreads = shared.nidle = 0;
+        shared.queue.clear();
+        for (LookupMap::iterator it = shared.inflight.begin();
+                it != shared.inflight.end(); ++it) {
+            shared.queue.push_back(it->second);
+        }
+        if (!shared.queue.empty()) {
+            spawn_locked();
+        }
+    }
+
+    LookupMap::iterator it = shared.inflight.find(key);
+    if (it != shared.inflight.end() && shared.nthreads) {
+        shared.stats.coalesced++;
+        it->second->waiters.push_back(r);
+        r->lookup = it->second;
+        return true;
+    }
+
+    if (!spawn_locked()) {
+        return false;
+    }
+    Lookup *lk = new Lookup(key, host, family);
+    lk->waiters.push_back(r);
+    r->lookup = lk;
+    shared.inflight[key] = lk;
+    shared.queue.push_back(lk);
+    pthread_cond_signal(&shared.queue_cond);
+    return true;
+}
+
+void
+lcb::io::resolve_cancel(Resolution *r)
+{
+    r->detach();
+    LockGuard lg(shared.lock);
+    unref_resolution_locked(r);
+}
+
+#else
+class lcb::io::Resolution {};
+void lcb::io::resolve_cancel(Resolution *) {}
+#endif
+
+AddrList *
+lcb::io::resolve(lcbio_TABLE *iot, const lcb_settings *settings,
+                 const lcb_host_t *host, ResolveHandler handler, void *arg,
+                 Resolution **pending, lcb_U32 *duration, bool *cached)
+{
+    int family = get_family(settings);
+    std::string key = make_key(host, family);
+    AddrList *al;
+
+    *pending = NULL;
+    *duration = 0;
+    *cached = true;
+    {
+        LockGuard lg(shared.lock);
+        shared.stats.lookups++;
+        if ((al = cache_get(key,
+                settings->dns_cache_ttl, settings->dns_negative_ttl))) {
+            if (al->error) {
+                shared.stats.negative_hits++;
+            } else {
+                shared.stats.hits++;
+            }
+            return al;
+        }
+
+#if defined(LCB_RESOLVER_THREADS)
+        if (iot->is_E()) {
+            Resolution *r = new Resolution(iot, handler, arg);
+            if (r->init()) {
+                if (schedule_locked(r, key, host, family)) {
+                    *pending = r;
+                    return NULL;
+                }
+                r->teardown();
+            }
+            delete r;
+        }
+#else
+        (void)iot; (void)handler; (void)arg;
+#endif
+    }
+
+    *cached = false;
+    al = do_lookup(host->host, host->port, family, duration);
+    LockGuard lg(shared.lock);
+    cache_put(key, al, *duration);
+    return al;
+}
+
+void
+lcb::io::resolve_invalidate(const lcb_settings *settings,
+                            const lcb_host_t *host)
+{
+    LockGuard lg(shared.lock);
+    CacheMap::iterator it = shared.cache.find(make_key(host, get_family(settings)));
+    if (it != shared.cache.end()) {
+        addrlist_unref_locked(it->second);
+        shared.cache.erase(it);
+    }
+}
+
+void
+lcb::io::resolver_stats(lcb_cntl_dnsstats *out)
+{
+    LockGuard lg(shared.lock);
+    *out = shared.stats;
+}
+
+void
+lcb::io::resolver_seed(const lcb_settings *settings, const lcb_host_t *host,
+                       const char * const *addrs, size_t naddrs)
+{
+    AddrList *al = new AddrList();
+    addrinfo **tail = &al->root;
+    addrinfo hints;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_flags = AI_NUMERICHOST;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_family = AF_UNSPEC;
+
+    al->root = NULL;
+    al->error = 0;
+    al->refcount = 0;
+    al->created = gethrtime();
+    for (size_t ii = 0; ii < naddrs; ii++) {
+        addrinfo *res = NULL;
+        if (getaddrinfo(addrs[ii], host->port, &hints, &res) == 0) {
+            append_addrinfo(&tail, res);
+            freeaddrinfo(res);
+        }
+    }
+
+    LockGuard lg(shared.lock);
+    std::string key = make_key(host, get_family(settings));
+    CacheMap::iterator it = shared.cache.find(key);
+    if (it != shared.cache.end()) {
+        addrlist_unref_locked(it->second);
+        shared.cache.erase(it);
+    }
+    shared.cache[key] = al;
+    al->refcount++;
+}
+
+void
+lcb::io::resolver_clear_cache()
+{
+    LockGuard lg(shared.lock);
+    for (CacheMap::iterator it = shared.cache.begin(); it != shared.cache.end(); ++it) {
+        addrlist_unref_locked(it->second);
+    }
+    shared.cache.clear();
+}
@@ -0,0 +1,109 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCBIO_RESOLVER_H
+#define LCBIO_RESOLVER_H
+
+#include "config.h"
+#include <libcouchbase/couchbase.h>
+#include "settings.h"
+#include "hostlist.h"
+#include "iotable.h"
+
+/**
+ * @file
+ * @brief Hostname resolution for new connections
+ *
+ * Lookups are performed by getaddrinfo(). Results (including failures) are
+ * kept in a process-wide cache which is shared by all instances, so that
+ * reconnecting to a known node does not involve the system resolver at all.
+ *
+ * Where the I/O plugin supports it (event based plugins on POSIX systems),
+ * cache misses are resolved on a small pool of helper threads and the
+ * result is delivered back on the event loop. Otherwise the lookup is
+ * performed synchronously, as was always the case.
+ */
+
+namespace lcb {
+namespace io {
+
+/**
+ * Reference counted result of a hostname lookup. The addresses are copies of
+ * those returned by getaddrinfo() and must not be passed to freeaddrinfo().
+ */
+struct AddrList {
+    addrinfo *root; /**< Resolved addresses, NULL on failure */
+    int error; /**< getaddrinfo() error code, 0 on success */
+    hrtime_t created; /**< When the lookup completed */
+    unsigned refcount;
+};
+
+void addrlist_unref(AddrList *);
+
+class Resolution;
+
+/**
+ * Handler invoked once an asynchronous lookup completes
+ * @param arg the argument passed to resolve()
+ * @param res the result. The handler takes ownership of this reference
+ * @param duration time spent resolving, in microseconds
+ */
+typedef void (*ResolveHandler)(void *arg, AddrList *res, lcb_U32 duration);
+
+/**
+ * Look up the addresses for the given host.
+ *
+ * If the result is available immediately (from the cache, or because it was
+ * resolved synchronously) it is returned and `*pending` is set to NULL.
+ *
+ * Otherwise NULL is returned, and `*pending` is set to a handle which may be
+ * passed to resolve_cancel(). The handler will be invoked from the event loop
+ * once the lookup completes, unless it is cancelled first.
+ *
+ * @param[out] duration time spent resolving (synchronous results only)
+ * @param[out] cached whether the result was taken from the cache
+ */
+AddrList *
+resolve(lcbio_TABLE *iot, const lcb_settings *settings, const lcb_host_t *host,
+        ResolveHandler handler, void *arg, Resolution **pending,
+        lcb_U32 *duration, bool *cached);
+
+/** Cancel a pending lookup. The handler will not be invoked. */
+void resolve_cancel(Resolution *pending);
+
+/**
+ * Remove the cached result for a host, e.g. because connecting to the
+ * cached addresses failed.
+ */
+void resolve_invalidate(const lcb_settings *settings, const lcb_host_t *host);
+
+/** Copy the process-wide resolver counters */
+void resolver_stats(lcb_cntl_dnsstats *stats);
+
+/** Drop all cached results. Mainly for testing */
+void resolver_clear_cache();
+
+/**
+ * Cache the given numeric addresses (in order) as the result for a host.
+ * This is for testing.
+ */
+void resolver_seed(const lcb_settings *settings, const lcb_host_t *host,
+                   const char * const *addrs, size_t naddrs);
+
+} // namespace io
+} // namespace lcb
+#endif
@@ -93,6 +93,15 @@ lcbio_ssl_free(lcbio_pSSLCTX ctx);
 lcb_error_t
 lcbio_ssl_apply(lcbio_SOCKET *sock, lcbio_pSSLCTX sctx);
 
+/**
+ * Retrieve the handshake counters and the number of cached sessions for
+ * the context.
+ * @param ctx the context
+ * @param[out] stats the counters
+ */
+void
+lcbio_ssl_get_stats(lcbio_pSSLCTX ctx, lcb_cntl_sslstats *stats);
+
 /**
  * Checks whether the given socket is using SSL
  * @param sock The socket to check
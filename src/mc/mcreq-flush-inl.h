@@ -63,6 +63,9 @@ mcreq__pktflush_callback(void *p, nb_SIZE hint, void *arg)
 
     /** Packet is flushed */
     pkt->flags |= MCREQ_F_FLUSHED;
+    if (info->pl->parent && info->pl->parent->trace) {
+        info->pl->parent->trace(info->pl->parent, pkt, MCREQ_TRACE_FLUSHED);
+    }
 
     if (pkt->flags & MCREQ_F_INVOKED) {
         mcreq_packet_done(info->pl, pkt);
@@ -19,6 +19,7 @@
 #include "compress.h"
 #include "sllist-inl.h"
 #include "internal.h"
+#include "trace.h"
 
 #define PKT_HDRSIZE(pkt) (MCREQ_PKT_BASESIZE + (pkt)->extlen)
 
@@ -224,6 +225,11 @@ mcreq_enqueue_packet(mc_PIPELINE *pipeline, mc_PACKET *packet)
 
     GT_ENQUEUE_PDU:
     netbuf_pdu_enqueue(&pipeline->nbmgr, packet, offsetof(mc_PACKET, sl_flushq));
+    TRACE_PACKET_ENQUEUE(pipeline, packet);
+
+    if (pipeline->parent && pipeline->parent->trace) {
+        pipeline->parent->trace(pipeline->parent, packet, MCREQ_TRACE_ENQUEUED);
+    }
 }
 
 void
@@ -275,6 +281,7 @@ mcreq_allocate_packet(mc_PIPELINE *pipeline)
     ret->flags = 0;
     ret->retries = 0;
     ret->opaque = pipeline->parent->seq++;
+    TRACE_PACKET_ALLOC(pipeline, ret);
     return ret;
 }
 
@@ -611,6 +618,7 @@ mcreq_queue_init(mc_CMDQUEUE *queue)
     queue->scheds = NULL;
     queue->fallback = NULL;
     queue->npipelines = 0;
+    queue->trace = NULL;
     return 0;
 }
 
@@ -647,6 +655,7 @@ queuectx_leave(mc_CMDQUEUE *queue, int success, int flush)
     for (ii = 0; ii < queue->_npipelines_ex; ii++) {
         mc_PIPELINE *pipeline;
         sllist_node *ll_next, *ll;
+        unsigned npkts = 0;
 
         if (!queue->scheds[ii]) {
             continue;
@@ -661,6 +670,7 @@ queuectx_leave(mc_CMDQUEUE *queue, int success, int flush)
 
             if (success) {
                 mcreq_enqueue_packet(pipeline, pkt);
+                npkts++;
             } else {
                 if (pkt->flags & MCREQ_F_REQEXT) {
                     mc_REQDATAEX *rd = pkt->u_rdata.exdata;
@@ -675,6 +685,9 @@ queuectx_leave(mc_CMDQUEUE *queue, int success, int flush)
             ll = ll_next;
         }
         SLLIST_FIRST(&pipeline->ctxqueued) = pipeline->ctxqueued.last = NULL;
+        if (success) {
+            TRACE_SCHED_LEAVE(pipeline, npkts, flush);
+        }
         if (flush) {
             pipeline->flush_start(pipeline);
         }
@@ -402,6 +402,16 @@ typedef struct mc_pipeline_st {
     nb_MGR reqpool;
 } mc_PIPELINE;
 
+/** Events reported to mc_CMDQUEUE::trace */
+typedef enum {
+    MCREQ_TRACE_ENQUEUED, /**< Packet was added to its pipeline's output */
+    MCREQ_TRACE_FLUSHED /**< Packet was completely written out */
+} mcreq_TRACEEVENT;
+
+struct mc_cmdqueue_st;
+typedef void (*mcreq_trace_fn)(struct mc_cmdqueue_st *,
+        const struct mc_packet_st *, mcreq_TRACEEVENT);
+
 typedef struct mc_cmdqueue_st {
     /** Indexed pipelines, i.e. server map target */
     mc_PIPELINE **pipelines;
@@ -435,6 +445,9 @@ typedef struct mc_cmdqueue_st {
     /**Special pipeline used to contain orphaned packets within a scheduling
      * context. This field is used by mcreq_set_fallback_handler() */
     mc_PIPELINE *fallback;
+
+    /** If set, invoked as packets progress through their pipelines */
+    mcreq_trace_fn trace;
 } mc_CMDQUEUE;
 
 /**
@@ -24,6 +24,9 @@
 #include "mc/mcreq-flush-inl.h"
 #include <lcbio/ssl.h>
 #include "ctx-log-inl.h"
+#include "slowops.h"
+#include "metrics.h"
+#include "trace.h"
 
 #define LOGARGS(c, lvl) (c)->settings, "server", LCB_LOG_##lvl, __FILE__, __LINE__
 #define LOGARGS_T(lvl) LOGARGS(this, lvl)
@@ -56,6 +59,7 @@ on_flush_ready(lcbio_CTX *ctx)
         if (!nb) {
             return;
         }
+        TRACE_FLUSH_START(server, nb);
         ready = lcbio_ctx_put_ex(ctx, (lcb_IOV *)iov, niov, nb);
     } while (ready);
     lcbio_ctx_wwant(ctx);
@@ -70,8 +74,19 @@ on_flush_done(lcbio_CTX *ctx, unsigned expected, unsigned actual)
         now = gethrtime();
     }
 
+    TRACE_FLUSH_DONE(server, actual, expected);
     mcreq_flush_done_ex(server, actual, expected, now);
-    server->check_closed();
+    if (server->check_closed()) {
+        return;
+    }
+    if (server->counters) {
+        server->counters->bytes_written += actual;
+    }
+    if (server->connctx->zc) {
+        /* Zerocopy sends may complete after their responses were received,
+         * and lcb_wait() waits for them */
+        lcb_maybe_breakout(server->instance);
+    }
 }
 
 void
@@ -125,8 +140,12 @@ Server::handle_nmv(MemcachedResponse& resinfo, mc_PACKET *oldpkt)
     lcb::clconfig::Provider *cccp =
             instance->confmon->get_provider(lcb::clconfig::CLCONFIG_CCCP);
 
+    if (counters) {
+        counters->nmv++;
+    }
     mcreq_read_hdr(oldpkt, &hdr);
     vbid = ntohs(hdr.request.vbucket);
+    TRACE_NMV(this, oldpkt, vbid);
     lcb_log(LOGARGS_T(WARN), LOGFMT "NOT_MY_VBUCKET. Packet=%p (S=%u). VBID=%u", LOGID_T(), (void*)oldpkt, oldpkt->opaque, vbid);
 
     /* Notify of new map */
@@ -135,6 +154,9 @@ Server::handle_nmv(MemcachedResponse& resinfo, mc_PACKET *oldpkt)
     if (resinfo.bodylen() && cccp->enabled) {
         std::string s(resinfo.body<const char*>(), resinfo.vallen());
         err = lcb::clconfig::cccp_update(cccp, curhost->host, s.c_str());
+        if (err == LCB_SUCCESS && instance->slowops) {
+            instance->slowops->decided(oldpkt, SlowOpTracer::NMV_CONFIG_UPDATED);
+        }
     }
 
     if (err != LCB_SUCCESS) {
@@ -156,9 +178,16 @@ Server::handle_nmv(MemcachedResponse& resinfo, mc_PACKET *oldpkt)
     }
 
     if (!lcb_should_retry(settings, oldpkt, LCB_NOT_MY_VBUCKET)) {
+        if (instance->slowops) {
+            instance->slowops->decided(oldpkt, SlowOpTracer::NMV_FAILED);
+        }
         return false;
     }
 
+    if (instance->slowops) {
+        instance->slowops->decided(oldpkt, SlowOpTracer::NMV_RETRIED);
+    }
+
     /** Reschedule the packet again .. */
     mc_PACKET *newpkt = mcreq_renew_packet(oldpkt);
     newpkt->flags &= ~MCREQ_STATE_FLAGS;
@@ -235,14 +264,20 @@ int Server::handle_unknown_error(const mc_PACKET *request,
 
     if (!err.isValid() || err.hasAttribute(errmap::SPECIAL_HANDLING)) {
         lcb_log(LOGARGS_T(ERR), LOGFMT "Received error not in error map or requires special handling! " PKTFMT, LOGID_T(), PKTARGS(mcresp));
+        if (instance->slowops) {
+            instance->slowops->decided(request, SlowOpTracer::ERRMAP_UNKNOWN);
+        }
         lcbio_ctx_senderr(connctx, LCB_PROTOCOL_ERROR);
         return ERRMAP_HANDLE_DISCONN;
     } else {
         lcb_log(LOGARGS_T(WARN), LOGFMT "Received server error %s (0x%x) on packet: " PKTFMT, LOGID_T(), err.shortname.c_str(), err.code, PKTARGS(mcresp));
     }
 
+    int decisions = 0;
+
     if (err.hasAttribute(errmap::FETCH_CONFIG)) {
         instance->bootstrap(BS_REFRESH_THROTTLE);
+        decisions |= SlowOpTracer::ERRMAP_FETCH_CONFIG;
     }
 
     if (err.hasAttribute(errmap::TEMPORARY)) {
@@ -270,6 +305,7 @@ int Server::handle_unknown_error(const mc_PACKET *request,
         newpkt->flags &= ~MCREQ_STATE_FLAGS;
         instance->retryq->add((mc_EXPACKET *)newpkt, newerr ? newerr : LCB_ERROR, spec);
         rv |= ERRMAP_HANDLE_RETRY;
+        decisions |= SlowOpTracer::ERRMAP_RETRIED;
     }
 
     if (err.hasAttribute(errmap::CONN_STATE_INVALIDATED)) {
@@ -278,8 +314,12 @@ int Server::handle_unknown_error(const mc_PACKET *request,
         }
         lcbio_ctx_senderr(connctx, newerr);
         rv |= ERRMAP_HANDLE_DISCONN;
+        decisions |= SlowOpTracer::ERRMAP_DISCONNECTED;
     }
 
+    if (decisions && instance->slowops) {
+        instance->slowops->decided(request, decisions);
+    }
     return rv;
 
 }
@@ -323,6 +363,9 @@ Server::try_read(lcbio_CTX *ctx, rdb_IOROPE *ior)
 
     /* copy bytes into the info structure */
     rdb_copyread(ior, mcresp.hdrbytes(), mcresp.hdrsize());
+    if (instance->slowops) {
+        instance->slowops->header_received(mcresp.opaque());
+    }
 
     pktsize += mcresp.bodylen();
     if (rdb_get_nused(ior) < pktsize) {
@@ -343,6 +386,11 @@ Server::try_read(lcbio_CTX *ctx, rdb_IOROPE *ior)
         rdb_consumed(ior, pktsize);
         return PKT_READ_COMPLETE;
     }
+    TRACE_RESPONSE(this, mcresp, request, is_last);
+    if (counters) {
+        counters->responses++;
+        counters->bytes_read += pktsize;
+    }
 
     lcb_error_t err_override = LCB_SUCCESS;
     ReadState rdstate = PKT_READ_COMPLETE;
@@ -418,6 +466,7 @@ on_read(lcbio_CTX *ctx, unsigned)
         return;
     }
 
+    TRACE_SOCKET_READ(server, rdb_get_nused(ior));
     Server::ReadState rv;
     while ((rv = server->try_read(ctx, ior)) == Server::PKT_READ_COMPLETE);
     lcbio_ctx_schedule(ctx);
@@ -458,6 +507,13 @@ fail_callback(mc_PIPELINE *pipeline, mc_PACKET *pkt, lcb_error_t err, void *) {
 }
 
 void Server::purge_single(mc_PACKET *pkt, lcb_error_t err) {
+    TRACE_PACKET_FAIL(this, pkt, err);
+    if (counters) {
+        counters->failures++;
+        if (err == LCB_ETIMEDOUT) {
+            counters->timeouts++;
+        }
+    }
     if (maybe_retry_packet(pkt, err)) {
         return;
     }
@@ -597,7 +653,27 @@ on_connected(lcbio_SOCKET *sock, void *data, lcb_error_t err, lcbio_OSERR syserr
     server->handle_connected(sock, err, syserr);
 }
 
-static void mcserver_flush(Server *s) { s->flush(); }
+static void mcserver_flush(Server *s) { s->cork(); }
+
+static void
+uncork_server(void *arg)
+{
+    Server *server = reinterpret_cast<Server*>(arg);
+    /* The connection may have failed in the meantime */
+    if (server->flush_start == (mcreq_flushstart_fn)mcserver_flush) {
+        server->flush();
+    }
+}
+
+void
+Server::cork()
+{
+    if (!settings->autocork || cork_timer == NULL) {
+        flush();
+    } else if (!lcbio_timer_armed(cork_timer)) {
+        lcbio_timer_rearm(cork_timer, settings->autocork_window);
+    }
+}
 
 void
 Server::handle_connected(lcbio_SOCKET *sock, lcb_error_t err, lcbio_OSERR syserr)
@@ -608,6 +684,7 @@ Server::handle_connected(lcbio_SOCKET *sock, lcb_error_t err, lcbio_OSERR syserr
         lcb_log(LOGARGS_T(ERR), LOGFMT "Connection attempt failed. Received %s from libcouchbase, received %d from operating system", LOGID_T(), lcb_strerror_short(err), syserr);
         if (!maybe_reconnect_on_fake_timeout(err)) {
             socket_failed(err);
+            preconnect_done(err);
         }
         return;
     }
@@ -633,11 +710,66 @@ Server::handle_connected(lcbio_SOCKET *sock, lcb_error_t err, lcbio_OSERR syserr
     procs.cb_flush_ready = on_flush_ready;
     connctx = lcbio_ctx_new(sock, this, &procs);
     connctx->subsys = "memcached";
+    TRACE_CONN_OPEN(this, *curhost);
+    if (counters) {
+        counters->connects++;
+    }
     flush_start = (mcreq_flushstart_fn)mcserver_flush;
 
+    if (settings->zerocopy_threshold) {
+        lcb_SIZE threshold = settings->zerocopy_threshold;
+        if (!lcbio_ctx_zerocopy(connctx, threshold > UINT_MAX ? UINT_MAX : threshold)) {
+            lcb_log(LOGARGS_T(DEBUG), LOGFMT "Zerocopy sends not available for this connection", LOGID_T());
+        }
+    }
+
     uint32_t tmo = next_timeout();
     lcbio_timer_rearm(io_timer, tmo);
     flush();
+    preconnect_done(LCB_SUCCESS);
+}
+
+bool
+Server::preconnect()
+{
+    if (state != S_CLEAN || connreq != NULL || connctx != NULL ||
+            flush_start != (mcreq_flushstart_fn)server_connect) {
+        return false;
+    }
+    lcb_log(LOGARGS_T(DEBUG), LOGFMT "Connecting ahead of use", LOGID_T());
+    preconnecting = true;
+    instance->npreconnects++;
+    lcb_aspend_add(&instance->pendops, LCB_PENDTYPE_COUNTER, NULL);
+    connect();
+    return true;
+}
+
+/**
+ * Called when a connection started by preconnect() is ready or has failed.
+ * Once all connections started together are done, the nodes_ready callback
+ * is invoked (unless `notify` is false) and lcb_wait() may return.
+ */
+void
+Server::preconnect_done(lcb_error_t err, bool notify)
+{
+    if (!preconnecting) {
+        return;
+    }
+    preconnecting = false;
+    lcb_aspend_del(&instance->pendops, LCB_PENDTYPE_COUNTER, NULL);
+    if (err != LCB_SUCCESS && instance->preconnect_err == LCB_SUCCESS) {
+        instance->preconnect_err = err;
+    }
+    if (--instance->npreconnects) {
+        return;
+    }
+
+    err = instance->preconnect_err;
+    instance->preconnect_err = LCB_SUCCESS;
+    if (notify) {
+        instance->callbacks.nodes_ready(instance, err);
+        lcb_maybe_breakout(instance);
+    }
 }
 
 void
@@ -659,12 +791,15 @@ buf_done_cb(mc_PIPELINE *pl, const void *cookie, void *, void *)
 Server::Server(lcb_t instance_, int ix)
     : mc_PIPELINE(), state(S_CLEAN),
       io_timer(lcbio_timer_new(instance_->iotable, this, timeout_server)),
+      cork_timer(lcbio_timer_new(instance_->iotable, this, uncork_server)),
       instance(instance_),
       settings(lcb_settings_ref2(instance_->settings)),
       compsupport(0),
       mutation_tokens(0),
       connctx(NULL),
-      curhost(new lcb_host_t())
+      curhost(new lcb_host_t()),
+      counters(NULL),
+      preconnecting(false)
 {
     mcreq_pipeline_init(this);
     flush_start = (mcreq_flushstart_fn)server_connect;
@@ -681,12 +816,15 @@ Server::Server(lcb_t instance_, int ix)
     if (datahost) {
         lcb_host_parsez(curhost, datahost, LCB_CONFIG_MCD_PORT);
     }
+    counters = instance->metrics->node(*curhost);
 }
 
 Server::Server()
     : state(S_TEMPORARY),
-      io_timer(NULL), instance(NULL), settings(NULL), compsupport(0),
-      mutation_tokens(0), connctx(NULL), connreq(NULL), curhost(NULL)
+      io_timer(NULL), cork_timer(NULL), instance(NULL), settings(NULL),
+      compsupport(0),
+      mutation_tokens(0), connctx(NULL), connreq(NULL), curhost(NULL),
+      counters(NULL), preconnecting(false)
 {
 }
 
@@ -700,6 +838,9 @@ Server::~Server() {
     if (io_timer) {
         lcbio_timer_destroy(io_timer);
     }
+    if (cork_timer) {
+        lcbio_timer_destroy(cork_timer);
+    }
 
     delete curhost;
     lcb_settings_unref(settings);
@@ -733,6 +874,10 @@ Server::socket_failed(lcb_error_t err)
         return;
     }
 
+    TRACE_CONN_CLOSE(this, *curhost, err);
+    if (counters) {
+        counters->socket_errors++;
+    }
     purge(err, 0, NULL, REFRESH_ALWAYS);
     lcb_maybe_breakout(instance);
     start_errored_ctx(S_ERRDRAIN);
@@ -743,6 +888,11 @@ Server::close()
 {
     /* Should never be called twice */
     lcb_assert(state != Server::S_CLOSED);
+    /* A node removed by a new configuration may complete the batch, which is
+     * reported as usual. When the instance is being destroyed (and its
+     * configuration already released), nothing is reported */
+    preconnect_done(LCB_MAP_CHANGED, LCBT_VBCONFIG(instance) != NULL);
+    TRACE_CONN_CLOSE(this, *curhost, LCB_SUCCESS);
     start_errored_ctx(S_CLOSED);
 }
 
@@ -765,6 +915,15 @@ Server::start_errored_ctx(State next_state)
         lcbio_timer_destroy(io_timer);
         io_timer = NULL;
     }
+    if (next_state == Server::S_CLOSED && cork_timer != NULL) {
+        lcbio_timer_destroy(cork_timer);
+        cork_timer = NULL;
+    }
+    /* The counters belong to the instance, which may be destroyed while this
+     * server is still draining */
+    if (next_state == Server::S_CLOSED) {
+        counters = NULL;
+    }
 
     if (ctx == NULL) {
         if (next_state == Server::S_CLOSED) {
@@ -785,14 +944,20 @@ Server::start_errored_ctx(State next_state)
         }
 
     } else {
-        if (ctx->npending) {
+        if (ctx->npending || lcbio_ctx_zcpending(ctx)) {
             /* Have pending items? */
 
             /* Flush any remaining events */
             lcbio_ctx_schedule(ctx);
 
-            /* Close the socket not to leak resources */
-            lcbio_shutdown(lcbio_ctx_sock(ctx));
+            if (lcbio_ctx_zcpending(ctx)) {
+                /* The kernel may still be sending from our buffers. Keep the
+                 * socket until it is done with them */
+                lcbio_ctx_zcdrain(ctx);
+            } else {
+                /* Close the socket not to leak resources */
+                lcbio_shutdown(lcbio_ctx_sock(ctx));
+            }
             if (next_state == Server::S_ERRDRAIN) {
                 flush_start = (mcreq_flushstart_fn)flush_errdrain;
             }
@@ -812,7 +977,7 @@ Server::start_errored_ctx(State next_state)
 void
 Server::finalize_errored_ctx()
 {
-    if (connctx->npending) {
+    if (connctx->npending || lcbio_ctx_zcpending(connctx)) {
         return;
     }
 
@@ -828,6 +993,8 @@ Server::finalize_errored_ctx()
 
     unsigned toflush;
     nb_IOV iov;
+    /* Data which the ctx had not yet written was never reported as flushed */
+    netbuf_reset_flush(&nbmgr);
     while ((toflush = mcreq_flush_iov_fill(this, &iov, 1, NULL))) {
         mcreq_flush_done(this, toflush, toflush);
     }
@@ -28,6 +28,9 @@ namespace lcb {
 
 class RetryQueue;
 struct RetryOp;
+namespace metrics {
+struct NodeCounters;
+}
 
 /**
  * The structure representing each couchbase server
@@ -56,6 +59,21 @@ public:
      */
     void flush();
 
+    /**
+     * Like flush(), but when LCB_CNTL_AUTOCORK is enabled the flush is deferred
+     * until the end of the current event loop iteration (or the configured
+     * window), so that commands scheduled in the meantime are written together.
+     */
+    void cork();
+
+    /**
+     * Connect to the server now, rather than once the first command is
+     * scheduled to it (see LCB_CNTL_KV_PRECONNECT). Does nothing if the
+     * server is connected, connecting or failed.
+     * @return true if a connection was started
+     */
+    bool preconnect();
+
     /**
      * Wrapper around mcreq_pipeline_timeout() and/or mcreq_pipeline_fail(). This
      * function will purge all pending requests within the server and invoke
@@ -82,6 +100,14 @@ public:
         return !SLLIST_IS_EMPTY(&requests);
     }
 
+    /**
+     * Whether buffers sent without copying (see LCB_CNTL_ZEROCOPY_THRESHOLD)
+     * may still be in use by the kernel
+     */
+    bool has_pending_flush() const {
+        return connctx && lcbio_ctx_zcpending(connctx);
+    }
+
     int get_index() const {
         return mc_PIPELINE::index;
     }
@@ -192,6 +218,9 @@ public:
     /** IO/Operation timer */
     lcbio_pTIMER io_timer;
 
+    /** Timer for deferred flushes. See cork() */
+    lcbio_pTIMER cork_timer;
+
     /** Pointer back to the instance */
     lcb_t instance;
 
@@ -208,6 +237,18 @@ public:
 
     /** Request for current connection */
     lcb_host_t *curhost;
+
+    /**
+     * Counters for this node in the instance's lcb::Metrics. NULL once the
+     * server is closed, since the instance may be destroyed before it is
+     */
+    metrics::NodeCounters *counters;
+
+    /** Whether the current connection attempt was started by preconnect() */
+    bool preconnecting;
+
+private:
+    void preconnect_done(lcb_error_t err, bool notify = true);
 };
 }
 #endif /* __cplusplus */
@@ -73,6 +73,9 @@ public:
     void send_auth(const char *sasl_data, unsigned ndata);
     void handle_read(lcbio_CTX *ioctx);
     bool maybe_select_bucket();
+    void send_select_bucket();
+    bool send_optimistic();
+    bool restart_sasl();
 
     enum MechStatus { MECH_UNAVAILABLE, MECH_NOT_NEEDED, MECH_OK };
     MechStatus set_chosen_mech(std::string& mechlist, const char **data, unsigned int *ndata);
@@ -82,8 +85,9 @@ public:
     SessionRequestImpl(lcbio_CONNDONE_cb callback, void *data, uint32_t timeout, lcbio_TABLE *iot, lcb_settings* settings_)
         : ctx(NULL), cb(callback), cbdata(data),
           timer(lcbio_timer_new(iot, this, timeout_handler)),
-          last_err(LCB_SUCCESS), info(NULL),
-          settings(settings_) {
+          last_err(LCB_SUCCESS), sasl_client(NULL), info(NULL),
+          settings(settings_), npending(0), done(false), optimistic(false),
+          select_pending(false), select_stale(false), errmap_sent(false) {
 
         if (timeout) {
             lcbio_timer_rearm(timer, timeout);
@@ -118,6 +122,13 @@ public:
         lcbio_ctx_close(ctx, close_cb, &s);
         ctx = NULL;
 
+        if (settings->optimistic_negotiation && !info->mech.empty()) {
+            if (settings->sesscache == NULL) {
+                settings->sesscache = new SessionCache();
+            }
+            settings->sesscache->store(cachekey, *info);
+        }
+
         lcbio_protoctx_add(s, info);
         info = NULL;
 
@@ -174,6 +185,23 @@ public:
     cbsasl_conn_t *sasl_client;
     SessionInfo* info;
     lcb_settings *settings;
+
+    /** Requests sent which were not yet answered */
+    unsigned npending;
+    /** Negotiation is complete once the remaining responses are read */
+    bool done;
+    /** Whether the requests were pipelined using a SessionCache entry */
+    bool optimistic;
+    /** Whether a pipelined SELECT_BUCKET was not yet answered */
+    bool select_pending;
+    /** Whether the response to the pipelined SELECT_BUCKET is to be ignored */
+    bool select_stale;
+    /** Whether GET_ERROR_MAP was sent */
+    bool errmap_sent;
+    /** host:port, for the SessionCache */
+    std::string cachekey;
+    lcb_host_t hostinfo;
+    lcbio_NAMEINFO nameinfo;
 };
 
 static void handle_read(lcbio_CTX *ioctx, unsigned) {
@@ -314,6 +342,7 @@ SessionRequestImpl::send_auth(const char *sasl_data, unsigned ndata)
     lcbio_ctx_put(ctx, info->mech.c_str(), info->mech.size());
     lcbio_ctx_put(ctx, sasl_data, ndata);
     lcbio_ctx_rwant(ctx, 24);
+    npending++;
 }
 
 bool
@@ -337,6 +366,7 @@ SessionRequestImpl::send_step(const lcb::MemcachedResponse& packet)
     lcbio_ctx_put(ctx, info->mech.c_str(), info->mech.size());
     lcbio_ctx_put(ctx, step_data, ndata);
     lcbio_ctx_rwant(ctx, 24);
+    npending++;
     return true;
 }
 
@@ -393,6 +423,7 @@ SessionRequestImpl::send_hello()
     }
 
     lcbio_ctx_rwant(ctx, 24);
+    npending++;
     return true;
 }
 
@@ -402,6 +433,7 @@ SessionRequestImpl::send_list_mechs()
     lcb::MemcachedRequest req(PROTOCOL_BINARY_CMD_SASL_LIST_MECHS);
     lcbio_ctx_put(ctx, req.data(), req.size());
     LCBIO_CTX_RSCHEDULE(ctx, 24);
+    npending++;
 }
 
 bool
@@ -431,6 +463,8 @@ SessionRequestImpl::request_errmap() {
     lcbio_ctx_put(ctx, hdr.data(), hdr.size());
     lcbio_ctx_put(ctx, p, 2);
     lcbio_ctx_rwant(ctx, 24);
+    npending++;
+    errmap_sent = true;
     return true;
 }
 
@@ -468,13 +502,78 @@ SessionRequestImpl::maybe_select_bucket() {
         return false;
     }
 
-    // send the SELECT_BUCKET command:
+    send_select_bucket();
+    return true;
+}
+
+void
+SessionRequestImpl::send_select_bucket() {
     lcb_log(LOGARGS(this, INFO), SESSREQ_LOGFMT "Sending SELECT_BUCKET", SESSREQ_LOGID(this));
     lcb::MemcachedRequest req(PROTOCOL_BINARY_CMD_SELECT_BUCKET);
     req.sizes(0, strlen(settings->bucket), 0);
     lcbio_ctx_put(ctx, req.data(), req.size());
     lcbio_ctx_put(ctx, settings->bucket, strlen(settings->bucket));
     LCBIO_CTX_RSCHEDULE(ctx, 24);
+    npending++;
+}
+
+/**
+ * Send the requests of a whole negotiation at once, expecting the same
+ * results as the last negotiation with this host.
+ * @return false if there is nothing known about the host
+ */
+bool
+SessionRequestImpl::send_optimistic() {
+    if (!settings->sesscache) {
+        return false;
+    }
+    const SessionCache::Entry *entry = settings->sesscache->find(cachekey);
+    if (entry == NULL) {
+        return false;
+    }
+    if (settings->sasl_mech_force && entry->mech != settings->sasl_mech_force) {
+        return false;
+    }
+
+    std::string mechs(entry->mech);
+    const char *sasl_data;
+    unsigned int nsasl_data;
+    if (set_chosen_mech(mechs, &sasl_data, &nsasl_data) != MECH_OK) {
+        return false;
+    }
+
+    lcb_log(LOGARGS(this, DEBUG), SESSREQ_LOGFMT "Pipelining negotiation using %s", SESSREQ_LOGID(this), info->mech.c_str());
+    optimistic = true;
+    info->server_features = entry->server_features;
+
+    send_hello();
+    if (info->has_feature(PROTOCOL_BINARY_FEATURE_XERROR)) {
+        request_errmap();
+    }
+    send_auth(sasl_data, nsasl_data);
+
+    // Other mechanisms need more steps, which SELECT_BUCKET must follow
+    if (info->mech == "PLAIN" && settings->select_bucket &&
+            info->has_feature(PROTOCOL_BINARY_FEATURE_SELECT_BUCKET)) {
+        send_select_bucket();
+        select_pending = true;
+    }
+    info->server_features.clear();
+    return true;
+}
+
+/**
+ * Start over with a new SASL client, so that the mechanism may be chosen
+ * again from SASL_LIST_MECHS
+ */
+bool
+SessionRequestImpl::restart_sasl() {
+    cbsasl_dispose(&sasl_client);
+    info->mech.clear();
+    if (!setup(nameinfo, hostinfo, *settings->auth)) {
+        set_error(LCB_EINTERNAL, "Couldn't start SASL client");
+        return false;
+    }
     return true;
 }
 
@@ -502,6 +601,9 @@ SessionRequestImpl::handle_read(lcbio_CTX *ioctx)
         return;
     }
     const uint16_t status = resp.status();
+    if (npending) {
+        npending--;
+    }
 
     switch (resp.opcode()) {
     case PROTOCOL_BINARY_CMD_SASL_LIST_MECHS: {
@@ -522,10 +624,21 @@ SessionRequestImpl::handle_read(lcbio_CTX *ioctx)
 
     case PROTOCOL_BINARY_CMD_SASL_AUTH: {
         if (status == PROTOCOL_BINARY_RESPONSE_SUCCESS) {
-            completed = !maybe_select_bucket();
+            if (!select_pending) {
+                completed = !maybe_select_bucket();
+            }
             break;
         } else if (status == PROTOCOL_BINARY_RESPONSE_AUTH_CONTINUE) {
             send_step(resp);
+        } else if (optimistic) {
+            // The mechanism or the credentials may have changed
+            lcb_log(LOGARGS(this, INFO), SESSREQ_LOGFMT "Pipelined SASL_AUTH failed with STATUS=0x%x. Negotiating step by step", SESSREQ_LOGID(this), status);
+            settings->sesscache->remove(cachekey);
+            optimistic = false;
+            select_stale = select_pending;
+            if (restart_sasl()) {
+                send_list_mechs();
+            }
         } else {
             set_error(LCB_AUTH_ERROR, "SASL AUTH failed", &resp);
             break;
@@ -557,6 +670,20 @@ SessionRequestImpl::handle_read(lcbio_CTX *ioctx)
             break;
         }
 
+        if (optimistic) {
+            const SessionCache::Entry *entry = settings->sesscache->find(cachekey);
+            if (entry && entry->server_features != info->server_features) {
+                lcb_log(LOGARGS(this, INFO), SESSREQ_LOGFMT "Server features changed since the last negotiation", SESSREQ_LOGID(this));
+                settings->sesscache->remove(cachekey);
+            }
+            // The remaining requests were already sent. SELECT_BUCKET is sent
+            // after SASL_AUTH if it was not pipelined, and is now supported.
+            if (!errmap_sent && info->has_feature(PROTOCOL_BINARY_FEATURE_XERROR)) {
+                request_errmap();
+            }
+            break;
+        }
+
         if (info->has_feature(PROTOCOL_BINARY_FEATURE_XERROR)) {
             request_errmap();
         } else {
@@ -584,7 +711,16 @@ SessionRequestImpl::handle_read(lcbio_CTX *ioctx)
     }
 
     case PROTOCOL_BINARY_CMD_SELECT_BUCKET: {
-        if (status == PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+        select_pending = false;
+        if (select_stale) {
+            // Pipelined before a SASL_AUTH which failed
+            select_stale = false;
+        } else if (status == PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+            completed = true;
+        } else if (optimistic && !info->has_feature(PROTOCOL_BINARY_FEATURE_SELECT_BUCKET) &&
+                (status == PROTOCOL_BINARY_RESPONSE_UNKNOWN_COMMAND ||
+                        status == PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED)) {
+            // Pipelined, but no longer supported (and not needed)
             completed = true;
         } else if (status == PROTOCOL_BINARY_RESPONSE_EACCESS) {
             set_error(LCB_AUTH_ERROR, "Provided credentials not allowed for bucket", &resp);
@@ -608,9 +744,12 @@ SessionRequestImpl::handle_read(lcbio_CTX *ioctx)
 
     // Once there is no more any dependencies on the buffers, we can succeed
     // or fail the request, potentially destroying the underlying connection
+    if (completed) {
+        done = true;
+    }
     if (has_error()) {
         fail();
-    } else if (completed) {
+    } else if (done && npending == 0) {
         success();
     } else {
         goto GT_NEXT_PACKET;
@@ -645,18 +784,20 @@ SessionRequestImpl::start(lcbio_SOCKET *sock) {
     ctx = lcbio_ctx_new(sock, this, &procs);
     ctx->subsys = "sasl";
 
-    const lcb_host_t *curhost = lcbio_get_host(sock);
-    lcbio_NAMEINFO nistrs;
-    lcbio_get_nameinfo(sock, &nistrs);
+    hostinfo = *lcbio_get_host(sock);
+    lcbio_get_nameinfo(sock, &nameinfo);
+    cachekey.assign(hostinfo.host).append(":").append(hostinfo.port);
 
-    if (!setup(nistrs, *curhost, *settings->auth)) {
+    if (!setup(nameinfo, hostinfo, *settings->auth)) {
         set_error(LCB_EINTERNAL, "Couldn't start SASL client");
         lcbio_async_signal(timer);
         return;
     }
 
     if (settings->send_hello) {
-        send_hello();
+        if (!(settings->optimistic_negotiation && send_optimistic())) {
+            send_hello();
+        }
     } else {
         lcb_log(LOGARGS(this, INFO), SESSREQ_LOGFMT "HELLO negotiation disabled by user", SESSREQ_LOGID(this));
         send_list_mechs();
@@ -699,3 +840,20 @@ SessionInfo::has_feature(uint16_t feature) const {
     return std::find(server_features.begin(), server_features.end(), feature)
         != server_features.end();
 }
+
+const SessionCache::Entry *
+SessionCache::find(const std::string& key) const {
+    std::map<std::string, Entry>::const_iterator ii = entries.find(key);
+    return ii == entries.end() ? NULL : &ii->second;
+}
+
+void
+SessionCache::store(const std::string& key, const SessionInfo& info) {
+    Entry& entry = entries[key];
+    entry.server_features = info.server_features;
+    entry.mech = info.mech;
+}
+
+void lcb_sesscache_free(SessionCache *cache) {
+    delete cache;
+}
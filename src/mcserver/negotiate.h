@@ -19,6 +19,7 @@
 #define LCB_MCSERVER_NEGOTIATE_H
 #include <libcouchbase/couchbase.h>
 #include <lcbio/lcbio.h>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -81,6 +82,7 @@ public:
     virtual ~SessionRequest(){}
 };
 class SessionRequestImpl;
+class SessionCache;
 
 class SessionInfo : public lcbio_PROTOCTX {
 public:
@@ -115,11 +117,39 @@ public:
 private:
     SessionInfo();
     friend class lcb::SessionRequestImpl;
+    friend class lcb::SessionCache;
 
     std::string mech;
     std::vector<uint16_t> server_features;
 };
 
+/**
+ * @brief Results of earlier negotiations, by host
+ *
+ * When @ref LCB_CNTL_OPTIMISTIC_NEGOTIATION is enabled, the features and SASL
+ * mechanism negotiated with each host are kept here. New connections to the
+ * same host then send HELLO, GET_ERROR_MAP, SASL_AUTH and (for single step
+ * mechanisms) SELECT_BUCKET without waiting for each other's responses, and
+ * only continue step by step if a response does not match what was expected.
+ */
+class SessionCache {
+public:
+    struct Entry {
+        std::vector<uint16_t> server_features;
+        std::string mech;
+    };
+
+    /** @return the entry for the host, or NULL */
+    const Entry *find(const std::string& key) const;
+    void store(const std::string& key, const SessionInfo& info);
+    void remove(const std::string& key) {
+        entries.erase(key);
+    }
+
+private:
+    std::map<std::string, Entry> entries;
+};
+
 
 } // namespace
 
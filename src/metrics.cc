@@ -0,0 +1,301 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "metrics.h"
+#include <lcbio/manager.h>
+#include <stdio.h>
+
+using namespace lcb;
+using metrics::NodeCounters;
+
+static std::string
+node_key(const lcb_host_t& host)
+{
+    std::string key(host.host);
+    key += ':';
+    key += host.port;
+    return key;
+}
+
+Metrics::~Metrics()
+{
+    for (NodeMap::iterator ii = nodes.begin(); ii != nodes.end(); ++ii) {
+        delete ii->second;
+    }
+}
+
+NodeCounters *
+Metrics::node(const lcb_host_t& host)
+{
+    std::string key = node_key(host);
+    NodeMap::iterator ii = nodes.find(key);
+    if (ii != nodes.end()) {
+        return ii->second;
+    }
+    NodeCounters *counters = new NodeCounters();
+    nodes.insert(std::make_pair(key, counters));
+    return counters;
+}
+
+namespace {
+/**
+ * Writes the OpenMetrics text format. Each family is started with begin(),
+ * and its samples are then added with the labels set by label()
+ */
+class Writer {
+public:
+    Writer(const char *bucket) {
+        common = "bucket=\"";
+        escape(common, bucket ? bucket : "");
+        common += '"';
+    }
+
+    void begin(const char *name_, const char *type, const char *help) {
+        name = name_;
+        out += "# TYPE ";
+        out += name;
+        out += ' ';
+        out += type;
+        out += "\n# HELP ";
+        out += name;
+        out += ' ';
+        out += help;
+        out += '\n';
+        suffix = strcmp(type, "counter") == 0 ? "_total" : "";
+    }
+
+    /** Labels for the next samples, in addition to the bucket */
+    void label(const char *key = NULL, const std::string& value = std::string(),
+               const char *key2 = NULL, const char *value2 = NULL) {
+        labels = common;
+        if (key) {
+            labels += ',';
+            labels += key;
+            labels += "=\"";
+            escape(labels, value.c_str());
+            labels += '"';
+        }
+        if (key2) {
+            labels += ',';
+            labels += key2;
+            labels += "=\"";
+            escape(labels, value2);
+            labels += '"';
+        }
+    }
+
+    void sample(lcb_U64 value) {
+        char buf[32];
+        sprintf(buf, "%llu", (unsigned long long)value);
+        out += name;
+        out += suffix;
+        out += '{';
+        out += labels;
+        out += "} ";
+        out += buf;
+        out += '\n';
+    }
+
+    std::string& finish() {
+        out += "# EOF\n";
+        return out;
+    }
+
+private:
+    static void escape(std::string& s, const char *value) {
+        for (; *value; value++) {
+            if (*value == '\\' || *value == '"') {
+                s += '\\';
+                s += *value;
+            } else if (*value == '\n') {
+                s += "\\n";
+            } else {
+                s += *value;
+            }
+        }
+    }
+
+    std::string out;
+    std::string common;
+    std::string labels;
+    const char *name;
+    const char *suffix;
+};
+}
+
+#define NODE_COUNTER(fld, name, help) \
+    w.begin(name, "counter", help); \
+    for (ii = nodes.begin(); ii != nodes.end(); ++ii) { \
+        w.label("node", ii->first); \
+        w.sample(ii->second->fld); \
+    }
+
+#define POOL_SAMPLE(expr) \
+    for (size_t jj = 0; jj < 2; jj++) { \
+        w.label("pool", pools[jj].name); \
+        w.sample(pools[jj].expr); \
+    }
+
+namespace {
+struct PoolInfo {
+    PoolInfo(const char *name_, const io::Pool *pool)
+        : name(name_), stats(pool->get_stats()), usage(pool->get_usage()) {
+    }
+    const char *name;
+    io::Pool::Stats stats;
+    io::Pool::Usage usage;
+};
+}
+
+static void
+add_pools(Writer& w, lcb_t instance)
+{
+    PoolInfo pools[] = {
+        PoolInfo("kv", instance->memd_sockpool),
+        PoolInfo("http", instance->http_sockpool)
+    };
+
+    w.begin("lcb_pool_hits", "counter",
+            "Connection requests satisfied by an idle connection.");
+    POOL_SAMPLE(stats.hits)
+    w.begin("lcb_pool_misses", "counter",
+            "Connection requests which waited for a new connection.");
+    POOL_SAMPLE(stats.misses)
+    w.begin("lcb_pool_preconnects", "counter",
+            "Connections opened ahead of use.");
+    POOL_SAMPLE(stats.preconnects)
+    w.begin("lcb_pool_dead", "counter",
+            "Idle connections found closed by the peer.");
+    POOL_SAMPLE(stats.dead)
+    w.begin("lcb_pool_connections", "gauge",
+            "Connections held by the pool.");
+    for (size_t jj = 0; jj < 2; jj++) {
+        w.label("pool", pools[jj].name, "state", "idle");
+        w.sample(pools[jj].usage.idle);
+        w.label("pool", pools[jj].name, "state", "leased");
+        w.sample(pools[jj].usage.leased);
+        w.label("pool", pools[jj].name, "state", "pending");
+        w.sample(pools[jj].usage.pending);
+    }
+    w.begin("lcb_pool_waiting_requests", "gauge",
+            "Connection requests waiting for a connection.");
+    POOL_SAMPLE(usage.requests)
+}
+
+std::string
+Metrics::render(lcb_t instance) const
+{
+    Writer w(LCBT_SETTING(instance, bucket));
+    NodeMap::const_iterator ii;
+
+    NODE_COUNTER(responses, "lcb_kv_responses",
+                 "Responses received from the node.")
+    NODE_COUNTER(failures, "lcb_kv_failures",
+                 "Operations failed or rescheduled without a response.")
+    NODE_COUNTER(timeouts, "lcb_kv_timeouts",
+                 "Operations which timed out.")
+    NODE_COUNTER(nmv, "lcb_kv_not_my_vbucket",
+                 "NOT_MY_VBUCKET responses.")
+    NODE_COUNTER(bytes_written, "lcb_kv_written_bytes",
+                 "Bytes written to the node.")
+    NODE_COUNTER(bytes_read, "lcb_kv_read_bytes",
+                 "Bytes of responses read from the node.")
+    NODE_COUNTER(connects, "lcb_kv_connects",
+                 "Connections established to the node.")
+    NODE_COUNTER(socket_errors, "lcb_kv_socket_errors",
+                 "Connections which failed or could not be established.")
+
+    /* Gauges are only available for the nodes in the current configuration */
+    size_t nservers = LCBT_NSERVERS(instance);
+    std::vector<std::string> keys;
+    for (size_t jj = 0; jj < nservers; jj++) {
+        keys.push_back(node_key(instance->get_server(jj)->get_host()));
+    }
+
+    w.begin("lcb_kv_queued_operations", "gauge",
+            "Operations scheduled to the node and awaiting a response.");
+    for (size_t jj = 0; jj < nservers; jj++) {
+        const Server *server = instance->get_server(jj);
+        sllist_node *ll;
+        lcb_U64 n = 0;
+        SLLIST_FOREACH(&server->requests, ll) {
+            n++;
+        }
+        w.label("node", keys[jj]);
+        w.sample(n);
+    }
+    w.begin("lcb_kv_unflushed_bytes", "gauge",
+            "Bytes scheduled to the node which were not yet written.");
+    for (size_t jj = 0; jj < nservers; jj++) {
+        Server *server = instance->get_server(jj);
+        w.label("node", keys[jj]);
+        w.sample(netbuf_get_pending_size(&server->nbmgr));
+    }
+    w.begin("lcb_kv_connected", "gauge",
+            "Whether the node has an established connection.");
+    for (size_t jj = 0; jj < nservers; jj++) {
+        const Server *server = instance->get_server(jj);
+        w.label("node", keys[jj]);
+        w.sample(server->connctx != NULL && server->state == Server::S_CLEAN);
+    }
+
+    w.begin("lcb_retries", "counter",
+            "Operations placed in the retry queue.");
+    w.label();
+    w.sample(retries);
+    w.begin("lcb_retry_queue_operations", "gauge",
+            "Operations waiting in the retry queue.");
+    w.label();
+    w.sample(instance->retryq->size());
+
+    w.begin("lcb_config_updates", "counter",
+            "Cluster configurations applied.");
+    w.label();
+    w.sample(config_updates);
+    if (LCBT_VBCONFIG(instance) && LCBT_VBCONFIG(instance)->revid >= 0) {
+        w.begin("lcb_config_revision", "gauge",
+                "Revision of the current cluster configuration.");
+        w.label();
+        w.sample(LCBT_VBCONFIG(instance)->revid);
+    }
+
+    w.begin("lcb_compression_input_bytes", "counter",
+            "Bytes of values before compression.");
+    w.label();
+    w.sample(compress_input);
+    w.begin("lcb_compression_output_bytes", "counter",
+            "Bytes of values after compression.");
+    w.label();
+    w.sample(compress_output);
+
+    add_pools(w, instance);
+    return w.finish();
+}
+
+LIBCOUCHBASE_API
+lcb_SIZE
+lcb_metrics_snapshot(lcb_t instance, char *buf, lcb_SIZE nbuf)
+{
+    std::string s = instance->metrics->render(instance);
+    if (nbuf) {
+        lcb_SIZE ncopy = s.size() < nbuf ? s.size() : nbuf - 1;
+        memcpy(buf, s.c_str(), ncopy);
+        buf[ncopy] = '\0';
+    }
+    return s.size();
+}
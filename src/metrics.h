@@ -0,0 +1,97 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_METRICS_H
+#define LCB_METRICS_H
+
+#include <libcouchbase/couchbase.h>
+#include <map>
+#include <string>
+
+/**
+ * @file
+ * @brief Counters rendered by lcb_metrics_snapshot()
+ *
+ * Counters are plain integers incremented where the event happens. An
+ * instance is only ever used from one thread at a time, so they need no
+ * locking. Gauges (queue depths, buffered bytes, pool usage) are not kept
+ * here; they are computed from the instance's structures when a snapshot is
+ * taken.
+ */
+
+namespace lcb {
+namespace metrics {
+
+/**
+ * Counters for a single KV node. These are kept by address, so that they
+ * continue across configuration changes which recreate its lcb::Server
+ */
+struct NodeCounters {
+    NodeCounters()
+        : responses(0), failures(0), timeouts(0), nmv(0), bytes_written(0),
+          bytes_read(0), connects(0), socket_errors(0) {
+    }
+
+    /** Responses received */
+    lcb_U64 responses;
+    /** Operations failed (or retried) without a response */
+    lcb_U64 failures;
+    /** Failures which were timeouts */
+    lcb_U64 timeouts;
+    /** NOT_MY_VBUCKET responses */
+    lcb_U64 nmv;
+    lcb_U64 bytes_written;
+    lcb_U64 bytes_read;
+    /** Connections established */
+    lcb_U64 connects;
+    /** Connections which failed, or could not be established */
+    lcb_U64 socket_errors;
+};
+
+}
+
+class Metrics {
+public:
+    Metrics() : retries(0), config_updates(0), compress_input(0),
+        compress_output(0) {
+    }
+    ~Metrics();
+
+    /**
+     * Get the counters for a node, creating them if needed. The pointer
+     * remains valid for the lifetime of the registry
+     */
+    metrics::NodeCounters *node(const lcb_host_t& host);
+
+    /** Render the registry and the instance's gauges as OpenMetrics text */
+    std::string render(lcb_t instance) const;
+
+    /** Operations placed in the retry queue */
+    lcb_U64 retries;
+    /** Cluster configurations applied */
+    lcb_U64 config_updates;
+    /** Value bytes before and after compression, for compressed values */
+    lcb_U64 compress_input;
+    lcb_U64 compress_output;
+
+private:
+    typedef std::map<std::string, metrics::NodeCounters*> NodeMap;
+    NodeMap nodes;
+};
+
+}
+#endif
@@ -0,0 +1,440 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "nearcache.h"
+
+using namespace lcb;
+
+/** Rough per-entry cost of the bookkeeping structures */
+#define ENTRY_OVERHEAD 96
+
+#define SKETCH_DEPTH 4
+#define SKETCH_MAX_COUNT 15
+#define SKETCH_MIN_WIDTH 1024
+#define SKETCH_MAX_WIDTH (1 << 20)
+
+NearCache::Value::Value(const lcb_RESPGET *resp)
+    : key(static_cast<const char*>(resp->key), resp->nkey),
+      data(static_cast<const char*>(resp->value), resp->nvalue),
+      itmflags(resp->itmflags), datatype(resp->datatype), cas(resp->cas),
+      refcount(1) {
+}
+
+size_t NearCache::Value::size() const {
+    return key.size() + data.size() + ENTRY_OVERHEAD;
+}
+
+/** Invoke the GET callback for a value which was found in the cache */
+static void
+invoke_get(lcb_t instance, const void *cookie, const NearCache::Value *value,
+           lcb_error_t rc)
+{
+    lcb_RESPGET resp = { 0 };
+    resp.cookie = const_cast<void*>(cookie);
+    resp.key = value->key.c_str();
+    resp.nkey = value->key.size();
+    resp.rc = rc;
+    resp.rflags = LCB_RESP_F_FINAL;
+    if (rc == LCB_SUCCESS) {
+        resp.cas = value->cas;
+        resp.value = value->data.c_str();
+        resp.nvalue = value->data.size();
+        resp.itmflags = value->itmflags;
+        resp.datatype = value->datatype;
+    } else {
+        resp.rflags |= LCB_RESP_F_CLIENTGEN;
+    }
+    lcb_RESPCALLBACK callback = lcb_find_callback(instance, LCB_CALLBACK_GET);
+    callback(instance, LCB_CALLBACK_GET, (const lcb_RESPBASE *)&resp);
+}
+
+NearCache::NearCache(lcb_t instance_)
+    : instance(instance_), hand(0), nbytes(0), sketch_additions(0),
+      pending_scheduled(false) {
+
+    size_t width = SKETCH_MIN_WIDTH;
+    while (width < SKETCH_MAX_WIDTH &&
+            width < LCBT_SETTING(instance, near_cache_size) / 128) {
+        width <<= 1;
+    }
+    sketch.resize(width * SKETCH_DEPTH);
+    sketch_mask = width - 1;
+
+    pending_timer = lcbio_timer_new(instance->iotable, this, deliver_pending);
+    memset(&stats, 0, sizeof stats);
+}
+
+NearCache::~NearCache() {
+    lcbio_timer_destroy(pending_timer);
+    for (size_t ii = 0; ii < pending.size(); ++ii) {
+        pending[ii].value->unref();
+    }
+    for (size_t ii = 0; ii < ctxhits.size(); ++ii) {
+        ctxhits[ii].value->unref();
+    }
+    if (pending_scheduled) {
+        lcb_aspend_del(&instance->pendops, LCB_PENDTYPE_COUNTER, NULL);
+    }
+    clear();
+}
+
+lcb_U64 NearCache::hash(const std::string& key) const {
+    /* FNV-1a */
+    lcb_U64 h = 14695981039346656037ULL;
+    for (size_t ii = 0; ii < key.size(); ++ii) {
+        h ^= static_cast<lcb_U8>(key[ii]);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/* Each row of the sketch is indexed by a different combination of the two
+ * halves of the hash */
+#define SKETCH_INDEX(h, row) \
+    ((row) * (sketch_mask + 1) + \
+        (((lcb_U32)(h) + (row) * (lcb_U32)((h) >> 32)) & sketch_mask))
+
+void NearCache::record_access(lcb_U64 h) {
+    for (size_t ii = 0; ii < SKETCH_DEPTH; ++ii) {
+        lcb_U8& counter = sketch[SKETCH_INDEX(h, ii)];
+        if (counter < SKETCH_MAX_COUNT) {
+            counter++;
+        }
+    }
+
+    /* Age the counters so that keys which are no longer popular make way */
+    if (++sketch_additions >= (sketch_mask + 1) * 10) {
+        for (size_t ii = 0; ii < sketch.size(); ++ii) {
+            sketch[ii] >>= 1;
+        }
+        sketch_additions /= 2;
+    }
+}
+
+unsigned NearCache::frequency(lcb_U64 h) const {
+    unsigned ret = SKETCH_MAX_COUNT;
+    for (size_t ii = 0; ii < SKETCH_DEPTH; ++ii) {
+        unsigned cur = sketch[SKETCH_INDEX(h, ii)];
+        if (cur < ret) {
+            ret = cur;
+        }
+    }
+    return ret;
+}
+
+void NearCache::remove(EntryMap::iterator it) {
+    Entry *ent = it->second;
+    slots[ent->slot] = NULL;
+    free_slots.push_back(ent->slot);
+    nbytes -= ent->value->size();
+    ent->value->unref();
+    delete ent;
+    entries.erase(it);
+}
+
+void NearCache::clear() {
+    while (!entries.empty()) {
+        remove(entries.begin());
+    }
+    slots.clear();
+    free_slots.clear();
+    hand = 0;
+}
+
+NearCache::Entry *NearCache::next_victim(hrtime_t now) {
+    if (entries.empty()) {
+        return NULL;
+    }
+    /* Terminates within two revolutions, as each referenced entry which
+     * is passed over is unmarked */
+    for (;;) {
+        if (hand >= slots.size()) {
+            hand = 0;
+        }
+        Entry *ent = slots[hand++];
+        if (ent == NULL) {
+            continue;
+        }
+        if (ent->referenced && ent->expires > now) {
+            ent->referenced = false;
+            continue;
+        }
+        return ent;
+    }
+}
+
+void NearCache::insert(const std::string& key, Value *value, hrtime_t now) {
+    lcb_SIZE capacity = LCBT_SETTING(instance, near_cache_size);
+    unsigned freq = frequency(hash(key));
+
+    while (nbytes + value->size() > capacity) {
+        Entry *victim = next_victim(now);
+        if (victim == NULL) {
+            break;
+        }
+        if (victim->expires > now && frequency(hash(victim->value->key)) >= freq) {
+            stats.rejections++;
+            value->unref();
+            return;
+        }
+        remove(entries.find(victim->value->key));
+        stats.evictions++;
+    }
+
+    Entry *ent = new Entry();
+    ent->value = value;
+    ent->expires = now + LCB_US2NS(LCBT_SETTING(instance, near_cache_ttl));
+    ent->referenced = false;
+    if (free_slots.empty()) {
+        ent->slot = slots.size();
+        slots.push_back(ent);
+    } else {
+        ent->slot = free_slots.back();
+        free_slots.pop_back();
+        slots[ent->slot] = ent;
+    }
+    entries[key] = ent;
+    nbytes += value->size();
+}
+
+bool NearCache::get(const void *cookie, const lcb_CMDGET *cmd) {
+    if (LCBT_SETTING(instance, near_cache_size) == 0) {
+        if (!entries.empty()) {
+            clear();
+        }
+        return false;
+    }
+    if (cmd->_hashkey.type == LCB_KV_VBID || cmd->_hashkey.contig.nbytes) {
+        /* May refer to a different document than the key itself */
+        return false;
+    }
+
+    std::string key(static_cast<const char*>(cmd->key.contig.bytes),
+        cmd->key.contig.nbytes);
+    record_access(hash(key));
+
+    EntryMap::iterator it = entries.find(key);
+    if (it == entries.end()) {
+        stats.misses++;
+        return false;
+    }
+
+    Entry *ent = it->second;
+    if (ent->expires > gethrtime()) {
+        ent->referenced = true;
+        stats.hits++;
+        deliver(cookie, ent->value);
+        return true;
+    }
+
+    if (LCBT_SETTING(instance, near_cache_revalidate) &&
+            revalidate(cookie, ent->value)) {
+        return true;
+    }
+    remove(it);
+    stats.misses++;
+    return false;
+}
+
+void NearCache::update(const lcb_RESPGET *resp) {
+    lcb_SIZE capacity = LCBT_SETTING(instance, near_cache_size);
+    if (resp->rc == LCB_KEY_ENOENT) {
+        invalidate(resp->key, resp->nkey);
+        return;
+    }
+    if (resp->rc != LCB_SUCCESS || capacity == 0) {
+        return;
+    }
+
+    Value *value = new Value(resp);
+    hrtime_t now = gethrtime();
+    EntryMap::iterator it = entries.find(value->key);
+    if (it != entries.end()) {
+        remove(it);
+    }
+    if (value->size() > capacity) {
+        stats.rejections++;
+        value->unref();
+        return;
+    }
+    insert(value->key, value, now);
+}
+
+void NearCache::invalidate(const void *key, size_t nkey) {
+    EntryMap::iterator it = entries.find(
+        std::string(static_cast<const char*>(key), nkey));
+    if (it != entries.end()) {
+        remove(it);
+        stats.invalidations++;
+    }
+}
+
+void NearCache::get_stats(lcb_cntl_nearcachestats *out) const {
+    *out = stats;
+    out->items = entries.size();
+    out->bytes = nbytes;
+}
+
+void NearCache::deliver(const void *cookie, Value *value) {
+    PendingHit hit;
+    hit.cookie = cookie;
+    hit.value = value;
+    value->ref();
+    /* Like the packets of the context, the hit is sent once it is left */
+    if (instance->cmdq.ctxenter) {
+        ctxhits.push_back(hit);
+        return;
+    }
+    pending.push_back(hit);
+    schedule_pending();
+}
+
+void NearCache::ctxdone(bool success) {
+    if (ctxhits.empty()) {
+        return;
+    }
+    if (!success) {
+        for (size_t ii = 0; ii < ctxhits.size(); ++ii) {
+            ctxhits[ii].value->unref();
+        }
+        stats.hits -= ctxhits.size();
+        ctxhits.clear();
+        return;
+    }
+    pending.insert(pending.end(), ctxhits.begin(), ctxhits.end());
+    ctxhits.clear();
+    schedule_pending();
+}
+
+void NearCache::schedule_pending() {
+    if (!pending_scheduled) {
+        pending_scheduled = true;
+        lcb_aspend_add(&instance->pendops, LCB_PENDTYPE_COUNTER, NULL);
+        lcbio_async_signal(pending_timer);
+    }
+}
+
+void NearCache::deliver_pending(void *arg) {
+    NearCache *nc = reinterpret_cast<NearCache*>(arg);
+    lcb_t instance = nc->instance;
+
+    /* Callbacks may schedule further hits, which are delivered here too */
+    while (!nc->pending.empty()) {
+        std::vector<PendingHit> hits;
+        hits.swap(nc->pending);
+        for (size_t ii = 0; ii < hits.size(); ++ii) {
+            invoke_get(instance, hits[ii].cookie, hits[ii].value, LCB_SUCCESS);
+            hits[ii].value->unref();
+        }
+    }
+    nc->pending_scheduled = false;
+    lcb_aspend_del(&instance->pendops, LCB_PENDTYPE_COUNTER, NULL);
+    lcb_maybe_breakout(instance);
+}
+
+namespace {
+/** State for an expired entry whose CAS is being checked */
+struct Revalidation {
+    const void *cookie;
+    NearCache::Value *value;
+};
+}
+
+bool NearCache::revalidate(const void *cookie, Value *value) {
+    lcb_CMDOBSERVE cmd = { 0 };
+    lcb_MULTICMD_CTX *mctx = lcb_observe_ctx_nearcache_new(instance);
+    LCB_CMD_SET_KEY(&cmd, value->key.c_str(), value->key.size());
+    cmd.cmdflags |= LCB_CMDOBSERVE_F_MASTER_ONLY;
+
+    Revalidation *rv = new Revalidation();
+    rv->cookie = cookie;
+    rv->value = value;
+    value->ref();
+
+    lcb_error_t err = mctx->addcmd(mctx, (const lcb_CMDBASE *)&cmd);
+    if (err == LCB_SUCCESS) {
+        err = mctx->done(mctx, rv);
+    } else {
+        mctx->fail(mctx);
+    }
+    if (err != LCB_SUCCESS) {
+        delete rv;
+        value->unref();
+        return false;
+    }
+    stats.revalidations++;
+    return true;
+}
+
+void NearCache::revalidated(Value *value, bool valid) {
+    EntryMap::iterator it = entries.find(value->key);
+    if (valid) {
+        stats.hits++;
+    } else {
+        stats.misses++;
+    }
+    if (it == entries.end() || it->second->value != value) {
+        return;
+    }
+    if (valid) {
+        it->second->expires = gethrtime() +
+                LCB_US2NS(LCBT_SETTING(instance, near_cache_ttl));
+        it->second->referenced = true;
+    } else {
+        remove(it);
+    }
+}
+
+void
+lcb_nearcache_revalidated(lcb_t instance, const void *cookie,
+                          const lcb_RESPOBSERVE *resp)
+{
+    Revalidation *rv = reinterpret_cast<Revalidation*>(const_cast<void*>(cookie));
+    if (resp->rflags & LCB_RESP_F_FINAL) {
+        rv->value->unref();
+        delete rv;
+        return;
+    }
+
+    bool valid = resp->rc == LCB_SUCCESS && resp->cas == rv->value->cas &&
+            (resp->status == LCB_OBSERVE_FOUND ||
+                    resp->status == LCB_OBSERVE_PERSISTED);
+    if (instance->near_cache) {
+        instance->near_cache->revalidated(rv->value, valid);
+    }
+
+    if (valid) {
+        invoke_get(instance, rv->cookie, rv->value, LCB_SUCCESS);
+        return;
+    } else if (resp->rc != LCB_SUCCESS) {
+        invoke_get(instance, rv->cookie, rv->value, resp->rc);
+        return;
+    }
+
+    lcb_CMDGET gcmd = { 0 };
+    LCB_CMD_SET_KEY(&gcmd, rv->value->key.c_str(), rv->value->key.size());
+    gcmd.cmdflags |= LCB_CMDGET_F_NOCACHE;
+    lcb_sched_enter(instance);
+    lcb_error_t err = lcb_get3(instance, rv->cookie, &gcmd);
+    if (err == LCB_SUCCESS) {
+        lcb_sched_leave(instance);
+    } else {
+        lcb_sched_fail(instance);
+        invoke_get(instance, rv->cookie, rv->value, err);
+    }
+}
@@ -0,0 +1,155 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_NEARCACHE_H
+#define LCB_NEARCACHE_H
+
+#include "config.h"
+#include <libcouchbase/couchbase.h>
+#include <lcbio/timer-ng.h>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * @file
+ * @brief Client side cache of recently read documents
+ *
+ * When LCB_CNTL_NEAR_CACHE_SIZE is set, the values returned by plain GETs are
+ * kept in a byte bounded, per-instance cache for LCB_CNTL_NEAR_CACHE_TTL,
+ * and subsequent GETs for the same key are answered from it without a round
+ * trip to the server.
+ *
+ * Entries are evicted using the CLOCK algorithm. A new entry which requires
+ * evicting others is only admitted if it has been requested more often than
+ * the entry it would replace (TinyLFU); access frequencies are tracked in a
+ * count-min sketch which is periodically halved, so that the cache favours
+ * keys which are popular now rather than keys which were popular once.
+ *
+ * Responses to mutations (store, remove, counter, subdoc) issued through
+ * this instance invalidate the entry for their key.
+ */
+
+namespace lcb {
+
+class NearCache {
+public:
+    /** Immutable snapshot of a document, shared with pending responses */
+    struct Value {
+        Value(const lcb_RESPGET *resp);
+        void ref() { refcount++; }
+        void unref() {
+            if (!--refcount) {
+                delete this;
+            }
+        }
+        size_t size() const;
+
+        std::string key;
+        std::string data;
+        lcb_U32 itmflags;
+        lcb_U8 datatype;
+        lcb_CAS cas;
+        unsigned refcount;
+    };
+
+    NearCache(lcb_t instance);
+    ~NearCache();
+
+    /**
+     * Answer a GET from the cache.
+     * @return true if the cookie will receive the cached value, in which case
+     * the GET must not be sent.
+     */
+    bool get(const void *cookie, const lcb_CMDGET *cmd);
+
+    /** Cache (or drop) the value received in response to a plain GET */
+    void update(const lcb_RESPGET *resp);
+
+    /** Drop the entry for a key which was (or may have been) modified */
+    void invalidate(const void *key, size_t nkey);
+
+    /**
+     * Complete the revalidation of an expired entry.
+     * @param valid whether the server still has the cached revision
+     */
+    void revalidated(Value *value, bool valid);
+
+    /**
+     * Called when the scheduling context is left. Hits found within it are
+     * only delivered if `success` is true
+     */
+    void ctxdone(bool success);
+
+    void get_stats(lcb_cntl_nearcachestats *stats) const;
+
+private:
+    struct Entry {
+        Value *value;
+        hrtime_t expires;
+        size_t slot;
+        bool referenced;
+    };
+    typedef std::map<std::string, Entry*> EntryMap;
+
+    struct PendingHit {
+        const void *cookie;
+        Value *value;
+    };
+
+    lcb_U64 hash(const std::string& key) const;
+    void record_access(lcb_U64 h);
+    unsigned frequency(lcb_U64 h) const;
+
+    void remove(EntryMap::iterator it);
+    void clear();
+    Entry *next_victim(hrtime_t now);
+    void insert(const std::string& key, Value *value, hrtime_t now);
+    void deliver(const void *cookie, Value *value);
+    void schedule_pending();
+    bool revalidate(const void *cookie, Value *value);
+    static void deliver_pending(void *arg);
+
+    lcb_t instance;
+    EntryMap entries;
+    std::vector<Entry*> slots; /**< CLOCK ring. Unused slots are NULL */
+    std::vector<size_t> free_slots;
+    size_t hand;
+    size_t nbytes;
+
+    std::vector<lcb_U8> sketch; /**< 4 rows of 4 bit counters (one per byte) */
+    size_t sketch_mask;
+    size_t sketch_additions;
+
+    std::vector<PendingHit> pending;
+    std::vector<PendingHit> ctxhits; /**< Hits of the open scheduling context */
+    lcbio_pTIMER pending_timer;
+    bool pending_scheduled;
+
+    lcb_cntl_nearcachestats stats;
+};
+
+} // namespace lcb
+
+/** Create an OBSERVE context whose responses are passed to the near cache */
+lcb_MULTICMD_CTX *lcb_observe_ctx_nearcache_new(lcb_t instance);
+
+/** Handle an OBSERVE response for a revalidation started by NearCache::get() */
+void lcb_nearcache_revalidated(lcb_t instance, const void *cookie,
+                               const lcb_RESPOBSERVE *resp);
+
+#endif
@@ -529,6 +529,18 @@ netbuf_get_niov(nb_MGR *mgr)
     return ret;
 }
 
+nb_SIZE
+netbuf_get_pending_size(nb_MGR *mgr)
+{
+    sllist_node *ll;
+    nb_SIZE ret = 0;
+    SLLIST_FOREACH(&mgr->sendq.pending, ll) {
+        ret += SLLIST_ITEM(ll, nb_SNDQELEM, slnode)->len;
+    }
+
+    return ret;
+}
+
 /******************************************************************************
  ******************************************************************************
  ** Flush Routines                                                           **
@@ -220,6 +220,13 @@ netbuf_enqueue_span(nb_MGR *mgr, nb_SPAN *span);
 unsigned int
 netbuf_get_niov(nb_MGR *mgr);
 
+/**
+ * Gets the number of bytes which have been enqueued but not yet reported as
+ * flushed. Like netbuf_get_niov(), this traverses the send queue.
+ */
+nb_SIZE
+netbuf_get_pending_size(nb_MGR *mgr);
+
 /**
  * @brief
  * Populates an iovec structure for flushing a set of bytes from the various
@@ -20,6 +20,9 @@
 #include "bucketconfig/clconfig.h"
 #include "vbucket/aliases.h"
 #include "sllist-inl.h"
+#include "http/http.h"
+#include "trace.h"
+#include "metrics.h"
 
 #define LOGARGS(instance, lvl) (instance)->settings, "newconfig", LCB_LOG_##lvl, __FILE__, __LINE__
 #define LOG(instance, lvlbase, msg) lcb_log(instance->settings, "newconfig", LCB_LOG_##lvlbase, __FILE__, __LINE__, msg)
@@ -328,6 +331,7 @@ void lcb_update_vbconfig(lcb_t instance, lcb_pCONFIGINFO config)
         lcb_vbguess_newconfig(instance, config->vbc, instance->vbguess);
 
         replace_config(instance, old_config->vbc, config->vbc);
+        lcb::http::preconnect(instance, old_config->vbc, config->vbc);
         old_config->decref();
         change_status = LCB_CONFIGURATION_CHANGED;
     } else {
@@ -339,9 +343,16 @@ void lcb_update_vbconfig(lcb_t instance, lcb_pCONFIGINFO config)
         }
 
         mcreq_queue_add_pipelines(q, &servers[0], nservers, config->vbc);
+        lcb::http::preconnect(instance, NULL, config->vbc);
         change_status = LCB_CONFIGURATION_NEW;
     }
 
+    if (LCBT_SETTING(instance, kv_preconnect)) {
+        for (size_t ii = 0; ii < LCBT_NSERVERS(instance); ii++) {
+            instance->get_server(ii)->preconnect();
+        }
+    }
+
     /* Update the list of nodes here for server list */
     instance->ht_nodes->clear();
     for (size_t ii = 0; ii < LCBVB_NSERVERS(config->vbc); ++ii) {
@@ -352,6 +363,8 @@ void lcb_update_vbconfig(lcb_t instance, lcb_pCONFIGINFO config)
         }
     }
 
+    instance->metrics->config_updates++;
+    TRACE_CONFIG_CHANGE(config->vbc, change_status);
     instance->callbacks.configuration(instance, change_status);
     lcb_maybe_breakout(instance);
 }
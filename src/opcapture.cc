@@ -0,0 +1,157 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "opcapture.h"
+#include "packetutils.h"
+#ifdef HAVE_GETTIMEOFDAY
+#include <sys/time.h>
+#endif
+#include <time.h>
+#include <algorithm>
+
+#define LOGARGS(settings, lvl) settings, "opcapture", LCB_LOG_##lvl, __FILE__, __LINE__
+
+/* Records are buffered and written in chunks of this size, or at most this
+ * long (in microseconds) after they were recorded, so that little is lost if
+ * the instance is never destroyed */
+#define CAPTURE_BUFSIZE 65536
+#define CAPTURE_FLUSH_INTERVAL 1000000
+
+using namespace lcb;
+using namespace lcb::opcapture;
+
+static lcb_U64
+wallclock_us()
+{
+#ifdef HAVE_GETTIMEOFDAY
+    struct timeval tv;
+    if (gettimeofday(&tv, NULL) == 0) {
+        return (lcb_U64)tv.tv_sec * 1000000 + tv.tv_usec;
+    }
+#endif
+    return (lcb_U64)time(NULL) * 1000000;
+}
+
+OpCapture *
+OpCapture::open(lcb_t instance, const char *path)
+{
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        lcb_log(LOGARGS(instance->settings, ERROR), "Couldn't open capture file %s", path);
+        return NULL;
+    }
+    lcb_U8 hdr[LCB_OPCAPTURE_HEADER_SIZE] = { 0 };
+    memcpy(hdr, LCB_OPCAPTURE_MAGIC, 8);
+    put_le(hdr + 8, LCB_OPCAPTURE_VERSION, 4);
+    put_le(hdr + 16, wallclock_us(), 8);
+    if (fwrite(hdr, 1, sizeof hdr, fp) != sizeof hdr) {
+        fclose(fp);
+        return NULL;
+    }
+    return new OpCapture(instance, fp, path);
+}
+
+OpCapture::OpCapture(lcb_t instance, FILE *fp_, const char *path)
+    : settings(instance->settings), fp(fp_), filename(path),
+      buf(CAPTURE_BUFSIZE), used(0), opened(gethrtime()),
+      timer(lcbio_timer_new(instance->iotable, this, flush_cb))
+{
+    lcb_settings_ref(settings);
+    lcb_log(LOGARGS(settings, INFO), "Capturing operations to %s", path);
+}
+
+OpCapture::~OpCapture()
+{
+    if (fp) {
+        flush();
+    }
+    if (fp) {
+        fclose(fp);
+    }
+    lcbio_timer_destroy(timer);
+    lcb_settings_unref(settings);
+}
+
+void
+OpCapture::flush_cb(void *arg)
+{
+    OpCapture *capture = reinterpret_cast<OpCapture*>(arg);
+    if (capture->fp) {
+        capture->flush();
+    }
+}
+
+void
+OpCapture::flush()
+{
+    if (used && (fwrite(&buf[0], 1, used, fp) != used || fflush(fp) != 0)) {
+        lcb_log(LOGARGS(settings, ERROR), "Couldn't write to %s. Capture stopped", path());
+        fclose(fp);
+        fp = NULL;
+    }
+    used = 0;
+}
+
+void
+OpCapture::record(const mc_PACKET *req, const MemcachedResponse *res,
+                  lcb_error_t err)
+{
+    if (!fp) {
+        return;
+    }
+
+    protocol_binary_request_header hdr;
+    const void *key;
+    lcb_size_t nkey;
+    mcreq_read_hdr(req, &hdr);
+    mcreq_get_key(req, &key, &nkey);
+
+    hrtime_t start = MCREQ_PKT_RDATA(req)->start;
+    hrtime_t now = gethrtime();
+    lcb_U32 value_size = mcreq_get_bodysize(req) - nkey - hdr.request.extlen;
+    if (value_size == 0 && res) {
+        value_size = res->vallen();
+    }
+    size_t nstored = settings->opcapture_keys ? std::min(nkey, (lcb_size_t)0xffff) : 0;
+
+    if (used + LCB_OPCAPTURE_RECORD_SIZE + nstored > buf.size()) {
+        flush();
+        if (!fp) {
+            return;
+        }
+    }
+
+    lcb_U8 *p = &buf[used];
+    put_le(p, start > opened ? start - opened : 0, 8);
+    put_le(p + 8, now > start ? (now - start) / 1000 : 0, 4);
+    put_le(p + 12, value_size, 4);
+    put_le(p + 16, hash_key(key, nkey), 8);
+    put_le(p + 24, ntohs(hdr.request.vbucket), 2);
+    put_le(p + 26, res ? res->status() : 0, 2);
+    put_le(p + 28, err, 2);
+    p[30] = hdr.request.opcode;
+    p[31] = 0;
+    put_le(p + 32, nstored, 2);
+    if (nstored) {
+        memcpy(p + LCB_OPCAPTURE_RECORD_SIZE, key, nstored);
+    }
+    used += LCB_OPCAPTURE_RECORD_SIZE + nstored;
+    if (!lcbio_timer_armed(timer)) {
+        lcbio_timer_rearm(timer, CAPTURE_FLUSH_INTERVAL);
+    }
+}
@@ -0,0 +1,223 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_OPCAPTURE_H
+#define LCB_OPCAPTURE_H
+
+#include <libcouchbase/couchbase.h>
+#include <lcbio/lcbio.h>
+#include <lcbio/timer-ng.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/**
+ * @file
+ * @brief Capture of the KV operations performed by an instance
+ *
+ * When LCB_CNTL_OPCAPTURE_FILE is set, a record is appended to the file for
+ * every KV response (including operations which failed or timed out) with
+ * the opcode, key hash, value size, vBucket, status and latency of the
+ * operation, and the time at which it was scheduled. The file can be
+ * replayed with `cbc-pillowfight --replay`.
+ *
+ * The file starts with a 32 byte header:
+ *
+ * | Offset | Size | Field                                         |
+ * |--------|------|-----------------------------------------------|
+ * | 0      | 8    | "LCBOPCAP"                                    |
+ * | 8      | 4    | Format version (1)                            |
+ * | 12     | 4    | Reserved                                      |
+ * | 16     | 8    | Time the capture was started, in microseconds |
+ * |        |      | since the epoch                               |
+ * | 24     | 8    | Reserved                                      |
+ *
+ * followed by records, each of which is 34 bytes plus the key (if
+ * LCB_CNTL_OPCAPTURE_KEYS was enabled when it was written):
+ *
+ * | Offset | Size  | Field                                                 |
+ * |--------|-------|-------------------------------------------------------|
+ * | 0      | 8     | Nanoseconds between the start of the capture and the  |
+ * |        |       | scheduling of the operation                           |
+ * | 8      | 4     | Latency, in microseconds                              |
+ * | 12     | 4     | Size of the value sent, or else of the value received |
+ * | 16     | 8     | 64 bit FNV-1a hash of the key                         |
+ * | 24     | 2     | vBucket                                               |
+ * | 26     | 2     | Memcached status of the response                      |
+ * | 28     | 2     | lcb_error_t of a failure detected by the client       |
+ * | 30     | 1     | Opcode                                                |
+ * | 31     | 1     | Reserved                                              |
+ * | 32     | 2     | Length of the key which follows, or 0                 |
+ * | 34     | nkey  | Key                                                   |
+ *
+ * All integers are little endian. Records are written in the order in which
+ * the operations completed, so an operation which took longer than those
+ * scheduled after it appears after them. Readers which need the operations in
+ * the order in which they were scheduled (such as `--replay`) must sort the
+ * records by their scheduling time.
+ */
+
+struct mc_packet_st;
+struct lcb_settings_st;
+
+namespace lcb {
+class MemcachedResponse;
+
+namespace opcapture {
+
+#define LCB_OPCAPTURE_MAGIC "LCBOPCAP"
+#define LCB_OPCAPTURE_VERSION 1
+#define LCB_OPCAPTURE_HEADER_SIZE 32
+#define LCB_OPCAPTURE_RECORD_SIZE 34
+
+struct Record {
+    lcb_U64 start_ns;
+    lcb_U32 latency_us;
+    lcb_U32 value_size;
+    lcb_U64 key_hash;
+    lcb_U16 vbucket;
+    lcb_U16 status;
+    lcb_U16 rc;
+    lcb_U8 opcode;
+    std::string key;
+};
+
+inline lcb_U64 hash_key(const void *key, size_t nkey) {
+    const lcb_U8 *p = static_cast<const lcb_U8*>(key);
+    lcb_U64 h = 14695981039346656037ULL;
+    for (size_t ii = 0; ii < nkey; ii++) {
+        h ^= p[ii];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+inline void put_le(lcb_U8 *p, lcb_U64 v, size_t n) {
+    for (size_t ii = 0; ii < n; ii++) {
+        p[ii] = static_cast<lcb_U8>(v >> (ii * 8));
+    }
+}
+
+inline lcb_U64 get_le(const lcb_U8 *p, size_t n) {
+    lcb_U64 v = 0;
+    for (size_t ii = 0; ii < n; ii++) {
+        v |= static_cast<lcb_U64>(p[ii]) << (ii * 8);
+    }
+    return v;
+}
+
+/** Reads a capture file, one record at a time */
+class Reader {
+public:
+    Reader() : fp(NULL), start_us(0) {}
+    ~Reader() { close(); }
+
+    /** @return an error message, or an empty string if the file was opened */
+    std::string open(const char *path) {
+        close();
+        fp = fopen(path, "rb");
+        if (!fp) {
+            return std::string("Couldn't open ") + path;
+        }
+        lcb_U8 hdr[LCB_OPCAPTURE_HEADER_SIZE];
+        if (fread(hdr, 1, sizeof hdr, fp) != sizeof hdr ||
+                memcmp(hdr, LCB_OPCAPTURE_MAGIC, 8) != 0) {
+            close();
+            return std::string(path) + " is not an operation capture";
+        }
+        if (get_le(hdr + 8, 4) != LCB_OPCAPTURE_VERSION) {
+            close();
+            return std::string(path) + " has an unsupported capture version";
+        }
+        start_us = get_le(hdr + 16, 8);
+        return std::string();
+    }
+
+    /** @return false at the end of the file (or on a truncated record) */
+    bool next(Record& rec) {
+        lcb_U8 buf[LCB_OPCAPTURE_RECORD_SIZE];
+        if (!fp || fread(buf, 1, sizeof buf, fp) != sizeof buf) {
+            return false;
+        }
+        rec.start_ns = get_le(buf, 8);
+        rec.latency_us = static_cast<lcb_U32>(get_le(buf + 8, 4));
+        rec.value_size = static_cast<lcb_U32>(get_le(buf + 12, 4));
+        rec.key_hash = get_le(buf + 16, 8);
+        rec.vbucket = static_cast<lcb_U16>(get_le(buf + 24, 2));
+        rec.status = static_cast<lcb_U16>(get_le(buf + 26, 2));
+        rec.rc = static_cast<lcb_U16>(get_le(buf + 28, 2));
+        rec.opcode = buf[30];
+        size_t nkey = static_cast<size_t>(get_le(buf + 32, 2));
+        rec.key.resize(nkey);
+        if (nkey && fread(&rec.key[0], 1, nkey, fp) != nkey) {
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (fp) {
+            fclose(fp);
+            fp = NULL;
+        }
+    }
+
+    /** Time the capture was started, in microseconds since the epoch */
+    lcb_U64 started() const { return start_us; }
+
+private:
+    Reader(const Reader&);
+    Reader& operator=(const Reader&);
+    FILE *fp;
+    lcb_U64 start_us;
+};
+
+}
+
+class OpCapture {
+public:
+    /**
+     * Create (or truncate) a capture file
+     * @return the capture, or NULL if the file could not be opened
+     */
+    static OpCapture *open(lcb_t instance, const char *path);
+    ~OpCapture();
+
+    /** Append the record for a completed operation */
+    void record(const mc_packet_st *req, const MemcachedResponse *res,
+                lcb_error_t err);
+
+    const char *path() const { return filename.c_str(); }
+
+private:
+    OpCapture(lcb_t instance, FILE *fp, const char *path);
+    void flush();
+    static void flush_cb(void *arg);
+
+    lcb_settings_st *settings;
+    FILE *fp;
+    std::string filename;
+    std::vector<lcb_U8> buf;
+    size_t used;
+    lcb_U64 opened;
+    /** Flushes buffered records, armed when the buffer is no longer empty */
+    lcbio_pTIMER timer;
+};
+
+}
+#endif
@@ -19,14 +19,103 @@
 #include "internal.h"
 #include <libcouchbase/api3.h>
 #include "durability_internal.h"
+#include <lcbio/timer-ng.h>
+#include <algorithm>
+#include <map>
+#include <set>
 
 using namespace lcb::durability;
 
+/* Shortest interval between two polls of the same durability request */
+#define MIN_POLL_INTERVAL LCB_MS2US(1)
+
+namespace lcb {
+namespace durability {
+
+/**
+ * Coalesces OBSERVE_SEQNO probes from all seqno-based durability requests on
+ * the instance. Since the response to OBSERVE_SEQNO describes the state of an
+ * entire vBucket on a given server, only a single probe per (vBucket, UUID,
+ * server) needs to be sent for any number of items.
+ *
+ * Probes requested within the same event loop iteration are gathered and
+ * sent together on the next iteration.
+ *
+ * The poller also tracks how long it takes items to satisfy their
+ * durability requirements so that requests are not polled much sooner (or
+ * later) than they are likely to complete.
+ */
+class SeqnoPoller {
+public:
+    struct Probe : CallbackCookie {
+        SeqnoPoller *parent;
+        lcb_U64 uuid;
+        lcb_U16 vbid;
+        lcb_U16 server_index;
+        std::vector<Item*> items;
+    };
+
+    static SeqnoPoller *get(lcb_t instance) {
+        if (!instance->dur_poller) {
+            instance->dur_poller = new SeqnoPoller(instance);
+        }
+        return instance->dur_poller;
+    }
+
+    SeqnoPoller(lcb_t instance_)
+        : instance(instance_),
+          timer(lcbio_timer_new(instance_->iotable, this, flush_cb)),
+          lat_avg(0), lat_dev(0) {
+    }
+
+    ~SeqnoPoller();
+
+    /**
+     * Request that the item's vBucket be checked on the given server.
+     * The item's parent is expected to account for this in its
+     * `waiting` counter.
+     */
+    void add(Item *item, lcb_U16 server_index);
+
+    /** Send all pending probes */
+    void flush();
+
+    /** Invoked when a probe's response has been received */
+    void complete(Probe *probe, const lcb_RESPOBSEQNO *resp);
+
+    /** Record the time it took for an item to be satisfied */
+    void record_latency(hrtime_t latency);
+
+    /**
+     * Return the time after which most items are likely to be satisfied,
+     * or 0 if there is no data yet
+     */
+    hrtime_t expected_latency() const {
+        return lat_avg > lat_dev ? lat_avg - lat_dev : lat_avg;
+    }
+
+private:
+    typedef std::pair<std::pair<lcb_U64, lcb_U16>, lcb_U16> ProbeKey;
+    static void flush_cb(void *arg) {
+        reinterpret_cast<SeqnoPoller*>(arg)->flush();
+    }
+
+    lcb_t instance;
+    lcbio_pTIMER timer;
+    std::map<ProbeKey, Probe*> pending; /**< Probes not yet sent */
+    std::set<Probe*> inflight; /**< Probes awaiting a response */
+    hrtime_t lat_avg; /**< Smoothed time for items to be satisfied */
+    hrtime_t lat_dev; /**< Smoothed deviation of lat_avg */
+};
+}
+}
+
 namespace {
 class SeqnoDurset : public Durset {
 public:
     SeqnoDurset(lcb_t instance_, const lcb_durability_opts_t *options)
-        : Durset(instance_, options) {
+        : Durset(instance_, options), ns_start(0),
+          cur_interval(std::min<lcb_U32>(MIN_POLL_INTERVAL, opts.interval)) {
     }
 
     // Override
@@ -35,7 +124,17 @@ public:
     // Override
     lcb_error_t after_add(Item& item, const lcb_CMDENDURE *cmd);
 
-    void update(const lcb_RESPOBSEQNO *resp);
+    // Override
+    lcb_error_t prepare_schedule() {
+        ns_start = gethrtime();
+        return LCB_SUCCESS;
+    }
+
+    // Override
+    lcb_U32 poll_interval();
+
+    hrtime_t ns_start; /**< Time the request was scheduled */
+    lcb_U32 cur_interval; /**< Current (backed-off) poll interval */
 };
 }
 
@@ -47,11 +146,12 @@ Durset::createSeqnoDurset(lcb_t instance, const lcb_durability_opts_t *options)
 #define ENT_SEQNO(ent) (ent)->reqseqno
 
 static void
-seqno_callback(lcb_t, int, const lcb_RESPBASE *rb)
+update_item(Item *ent, const lcb_RESPOBSEQNO *resp)
 {
-    const lcb_RESPOBSEQNO *resp = (const lcb_RESPOBSEQNO*)rb;
     int flags = 0;
-    Item *ent = static_cast<Item*>(reinterpret_cast<CallbackCookie*>(resp->cookie));
+    Durset *dset = ent->parent;
+    SeqnoDurset *sdset = static_cast<SeqnoDurset*>(dset);
+    bool was_done = ent->done;
 
     /* Now, process the response */
     if (resp->rc != LCB_SUCCESS) {
@@ -82,57 +182,173 @@ seqno_callback(lcb_t, int, const lcb_RESPBASE *rb)
     }
 
     ent->update(flags, resp->server_index);
+    if (!was_done && ent->done && ent->res().rc == LCB_SUCCESS) {
+        SeqnoPoller::get(dset->instance)->record_latency(
+            gethrtime() - sdset->ns_start);
+    }
 
     GT_TALLY:
-    if (!--ent->parent->waiting) {
+    if (!--dset->waiting) {
         /* avoid ssertion (wait==0)! */
-        ent->parent->waiting = 1;
-        ent->parent->on_poll_done();
+        dset->waiting = 1;
+        dset->on_poll_done();
+    }
+}
+
+static void
+probe_callback(lcb_t, int, const lcb_RESPBASE *rb)
+{
+    const lcb_RESPOBSEQNO *resp = (const lcb_RESPOBSEQNO*)rb;
+    SeqnoPoller::Probe *probe = static_cast<SeqnoPoller::Probe*>(
+        reinterpret_cast<CallbackCookie*>(resp->cookie));
+    probe->parent->complete(probe, resp);
+}
+
+void
+SeqnoPoller::add(Item *item, lcb_U16 server_index)
+{
+    ProbeKey key(std::make_pair(item->uuid, item->vbid), server_index);
+    Probe*& probe = pending[key];
+    if (probe == NULL) {
+        probe = new Probe();
+        probe->parent = this;
+        probe->uuid = item->uuid;
+        probe->vbid = item->vbid;
+        probe->server_index = server_index;
+        probe->callback = probe_callback;
+    }
+    probe->items.push_back(item);
+    if (!lcbio_timer_armed(timer)) {
+        lcbio_async_signal(timer);
+    }
+}
+
+void
+SeqnoPoller::flush()
+{
+    std::vector<std::pair<Probe*, lcb_error_t> > failed;
+    std::map<ProbeKey, Probe*>::iterator it;
+
+    lcb_sched_enter(instance);
+    for (it = pending.begin(); it != pending.end(); ++it) {
+        Probe *probe = it->second;
+        lcb_CMDOBSEQNO cmd = { 0 };
+        cmd.uuid = probe->uuid;
+        cmd.vbid = probe->vbid;
+        cmd.server_index = probe->server_index;
+        cmd.cmdflags = LCB_CMD_F_INTERNAL_CALLBACK;
+
+        lcb_error_t err = lcb_observe_seqno3(instance, &probe->callback, &cmd);
+        if (err == LCB_SUCCESS) {
+            inflight.insert(probe);
+        } else {
+            failed.push_back(std::make_pair(probe, err));
+        }
+    }
+    pending.clear();
+    lcb_sched_leave(instance);
+
+    /* Deliver any scheduling errors only after leaving the scheduling
+     * context, since these may invoke user callbacks */
+    for (size_t ii = 0; ii < failed.size(); ii++) {
+        lcb_RESPOBSEQNO resp = { 0 };
+        Probe *probe = failed[ii].first;
+        resp.rc = failed[ii].second;
+        resp.server_index = probe->server_index;
+        resp.vbid = probe->vbid;
+        inflight.insert(probe);
+        complete(probe, &resp);
+    }
+}
+
+void
+SeqnoPoller::complete(Probe *probe, const lcb_RESPOBSEQNO *resp)
+{
+    inflight.erase(probe);
+    for (size_t ii = 0; ii < probe->items.size(); ii++) {
+        update_item(probe->items[ii], resp);
+    }
+    delete probe;
+}
+
+void
+SeqnoPoller::record_latency(hrtime_t latency)
+{
+    if (lat_avg == 0) {
+        lat_avg = latency;
+        lat_dev = latency / 2;
+    } else {
+        hrtime_t diff = latency > lat_avg ? latency - lat_avg : lat_avg - latency;
+        lat_dev = (lat_dev * 3 + diff) / 4;
+        lat_avg = (lat_avg * 7 + latency) / 8;
     }
 }
 
+SeqnoPoller::~SeqnoPoller()
+{
+    std::map<ProbeKey, Probe*>::iterator it;
+    for (it = pending.begin(); it != pending.end(); ++it) {
+        delete it->second;
+    }
+    std::set<Probe*>::iterator sit;
+    for (sit = inflight.begin(); sit != inflight.end(); ++sit) {
+        delete *sit;
+    }
+    lcbio_timer_destroy(timer);
+}
+
+void lcbdur_poller_destroy(void *poller)
+{
+    delete reinterpret_cast<SeqnoPoller*>(poller);
+}
+
 lcb_error_t
 SeqnoDurset::poll_impl()
 {
-    lcb_error_t ret_err = LCB_EINTERNAL; /* This should never be returned */
     bool has_ops = false;
+    SeqnoPoller *poller = SeqnoPoller::get(instance);
 
-    lcb_sched_enter(instance);
     for (size_t ii = 0; ii < entries.size(); ii++) {
         Item& ent = entries[ii];
         lcb_U16 servers[4];
-        lcb_CMDOBSEQNO cmd = { 0 };
 
         if (ent.done) {
             continue;
         }
 
-        cmd.uuid = ent.uuid;
-        cmd.vbid = ent.vbid;
-        cmd.cmdflags = LCB_CMD_F_INTERNAL_CALLBACK;
-        ent.callback = seqno_callback;
-
         size_t nservers = ent.prepare(servers);
         for (size_t jj = 0; jj < nservers; jj++) {
-            lcb_error_t err;
-            cmd.server_index = servers[jj];
-            err = lcb_observe_seqno3(instance, &ent.callback, &cmd);
-            if (err == LCB_SUCCESS) {
-                waiting++;
-                has_ops = true;
-            } else {
-                ent.res().rc = ret_err = err;
-            }
+            poller->add(&ent, servers[jj]);
+            waiting++;
+            has_ops = true;
         }
     }
-    lcb_sched_leave(instance);
     if (!has_ops) {
-        return ret_err;
+        return LCB_EINTERNAL; /* This should never be returned */
     } else {
         return LCB_SUCCESS;
     }
 }
 
+/**
+ * Polls start out at a short interval which doubles after every sweep, up
+ * to the interval specified in the options. If we know how long it usually
+ * takes for items to be persisted/replicated, don't poll before then.
+ */
+lcb_U32
+SeqnoDurset::poll_interval()
+{
+    lcb_U32 interval = cur_interval;
+    cur_interval = std::min(cur_interval * 2, opts.interval);
+
+    hrtime_t expected = SeqnoPoller::get(instance)->expected_latency();
+    hrtime_t now = gethrtime();
+    if (expected && ns_start + expected > now) {
+        interval = std::max(interval, LCB_NS2US(ns_start + expected - now));
+    }
+    return std::min(interval, opts.interval);
+}
+
 lcb_error_t
 SeqnoDurset::after_add(Item &item, const lcb_CMDENDURE *cmd)
 {
@@ -627,8 +627,9 @@ Durset::switch_state(State state)
             delay = 0;
         }
     } else if (state == STATE_OBSPOLL) {
-        if (now + LCB_US2NS(opts.interval) < ns_timeout) {
-            delay = opts.interval;
+        lcb_U32 interval = poll_interval();
+        if (now + LCB_US2NS(interval) < ns_timeout) {
+            delay = interval;
         } else {
             delay = 0;
             state = STATE_TIMEOUT;
@@ -47,6 +47,9 @@ void lcbdurctx_set_durstore(lcb_MULTICMD_CTX *ctx, int enabled);
 
 void lcbdur_destroy(void *dset);
 
+/** Destroys the instance-wide OBSERVE_SEQNO poller, if it was created */
+void lcbdur_poller_destroy(void *poller);
+
 /** Called from durability-cas to request an OBSERVE with a special callback */
 lcb_MULTICMD_CTX *lcb_observe_ctx_dur_new(lcb_t instance);
 
@@ -246,6 +249,14 @@ struct Durset : public MultiCmdContext {
      */
     virtual lcb_error_t poll_impl() = 0;
 
+    /**
+     * Returns the amount of time (in microseconds) to wait before the next
+     * poll. By default this is the interval specified in the options.
+     */
+    virtual lcb_U32 poll_interval() {
+        return opts.interval;
+    }
+
     virtual ~Durset();
     Durset(lcb_t instance, const lcb_durability_opts_t* options);
 
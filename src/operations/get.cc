@@ -17,6 +17,181 @@
 
 #include "internal.h"
 #include "trace.h"
+#include "nearcache.h"
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+namespace lcb {
+struct CoalescedGet;
+
+/**
+ * Plain GETs currently in flight, by key. Only used when
+ * LCB_CNTL_GET_COALESCE is enabled
+ */
+struct GetCoalescer {
+    GetCoalescer() : nrequests(0), ncoalesced(0) {}
+    std::map<std::string, CoalescedGet*> inflight;
+    /** Requests with waiters attached in the current scheduling context */
+    std::vector<CoalescedGet*> ctxleaders;
+    lcb_U64 nrequests;
+    lcb_U64 ncoalesced;
+};
+
+/**
+ * Request data for a GET which other GETs for the same key may attach to.
+ * The response is delivered to the original cookie first, and then to each
+ * of the waiters in the order in which they were scheduled.
+ */
+struct CoalescedGet : mc_REQDATAEX {
+    CoalescedGet(const void *cookie, lcb_t instance, const std::string& key,
+                 const mc_PIPELINE *pipeline, int vbid);
+
+    /** Stop accepting waiters. Safe to call more than once */
+    void detach() {
+        GetCoalescer *gc = instance->get_coalescer;
+        if (!gc) {
+            return;
+        }
+        std::map<std::string, CoalescedGet*>::iterator it = gc->inflight.find(key);
+        if (it != gc->inflight.end() && it->second == this) {
+            gc->inflight.erase(it);
+        }
+        if (ncommitted != waiters.size()) {
+            /* Waiters of the current context are delivered with the rest */
+            ncommitted = waiters.size();
+            gc->ctxleaders.erase(std::find(
+                gc->ctxleaders.begin(), gc->ctxleaders.end(), this));
+        }
+    }
+
+    lcb_t instance;
+    std::string key;
+    const mc_PIPELINE *pipeline;
+    int vbid;
+    std::vector<const void*> waiters;
+    /** Number of waiters whose scheduling context was left successfully */
+    size_t ncommitted;
+};
+}
+
+using lcb::CoalescedGet;
+using lcb::GetCoalescer;
+
+static void coalesced_dtor(mc_PACKET *pkt) {
+    CoalescedGet *cg = static_cast<CoalescedGet*>(pkt->u_rdata.exdata);
+    cg->detach();
+    delete cg;
+}
+
+static void
+coalesced_callback(mc_PIPELINE *, mc_PACKET *pkt, lcb_error_t, const void *arg)
+{
+    CoalescedGet *cg = static_cast<CoalescedGet*>(pkt->u_rdata.exdata);
+    lcb_RESPGET *resp = reinterpret_cast<lcb_RESPGET*>(const_cast<void*>(arg));
+    lcb_t instance = cg->instance;
+
+    /* A GET issued from within one of the callbacks must not attach to a
+     * request whose response has already been received */
+    cg->detach();
+
+    if (!(pkt->flags & MCREQ_F_INVOKED)) {
+        resp->cookie = const_cast<void*>(cg->cookie);
+        lcb_find_callback(instance, LCB_CALLBACK_GET)(
+            instance, LCB_CALLBACK_GET, (const lcb_RESPBASE *)resp);
+        for (size_t ii = 0; ii < cg->waiters.size(); ++ii) {
+            resp->cookie = const_cast<void*>(cg->waiters[ii]);
+            lcb_find_callback(instance, LCB_CALLBACK_GET)(
+                instance, LCB_CALLBACK_GET, (const lcb_RESPBASE *)resp);
+        }
+    }
+    delete cg;
+}
+
+static mc_REQDATAPROCS coalesced_procs = {
+        coalesced_callback,
+        coalesced_dtor
+};
+
+CoalescedGet::CoalescedGet(const void *cookie_, lcb_t instance_,
+    const std::string& key_, const mc_PIPELINE *pipeline_, int vbid_)
+    : mc_REQDATAEX(cookie_, coalesced_procs, gethrtime()),
+      instance(instance_), key(key_), pipeline(pipeline_), vbid(vbid_),
+      ncommitted(0) {
+}
+
+/**
+ * Attach the GET to a request for the same key which is already in flight
+ * to the same server.
+ * @return true if the GET was attached and must not be sent
+ */
+static bool
+coalesce_get(lcb_t instance, const void *cookie, const lcb_CMDGET *cmd,
+             const std::string& key)
+{
+    GetCoalescer *gc = instance->get_coalescer;
+    if (!gc) {
+        return false;
+    }
+    std::map<std::string, CoalescedGet*>::iterator it = gc->inflight.find(key);
+    if (it == gc->inflight.end()) {
+        return false;
+    }
+
+    CoalescedGet *leader = it->second;
+    mc_CMDQUEUE *cq = &instance->cmdq;
+    int vbid, srvix;
+    mcreq_map_key(cq, &cmd->key, &cmd->_hashkey, MCREQ_PKT_BASESIZE,
+        &vbid, &srvix);
+    if (vbid != leader->vbid || srvix < 0 || srvix >= (int)cq->npipelines ||
+            cq->pipelines[srvix] != leader->pipeline) {
+        return false;
+    }
+
+    if (instance->cmdq.ctxenter && leader->ncommitted == leader->waiters.size()) {
+        gc->ctxleaders.push_back(leader);
+    }
+    leader->waiters.push_back(cookie);
+    if (!instance->cmdq.ctxenter) {
+        leader->ncommitted++;
+    }
+    gc->ncoalesced++;
+    return true;
+}
+
+void
+lcb_getcoalescer_ctxdone(lcb_GETCOALESCER *gc, int success)
+{
+    for (size_t ii = 0; ii < gc->ctxleaders.size(); ii++) {
+        CoalescedGet *leader = gc->ctxleaders[ii];
+        if (!success) {
+            gc->ncoalesced -= leader->waiters.size() - leader->ncommitted;
+            leader->waiters.resize(leader->ncommitted);
+        }
+        leader->ncommitted = leader->waiters.size();
+    }
+    gc->ctxleaders.clear();
+}
+
+void
+lcb_getcoalescer_destroy(lcb_GETCOALESCER *gc)
+{
+    /* Requests still in flight free themselves once they complete */
+    delete gc;
+}
+
+void
+lcb_getcoalescer_stats(lcb_t instance, lcb_cntl_coalescestats *stats)
+{
+    GetCoalescer *gc = instance->get_coalescer;
+    if (gc) {
+        stats->requests = gc->nrequests;
+        stats->coalesced = gc->ncoalesced;
+    } else {
+        memset(stats, 0, sizeof(*stats));
+    }
+}
 
 LIBCOUCHBASE_API
 lcb_error_t
@@ -31,6 +206,8 @@ lcb_get3(lcb_t instance, const void *cookie, const lcb_CMDGET *cmd)
     lcb_uint8_t opcode = PROTOCOL_BINARY_CMD_GET;
     protocol_binary_request_gat gcmd;
     protocol_binary_request_header *hdr = &gcmd.message.header;
+    bool coalesce;
+    std::string ckey;
 
     if (LCB_KEYBUF_IS_EMPTY(&cmd->key)) {
         return LCB_EMPTY_KEY;
@@ -47,15 +224,50 @@ lcb_get3(lcb_t instance, const void *cookie, const lcb_CMDGET *cmd)
         opcode = PROTOCOL_BINARY_CMD_GAT;
     }
 
+    if (opcode == PROTOCOL_BINARY_CMD_GET &&
+            (cmd->cmdflags & (LCB_CMD_F_INTERNAL_CALLBACK|LCB_CMDGET_F_NOCACHE)) == 0) {
+        if (!instance->near_cache && LCBT_SETTING(instance, near_cache_size)) {
+            instance->near_cache = new lcb::NearCache(instance);
+        }
+        if (instance->near_cache && instance->near_cache->get(cookie, cmd)) {
+            return LCB_SUCCESS;
+        }
+    }
+
+    /* Only plain GETs delivered to the user's callback are shared */
+    coalesce = LCBT_SETTING(instance, get_coalesce) &&
+            opcode == PROTOCOL_BINARY_CMD_GET &&
+            (cmd->cmdflags & LCB_CMD_F_INTERNAL_CALLBACK) == 0 &&
+            q->config != NULL;
+    if (coalesce) {
+        ckey.assign(static_cast<const char *>(cmd->key.contig.bytes),
+            cmd->key.contig.nbytes);
+        if (coalesce_get(instance, cookie, cmd, ckey)) {
+            return LCB_SUCCESS;
+        }
+    }
+
     err = mcreq_basic_packet(q, (const lcb_CMDBASE *)cmd, hdr, extlen, &pkt, &pl,
         MCREQ_BASICPACKET_F_FALLBACKOK);
     if (err != LCB_SUCCESS) {
         return err;
     }
 
-    rdata = &pkt->u_rdata.reqdata;
-    rdata->cookie = cookie;
-    rdata->start = gethrtime();
+    if (coalesce) {
+        if (!instance->get_coalescer) {
+            instance->get_coalescer = new GetCoalescer();
+        }
+        CoalescedGet *cg = new CoalescedGet(cookie, instance, ckey, pl,
+            ntohs(hdr->request.vbucket));
+        pkt->u_rdata.exdata = cg;
+        pkt->flags |= MCREQ_F_REQEXT;
+        instance->get_coalescer->inflight[ckey] = cg;
+        instance->get_coalescer->nrequests++;
+    } else {
+        rdata = &pkt->u_rdata.reqdata;
+        rdata->cookie = cookie;
+        rdata->start = gethrtime();
+    }
 
     hdr->request.magic = PROTOCOL_BINARY_REQ;
     hdr->request.opcode = opcode;
@@ -19,6 +19,7 @@
 #include "durability_internal.h"
 #include "trace.h"
 #include "mctx-helper.h"
+#include "nearcache.h"
 
 struct ObserveCtx : mc_REQDATAEX, lcb::MultiCmdContext {
     void clear_requests() { requests.clear(); }
@@ -42,7 +43,8 @@ struct ObserveCtx : mc_REQDATAEX, lcb::MultiCmdContext {
 typedef enum {
     F_DURABILITY = 0x01,
     F_DESTROY = 0x02,
-    F_SCHEDFAILED = 0x04
+    F_SCHEDFAILED = 0x04,
+    F_NEARCACHE = 0x08
 } obs_flags;
 
 // TODO: Move this to a common file
@@ -97,6 +99,12 @@ handle_observe_callback(mc_PIPELINE *pl,
         resp->ttp = pl ? pl->index : -1;
         lcbdur_cas_update(instance, (void*)MCREQ_PKT_COOKIE(pkt), err, resp);
 
+    } else if (oc->oflags & F_NEARCACHE) {
+        /* The final response is still needed to release the cookie */
+        if ((oc->oflags & F_SCHEDFAILED) == 0 || (resp->rflags & LCB_RESP_F_FINAL)) {
+            lcb_nearcache_revalidated(instance, MCREQ_PKT_COOKIE(pkt), resp);
+        }
+
     } else if ((oc->oflags & F_SCHEDFAILED) == 0) {
         lcb_RESPCALLBACK callback = lcb_find_callback(instance, LCB_CALLBACK_OBSERVE);
         callback(instance, LCB_CALLBACK_OBSERVE, (lcb_RESPBASE *)resp);
@@ -277,6 +285,13 @@ lcb_observe_ctx_dur_new(lcb_t instance) {
     return ctx;
 }
 
+lcb_MULTICMD_CTX *
+lcb_observe_ctx_nearcache_new(lcb_t instance) {
+    ObserveCtx *ctx = new ObserveCtx(instance);
+    ctx->oflags |= F_NEARCACHE;
+    return ctx;
+}
+
 LIBCOUCHBASE_API
 lcb_error_t lcb_observe(lcb_t instance,
     const void *command_cookie, lcb_size_t num,
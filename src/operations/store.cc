@@ -17,6 +17,7 @@
 #include "internal.h"
 #include "mc/compress.h"
 #include "trace.h"
+#include "metrics.h"
 #include "durability_internal.h"
 
 struct DurStoreCtx : mc_REQDATAEX {
@@ -250,6 +251,8 @@ do_store3(lcb_t instance, const void *cookie,
             mcreq_release_packet(pipeline, packet);
             return LCB_CLIENT_ENOMEM;
         }
+        instance->metrics->compress_input += vbuf->u_buf.contig.nbytes;
+        instance->metrics->compress_output += packet->u_value.single.size;
     } else {
         mcreq_reserve_value(pipeline, packet, vbuf);
     }
@@ -21,6 +21,8 @@
 #include "logging.h"
 #include "internal.h"
 #include "bucketconfig/clconfig.h"
+#include "trace.h"
+#include "metrics.h"
 
 #define LOGARGS(rq, lvl) (rq)->settings, "retryq", LCB_LOG_##lvl, __FILE__, __LINE__
 #define RETRY_PKT_KEY "retry_queue"
@@ -335,7 +337,9 @@ RetryQueue::add(mc_EXPACKET *pkt, const lcb_error_t err,
 
     op->pkt = &pkt->base;
     pkt->base.retries++;
+    get_instance()->metrics->retries++;
     assign_error(op, err);
+    TRACE_RETRY(&pkt->base, err);
     if (options & RETRY_SCHED_IMM) {
         op->trytime = gethrtime(); /* now */
     } else if (err == LCB_NOT_MY_VBUCKET) {
@@ -373,6 +377,17 @@ void RetryQueue::add_fallback(mc_PACKET *pkt) {
     add((mc_EXPACKET*)copy, LCB_NO_MATCHING_SERVER, NULL, RETRY_SCHED_IMM);
 }
 
+size_t
+RetryQueue::size() const
+{
+    size_t n = 0;
+    lcb_list_t *ll;
+    LCB_LIST_FOR(ll, const_cast<lcb_list_t*>(&schedops)) {
+        n++;
+    }
+    return n;
+}
+
 void
 RetryQueue::reset_timeouts(lcb_U64 now)
 {
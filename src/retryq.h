@@ -119,6 +119,12 @@ public:
      */
     bool empty() const { return LCB_LIST_IS_EMPTY(&schedops); }
 
+    /**
+     * @brief Count the operations waiting to be retried. This walks the
+     * queue, and is meant for statistics.
+     */
+    size_t size() const;
+
     /**
      * @brief Reset all timeouts on the retry queue.
      *
@@ -22,6 +22,8 @@
 LCB_INTERNAL_API
 void lcb_default_settings(lcb_settings *settings)
 {
+    unsigned ii;
+
     settings->ipv6 = LCB_IPV6_DISABLED;
     settings->operation_timeout = LCB_DEFAULT_TIMEOUT;
     settings->config_timeout = LCB_DEFAULT_CONFIGURATION_TIMEOUT;
@@ -60,6 +62,27 @@ void lcb_default_settings(lcb_settings *settings)
     settings->select_bucket = LCB_DEFAULT_SELECT_BUCKET;
     settings->tcp_keepalive = LCB_DEFAULT_TCP_KEEPALIVE;
     settings->send_hello = 1;
+    settings->ssl_ktls = 0;
+    settings->get_coalesce = 0;
+    settings->near_cache_revalidate = 0;
+    settings->near_cache_size = 0;
+    settings->near_cache_ttl = LCB_DEFAULT_NEAR_CACHE_TTL;
+    settings->autocork = 0;
+    settings->opcapture_keys = 0;
+    settings->optimistic_negotiation = 0;
+    settings->kv_preconnect = 0;
+    settings->autocork_window = 0;
+    settings->zerocopy_threshold = 0;
+    settings->slowop_count = 0;
+    settings->slowop_threshold = 0;
+    settings->slowop_interval = LCB_DEFAULT_SLOWOP_INTERVAL;
+    settings->views_docs_window = LCB_DEFAULT_VIEWS_DOCS_WINDOW;
+    settings->dns_cache_ttl = LCB_DEFAULT_DNS_CACHE_TTL;
+    settings->dns_negative_ttl = LCB_DEFAULT_DNS_NEGATIVE_TTL;
+    settings->connect_attempt_delay = LCB_DEFAULT_CONNECT_ATTEMPT_DELAY;
+    for (ii = 0; ii < LCB_HTTP_TYPE_MAX; ii++) {
+        settings->http_svc_poolsize[ii] = LCB_HTTPPOOL_INHERIT;
+    }
 }
 
 LCB_INTERNAL_API
@@ -88,6 +111,7 @@ lcb_settings_unref(lcb_settings *settings)
 
     lcbauth_unref(settings->auth);
     lcb_errmap_free(settings->errmap);
+    lcb_sesscache_free(settings->sesscache);
 
     if (settings->ssl_ctx) {
         lcbio_ssl_free(settings->ssl_ctx);
@@ -86,11 +86,27 @@
 #define LCB_DEFAULT_TCP_NODELAY 1
 #define LCB_DEFAULT_SELECT_BUCKET 1
 #define LCB_DEFAULT_TCP_KEEPALIVE 1
+#define LCB_DEFAULT_VIEWS_DOCS_WINDOW 128
+#define LCB_DEFAULT_HTTP_POOL_PROBE_INTERVAL LCB_MS2US(2000)
+#define LCB_DEFAULT_DNS_CACHE_TTL LCB_MS2US(30000)
+#define LCB_DEFAULT_DNS_NEGATIVE_TTL LCB_MS2US(2000)
+#define LCB_DEFAULT_CONNECT_ATTEMPT_DELAY LCB_MS2US(250)
+#define LCB_DEFAULT_NEAR_CACHE_TTL LCB_MS2US(500)
+#define LCB_DEFAULT_SLOWOP_INTERVAL LCB_MS2US(10000)
 
 #include "config.h"
 #include <libcouchbase/couchbase.h>
 #include "errmap.h"
 
+#ifdef __cplusplus
+namespace lcb {
+class SessionCache;
+}
+typedef lcb::SessionCache* lcb_pSESSCACHE;
+#else
+typedef struct lcb_SESSCACHE* lcb_pSESSCACHE;
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -158,6 +174,20 @@ typedef struct lcb_settings_st {
     unsigned select_bucket : 1;
     unsigned tcp_keepalive : 1;
     unsigned send_hello : 1;
+    /** Whether to offload TLS record encryption to the kernel */
+    unsigned ssl_ktls : 1;
+    /** Whether concurrent GETs for the same key share a single request */
+    unsigned get_coalesce : 1;
+    /** Whether expired near cache entries are revalidated using their CAS */
+    unsigned near_cache_revalidate : 1;
+    /** Whether flushes are deferred to the end of the loop iteration */
+    unsigned autocork : 1;
+    /** Whether operation captures include the keys, rather than only their hashes */
+    unsigned opcapture_keys : 1;
+    /** Whether negotiation is pipelined using the results of earlier ones */
+    unsigned optimistic_negotiation : 1;
+    /** Whether all data nodes are connected to before they are used */
+    unsigned kv_preconnect : 1;
 
     short max_redir;
     unsigned refcount;
@@ -176,7 +206,43 @@ typedef struct lcb_settings_st {
     void *dtorarg;
     char *client_string;
     lcb_pERRMAP errmap;
+    /** Results of earlier negotiations, if optimistic_negotiation is set */
+    lcb_pSESSCACHE sesscache;
     lcb_U32 retry_nmv_interval;
+
+    /** Upper bound for concurrent include_docs fetches in view queries */
+    lcb_U32 views_docs_window;
+
+    /** Per-service idle HTTP socket quota, or LCB_HTTPPOOL_INHERIT */
+    lcb_U16 http_svc_poolsize[LCB_HTTP_TYPE_MAX];
+
+    /** Per-service number of HTTP sockets to open to newly added nodes */
+    lcb_U16 http_preconnect[LCB_HTTP_TYPE_MAX];
+
+    /** How long successful and failed hostname lookups may be reused */
+    lcb_U32 dns_cache_ttl;
+    lcb_U32 dns_negative_ttl;
+
+    /** Delay before racing the next address when connecting. 0 disables */
+    lcb_U32 connect_attempt_delay;
+
+    /** Byte limit for the near cache. 0 disables */
+    lcb_SIZE near_cache_size;
+    /** How long near cache entries remain valid */
+    lcb_U32 near_cache_ttl;
+
+    /** How long flushes are deferred for, if autocork is set */
+    lcb_U32 autocork_window;
+
+    /** Minimum buffer size sent with MSG_ZEROCOPY. 0 disables */
+    lcb_SIZE zerocopy_threshold;
+
+    /** Number of slow operations kept per opcode. 0 disables */
+    lcb_U32 slowop_count;
+    /** Latency above which operations are considered slow */
+    lcb_U32 slowop_threshold;
+    /** How often the slowest operations are logged */
+    lcb_U32 slowop_interval;
 } lcb_settings;
 
 LCB_INTERNAL_API
@@ -190,6 +256,9 @@ LCB_INTERNAL_API
 void
 lcb_settings_unref(lcb_settings *);
 
+void
+lcb_sesscache_free(lcb_pSESSCACHE);
+
 #define lcb_settings_ref(settings) ((void)(settings)->refcount++)
 #define lcb_settings_ref2(settings) ((settings)->refcount++, settings)
 
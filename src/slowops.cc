@@ -0,0 +1,278 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "slowops.h"
+#include "opcapture.h"
+#include "packetutils.h"
+#include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
+#include <algorithm>
+#include <stdio.h>
+
+#define LOGARGS(instance, lvl) (instance)->settings, "slowops", LCB_LOG_##lvl, __FILE__, __LINE__
+
+/* Number of in-flight operations whose phases can be tracked. A power of two */
+#define SLOWOP_RING_SIZE 4096
+
+using namespace lcb;
+
+static void
+trace_cb(mc_CMDQUEUE *cq, const mc_PACKET *pkt, mcreq_TRACEEVENT event)
+{
+    SlowOpTracer *tracer = reinterpret_cast<lcb_t>(cq->cqdata)->slowops;
+    if (event == MCREQ_TRACE_ENQUEUED) {
+        tracer->enqueued(pkt);
+    } else {
+        tracer->flushed(pkt);
+    }
+}
+
+static void
+report_cb(void *arg)
+{
+    reinterpret_cast<SlowOpTracer*>(arg)->report();
+}
+
+SlowOpTracer::SlowOpTracer(lcb_t instance_)
+    : instance(instance_), ring(SLOWOP_RING_SIZE)
+{
+    memset(&ring[0], 0, sizeof(Phases) * ring.size());
+    memset(nslow, 0, sizeof nslow);
+    timer = lcbio_timer_new(instance->iotable, this, report_cb);
+    instance->cmdq.trace = trace_cb;
+}
+
+SlowOpTracer::~SlowOpTracer()
+{
+    report();
+    instance->cmdq.trace = NULL;
+    lcbio_timer_destroy(timer);
+}
+
+void
+SlowOpTracer::enqueued(const mc_PACKET *pkt)
+{
+    Phases& ph = ring[pkt->opaque & (ring.size() - 1)];
+    if (ph.opaque != pkt->opaque) {
+        // Otherwise this is a retry, which keeps the decisions made so far
+        ph.opaque = pkt->opaque;
+        ph.decisions = 0;
+    }
+    ph.enqueued = gethrtime();
+    ph.flushed = 0;
+    ph.header = 0;
+    ph.dispatched = 0;
+}
+
+void
+SlowOpTracer::flushed(const mc_PACKET *pkt)
+{
+    Phases& ph = ring[pkt->opaque & (ring.size() - 1)];
+    if (ph.opaque == pkt->opaque && ph.flushed == 0) {
+        ph.flushed = gethrtime();
+    }
+}
+
+void
+SlowOpTracer::decided(const mc_PACKET *pkt, int decision)
+{
+    Phases& ph = ring[pkt->opaque & (ring.size() - 1)];
+    if (ph.opaque == pkt->opaque) {
+        ph.decisions |= decision;
+    }
+}
+
+void
+SlowOpTracer::completed(mc_PIPELINE *pipeline, const mc_PACKET *pkt,
+                        const MemcachedResponse *res, lcb_error_t err)
+{
+    hrtime_t now = gethrtime();
+    hrtime_t start = MCREQ_PKT_RDATA(pkt)->start;
+    hrtime_t threshold = LCB_US2NS(LCBT_SETTING(instance, slowop_threshold));
+    if (now - start < threshold) {
+        return;
+    }
+
+    protocol_binary_request_header hdr;
+    mcreq_read_hdr(pkt, &hdr);
+    std::vector<Record>& slow = slowest[hdr.request.opcode];
+    size_t limit = LCBT_SETTING(instance, slowop_count);
+    nslow[hdr.request.opcode]++;
+
+    if (slow.size() == limit) {
+        if (now - start <= slow.front().latency()) {
+            return;
+        }
+        std::pop_heap(slow.begin(), slow.end(), slower);
+    } else {
+        if (slow.capacity() < limit) {
+            slow.reserve(limit);
+        }
+        slow.resize(slow.size() + 1);
+    }
+
+    Record& rec = slow.back();
+    const void *key;
+    lcb_size_t nkey;
+    mcreq_get_key(pkt, &key, &nkey);
+    rec.start = start;
+    rec.completed = now;
+    rec.key_hash = opcapture::hash_key(key, nkey);
+    rec.vbucket = ntohs(hdr.request.vbucket);
+    rec.status = res ? res->status() : 0;
+    rec.rc = err;
+    rec.retries = pkt->retries;
+
+    const Phases& ph = ring[pkt->opaque & (ring.size() - 1)];
+    if (ph.opaque == pkt->opaque) {
+        rec.phases = ph;
+    } else {
+        // Overwritten by a later operation
+        memset(&rec.phases, 0, sizeof rec.phases);
+        rec.phases.opaque = pkt->opaque;
+    }
+
+    if (pipeline == pipeline->parent->fallback) {
+        rec.node[0] = '\0';
+    } else {
+        const lcb_host_t& host = static_cast<Server*>(pipeline)->get_host();
+        snprintf(rec.node, sizeof rec.node, "%.100s:%.20s", host.host, host.port);
+    }
+    std::push_heap(slow.begin(), slow.end(), slower);
+
+    if (!lcbio_timer_armed(timer)) {
+        lcbio_timer_rearm(timer, LCBT_SETTING(instance, slowop_interval));
+    }
+}
+
+static std::string
+opcode_name(lcb_U8 opcode)
+{
+    switch (opcode) {
+    case PROTOCOL_BINARY_CMD_GET: return "get";
+    case PROTOCOL_BINARY_CMD_SET: return "set";
+    case PROTOCOL_BINARY_CMD_ADD: return "add";
+    case PROTOCOL_BINARY_CMD_REPLACE: return "replace";
+    case PROTOCOL_BINARY_CMD_DELETE: return "delete";
+    case PROTOCOL_BINARY_CMD_INCREMENT: return "increment";
+    case PROTOCOL_BINARY_CMD_DECREMENT: return "decrement";
+    case PROTOCOL_BINARY_CMD_APPEND: return "append";
+    case PROTOCOL_BINARY_CMD_PREPEND: return "prepend";
+    case PROTOCOL_BINARY_CMD_TOUCH: return "touch";
+    case PROTOCOL_BINARY_CMD_GAT: return "get_and_touch";
+    case PROTOCOL_BINARY_CMD_GET_LOCKED: return "get_locked";
+    case PROTOCOL_BINARY_CMD_UNLOCK_KEY: return "unlock";
+    case PROTOCOL_BINARY_CMD_GET_REPLICA: return "get_replica";
+    case PROTOCOL_BINARY_CMD_OBSERVE: return "observe";
+    case PROTOCOL_BINARY_CMD_OBSERVE_SEQNO: return "observe_seqno";
+    case PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP: return "subdoc_multi_lookup";
+    case PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION: return "subdoc_multi_mutation";
+    case PROTOCOL_BINARY_CMD_STAT: return "stat";
+    default: {
+        char buf[8];
+        sprintf(buf, "0x%02x", opcode);
+        return buf;
+    }
+    }
+}
+
+static Json::Value
+decision_names(lcb_U32 decisions)
+{
+    static const struct {
+        int flag;
+        const char *name;
+    } names[] = {
+        { SlowOpTracer::NMV_CONFIG_UPDATED, "nmv_config_updated" },
+        { SlowOpTracer::NMV_RETRIED, "nmv_retried" },
+        { SlowOpTracer::NMV_FAILED, "nmv_failed" },
+        { SlowOpTracer::ERRMAP_UNKNOWN, "errmap_unknown" },
+        { SlowOpTracer::ERRMAP_FETCH_CONFIG, "errmap_fetch_config" },
+        { SlowOpTracer::ERRMAP_RETRIED, "errmap_retried" },
+        { SlowOpTracer::ERRMAP_DISCONNECTED, "errmap_disconnected" }
+    };
+    Json::Value arr(Json::arrayValue);
+    for (size_t ii = 0; ii < sizeof names / sizeof names[0]; ii++) {
+        if (decisions & names[ii].flag) {
+            arr.append(names[ii].name);
+        }
+    }
+    return arr;
+}
+
+/* Microseconds between the scheduling of the operation and the phase, which
+ * is left out if it was not reached (or its slot was overwritten) */
+static void
+add_phase(Json::Value& phases, const char *name, hrtime_t start, hrtime_t ts)
+{
+    if (ts) {
+        phases[name] = (Json::UInt64)(ts > start ? LCB_NS2US(ts - start) : 0);
+    }
+}
+
+void
+SlowOpTracer::report()
+{
+    lcbio_timer_disarm(timer);
+
+    Json::Value root;
+    for (size_t op = 0; op < 256; op++) {
+        std::vector<Record>& slow = slowest[op];
+        if (slow.empty()) {
+            continue;
+        }
+        std::sort_heap(slow.begin(), slow.end(), slower);
+
+        Json::Value& entry = root[opcode_name(op)];
+        entry["count"] = (Json::UInt64)nslow[op];
+        Json::Value& ops = entry["slowest"];
+        for (size_t ii = 0; ii < slow.size(); ii++) {
+            const Record& rec = slow[ii];
+            char hash[17];
+            sprintf(hash, "%016llx", (unsigned long long)rec.key_hash);
+
+            Json::Value cur;
+            cur["total_us"] = (Json::UInt64)LCB_NS2US(rec.latency());
+            cur["key_hash"] = hash;
+            cur["node"] = rec.node;
+            cur["vbucket"] = rec.vbucket;
+            cur["opaque"] = rec.phases.opaque;
+            cur["status"] = rec.status;
+            cur["rc"] = lcb_strerror_short(rec.rc);
+            cur["retries"] = rec.retries;
+            cur["decisions"] = decision_names(rec.phases.decisions);
+            Json::Value& phases = cur["phases_us"];
+            add_phase(phases, "enqueued", rec.start, rec.phases.enqueued);
+            add_phase(phases, "flushed", rec.start, rec.phases.flushed);
+            add_phase(phases, "header", rec.start, rec.phases.header);
+            add_phase(phases, "dispatched", rec.start, rec.phases.dispatched);
+            add_phase(phases, "callback", rec.start, rec.completed);
+            ops.append(cur);
+        }
+        slow.clear();
+        nslow[op] = 0;
+    }
+
+    if (root.isNull()) {
+        return;
+    }
+    std::string s = Json::FastWriter().write(root);
+    if (!s.empty() && s[s.size() - 1] == '\n') {
+        s.erase(s.size() - 1);
+    }
+    lcb_log(LOGARGS(instance, INFO), "Slowest operations: %s", s.c_str());
+}
@@ -0,0 +1,145 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_SLOWOPS_H
+#define LCB_SLOWOPS_H
+
+#include "config.h"
+#include <libcouchbase/couchbase.h>
+#include <lcbio/timer-ng.h>
+#include <vector>
+
+/**
+ * @file
+ * @brief Tracing of the slowest KV operations
+ *
+ * When LCB_CNTL_SLOWOP_COUNT is set, the tracer keeps the slowest operations
+ * of each opcode which took longer than LCB_CNTL_SLOWOP_THRESHOLD, and logs
+ * them as JSON every LCB_CNTL_SLOWOP_INTERVAL.
+ *
+ * The times at which a packet was enqueued, written out, answered and handed
+ * to its callback are stamped into a fixed ring indexed by the packet's
+ * opaque. Opaques are
+ * unique within an instance and are kept when a packet is retried, so the
+ * slot also accumulates the NOT_MY_VBUCKET and error map decisions made for
+ * the operation. When the operation completes, its slot is copied into the
+ * table of its opcode if it is slow enough. Neither step allocates, except
+ * for the table of an opcode the first time one of its operations is kept.
+ */
+
+struct mc_packet_st;
+struct mc_pipeline_st;
+
+namespace lcb {
+class MemcachedResponse;
+
+class SlowOpTracer {
+public:
+    /** Decisions made about an operation before it completed */
+    enum Decision {
+        /** A NOT_MY_VBUCKET response carried a configuration which was applied */
+        NMV_CONFIG_UPDATED = 1 << 0,
+        /** The operation was rescheduled after NOT_MY_VBUCKET */
+        NMV_RETRIED = 1 << 1,
+        /** NOT_MY_VBUCKET was returned to the user */
+        NMV_FAILED = 1 << 2,
+        /** The error was not in the error map, and the connection was reset */
+        ERRMAP_UNKNOWN = 1 << 3,
+        /** The error map requested a configuration refresh */
+        ERRMAP_FETCH_CONFIG = 1 << 4,
+        /** The error map requested a retry */
+        ERRMAP_RETRIED = 1 << 5,
+        /** The error map invalidated the connection */
+        ERRMAP_DISCONNECTED = 1 << 6
+    };
+
+    SlowOpTracer(lcb_t instance);
+    ~SlowOpTracer();
+
+    /** The packet was added to its pipeline's output */
+    void enqueued(const mc_packet_st *pkt);
+
+    /** The packet was completely written out */
+    void flushed(const mc_packet_st *pkt);
+
+    /** The response header for the given opaque has been read */
+    void header_received(lcb_U32 opaque) {
+        Phases& ph = ring[opaque & (ring.size() - 1)];
+        if (ph.opaque == opaque && ph.header == 0) {
+            ph.header = gethrtime();
+        }
+    }
+
+    /** The response for the given opaque is about to be passed to its callback */
+    void dispatched(lcb_U32 opaque) {
+        Phases& ph = ring[opaque & (ring.size() - 1)];
+        if (ph.opaque == opaque) {
+            ph.dispatched = gethrtime();
+        }
+    }
+
+    /** Add one of the Decision flags to the operation */
+    void decided(const mc_packet_st *pkt, int decision);
+
+    /**
+     * The operation's callback has returned. Its latency is measured up to
+     * this point, so that slow callbacks are accounted for as well
+     */
+    void completed(mc_pipeline_st *pipeline, const mc_packet_st *pkt,
+                   const MemcachedResponse *res, lcb_error_t err);
+
+    /** Log and reset the operations kept in this interval */
+    void report();
+
+private:
+    struct Phases {
+        lcb_U32 opaque;
+        lcb_U32 decisions;
+        hrtime_t enqueued;
+        hrtime_t flushed;
+        hrtime_t header;
+        hrtime_t dispatched;
+    };
+
+    struct Record {
+        hrtime_t start;
+        hrtime_t completed;
+        Phases phases;
+        lcb_U64 key_hash;
+        lcb_U16 vbucket;
+        lcb_U16 status;
+        lcb_error_t rc;
+        lcb_U8 retries;
+        char node[128];
+        hrtime_t latency() const { return completed - start; }
+    };
+
+    /** Orders a heap so that the fastest of the kept operations is first */
+    static bool slower(const Record& a, const Record& b) {
+        return a.latency() > b.latency();
+    }
+
+    lcb_t instance;
+    std::vector<Phases> ring;
+    std::vector<Record> slowest[256];
+    /** Number of operations of each opcode over the threshold */
+    lcb_U64 nslow[256];
+    lcbio_pTIMER timer;
+};
+
+}
+#endif
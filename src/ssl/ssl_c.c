@@ -22,7 +22,7 @@
 /* throw-away write buffer structure (for encoded data) */
 typedef struct {
     void *parent;
-    char buf[1];
+    BUF_MEM *bm; /**< Buffer taken from the wbio */
 } my_WBUF;
 
 /* throw-away write buffer structure (for application data) */
@@ -33,6 +33,7 @@ typedef struct {
     void *iovroot_;
     lcb_IOV *iov;
     lcb_size_t niov;
+    lcb_size_t skip; /**< Bytes of the first IOV already encoded */
 } my_WCTX;
 
 typedef struct {
@@ -56,6 +57,7 @@ typedef struct {
 
     int closed; /**< Pending delivery of close */
     int entered;
+    char rdbuf[IOTSSL_READ_BUFSIZE]; /**< Encrypted data read from the socket */
 } lcbio_CSSL;
 
 #define CS_FROM_IOPS(iops) (lcbio_CSSL *)IOTSSL_FROM_IOPS(iops)
@@ -95,6 +97,19 @@ appdata_free_flushed(lcbio_CSSL *cs)
     }
 }
 
+/* Advance the IOV position past data which has been encoded */
+static void
+wctx_consume(lcb_IOV **iov, lcb_size_t *niov, lcb_size_t *skip, lcb_size_t n)
+{
+    n += *skip;
+    while (*niov && n >= (*iov)->iov_len) {
+        n -= (*iov)->iov_len;
+        (*iov)++;
+        (*niov)--;
+    }
+    *skip = n;
+}
+
 /* This function will attempt to encode pending user data into SSL data. This
  * will be output to the wbio. */
 static void
@@ -106,12 +121,13 @@ appdata_encode(lcbio_CSSL *cs)
     SLLIST_FOREACH(&cs->writes, cur) {
         my_WCTX *ctx = SLLIST_ITEM(cur, my_WCTX, slnode);
 
-        for (; ctx->niov && cs->error == 0; ctx->niov--, ctx->iov++) {
+        while (ctx->niov && cs->error == 0) {
             int rv;
 
             assert(ctx->iov->iov_len);
-            rv = SSL_write(cs->ssl, ctx->iov->iov_base, ctx->iov->iov_len);
+            rv = iotssl_writev(cs->ssl, ctx->iov, ctx->niov, ctx->skip);
             if (rv > 0) {
+                wctx_consume(&ctx->iov, &ctx->niov, &ctx->skip, rv);
                 continue;
             } else if (maybe_set_error(cs, rv) == 0) {
                 /* SSL_ERROR_WANT_READ. Should schedule a read here.
@@ -153,6 +169,7 @@ write_callback(lcb_sockdata_t *sd, int status, void *arg)
         cs->error = 1;
     }
 
+    BUF_MEM_free(wb->bm);
     free(wb);
 
     appdata_free_flushed(cs);
@@ -194,11 +211,7 @@ read_callback(lcb_sockdata_t *sd, lcb_ssize_t nr, void *arg)
     cs->entered++;
 
     if (nr > 0) {
-        BUF_MEM *mb;
-
-        BIO_clear_retry_flags(cs->rbio);
-        BIO_get_mem_ptr(cs->rbio, &mb);
-        mb->length += nr;
+        BIO_write(cs->rbio, cs->rdbuf, nr);
 
     } else if (nr == 0) {
         cs->closed = 1;
@@ -234,14 +247,18 @@ schedule_wants(lcbio_CSSL *cs)
     }
 
     if (npend) {
-        /* Have pending data to write. The buffer is copied here because the
-         * BIO structure doesn't support "lockdown" semantics like netbuf/rdb
-         * do. We might transplant this with a different sort of BIO eventually..
+        /* Have pending data to write. The BIO structure doesn't support
+         * "lockdown" semantics like netbuf/rdb do, so rather than copying the
+         * data out, the BIO's buffer is taken over by the write and replaced
+         * with a fresh one. BIO_get_mem_ptr() ensures the buffer begins
+         * with the unread data.
          */
-        my_WBUF *wb = malloc(sizeof(*wb) + npend);
+        my_WBUF *wb = malloc(sizeof(*wb));
         lcb_IOV iov;
-        BIO_read(cs->wbio, wb->buf, npend);
-        iov.iov_base = wb->buf;
+        BIO_get_mem_ptr(cs->wbio, &wb->bm);
+        (void)BIO_set_close(cs->wbio, BIO_NOCLOSE);
+        BIO_set_mem_buf(cs->wbio, BUF_MEM_new(), BIO_CLOSE);
+        iov.iov_base = wb->bm->data;
         iov.iov_len = npend;
         wb->parent = cs;
 
@@ -271,14 +288,11 @@ schedule_wants(lcbio_CSSL *cs)
 
         } else if (SSL_want_read(cs->ssl) || (cs->urd_cb && has_appdata == 0)) {
             /* request more data from the socket */
-            BUF_MEM *mb;
             lcb_IOV iov;
 
             cs->rdactive = 1;
-            BIO_get_mem_ptr(cs->rbio, &mb);
-            iotssl_bm_reserve(mb);
-            iov.iov_base = mb->data + mb->length;
-            iov.iov_len = mb->max - mb->length;
+            iov.iov_base = cs->rdbuf;
+            iov.iov_len = sizeof cs->rdbuf;
             lcbio_table_ref(&cs->base_);
             IOT_V1(cs->orig).read2(
                 IOT_ARG(cs->orig), cs->sd, &iov, 1, cs, read_callback);
@@ -332,12 +346,10 @@ Cssl_write2(lcb_io_opt_t io, lcb_sockdata_t *sd, lcb_IOV *iov, lcb_size_t niov,
     /* If the socket does not have a pending error and there are no other
      * writes before this, then try to write the current buffer immediately. */
     if (cs->error == 0 && SLLIST_IS_EMPTY(&cs->writes)) {
-        unsigned ii;
-        for (ii = 0; ii < niov; ++ii) {
-            int rv = SSL_write(cs->ssl, iov->iov_base, iov->iov_len);
+        while (niov) {
+            int rv = iotssl_writev(cs->ssl, iov, niov, wc->skip);
             if (rv > 0) {
-                iov++;
-                niov--;
+                wctx_consume(&iov, &niov, &wc->skip, rv);
             } else {
                 maybe_set_error(cs, rv);
                 break;
@@ -23,6 +23,7 @@
 #include "settings.h"
 #include "logging.h"
 #include <openssl/err.h>
+#include <stdio.h>
 
 #define LOGARGS(ssl, lvl) \
     ((lcbio_SOCKET*)SSL_get_app_data(ssl))->settings, "SSL", lvl, __FILE__, __LINE__
@@ -123,21 +124,36 @@ void
 iotssl_destroy_common(lcbio_XSSL *xs)
 {
     free(xs->iops_dummy_);
+    if (!xs->error) {
+        /* Otherwise SSL_free() considers the session unusable, and it
+         * could not be resumed by later connections */
+        SSL_set_shutdown(xs->ssl, SSL_SENT_SHUTDOWN|SSL_RECEIVED_SHUTDOWN);
+    }
     SSL_free(xs->ssl);
     lcbio_table_unref(xs->orig);
 }
 
-void
-iotssl_bm_reserve(BUF_MEM *bm)
+int
+iotssl_writev(SSL *ssl, const lcb_IOV *iov, lcb_SIZE niov, lcb_SIZE skip)
 {
-    int oldlen;
-    oldlen = bm->length;
-    while (bm->max - bm->length < 4096) {
-        /* there's also a BUF_MEM_grow_clean() but that actually clears the
-         * used portion of the buffer */
-        BUF_MEM_grow(bm, bm->max + 4096);
+    char buf[IOTSSL_RECORD_SIZE];
+    lcb_SIZE nbuf = 0;
+    const char *first = (const char *)iov->iov_base + skip;
+    lcb_SIZE nfirst = iov->iov_len - skip;
+
+    if (niov == 1 || nfirst >= sizeof buf) {
+        return SSL_write(ssl, first, (int)nfirst);
+    }
+
+    for (; niov && nbuf < sizeof buf; niov--, iov++, skip = 0) {
+        lcb_SIZE ncopy = iov->iov_len - skip;
+        if (ncopy > sizeof buf - nbuf) {
+            ncopy = sizeof buf - nbuf;
+        }
+        memcpy(buf + nbuf, (const char *)iov->iov_base + skip, ncopy);
+        nbuf += ncopy;
     }
-    bm->length = oldlen;
+    return SSL_write(ssl, buf, (int)nbuf);
 }
 
 void
@@ -207,6 +223,76 @@ iotssl_maybe_error(lcbio_XSSL *xs, int rv)
  ** Higher Level SSL_CTX Wrappers                                            **
  ******************************************************************************
  ******************************************************************************/
+
+/** Maximum number of hosts for which a session is kept */
+#define SESSION_CACHE_SIZE 64
+
+typedef struct {
+    char key[NI_MAXHOST + NI_MAXSERV + 2]; /**< host:port */
+    SSL_SESSION *session;
+} lcbio_SSLSESSION;
+
+struct lcbio_SSLCTX {
+    SSL_CTX *ctx;
+    lcbio_SSLSESSION sessions[SESSION_CACHE_SIZE];
+    unsigned nsessions;
+    unsigned next_evict; /**< Slot to replace once the cache is full */
+    lcb_U64 full_handshakes;
+    lcb_U64 resumed_handshakes;
+    lcb_U64 ktls_handshakes;
+};
+
+static void
+session_key(const lcbio_SOCKET *sock, char *buf, size_t nbuf)
+{
+    snprintf(buf, nbuf, "%s:%s", sock->info->ep.host, sock->info->ep.port);
+}
+
+static lcbio_SSLSESSION *
+session_find(lcbio_pSSLCTX sctx, const char *key)
+{
+    unsigned ii;
+    for (ii = 0; ii < sctx->nsessions; ii++) {
+        if (strcmp(sctx->sessions[ii].key, key) == 0) {
+            return sctx->sessions + ii;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Invoked by OpenSSL whenever the server provides a session (or, with TLS 1.3,
+ * a session ticket) which may be used to resume future connections.
+ * Returning 1 means we keep the reference.
+ */
+static int
+new_session_callback(SSL *ssl, SSL_SESSION *session)
+{
+    lcbio_SOCKET *sock = SSL_get_app_data(ssl);
+    lcbio_pSSLCTX sctx = SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+    lcbio_SSLSESSION *ent;
+    char key[sizeof(ent->key)];
+
+    if (!sock || !sock->info) {
+        return 0;
+    }
+    session_key(sock, key, sizeof key);
+
+    if ((ent = session_find(sctx, key)) != NULL) {
+        SSL_SESSION_free(ent->session);
+    } else if (sctx->nsessions < SESSION_CACHE_SIZE) {
+        ent = sctx->sessions + sctx->nsessions++;
+    } else {
+        ent = sctx->sessions + sctx->next_evict;
+        sctx->next_evict = (sctx->next_evict + 1) % SESSION_CACHE_SIZE;
+        SSL_SESSION_free(ent->session);
+    }
+    strcpy(ent->key, key);
+    ent->session = session;
+    lcb_log(LOGARGS(ssl, LCB_LOG_TRACE), "sock=%p: Cached session for %s", (void*)sock, key);
+    return 1;
+}
+
 static void
 log_callback(const SSL *ssl, int where, int ret)
 {
@@ -234,7 +320,29 @@ log_callback(const SSL *ssl, int where, int ret)
         (void*)sock, where, SSL_state_string_long(ssl), ret, retstr);
 
     if (where == SSL_CB_HANDSHAKE_DONE) {
-        lcb_log(LOGARGS(ssl, LCB_LOG_DEBUG), "sock=%p. Using SSL version %s. Cipher=%s", (void*)sock, SSL_get_version(ssl), SSL_get_cipher_name(ssl));
+        lcbio_XSSL *xs = (lcbio_XSSL *)sock->io;
+        lcbio_pSSLCTX sctx = SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+        int reused = SSL_session_reused((SSL *)ssl);
+
+        lcb_log(LOGARGS(ssl, LCB_LOG_DEBUG), "sock=%p. Using SSL version %s. Cipher=%s. Resumed=%d", (void*)sock, SSL_get_version(ssl), SSL_get_cipher_name(ssl), reused);
+
+        /* TLS 1.3 signals this again for post-handshake messages */
+        if (!xs->handshake_done) {
+            xs->handshake_done = 1;
+            if (reused) {
+                sctx->resumed_handshakes++;
+            } else {
+                sctx->full_handshakes++;
+            }
+#if defined(__linux__) && defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+            /* The keys are installed on the socket as part of the handshake */
+            if (BIO_get_ktls_send(SSL_get_wbio(ssl))) {
+                xs->ktls_tx = 1;
+                sctx->ktls_handshakes++;
+                lcb_log(LOGARGS(ssl, LCB_LOG_DEBUG), "sock=%p. Kernel TLS enabled. RX=%d", (void*)sock, (int)BIO_get_ktls_recv(SSL_get_rbio(ssl)));
+            }
+#endif
+        }
     }
 }
 
@@ -249,10 +357,6 @@ msg_callback(int write_p, int version, int ctype, const void *buf, size_t n,
 }
 #endif
 
-struct lcbio_SSLCTX {
-    SSL_CTX *ctx;
-};
-
 lcbio_pSSLCTX
 lcbio_ssl_new(const char *cafile, int noverify, lcb_error_t *errp,
     lcb_settings *settings)
@@ -275,8 +379,18 @@ lcbio_ssl_new(const char *cafile, int noverify, lcb_error_t *errp,
         goto GT_ERR;
 
     }
-    SSL_CTX_set_cipher_list(ret->ctx, "DHE-RSA-AES256-SHA:DHE-DSS-AES256-SHA:AES256-SHA:EDH-RSA-DES-CBC3-SHA:EDH-DSS-DES-CBC3-SHA:DES-CBC3-SHA:DES-CBC3-MD5:DHE-RSA-AES128-SHA:DHE-DSS-AES128-SHA:AES128-SHA:DHE-RSA-SEED-SHA:DHE-DSS-SEED-SHA:SEED-SHA:RC2-CBC-MD5:RC4-SHA:RC4-MD5:RC4-MD5:EDH-RSA-DES-CBC-SHA:EDH-DSS-DES-CBC-SHA:DES-CBC-SHA:DES-CBC-MD5:EXP-EDH-RSA-DES-CBC-SHA:EXP-EDH-DSS-DES-CBC-SHA:EXP-DES-CBC-SHA:EXP-RC2-CBC-MD5:EXP-RC2-CBC-MD5:EXP-RC4-MD5:EXP-RC4-MD5");
-//    SSL_CTX_set_cipher_list(ret->ctx, "!NULL");
+    /* Prefer AEAD ciphers with forward secrecy: AES-GCM is the fastest where
+     * the CPU accelerates AES, and ChaCha20-Poly1305 elsewhere. The CBC
+     * ciphers are kept for older servers. TLS 1.3 suites are configured
+     * separately, and OpenSSL's defaults are already AEAD only. */
+    SSL_CTX_set_cipher_list(ret->ctx,
+        "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:"
+        "ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384:"
+        "ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-CHACHA20-POLY1305:"
+        "DHE-RSA-AES128-GCM-SHA256:DHE-RSA-AES256-GCM-SHA384:"
+        "AES128-GCM-SHA256:AES256-GCM-SHA384:"
+        "ECDHE-RSA-AES128-SHA:ECDHE-RSA-AES256-SHA:"
+        "DHE-RSA-AES128-SHA:DHE-RSA-AES256-SHA:AES128-SHA:AES256-SHA");
 
     if (cafile) {
         if (!SSL_CTX_load_verify_locations(ret->ctx, cafile, NULL)) {
@@ -292,6 +406,13 @@ lcbio_ssl_new(const char *cafile, int noverify, lcb_error_t *errp,
     }
 
     SSL_CTX_set_info_callback(ret->ctx, log_callback);
+    SSL_CTX_set_app_data(ret->ctx, ret);
+
+    /* Sessions are cached per host:port in lcbio_SSLCTX, rather than by
+     * OpenSSL's internal cache which is only useful to servers */
+    SSL_CTX_set_session_cache_mode(ret->ctx,
+        SSL_SESS_CACHE_CLIENT|SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ret->ctx, new_session_callback);
     #if 0
     SSL_CTX_set_msg_callback(ret->ctx, msg_callback);
     #endif
@@ -330,20 +451,33 @@ lcbio_ssl_apply(lcbio_SOCKET *sock, lcbio_pSSLCTX sctx)
     lcbio_PROTOCTX *sproto;
 
     if (old_iot->model == LCB_IOMODEL_EVENT) {
-        new_iot = lcbio_Essl_new(old_iot, sock->u.fd, sctx->ctx);
+        new_iot = lcbio_Essl_new(old_iot, sock->u.fd, sctx->ctx,
+            sock->settings->ssl_ktls);
     } else {
         new_iot = lcbio_Cssl_new(old_iot, sock->u.sd, sctx->ctx);
     }
 
     if (new_iot) {
+        SSL *ssl = ((lcbio_XSSL *)new_iot)->ssl;
+        lcbio_SSLSESSION *ent = NULL;
+
+        if (sock->info) {
+            char key[sizeof(ent->key)];
+            session_key(sock, key, sizeof key);
+            ent = session_find(sctx, key);
+        }
+        if (ent) {
+            SSL_set_session(ssl, ent->session);
+        }
+
         sproto = calloc(1, sizeof(*sproto));
         sproto->id = LCBIO_PROTOCTX_SSL;
         sproto->dtor = noop_dtor;
         lcbio_protoctx_add(sock, sproto);
         lcbio_table_unref(old_iot);
         sock->io = new_iot;
-        /* just for logging */
-        SSL_set_app_data(((lcbio_XSSL *)new_iot)->ssl, sock);
+        /* for logging and the session cache */
+        SSL_set_app_data(ssl, sock);
         return LCB_SUCCESS;
 
     } else {
@@ -367,10 +501,23 @@ lcbio_ssl_get_error(lcbio_SOCKET *sock)
 void
 lcbio_ssl_free(lcbio_pSSLCTX ctx)
 {
+    unsigned ii;
+    for (ii = 0; ii < ctx->nsessions; ii++) {
+        SSL_SESSION_free(ctx->sessions[ii].session);
+    }
     SSL_CTX_free(ctx->ctx);
     free(ctx);
 }
 
+void
+lcbio_ssl_get_stats(lcbio_pSSLCTX ctx, lcb_cntl_sslstats *stats)
+{
+    stats->full_handshakes = ctx->full_handshakes;
+    stats->resumed_handshakes = ctx->resumed_handshakes;
+    stats->cached_sessions = ctx->nsessions;
+    stats->ktls_handshakes = ctx->ktls_handshakes;
+}
+
 
 /**
  * According to https://www.openssl.org/docs/crypto/threads.html we need
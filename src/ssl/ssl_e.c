@@ -28,6 +28,11 @@
  *
  * - SSL_want_read() is true
  * - The wbio is not empty
+ *
+ * When kernel TLS is requested, OpenSSL must own the socket, so a socket BIO
+ * is used instead of the memory BIOs, and read_ssl_data() and
+ * flush_ssl_data() are not used. If the kernel then takes over encryption of
+ * outgoing data, writes bypass SSL entirely.
  */
 
 typedef struct {
@@ -42,6 +47,8 @@ typedef struct {
     lcb_socket_t fd; /**< Socket descriptor */
     lcbio_pTIMER as_fake;
     lcb_SIZE last_nw; /**< Last failed call to SSL_write() */
+    lcb_SIZE wbio_sent; /**< Bytes at the start of the wbio already sent */
+    int sockbio; /**< SSL performs its own I/O on the socket (for kTLS) */
 } lcbio_ESSL;
 
 #ifdef USE_EAGAIN
@@ -51,7 +58,6 @@ typedef struct {
 #endif
 
 #define ES_FROM_IOPS(iops) (lcbio_ESSL *)(IOTSSL_FROM_IOPS(iops))
-#define MINIMUM(a,b) a < b ? a : b
 
 static int maybe_error(lcbio_ESSL *es, int rv) {
     return iotssl_maybe_error((lcbio_XSSL *)es, rv);
@@ -83,11 +89,16 @@ schedule_pending(lcbio_ESSL *es)
         wanted |= LCB_READ_EVENT;
     }
 
-    if (BIO_ctrl_pending(es->wbio)) {
+    if (BIO_ctrl_pending(es->wbio) > es->wbio_sent) {
         /* have data to flush */
         wanted |= LCB_WRITE_EVENT;
     }
 
+    if (SSL_want_write(es->ssl)) {
+        /* SSL could not write to the socket (socket BIO only) */
+        wanted |= LCB_WRITE_EVENT;
+    }
+
     /* set the events to deliver on the next 'fake' event. This will be all
      * the available events AND'ed with all the events the user cared about */
     es->fakewhich = avail;
@@ -112,24 +123,15 @@ schedule_pending(lcbio_ESSL *es)
 static int
 read_ssl_data(lcbio_ESSL *es)
 {
-    BUF_MEM *rmb;
+    char buf[IOTSSL_READ_BUFSIZE];
     int nr;
     lcbio_pTABLE iot = es->orig;
 
-    /* This block is an optimization over BIO_write to avoid copying the memory
-     * to a temporary buffer and _then_ copying it into the BIO */
-
-    BIO_get_mem_ptr(es->rbio, &rmb);
     while (1) {
-        /* I don't know why this is here, but it's found inside BIO_write */
-        BIO_clear_retry_flags(es->rbio);
-        iotssl_bm_reserve(rmb);
-        nr = IOT_V0IO(iot).recv(IOT_ARG(iot), es->fd,
-            rmb->data + rmb->length, rmb->max - rmb->length, 0);
+        nr = IOT_V0IO(iot).recv(IOT_ARG(iot), es->fd, buf, sizeof buf, 0);
 
         if (nr > 0) {
-            /* Extend the BIO used length */
-            rmb->length += nr;
+            BIO_write(es->rbio, buf, nr);
         } else if (nr == 0) {
             es->closed = 1;
             return -1;
@@ -158,16 +160,18 @@ flush_ssl_data(lcbio_ESSL *es)
     lcbio_pTABLE iot = es->orig;
 
     BIO_get_mem_ptr(es->wbio, &wmb);
-    tmp_p = wmb->data;
-    tmp_len = wmb->length;
+    tmp_p = wmb->data + es->wbio_sent;
+    tmp_len = wmb->length - es->wbio_sent;
 
-    /* We use this block of code over BIO_read() as we have no guarantee that
-     * we'll be able to flush all the bytes received from BIO_read(), and
-     * BIO has no way to "put back" some bytes. Thus this block is not an
-     * optimization but a necessity.
+    /* We send directly from the BUF_MEM rather than using BIO_read() as we
+     * have no guarantee that we'll be able to flush all the bytes received
+     * from BIO_read(), and BIO has no way to "put back" some bytes. This also
+     * avoids copying the data.
      *
-     * tmp_len is the number of bytes originally inside the BUF_MEM structure.
-     * It is decremented each time we write data from the network.
+     * Nothing is consumed from the BIO until all of it has been sent; until
+     * then es->wbio_sent tracks what has already been written. Consuming
+     * part of the BIO would cause the remainder to be moved to the front of
+     * the buffer.
      *
      * The loop here terminates until we get a WOULDBLOCK from the socket or we
      * have no more data left to write.
@@ -177,6 +181,7 @@ flush_ssl_data(lcbio_ESSL *es)
         if (nw > 0) {
             tmp_len -= nw;
             tmp_p += nw;
+            es->wbio_sent += nw;
             continue;
         } else if (nw == 0) {
             return -1;
@@ -192,15 +197,11 @@ flush_ssl_data(lcbio_ESSL *es)
         }
     }
 
-    /* TODO: This block is inefficient as it results in a bunch of memmove()
-     * calls. While we could have done this inline with the send() call this
-     * would make future optimization more difficult. */
+    /* Everything was sent; empty the BIO */
+    (void)BIO_reset(es->wbio);
+    es->wbio_sent = 0;
+
     GT_WRITE_DONE:
-    while (wmb->length > (size_t)tmp_len) {
-        char dummy[4096];
-        unsigned to_read = MINIMUM(wmb->length-tmp_len, sizeof dummy);
-        BIO_read(es->wbio, dummy, to_read);
-    }
     BIO_clear_retry_flags(es->wbio);
     return 0;
 }
@@ -214,10 +215,11 @@ event_handler(lcb_socket_t fd, short which, void *arg)
     int u_which;
     es->entered++;
 
-    if (which & LCB_READ_EVENT) {
+    /* With a socket BIO, SSL reads and writes the socket as needed */
+    if ((which & LCB_READ_EVENT) && !es->sockbio) {
         rv = read_ssl_data(es);
     }
-    if (rv == 0 && (which & LCB_WRITE_EVENT)) {
+    if (rv == 0 && (which & LCB_WRITE_EVENT) && !es->sockbio) {
         rv = flush_ssl_data(es);
     }
 
@@ -329,20 +331,37 @@ Essl_recv(lcb_io_opt_t iops, lcb_socket_t sock, void *buf, lcb_size_t nbuf,
     return -1;
 }
 
+
 static lcb_ssize_t
-Essl_send(lcb_io_opt_t iops, lcb_socket_t sock, const void *buf, lcb_size_t nbuf,
-          int ign)
-{
+Essl_recvv(lcb_io_opt_t iops, lcb_socket_t sock, lcb_IOV *iov, lcb_size_t niov) {
+    (void) niov;
+    return Essl_recv(iops, sock, iov->iov_base, iov->iov_len, 0);
+}
+
+static lcb_ssize_t
+Essl_sendv(lcb_io_opt_t iops, lcb_socket_t sock, lcb_IOV *iov, lcb_size_t niov) {
     lcbio_ESSL *es = ES_FROM_IOPS(iops);
     int rv;
-    (void) ign; (void) sock;
+    (void) sock;
 
     if (es->error) {
         IOTSSL_ERRNO(es) = EINVAL;
         return -1;
     }
 
-    rv = SSL_write(es->ssl, buf, nbuf);
+    /* The kernel encrypts the data, so write it to the socket directly.
+     * A write which SSL could not complete must still be retried through
+     * SSL, however */
+    if (es->ktls_tx && !SSL_want_write(es->ssl)) {
+        lcb_ssize_t nw = IOT_V0IO(es->orig).sendv(
+            IOT_ARG(es->orig), es->fd, iov, niov);
+        if (nw < 0) {
+            IOTSSL_ERRNO(es) = IOT_ERRNO(es->orig);
+        }
+        return nw;
+    }
+
+    rv = iotssl_writev(es->ssl, iov, niov, 0);
     if (rv >= 0) {
         /* still need to schedule data to get flushed to the network */
         SCHEDULE_PENDING_SAFE(es);
@@ -357,15 +376,14 @@ Essl_send(lcb_io_opt_t iops, lcb_socket_t sock, const void *buf, lcb_size_t nbuf
 }
 
 static lcb_ssize_t
-Essl_recvv(lcb_io_opt_t iops, lcb_socket_t sock, lcb_IOV *iov, lcb_size_t niov) {
-    (void) niov;
-    return Essl_recv(iops, sock, iov->iov_base, iov->iov_len, 0);
-}
-
-static lcb_ssize_t
-Essl_sendv(lcb_io_opt_t iops, lcb_socket_t sock, lcb_IOV *iov, lcb_size_t niov) {
-    (void) niov;
-    return Essl_send(iops, sock, iov->iov_base, iov->iov_len, 0);
+Essl_send(lcb_io_opt_t iops, lcb_socket_t sock, const void *buf, lcb_size_t nbuf,
+          int ign)
+{
+    lcb_IOV iov;
+    iov.iov_base = (void *)buf;
+    iov.iov_len = nbuf;
+    (void) ign;
+    return Essl_sendv(iops, sock, &iov, 1);
 }
 
 static void
@@ -387,7 +405,7 @@ Essl_dtor(void *arg)
 }
 
 lcbio_pTABLE
-lcbio_Essl_new(lcbio_pTABLE orig, lcb_socket_t fd, SSL_CTX *sctx)
+lcbio_Essl_new(lcbio_pTABLE orig, lcb_socket_t fd, SSL_CTX *sctx, int ktls)
 {
     lcbio_ESSL *es = calloc(1, sizeof(*es));
     lcbio_TABLE *iot = &es->base_;
@@ -403,5 +421,18 @@ lcbio_Essl_new(lcbio_pTABLE orig, lcb_socket_t fd, SSL_CTX *sctx)
     iot->u_io.v0.io.close = Essl_close;
     iot->dtor = Essl_dtor;
     iotssl_init_common((lcbio_XSSL *)es, orig, sctx);
+
+#if defined(__linux__) && defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+    /* OpenSSL only installs the keys on the socket if it is doing the I/O.
+     * Whether this succeeds is only known once the handshake is done;
+     * otherwise encryption remains in userspace */
+    if (ktls && SSL_set_fd(es->ssl, fd)) {
+        es->rbio = SSL_get_rbio(es->ssl);
+        es->wbio = SSL_get_wbio(es->ssl);
+        es->sockbio = 1;
+        SSL_set_options(es->ssl, SSL_OP_ENABLE_KTLS);
+    }
+#endif
+    (void)ktls;
     return iot;
 }
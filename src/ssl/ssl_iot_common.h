@@ -34,7 +34,9 @@
     BIO *rbio; /**<< BIO used for reading data from network */\
     lcb_io_opt_t iops_dummy_; /**< Dummy IOPS structure which is exposed to LCB */ \
     int error; /**< Internal error flag set once a fatal error is detect */\
-    lcb_error_t errcode; /**< The error, converted into libcouchbase */
+    lcb_error_t errcode; /**< The error, converted into libcouchbase */ \
+    int handshake_done; /**< Whether the handshake has been counted */ \
+    int ktls_tx; /**< Whether the kernel encrypts outgoing data */
 
 /**
  * @brief
@@ -114,24 +116,39 @@ void
 iotssl_destroy_common(lcbio_XSSL *xs);
 
 /**
- * Reserve a specified amount of bytes for reading into a `BUF_MEM*` structure.
- * Currently the amount reserved is hard coded.
+ * Size of the buffer used to read encrypted data from the network before
+ * it is passed to the `rbio`.
  *
- * Use this function to retrievw a pointer to the unused (but allocated) portion
- * of the `BUF_MEM` structure rather than doing an explicit BIO_write which
- * will result in needless copying of memory. Unfortunately OpenSSL does not have
- * a clean way of growing this buffer but it is possible.
+ * Data cannot be read directly into the `BUF_MEM` of the memory BIO: since
+ * OpenSSL 1.1.0 the BIO tracks its readable portion separately, and would
+ * never see such data.
+ */
+#define IOTSSL_READ_BUFSIZE 16384
+
+/** Maximum amount of application data carried by a single TLS record */
+#define IOTSSL_RECORD_SIZE 16384
+
+/**
+ * Pass application data from an IOV array to SSL_write().
  *
- * @param bm The `BUF_MEM*` structure.
+ * Small buffers (e.g. the header and value of a pipelined packet) would
+ * otherwise each become a separate TLS record, with its own header and MAC.
+ * Adjacent buffers are therefore gathered into a single record of up to
+ * @ref IOTSSL_RECORD_SIZE bytes. A buffer which is large enough by itself is
+ * passed to SSL_write() directly.
  *
- * @code{.c}
- * BUF_MEM *bm;
- * iotssl_bm_reserve(bm);
- * recv(fd, bm->data, bm->max-mb->length, 0);
- * @endcode
+ * If SSL_write() fails with a retryable error, the same IOVs must be passed
+ * again, which yields the same data.
+ *
+ * @param ssl the SSL object
+ * @param iov the buffers. The first one must not be empty
+ * @param niov number of buffers
+ * @param skip number of bytes at the start of the first buffer which have
+ * already been written
+ * @return the return value of SSL_write()
  */
-void
-iotssl_bm_reserve(BUF_MEM *bm);
+int
+iotssl_writev(SSL *ssl, const lcb_IOV *iov, lcb_SIZE niov, lcb_SIZE skip);
 
 /**
  * Prepare the SSL structure so that a subsequent call to SSL_pending will
@@ -172,9 +189,10 @@ lcbio_Cssl_new(lcbio_pTABLE orig, lcb_sockdata_t *sd, SSL_CTX *sctx);
  * @param orig The original pointer
  * @param fd Socket descriptor
  * @param sctx
+ * @param ktls Whether to attempt to offload encryption to the kernel
  * @return NULL on error.
  */
 lcbio_pTABLE
-lcbio_Essl_new(lcbio_pTABLE orig, lcb_socket_t fd, SSL_CTX *sctx);
+lcbio_Essl_new(lcbio_pTABLE orig, lcb_socket_t fd, SSL_CTX *sctx, int ktls);
 
 #endif
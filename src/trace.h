@@ -103,6 +103,64 @@
 #define TRACE_HTTP_BEGIN(req) TRACE(LIBCOUCHBASE_HTTP_BEGIN((req)->url, (req)->nurl, (req)->method))
 #define TRACE_HTTP_END(req, rc, resp) TRACE(LIBCOUCHBASE_HTTP_END((req)->url, (req)->nurl, (req)->method, (resp)->rc, (resp)->htstatus
 
+/*
+ * Request lifecycle probes. With DTrace these are declared in probes.d like
+ * the ones above. On Linux, where DTrace is not normally available, they are
+ * defined directly with <sys/sdt.h>, which needs no generated code; each
+ * probe is then a single NOP until bpftrace, perf or SystemTap attaches to
+ * it. See tools/bpftrace for scripts which use them.
+ *
+ * Arguments are still evaluated when nothing is attached, so they should
+ * only be fields which are already at hand. Durations in particular are left
+ * to the scripts: `response` passes the time the operation was scheduled,
+ * which on Linux is CLOCK_MONOTONIC, the clock of bpftrace's `nsecs`.
+ */
+#if defined(HAVE_DTRACE)
+#define TRACE_PROBE2(NAME, name, a, b) LIBCOUCHBASE_##NAME(a, b)
+#define TRACE_PROBE3(NAME, name, a, b, c) LIBCOUCHBASE_##NAME(a, b, c)
+#define TRACE_PROBE4(NAME, name, a, b, c, d) LIBCOUCHBASE_##NAME(a, b, c, d)
+#define TRACE_PROBE6(NAME, name, a, b, c, d, e, f) LIBCOUCHBASE_##NAME(a, b, c, d, e, f)
+#elif defined(HAVE_USDT)
+#include <sys/sdt.h>
+#define TRACE_PROBE2(NAME, name, a, b) DTRACE_PROBE2(libcouchbase, name, a, b)
+#define TRACE_PROBE3(NAME, name, a, b, c) DTRACE_PROBE3(libcouchbase, name, a, b, c)
+#define TRACE_PROBE4(NAME, name, a, b, c, d) DTRACE_PROBE4(libcouchbase, name, a, b, c, d)
+#define TRACE_PROBE6(NAME, name, a, b, c, d, e, f) DTRACE_PROBE6(libcouchbase, name, a, b, c, d, e, f)
+#else
+#define TRACE_PROBE2(NAME, name, a, b)
+#define TRACE_PROBE3(NAME, name, a, b, c)
+#define TRACE_PROBE4(NAME, name, a, b, c, d)
+#define TRACE_PROBE6(NAME, name, a, b, c, d, e, f)
+#endif
+
+#define TRACE_PACKET_ALLOC(pl, pkt) \
+    TRACE_PROBE2(PACKET_ALLOC, packet_alloc, (pkt)->opaque, (pl)->index)
+#define TRACE_PACKET_ENQUEUE(pl, pkt) \
+    TRACE_PROBE3(PACKET_ENQUEUE, packet_enqueue, (pkt)->opaque, (pl)->index, (pkt)->retries)
+#define TRACE_SCHED_LEAVE(pl, npkts, flush) \
+    TRACE_PROBE3(SCHED_LEAVE, sched_leave, (pl)->index, npkts, flush)
+#define TRACE_FLUSH_START(pl, nbytes) \
+    TRACE_PROBE2(FLUSH_START, flush_start, (pl)->index, nbytes)
+#define TRACE_FLUSH_DONE(pl, nflushed, expected) \
+    TRACE_PROBE3(FLUSH_DONE, flush_done, (pl)->index, nflushed, expected)
+#define TRACE_SOCKET_READ(pl, nbytes) \
+    TRACE_PROBE2(SOCKET_READ, socket_read, (pl)->index, nbytes)
+#define TRACE_RESPONSE(pl, mcresp, pkt, is_last) \
+    TRACE_PROBE6(RESPONSE, response, (pl)->index, (mcresp).opaque(), (mcresp).opcode(), \
+        (mcresp).status(), MCREQ_PKT_RDATA(pkt)->start, is_last)
+#define TRACE_PACKET_FAIL(pl, pkt, err) \
+    TRACE_PROBE3(PACKET_FAIL, packet_fail, (pl)->index, (pkt)->opaque, err)
+#define TRACE_RETRY(pkt, err) \
+    TRACE_PROBE3(RETRY, retry, (pkt)->opaque, err, (pkt)->retries)
+#define TRACE_NMV(pl, pkt, vbid) \
+    TRACE_PROBE3(NMV, nmv, (pl)->index, (pkt)->opaque, vbid)
+#define TRACE_CONFIG_CHANGE(vbc, status) \
+    TRACE_PROBE3(CONFIG_CHANGE, config_change, lcbvb_get_revision(vbc), LCBVB_NSERVERS(vbc), status)
+#define TRACE_CONN_OPEN(pl, hp) \
+    TRACE_PROBE3(CONN_OPEN, conn_open, (pl)->index, (hp).host, (hp).port)
+#define TRACE_CONN_CLOSE(pl, hp, err) \
+    TRACE_PROBE4(CONN_CLOSE, conn_close, (pl)->index, (hp).host, (hp).port, err)
+
 #ifdef __clang__
 #pragma GCC diagnostic pop
 #endif /* __clang__ */
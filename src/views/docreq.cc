@@ -1,6 +1,7 @@
 #include "docreq.h"
 #include "internal.h"
 #include "sllist-inl.h"
+#include <algorithm>
 
 using namespace lcb::docreq;
 
@@ -12,6 +13,10 @@ static void doc_callback(lcb_t,int, const lcb_RESPBASE *);
 #define MIN_SCHED_SIZE 5
 #define DOCQ_DELAY_US 200000
 
+/* A GET is considered to be "flat" (i.e. not queued behind other requests)
+ * if its latency is within this factor of the lowest latency seen so far */
+#define DOCQ_LATENCY_SLACK 2
+
 Queue::Queue(lcb_t instance_)
     : instance(instance_),
       parent(NULL),
@@ -20,13 +25,19 @@ Queue::Queue(lcb_t instance_)
       n_awaiting_schedule(0),
       n_awaiting_response(0),
       max_pending_response(MAX_PENDING_DOCREQ),
+      max_window(MAX_PENDING_DOCREQ),
       min_batch_size(MIN_SCHED_SIZE),
+      n_window_acked(0),
+      lat_min(0),
+      lat_avg(0),
       cancelled(false),
-      refcount(1)
+      refcount(1),
+      stream_done(false)
       {
 
     memset(&pending_gets, 0, sizeof pending_gets);
     memset(&cb_queue, 0, sizeof cb_queue);
+    set_max_window(LCBT_SETTING(instance, views_docs_window));
 }
 
 Queue::~Queue() {
@@ -50,8 +61,11 @@ void Queue::cancel() {
 static void
 docq_poke(Queue *q)
 {
-    if (q->n_awaiting_response < q->max_pending_response) {
-        if (q->n_awaiting_schedule > q->min_batch_size) {
+    if (q->n_awaiting_response < q->max_pending_response &&
+            q->n_awaiting_schedule) {
+        /* Once the stream is done, no more items will arrive to fill up the
+         * batch, so there's no point in waiting for the timer */
+        if (q->n_awaiting_schedule > q->min_batch_size || q->stream_done) {
             lcbio_async_signal(q->timer);
             q->cb_throttle(q, 0);
         }
@@ -62,6 +76,50 @@ docq_poke(Queue *q)
     }
 }
 
+void Queue::end_stream() {
+    if (stream_done) {
+        return;
+    }
+    stream_done = true;
+    docq_poke(this);
+}
+
+/* Adjusts the window based on the outcome of a single GET. The window is
+ * grown by one for every window's worth of GETs which completed without a
+ * rise in latency, and is halved whenever a GET times out. */
+static void
+docq_adjust_window(Queue *q, const DocRequest *dreq, lcb_error_t rc)
+{
+    if (rc == LCB_ETIMEDOUT) {
+        q->max_pending_response = std::max(1U, q->max_pending_response / 2);
+        q->n_window_acked = 0;
+        return;
+    }
+
+    hrtime_t latency = gethrtime() - dreq->start;
+    if (q->lat_min == 0 || latency < q->lat_min) {
+        q->lat_min = latency;
+    }
+    if (q->lat_avg == 0) {
+        q->lat_avg = latency;
+    } else {
+        q->lat_avg = (q->lat_avg * 7 + latency) / 8;
+    }
+
+    if (q->lat_avg > q->lat_min * DOCQ_LATENCY_SLACK) {
+        /* Latency is rising: don't grow any further */
+        q->n_window_acked = 0;
+        return;
+    }
+
+    if (++q->n_window_acked >= q->max_pending_response) {
+        q->n_window_acked = 0;
+        if (q->max_pending_response < q->max_window) {
+            q->max_pending_response++;
+        }
+    }
+}
+
 void Queue::add(DocRequest *req)
 {
     sllist_append(&pending_gets, &req->slnode);
@@ -83,7 +141,7 @@ docreq_handler(void *arg)
     SLLIST_ITERFOR(&q->pending_gets, &iter) {
         DocRequest *cont = SLLIST_ITEM(iter.cur, DocRequest, slnode);
 
-        if (q->n_awaiting_response > q->max_pending_response) {
+        if (q->n_awaiting_response >= q->max_pending_response) {
             lcbio_timer_rearm(q->timer, DOCQ_DELAY_US);
             q->cb_throttle(q, 1);
             break;
@@ -101,6 +159,7 @@ docreq_handler(void *arg)
 
             LCB_CMD_SET_KEY(&gcmd, cont->docid.iov_base, cont->docid.iov_len);
             cont->callback = doc_callback;
+            cont->start = gethrtime();
             gcmd.cmdflags |= LCB_CMD_F_INTERNAL_CALLBACK;
             rc = lcb_get3(instance, &cont->callback, &gcmd);
 
@@ -169,6 +228,7 @@ doc_callback(lcb_t, int, const lcb_RESPBASE *rb)
     q->ref();
 
     q->n_awaiting_response--;
+    docq_adjust_window(q, dreq, rg->rc);
     dreq->docresp = *rg;
     dreq->ready = 1;
     dreq->docresp.key = dreq->docid.iov_base;
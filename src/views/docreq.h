@@ -23,6 +23,13 @@ struct Queue {
     void unref();
     void ref() {refcount++;}
     void cancel();
+    void end_stream();
+    void set_max_window(unsigned n) {
+        max_window = n ? n : 1;
+        if (max_pending_response > max_window) {
+            max_pending_response = max_window;
+        }
+    }
     bool has_pending() const {
         return n_awaiting_response || n_awaiting_schedule;
     }
@@ -54,10 +61,29 @@ struct Queue {
     unsigned n_awaiting_schedule;
     unsigned n_awaiting_response;
 
+    /**Current size of the fetch window, i.e. the number of GETs which may be
+     * in flight at any given time. This is adjusted between 1 and
+     * #max_window based on the observed latency of each GET */
     unsigned max_pending_response;
+
+    /**Upper bound for the fetch window */
+    unsigned max_window;
     unsigned min_batch_size;
+
+    /**Number of GETs completed since the window was last adjusted */
+    unsigned n_window_acked;
+
+    /**Lowest and smoothed per-GET latency, used to determine whether the
+     * window can be grown without increasing latency */
+    hrtime_t lat_min;
+    hrtime_t lat_avg;
+
     unsigned cancelled;
     unsigned refcount;
+
+    /**Set when no more requests will be added to the queue. Remaining
+     * requests are then scheduled without waiting for a batch to fill up */
+    bool stream_done;
 };
 
 struct DocRequest {
@@ -68,6 +94,7 @@ struct DocRequest {
     lcb_RESPGET docresp;
     /* To be filled in by the subclass */
     lcb_IOV docid;
+    hrtime_t start;
     unsigned ready;
 };
 
@@ -68,6 +68,9 @@ chunk_callback(lcb_t instance, int, const lcb_RESPBASE *rb)
             }
         }
         req->ref();
+        if (req->docq) {
+            req->docq->end_stream();
+        }
         req->invoke_last();
         if (rh->rflags & LCB_RESP_F_FINAL) {
             req->htreq = NULL;
@@ -146,7 +149,10 @@ void ViewRequest::JSPARSE_on_error(const std::string&) {
 }
 
 void ViewRequest::JSPARSE_on_complete(const std::string&) {
-    // Nothing
+    if (docq) {
+        // No more rows; schedule any remaining documents right away
+        docq->end_stream();
+    }
 }
 
 static void
@@ -259,7 +265,7 @@ ViewRequest::ViewRequest(lcb_t instance_, const void *cookie_,
         docq->cb_ready = cb_doc_ready;
         docq->cb_throttle = cb_docq_throttle;
         if (cmd->docs_concurrent_max) {
-            docq->max_pending_response = cmd->docs_concurrent_max;
+            docq->set_max_window(cmd->docs_concurrent_max);
         }
     }
 
@@ -17,6 +17,7 @@
 #include "internal.h"
 #include <lcbio/iotable.h>
 #include <lcbio/timer-ng.h>
+#include <set>
 
 static bool
 has_pending(lcb_t instance)
@@ -31,7 +32,8 @@ has_pending(lcb_t instance)
     }
 
     for (size_t ii = 0; ii < LCBT_NSERVERS(instance); ii++) {
-        if (instance->get_server(ii)->has_pending()) {
+        if (instance->get_server(ii)->has_pending() ||
+                instance->get_server(ii)->has_pending_flush()) {
             return true;
         }
     }
@@ -154,3 +156,142 @@ void lcb_breakout(lcb_t instance)
         instance->wait = 0;
     }
 }
+
+namespace lcb {
+struct WaitSet {
+    WaitSet(lcb_t instance_, const lcb_WAITCOOKIES *params)
+        : instance(instance_), threshold(params->threshold),
+          any(params->cookies == NULL), ncompleted(0), timedout(false),
+          timer(NULL) {
+
+        if (params->cookies) {
+            cookies.insert(params->cookies, params->cookies + params->ncookies);
+        }
+        if (params->timeout) {
+            timer = lcbio_timer_new(instance->iotable, this, on_deadline);
+            lcbio_timer_rearm(timer, params->timeout);
+        }
+    }
+
+    ~WaitSet() {
+        if (timer) {
+            lcbio_timer_destroy(timer);
+        }
+    }
+
+    /**
+     * Count the completion of an operation with this cookie. Each listed
+     * cookie stands for one operation, so one entry is removed per completion.
+     * Returns false if the operation is not waited for
+     */
+    bool complete(const void *cookie) {
+        if (!any) {
+            std::multiset<const void*>::iterator it = cookies.find(cookie);
+            if (it == cookies.end()) {
+                return false;
+            }
+            cookies.erase(it);
+        }
+        ncompleted++;
+        return true;
+    }
+
+    /** Whether the conditions for returning were met */
+    bool satisfied() const {
+        if (threshold && ncompleted >= threshold) {
+            return true;
+        }
+        return !any && cookies.empty();
+    }
+
+    void done() {
+        if (instance->wait) {
+            instance->wait = 0;
+            IOT_STOP(instance->iotable);
+        }
+    }
+
+    static void on_deadline(void *arg) {
+        WaitSet *ws = reinterpret_cast<WaitSet*>(arg);
+        ws->timedout = true;
+        ws->done();
+    }
+
+    lcb_t instance;
+    std::multiset<const void*> cookies; /**< Operations not yet completed */
+    size_t threshold; /**< 0 if waiting for all of the operations */
+    bool any; /**< Whether operations with any cookie are counted */
+    size_t ncompleted;
+    bool timedout;
+    lcbio_pTIMER timer;
+};
+}
+
+/**
+ * Returns true if this response is the last one for its operation. Most
+ * operations only ever get a single response.
+ */
+static bool
+is_final_response(int cbtype, const lcb_RESPBASE *rb)
+{
+    switch (cbtype) {
+    case LCB_CALLBACK_STATS:
+    case LCB_CALLBACK_VERSIONS:
+    case LCB_CALLBACK_VERBOSITY:
+    case LCB_CALLBACK_FLUSH:
+    case LCB_CALLBACK_OBSERVE:
+    case LCB_CALLBACK_GETREPLICA:
+    case LCB_CALLBACK_HTTP:
+        return rb->rflags & LCB_RESP_F_FINAL;
+    default:
+        return true;
+    }
+}
+
+void
+lcb_waitset_callback(lcb_t instance, int cbtype, const lcb_RESPBASE *rb)
+{
+    lcb::WaitSet *ws = instance->waitset;
+    // The response may not be valid once the user callback returns
+    const void *cookie = rb->cookie;
+    bool is_final = is_final_response(cbtype, rb);
+
+    lcb_find_user_callback(instance, (lcb_CALLBACKTYPE)cbtype)(
+            instance, cbtype, rb);
+
+    if (!is_final || ws != instance->waitset || !ws->complete(cookie)) {
+        return;
+    }
+    if (ws->satisfied()) {
+        ws->done();
+    }
+}
+
+LIBCOUCHBASE_API
+lcb_error_t lcb_wait_cookies(lcb_t instance, lcb_WAITCOOKIES *params)
+{
+    params->ncompleted = 0;
+    if (instance->wait) {
+        return LCB_EINVAL;
+    }
+    if (params->cookies && params->ncookies == 0) {
+        return LCB_SUCCESS;
+    }
+    if (!has_pending(instance)) {
+        return LCB_SUCCESS;
+    }
+
+    maybe_reset_timeouts(instance);
+    lcb::WaitSet ws(instance, params);
+    instance->waitset = &ws;
+    instance->wait = 1;
+    IOT_START(instance->iotable);
+    instance->wait = 0;
+    instance->waitset = NULL;
+
+    params->ncompleted = ws.ncompleted;
+    if (ws.timedout && !ws.satisfied()) {
+        return LCB_ETIMEDOUT;
+    }
+    return LCB_SUCCESS;
+}
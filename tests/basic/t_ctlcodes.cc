@@ -88,5 +88,93 @@ TEST_F(CtlTest, testStringCtls)
     err = lcb_cntl_string(instance, "unsafe_optimize", "0");
     ASSERT_NE(LCB_SUCCESS, err);
 
+    err = lcb_cntl_string(instance, "views_docs_window", "32");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(32, getSetting<lcb_U32>(instance, LCB_CNTL_VIEW_DOCS_WINDOW));
+    err = lcb_cntl_string(instance, "views_docs_window", "0");
+    ASSERT_NE(LCB_SUCCESS, err);
+
+    err = lcb_cntl_string(instance, "http_svc_poolsize", "query:8");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    lcb_U32 poolopt = LCB_HTTPPOOLOPT_CREATE(LCB_HTTP_TYPE_N1QL, 0);
+    err = lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_HTTP_SVC_POOLSIZE, &poolopt);
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(8, LCB_HTTPPOOLOPT_GETVALUE(poolopt));
+    poolopt = LCB_HTTPPOOLOPT_CREATE(LCB_HTTP_TYPE_FTS, 0);
+    err = lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_HTTP_SVC_POOLSIZE, &poolopt);
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(LCB_HTTPPOOL_INHERIT, LCB_HTTPPOOLOPT_GETVALUE(poolopt));
+    err = lcb_cntl_string(instance, "http_preconnect", "search:2");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    err = lcb_cntl_string(instance, "http_preconnect", "bogus:2");
+    ASSERT_NE(LCB_SUCCESS, err);
+
+    err = lcb_cntl_string(instance, "dns_cache_ttl", "5");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(5000000, getSetting<lcb_U32>(instance, LCB_CNTL_DNS_CACHE_TTL));
+    err = lcb_cntl_string(instance, "dns_negative_ttl", "0");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(0, getSetting<lcb_U32>(instance, LCB_CNTL_DNS_NEGATIVE_TTL));
+
+    ASSERT_EQ(0, getSetting<int>(instance, LCB_CNTL_GET_COALESCE));
+    err = lcb_cntl_string(instance, "get_coalesce", "true");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(1, getSetting<int>(instance, LCB_CNTL_GET_COALESCE));
+    lcb_cntl_coalescestats cstats = getSetting<lcb_cntl_coalescestats>(
+        instance, LCB_CNTL_GET_COALESCE_STATS);
+    ASSERT_EQ(0U, cstats.requests);
+    ASSERT_EQ(0U, cstats.coalesced);
+
+    err = lcb_cntl_string(instance, "autocork", "true");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(1, getSetting<int>(instance, LCB_CNTL_AUTOCORK));
+    err = lcb_cntl_string(instance, "autocork_window", "0.5");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(500000, getSetting<lcb_U32>(instance, LCB_CNTL_AUTOCORK_WINDOW));
+
+    ASSERT_EQ(0U, getSetting<lcb_SIZE>(instance, LCB_CNTL_ZEROCOPY_THRESHOLD));
+    err = lcb_cntl_string(instance, "zerocopy_threshold", "65536");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(65536U, getSetting<lcb_SIZE>(instance, LCB_CNTL_ZEROCOPY_THRESHOLD));
+
+    ASSERT_TRUE(getSetting<const char*>(instance, LCB_CNTL_OPCAPTURE_FILE) == NULL);
+    err = lcb_cntl_string(instance, "opcapture_file", "ctltest.opcap");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_STREQ("ctltest.opcap", getSetting<const char*>(instance, LCB_CNTL_OPCAPTURE_FILE));
+    err = lcb_cntl_string(instance, "opcapture_file", "");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_TRUE(getSetting<const char*>(instance, LCB_CNTL_OPCAPTURE_FILE) == NULL);
+    ASSERT_EQ(0, remove("ctltest.opcap"));
+    err = lcb_cntl_string(instance, "opcapture_file", "/nonexistent/ctltest.opcap");
+    ASSERT_NE(LCB_SUCCESS, err);
+    err = lcb_cntl_string(instance, "opcapture_keys", "true");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(1, getSetting<int>(instance, LCB_CNTL_OPCAPTURE_KEYS));
+
+    ASSERT_EQ(0U, getSetting<lcb_U32>(instance, LCB_CNTL_SLOWOP_COUNT));
+    err = lcb_cntl_string(instance, "slowop_count", "5");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(5U, getSetting<lcb_U32>(instance, LCB_CNTL_SLOWOP_COUNT));
+    err = lcb_cntl_string(instance, "slowop_threshold", "0.1");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(100000U, getSetting<lcb_U32>(instance, LCB_CNTL_SLOWOP_THRESHOLD));
+    ASSERT_EQ(10000000U, getSetting<lcb_U32>(instance, LCB_CNTL_SLOWOP_INTERVAL));
+    err = lcb_cntl_string(instance, "slowop_interval", "60");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(60000000U, getSetting<lcb_U32>(instance, LCB_CNTL_SLOWOP_INTERVAL));
+    err = lcb_cntl_string(instance, "slowop_count", "0");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(0U, getSetting<lcb_U32>(instance, LCB_CNTL_SLOWOP_COUNT));
+
+    ASSERT_EQ(0, getSetting<int>(instance, LCB_CNTL_OPTIMISTIC_NEGOTIATION));
+    err = lcb_cntl_string(instance, "optimistic_negotiation", "true");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(1, getSetting<int>(instance, LCB_CNTL_OPTIMISTIC_NEGOTIATION));
+
+    ASSERT_EQ(0, getSetting<int>(instance, LCB_CNTL_KV_PRECONNECT));
+    err = lcb_cntl_string(instance, "kv_preconnect", "true");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(1, getSetting<int>(instance, LCB_CNTL_KV_PRECONNECT));
+
     lcb_destroy(instance);
 }
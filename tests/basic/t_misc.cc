@@ -22,3 +22,33 @@ TEST_F(MiscTests, testGetTmpdir)
 TEST_F(MiscTests, testVersionG) {
     ASSERT_GT(lcb_version_g, 0);
 }
+
+TEST_F(MiscTests, testMetricsSnapshot)
+{
+    lcb_t instance;
+    lcb_create_st crst;
+    memset(&crst, 0, sizeof crst);
+    crst.version = 3;
+    crst.v.v3.connstr = "couchbase://localhost/my\"bucket";
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, &crst));
+
+    lcb_SIZE n = lcb_metrics_snapshot(instance, NULL, 0);
+    ASSERT_GT(n, 0U);
+    std::vector<char> buf(n + 1);
+    ASSERT_EQ(n, lcb_metrics_snapshot(instance, &buf[0], buf.size()));
+    std::string text(&buf[0]);
+    ASSERT_EQ(n, text.size());
+    ASSERT_NE(std::string::npos, text.find(
+        "# TYPE lcb_retries counter\n"));
+    ASSERT_NE(std::string::npos, text.find(
+        "lcb_retries_total{bucket=\"my\\\"bucket\"} 0\n"));
+    ASSERT_NE(std::string::npos, text.find(
+        "lcb_pool_connections{bucket=\"my\\\"bucket\",pool=\"kv\",state=\"idle\"} 0\n"));
+    ASSERT_EQ(text.size() - 6, text.rfind("# EOF\n"));
+
+    // Truncated like snprintf
+    char small[8];
+    ASSERT_EQ(n, lcb_metrics_snapshot(instance, small, sizeof small));
+    ASSERT_STREQ("# TYPE ", small);
+    lcb_destroy(instance);
+}
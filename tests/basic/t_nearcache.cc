@@ -0,0 +1,144 @@
+#include "config.h"
+#include "internal.h"
+#include "nearcache.h"
+#include <gtest/gtest.h>
+#include <unistd.h>
+#define LIBCOUCHBASE_INTERNAL 1
+#include <libcouchbase/couchbase.h>
+
+class NearCacheTest : public ::testing::Test
+{
+protected:
+    void SetUp() {
+        ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, NULL));
+        lcb_install_callback3(instance, LCB_CALLBACK_GET, get_callback);
+    }
+    void TearDown() {
+        lcb_destroy(instance);
+    }
+
+    // Pretend a GET for the key was answered by the server
+    void received(const std::string& key, const std::string& value,
+                  lcb_CAS cas = 1) {
+        lcb_RESPGET resp = { 0 };
+        resp.key = key.c_str();
+        resp.nkey = key.size();
+        resp.value = value.c_str();
+        resp.nvalue = value.size();
+        resp.cas = cas;
+        instance->near_cache->update(&resp);
+    }
+
+    lcb_error_t get(const std::string& key, lcb_U32 cmdflags = 0) {
+        lcb_CMDGET cmd = { 0 };
+        LCB_CMD_SET_KEY(&cmd, key.c_str(), key.size());
+        cmd.cmdflags = cmdflags;
+        return lcb_get3(instance, this, &cmd);
+    }
+
+    lcb_cntl_nearcachestats stats() {
+        lcb_cntl_nearcachestats ret;
+        EXPECT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET,
+            LCB_CNTL_NEAR_CACHE_STATS, &ret));
+        return ret;
+    }
+
+    static void get_callback(lcb_t, int, const lcb_RESPBASE *rb) {
+        const lcb_RESPGET *resp = (const lcb_RESPGET *)rb;
+        NearCacheTest *t = (NearCacheTest *)resp->cookie;
+        EXPECT_EQ(LCB_SUCCESS, resp->rc);
+        t->ncallbacks++;
+        t->lastval.assign((const char *)resp->value, resp->nvalue);
+        t->lastcas = resp->cas;
+    }
+
+    lcb_t instance;
+    int ncallbacks;
+    std::string lastval;
+    lcb_CAS lastcas;
+
+public:
+    NearCacheTest() : instance(NULL), ncallbacks(0), lastcas(0) {}
+};
+
+// Without a cluster configuration, any GET which is not answered from the
+// cache fails with LCB_CLIENT_ETMPFAIL
+
+TEST_F(NearCacheTest, testHitAndInvalidate)
+{
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "near_cache_size", "65536"));
+    ASSERT_EQ(LCB_CLIENT_ETMPFAIL, get("key"));
+    ASSERT_FALSE(instance->near_cache == NULL);
+
+    received("key", "value", 42);
+    ASSERT_EQ(LCB_SUCCESS, get("key"));
+    ASSERT_EQ(LCB_SUCCESS, get("key"));
+    // Responses are not delivered from within lcb_get3()
+    ASSERT_EQ(0, ncallbacks);
+    lcb_wait(instance);
+    ASSERT_EQ(2, ncallbacks);
+    ASSERT_EQ("value", lastval);
+    ASSERT_EQ(42U, lastcas);
+
+    ASSERT_EQ(LCB_CLIENT_ETMPFAIL, get("key", LCB_CMDGET_F_NOCACHE));
+
+    lcb_cntl_nearcachestats st = stats();
+    ASSERT_EQ(2U, st.hits);
+    ASSERT_EQ(1U, st.misses);
+    ASSERT_EQ(1U, st.items);
+    ASSERT_NE(0U, st.bytes);
+
+    instance->near_cache->invalidate("key", 3);
+    ASSERT_EQ(LCB_CLIENT_ETMPFAIL, get("key"));
+    st = stats();
+    ASSERT_EQ(1U, st.invalidations);
+    ASSERT_EQ(0U, st.items);
+    ASSERT_EQ(0U, st.bytes);
+}
+
+TEST_F(NearCacheTest, testExpiry)
+{
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "near_cache_size", "65536"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_setu32(instance, LCB_CNTL_NEAR_CACHE_TTL, 1000));
+    ASSERT_EQ(LCB_CLIENT_ETMPFAIL, get("key"));
+    received("key", "value");
+    usleep(5000);
+    ASSERT_EQ(LCB_CLIENT_ETMPFAIL, get("key"));
+    ASSERT_EQ(0U, stats().items);
+}
+
+TEST_F(NearCacheTest, testBoundedAdmission)
+{
+    const lcb_SIZE capacity = 8192;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET,
+        LCB_CNTL_NEAR_CACHE_SIZE, (void *)&capacity));
+
+    // A popular key
+    for (int ii = 0; ii < 10; ii++) {
+        ASSERT_EQ(LCB_CLIENT_ETMPFAIL, get("hot"));
+    }
+
+    std::string value(200, '*');
+    for (int ii = 0; ii < 500; ii++) {
+        char key[32];
+        sprintf(key, "cold_%d", ii);
+        ASSERT_EQ(LCB_CLIENT_ETMPFAIL, get(key));
+        received(key, value);
+        ASSERT_LE(stats().bytes, capacity);
+    }
+
+    lcb_cntl_nearcachestats st = stats();
+    ASSERT_GT(st.items, 0U);
+    ASSERT_GT(st.evictions + st.rejections, 0U);
+
+    // The popular key displaces a less popular one
+    received("hot", value);
+    ASSERT_EQ(LCB_SUCCESS, get("hot"));
+    lcb_wait(instance);
+    ASSERT_EQ(1, ncallbacks);
+    ASSERT_LE(stats().bytes, capacity);
+
+    // A value larger than the cache is never stored
+    received("huge", std::string(capacity, '*'));
+    ASSERT_EQ(LCB_CLIENT_ETMPFAIL, get("huge"));
+}
@@ -149,15 +149,18 @@ TEST_F(NetbufTest, testFlush)
         netbuf_enqueue_span(&mgr, spans + ii);
     }
 
+    ASSERT_EQ(150, netbuf_get_pending_size(&mgr));
     sz = netbuf_start_flush(&mgr, iov, 10, NULL);
     ASSERT_EQ(150, sz);
     netbuf_end_flush(&mgr, 75);
+    ASSERT_EQ(75, netbuf_get_pending_size(&mgr));
     netbuf_reset_flush(&mgr);
     sz = netbuf_start_flush(&mgr, iov, 10, NULL);
     ASSERT_EQ(75, sz);
     netbuf_end_flush(&mgr, 75);
     sz = netbuf_start_flush(&mgr, iov, 10, NULL);
     ASSERT_EQ(0, sz);
+    ASSERT_EQ(0, netbuf_get_pending_size(&mgr));
     netbuf_mblock_release(&mgr, &spans[0]);
 
     spans[0].size = 20;
@@ -171,3 +171,73 @@ TEST_F(HtparseTest, testCanKeepalive)
     delete parser;
     lcb_settings_unref(settings);
 }
+
+TEST_F(HtparseTest, testContentLengthReserve)
+{
+    lcb_settings *settings = lcb_settings_new();
+    Parser *parser = new Parser(settings);
+    string buf = "HTTP/1.1 200 OK\r\n"
+            "Content-Length: 4096\r\n"
+            "\r\n";
+    unsigned state = parser->parse(buf.c_str(), buf.size());
+    ASSERT_EQ(0, state & Parser::S_ERROR);
+    ASSERT_EQ(0, state & Parser::S_DONE);
+
+    Response& resp = parser->get_cur_response();
+    ASSERT_EQ(4096, resp.content_length);
+    ASSERT_GE(resp.body.capacity(), 4096);
+    delete parser;
+    lcb_settings_unref(settings);
+}
+
+TEST_F(HtparseTest, testBodySegments)
+{
+    lcb_settings *settings = lcb_settings_new();
+    Parser *parser = new Parser(settings);
+    rdb_IOROPE ior;
+    rdb_init(&ior, rdb_libcalloc_new());
+
+    string buf = "HTTP/1.1 200 OK\r\n"
+            "Transfer-Encoding: chunked\r\n"
+            "\r\n"
+            "6\r\nHello \r\n"
+            "5\r\nWorld\r\n"
+            "0\r\n\r\n";
+    rdb_copywrite(&ior, &buf[0], buf.size());
+
+    rdb_ROPESEG *seg = rdb_get_first_segment(&ior);
+    rdb_IOROPE *iorp = &ior;
+    const char *input = rdb_refread(iorp);
+    unsigned ninput = buf.size(), state;
+    Response& resp = parser->get_cur_response();
+    do {
+        const char *body;
+        unsigned nbody, nused;
+        state = parser->parse_ex(input, ninput, &nused, &nbody, &body);
+        ASSERT_EQ(0, state & Parser::S_ERROR);
+        if (nbody) {
+            resp.append_body_ref(body, nbody, seg);
+        }
+        input += nused;
+        ninput -= nused;
+    } while (!(state & Parser::S_DONE) && ninput);
+
+    ASSERT_NE(0, state & Parser::S_DONE);
+    ASSERT_EQ(0, resp.body.size());
+    ASSERT_EQ(2, resp.body_segments.size());
+    ASSERT_EQ(2, seg->refcnt);
+
+    // Data remains valid once consumed from the rope
+    rdb_consumed(&ior, buf.size());
+    string joined;
+    for (size_t ii = 0; ii < resp.body_segments.size(); ii++) {
+        joined.append(resp.body_segments[ii].buf, resp.body_segments[ii].nbuf);
+    }
+    ASSERT_EQ("Hello World", joined);
+
+    parser->reset();
+    ASSERT_TRUE(resp.body_segments.empty());
+    rdb_cleanup(&ior);
+    delete parser;
+    lcb_settings_unref(settings);
+}
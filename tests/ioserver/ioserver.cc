@@ -17,14 +17,14 @@ void
 TestServer::run()
 {
     fd_set fds;
-    struct timeval tmout = { 1, 0 };
-
-    FD_ZERO(&fds);
-    FD_SET(*lsn, &fds);
 
     while (!closed) {
         struct sockaddr_in newaddr;
         socklen_t naddr = sizeof(newaddr);
+        // select() modifies both of these, so reset them on each iteration
+        struct timeval tmout = { 1, 0 };
+        FD_ZERO(&fds);
+        FD_SET(*lsn, &fds);
 
         if (select(*lsn + 1, &fds, NULL, NULL, &tmout) == 1) {
             int newsock = accept(*lsn, (struct sockaddr *)&newaddr, &naddr);
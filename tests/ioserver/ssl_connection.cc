@@ -26,7 +26,6 @@ public:
 
 private:
     SSL *ssl;
-    SSL_CTX *ctx;
     SockFD *sfd;
     bool ok;
 };
@@ -87,7 +86,7 @@ static void genCertificate(SSL_CTX *ctx) {
     X509_NAME_add_entry_by_txt(name, "O",  MBSTRING_ASC, (unsigned char *)"MyCompany Inc.", -1, -1, 0);
     X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (unsigned char *)"localhost", -1, -1, 0);
     X509_set_issuer_name(x509, name);
-    X509_sign(x509, pkey, EVP_sha1());
+    X509_sign(x509, pkey, EVP_sha256());
 
     SSL_CTX_use_PrivateKey(ctx, pkey);
     SSL_CTX_use_certificate(ctx, x509);
@@ -95,9 +94,14 @@ static void genCertificate(SSL_CTX *ctx) {
     EVP_PKEY_free(pkey);
 }
 
-SslSocket::SslSocket(SockFD *inner) : SockFD(inner->getFD())
-{
-    sfd = inner;
+// The context is shared by all connections so that clients may resume
+// sessions established by earlier connections.
+static SSL_CTX *getServerContext() {
+    static SSL_CTX *ctx = NULL;
+    if (ctx != NULL) {
+        return ctx;
+    }
+
     ctx = SSL_CTX_new(SSLv23_server_method());
     assert(ctx != NULL);
 
@@ -107,8 +111,14 @@ SslSocket::SslSocket(SockFD *inner) : SockFD(inner->getFD())
     SSL_CTX_set_options(ctx, SSL_OP_NO_SSLv2|SSL_OP_NO_SSLv3);
     SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
     SSL_CTX_load_verify_locations(ctx, NULL, NULL);
+    SSL_CTX_set_session_id_context(ctx, (const unsigned char *)"ioserver", 8);
+    return ctx;
+}
 
-    ssl = SSL_new(ctx);
+SslSocket::SslSocket(SockFD *inner) : SockFD(inner->getFD())
+{
+    sfd = inner;
+    ssl = SSL_new(getServerContext());
     assert(ssl != NULL);
     SSL_set_accept_state(ssl);
     SSL_set_fd(ssl, sfd->getFD());
@@ -136,7 +146,6 @@ SslSocket::close()
 SslSocket::~SslSocket()
 {
     SSL_free(ssl);
-    SSL_CTX_free(ctx);
     delete sfd;
 }
 
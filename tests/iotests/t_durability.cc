@@ -1057,3 +1057,85 @@ TEST_F(DurabilityUnitTest, testDurStore)
         lcb_log(LOGARGS(instance, WARN), "Test skipped because mock is too fast(!)");
     }
 }
+
+extern "C" {
+static void durstoreCountCallback(lcb_t, int, const lcb_RESPBASE *rb)
+{
+    const lcb_RESPSTOREDUR *resp = reinterpret_cast<const lcb_RESPSTOREDUR*>(rb);
+    std::map<lcb_error_t, size_t> *counts =
+            reinterpret_cast<std::map<lcb_error_t, size_t>*>(rb->cookie);
+    (*counts)[resp->rc]++;
+}
+}
+
+extern "C" {
+static void seqnoProbeTrace(mc_CMDQUEUE *cq, const mc_PACKET *pkt, mcreq_TRACEEVENT event)
+{
+    if (event != MCREQ_TRACE_ENQUEUED) {
+        return;
+    }
+    protocol_binary_request_header hdr;
+    mcreq_read_hdr(pkt, &hdr);
+    if (hdr.request.opcode == PROTOCOL_BINARY_CMD_OBSERVE_SEQNO) {
+        (*(size_t *)lcb_get_cookie((lcb_t)cq->cqdata))++;
+    }
+}
+}
+
+TEST_F(DurabilityUnitTest, testDurStoreSeqnoBatch)
+{
+    HandleWrap hw;
+    lcb_t instance;
+    lcb_durability_opts_t options = { 0 };
+    createConnection(hw, instance);
+
+    if (!supportsMutationTokens(instance)) {
+        return;
+    }
+
+    lcb_install_callback3(instance, LCB_CALLBACK_STOREDUR, durstoreCountCallback);
+    defaultOptions(instance, options);
+
+    // Many items sharing the same vBucket; probes for these are coalesced
+    const size_t nkeys = 200;
+    std::vector<std::string> keys;
+    int targetVb = -1;
+    for (unsigned ii = 0; keys.size() < nkeys; ii++) {
+        char key[64];
+        int vb, srvix;
+        sprintf(key, "durStoreSeqnoBatch_%u", ii);
+        lcbvb_map_key(LCBT_VBCONFIG(instance), key, strlen(key), &vb, &srvix);
+        if (targetVb == -1) {
+            targetVb = vb;
+        }
+        if (vb == targetVb) {
+            keys.push_back(key);
+        }
+    }
+
+    size_t nprobes = 0;
+    lcb_set_cookie(instance, &nprobes);
+    instance->cmdq.trace = seqnoProbeTrace;
+
+    std::map<lcb_error_t, size_t> counts;
+    lcb_sched_enter(instance);
+    for (size_t ii = 0; ii < nkeys; ii++) {
+        lcb_CMDSTOREDUR cmd = { 0 };
+        LCB_CMD_SET_KEY(&cmd, keys[ii].c_str(), keys[ii].size());
+        LCB_CMD_SET_VALUE(&cmd, "value", 5);
+        cmd.operation = LCB_SET;
+        cmd.persist_to = options.v.v0.persist_to;
+        cmd.replicate_to = options.v.v0.replicate_to;
+        ASSERT_EQ(LCB_SUCCESS, lcb_storedur3(instance, &counts, &cmd));
+    }
+    lcb_sched_leave(instance);
+    lcb_wait(instance);
+
+    ASSERT_EQ(1, counts.size());
+    ASSERT_EQ(nkeys, counts[LCB_SUCCESS]);
+
+    // One probe per server and poll, rather than one per item
+    instance->cmdq.trace = NULL;
+    ASSERT_LT(0, nprobes);
+    ASSERT_GT(nkeys, nprobes);
+}
@@ -510,3 +510,293 @@ TEST_F(GetUnitTest, testGetReplica)
     lcb_sched_leave(instance);
     lcb_wait(instance);
 }
+
+struct CoalesceCookie {
+    int remaining;
+    std::string value;
+    CoalesceCookie() : remaining(0) {}
+};
+
+extern "C" {
+static void coalesce_callback(lcb_t, int, const lcb_RESPBASE *rb)
+{
+    const lcb_RESPGET *resp = (const lcb_RESPGET *)rb;
+    CoalesceCookie *ck = (CoalesceCookie *)resp->cookie;
+    EXPECT_EQ(LCB_SUCCESS, resp->rc);
+    ck->value.assign((const char *)resp->value, resp->nvalue);
+    ck->remaining--;
+}
+}
+
+/**
+ * @test GET coalescing
+ * @pre Enable LCB_CNTL_GET_COALESCE and schedule several GETs for the same
+ * key in a single batch, along with a GET which touches the key
+ * @post Every GET receives the value, and only the plain GETs after the first
+ * are reported as coalesced
+ */
+TEST_F(GetUnitTest, testGetCoalesce)
+{
+    HandleWrap hw;
+    lcb_t instance;
+    lcb_error_t err;
+    createConnection(hw, instance);
+
+    std::string key("testGetCoalesce");
+    storeKey(instance, key, "coalesced");
+
+    err = lcb_cntl_string(instance, "get_coalesce", "true");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    lcb_install_callback3(instance, LCB_CALLBACK_GET, coalesce_callback);
+
+    const int nplain = 5;
+    CoalesceCookie cookies[nplain + 1];
+    lcb_CMDGET gcmd = { 0 };
+    LCB_CMD_SET_KEY(&gcmd, key.c_str(), key.size());
+
+    lcb_sched_enter(instance);
+    for (int ii = 0; ii < nplain; ii++) {
+        cookies[ii].remaining = 1;
+        err = lcb_get3(instance, &cookies[ii], &gcmd);
+        ASSERT_EQ(LCB_SUCCESS, err);
+    }
+    gcmd.exptime = 300;
+    cookies[nplain].remaining = 1;
+    err = lcb_get3(instance, &cookies[nplain], &gcmd);
+    ASSERT_EQ(LCB_SUCCESS, err);
+    lcb_sched_leave(instance);
+    lcb_wait(instance);
+
+    for (int ii = 0; ii < nplain + 1; ii++) {
+        ASSERT_EQ(0, cookies[ii].remaining);
+        ASSERT_EQ("coalesced", cookies[ii].value);
+    }
+
+    lcb_cntl_coalescestats stats;
+    err = lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_GET_COALESCE_STATS, &stats);
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(1U, stats.requests);
+    ASSERT_EQ((lcb_U64)nplain - 1, stats.coalesced);
+
+    // Once the response has arrived, a new GET is sent again
+    gcmd.exptime = 0;
+    cookies[0].remaining = 1;
+    lcb_sched_enter(instance);
+    err = lcb_get3(instance, &cookies[0], &gcmd);
+    ASSERT_EQ(LCB_SUCCESS, err);
+    lcb_sched_leave(instance);
+    lcb_wait(instance);
+    ASSERT_EQ(0, cookies[0].remaining);
+    err = lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_GET_COALESCE_STATS, &stats);
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(2U, stats.requests);
+}
+
+/**
+ * @test GET coalescing with lcb_sched_fail()
+ * @pre Schedule a GET, then in a new scheduling context a GET for the same
+ * key which is attached to it, and fail that context
+ * @post Only the first GET receives a callback
+ */
+TEST_F(GetUnitTest, testGetCoalesceSchedFail)
+{
+    HandleWrap hw;
+    lcb_t instance;
+    lcb_error_t err;
+    createConnection(hw, instance);
+
+    std::string key("testGetCoalesceSchedFail");
+    storeKey(instance, key, "coalesced");
+
+    err = lcb_cntl_string(instance, "get_coalesce", "true");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    lcb_install_callback3(instance, LCB_CALLBACK_GET, coalesce_callback);
+
+    lcb_CMDGET gcmd = { 0 };
+    LCB_CMD_SET_KEY(&gcmd, key.c_str(), key.size());
+    CoalesceCookie leader, failed;
+    leader.remaining = 1;
+    lcb_sched_enter(instance);
+    ASSERT_EQ(LCB_SUCCESS, lcb_get3(instance, &leader, &gcmd));
+    lcb_sched_leave(instance);
+
+    lcb_sched_enter(instance);
+    ASSERT_EQ(LCB_SUCCESS, lcb_get3(instance, &failed, &gcmd));
+    lcb_sched_fail(instance);
+
+    lcb_cntl_coalescestats stats;
+    err = lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_GET_COALESCE_STATS, &stats);
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(0U, stats.coalesced);
+
+    lcb_wait(instance);
+    ASSERT_EQ(0, leader.remaining);
+    ASSERT_EQ("coalesced", leader.value);
+    ASSERT_EQ(0, failed.remaining);
+    ASSERT_TRUE(failed.value.empty());
+}
+
+/**
+ * @test Near cache
+ * @pre Enable the near cache, and read a key twice. Then modify it and read
+ * it again
+ * @post The second read is answered from the cache, and the modification
+ * invalidates the cached value
+ */
+TEST_F(GetUnitTest, testNearCache)
+{
+    HandleWrap hw;
+    lcb_t instance;
+    lcb_error_t err;
+    createConnection(hw, instance);
+
+    std::string key("testNearCache");
+    storeKey(instance, key, "first");
+
+    err = lcb_cntl_string(instance, "near_cache_size", "1048576");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    err = lcb_cntl_string(instance, "near_cache_ttl", "60");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    lcb_install_callback3(instance, LCB_CALLBACK_GET, coalesce_callback);
+
+    lcb_CMDGET gcmd = { 0 };
+    LCB_CMD_SET_KEY(&gcmd, key.c_str(), key.size());
+    CoalesceCookie ck;
+    for (int ii = 0; ii < 2; ii++) {
+        ck.remaining = 1;
+        lcb_sched_enter(instance);
+        ASSERT_EQ(LCB_SUCCESS, lcb_get3(instance, &ck, &gcmd));
+        lcb_sched_leave(instance);
+        lcb_wait(instance);
+        ASSERT_EQ(0, ck.remaining);
+        ASSERT_EQ("first", ck.value);
+    }
+
+    lcb_cntl_nearcachestats stats;
+    err = lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_NEAR_CACHE_STATS, &stats);
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(1U, stats.hits);
+    ASSERT_EQ(1U, stats.misses);
+
+    storeKey(instance, key, "second");
+    ck.remaining = 1;
+    lcb_sched_enter(instance);
+    ASSERT_EQ(LCB_SUCCESS, lcb_get3(instance, &ck, &gcmd));
+    lcb_sched_leave(instance);
+    lcb_wait(instance);
+    ASSERT_EQ("second", ck.value);
+    err = lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_NEAR_CACHE_STATS, &stats);
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(1U, stats.invalidations);
+}
+
+/**
+ * @test Near cache with lcb_sched_fail()
+ * @pre Cache a key, then read it within a scheduling context which is failed
+ * @post The cached value is not delivered. It is once the context is left
+ */
+TEST_F(GetUnitTest, testNearCacheSchedFail)
+{
+    HandleWrap hw;
+    lcb_t instance;
+    createConnection(hw, instance);
+
+    std::string key("testNearCacheSchedFail");
+    storeKey(instance, key, "cached");
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "near_cache_size", "1048576"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "near_cache_ttl", "60"));
+    lcb_install_callback3(instance, LCB_CALLBACK_GET, coalesce_callback);
+
+    lcb_CMDGET gcmd = { 0 };
+    LCB_CMD_SET_KEY(&gcmd, key.c_str(), key.size());
+    CoalesceCookie ck;
+    ck.remaining = 1;
+    ASSERT_EQ(LCB_SUCCESS, lcb_get3(instance, &ck, &gcmd));
+    lcb_wait(instance);
+    ASSERT_EQ(0, ck.remaining);
+
+    CoalesceCookie failed;
+    lcb_sched_enter(instance);
+    ASSERT_EQ(LCB_SUCCESS, lcb_get3(instance, &failed, &gcmd));
+    lcb_sched_fail(instance);
+    lcb_wait(instance);
+    ASSERT_EQ(0, failed.remaining);
+    ASSERT_TRUE(failed.value.empty());
+
+    lcb_cntl_nearcachestats stats;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_NEAR_CACHE_STATS, &stats));
+    ASSERT_EQ(0U, stats.hits);
+
+    // The hit is only delivered once the context is left
+    ck.remaining = 1;
+    ck.value.clear();
+    lcb_sched_enter(instance);
+    ASSERT_EQ(LCB_SUCCESS, lcb_get3(instance, &ck, &gcmd));
+    lcb_tick_nowait(instance);
+    ASSERT_EQ(1, ck.remaining);
+    lcb_sched_leave(instance);
+    lcb_wait(instance);
+    ASSERT_EQ(0, ck.remaining);
+    ASSERT_EQ("cached", ck.value);
+}
+
+/**
+ * @test Near cache revalidation
+ * @pre Enable LCB_CNTL_NEAR_CACHE_REVALIDATE with entries which expire at
+ * once. Read a key twice, then modify it through another instance and read
+ * it again
+ * @post The second read is answered from the cache after its CAS was
+ * checked. The third read finds the CAS changed and fetches the new value
+ */
+TEST_F(GetUnitTest, testNearCacheRevalidate)
+{
+    HandleWrap hw, hwWriter;
+    lcb_t instance, writer;
+    createConnection(hw, instance);
+    createConnection(hwWriter, writer);
+
+    std::string key("testNearCacheRevalidate");
+    storeKey(instance, key, "first");
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "near_cache_size", "1048576"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "near_cache_ttl", "0"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "near_cache_revalidate", "true"));
+    lcb_install_callback3(instance, LCB_CALLBACK_GET, coalesce_callback);
+
+    lcb_CMDGET gcmd = { 0 };
+    LCB_CMD_SET_KEY(&gcmd, key.c_str(), key.size());
+    CoalesceCookie ck;
+    lcb_cntl_nearcachestats stats;
+
+    // Fetched from the server and cached
+    ck.remaining = 1;
+    ASSERT_EQ(LCB_SUCCESS, lcb_get3(instance, &ck, &gcmd));
+    lcb_wait(instance);
+    ASSERT_EQ(0, ck.remaining);
+    ASSERT_EQ("first", ck.value);
+
+    // The entry has expired, but is still current
+    ck.remaining = 1;
+    ck.value.clear();
+    ASSERT_EQ(LCB_SUCCESS, lcb_get3(instance, &ck, &gcmd));
+    lcb_wait(instance);
+    ASSERT_EQ(0, ck.remaining);
+    ASSERT_EQ("first", ck.value);
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_NEAR_CACHE_STATS, &stats));
+    ASSERT_EQ(1U, stats.revalidations);
+    ASSERT_EQ(1U, stats.hits);
+    ASSERT_EQ(1U, stats.misses);
+    ASSERT_EQ(1U, stats.items);
+
+    // Modified elsewhere, so this instance's entry is not invalidated
+    storeKey(writer, key, "second");
+    ck.remaining = 1;
+    ck.value.clear();
+    ASSERT_EQ(LCB_SUCCESS, lcb_get3(instance, &ck, &gcmd));
+    lcb_wait(instance);
+    ASSERT_EQ(0, ck.remaining);
+    ASSERT_EQ("second", ck.value);
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_NEAR_CACHE_STATS, &stats));
+    ASSERT_EQ(2U, stats.revalidations);
+    ASSERT_EQ(1U, stats.hits);
+    ASSERT_EQ(2U, stats.misses);
+}
@@ -23,10 +23,16 @@
 #include "auth-priv.h"
 #include <lcbio/iotable.h>
 #include "bucketconfig/bc_http.h"
+#include "opcapture.h"
+#include <memcached/protocol_binary.h>
 
 #define LOGARGS(instance, lvl) \
     instance->settings, "tests-MUT", LCB_LOG_##lvl, __FILE__, __LINE__
 
+#if defined(_WIN32) && !defined(usleep)
+#define usleep(n) Sleep((n) / 1000)
+#endif
+
 
 extern "C" {
 static void timings_callback(lcb_t, const void *cookie, lcb_timeunit_t,
@@ -731,3 +737,143 @@ TEST_F(MockUnitTest, testMultiCreds)
     ASSERT_NE(auth.buckets().end(), res);
     ASSERT_EQ("secret", res->second);
 }
+
+/**
+ * @test Operation capture
+ * @pre Capture the operations of an instance, with their keys, while storing
+ * and then reading a key
+ * @post The capture holds a record for each operation with its opcode, key
+ * and value size
+ */
+TEST_F(MockUnitTest, testOpCapture)
+{
+    HandleWrap hw;
+    lcb_t instance;
+    createConnection(hw, instance);
+
+    lcb_error_t err = lcb_cntl_string(instance, "opcapture_keys", "true");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    err = lcb_cntl_string(instance, "opcapture_file", "testOpCapture.opcap");
+    ASSERT_EQ(LCB_SUCCESS, err);
+
+    std::string key("testOpCapture");
+    storeKey(instance, key, "captured");
+    Item itm;
+    getKey(instance, key, itm);
+
+    // Stopping the capture writes out the records
+    err = lcb_cntl_string(instance, "opcapture_file", "");
+    ASSERT_EQ(LCB_SUCCESS, err);
+
+    lcb::opcapture::Reader reader;
+    ASSERT_EQ("", reader.open("testOpCapture.opcap"));
+    lcb::opcapture::Record rec;
+    ASSERT_TRUE(reader.next(rec));
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_SET, rec.opcode);
+    ASSERT_EQ(key, rec.key);
+    ASSERT_EQ(lcb::opcapture::hash_key(key.c_str(), key.size()), rec.key_hash);
+    ASSERT_EQ(8U, rec.value_size);
+    ASSERT_EQ(0, rec.rc);
+    ASSERT_TRUE(reader.next(rec));
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_GET, rec.opcode);
+    ASSERT_EQ(key, rec.key);
+    ASSERT_EQ(8U, rec.value_size);
+    ASSERT_FALSE(reader.next(rec));
+    reader.close();
+    remove("testOpCapture.opcap");
+}
+
+namespace {
+struct SlowOpsLog : lcb_logprocs {
+    std::vector<std::string> messages;
+
+    SlowOpsLog() {
+        memset(static_cast<lcb_logprocs*>(this), 0, sizeof(lcb_logprocs));
+    }
+};
+}
+
+extern "C" {
+static void
+slowops_logger(lcb_logprocs *procs, unsigned int, const char *subsys,
+               int, const char *, int, const char *fmt, va_list ap)
+{
+    if (strcmp(subsys, "slowops") != 0) {
+        return;
+    }
+    char buf[8192];
+    vsnprintf(buf, sizeof buf, fmt, ap);
+    static_cast<SlowOpsLog*>(procs)->messages.push_back(buf);
+}
+
+static void
+slow_get_callback(lcb_t, int, const lcb_RESPBASE *rb)
+{
+    *(lcb_error_t *)rb->cookie = rb->rc;
+    usleep(200000);
+}
+}
+
+/**
+ * @test Slow operation tracing
+ * @pre Trace operations slower than 100ms, and read a key with a callback
+ * which takes 200ms
+ * @post The read is logged with its phases, and the time spent in its
+ * callback is part of its latency
+ */
+TEST_F(MockUnitTest, testSlowOps)
+{
+    HandleWrap hw;
+    lcb_t instance;
+    createConnection(hw, instance);
+
+    SlowOpsLog log;
+    log.v.v0.callback = slowops_logger;
+    lcb_error_t err = lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_LOGGER, &log);
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_setu32(instance, LCB_CNTL_SLOWOP_THRESHOLD, 100000));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_setu32(instance, LCB_CNTL_SLOWOP_COUNT, 2));
+
+    std::string key("testSlowOps");
+    storeKey(instance, key, "slow");
+    lcb_install_callback3(instance, LCB_CALLBACK_GET, slow_get_callback);
+    lcb_CMDGET gcmd = { 0 };
+    LCB_CMD_SET_KEY(&gcmd, key.c_str(), key.size());
+    lcb_error_t rc = LCB_ERROR;
+    ASSERT_EQ(LCB_SUCCESS, lcb_get3(instance, &rc, &gcmd));
+    lcb_wait(instance);
+    ASSERT_EQ(LCB_SUCCESS, rc);
+
+    // Disabling the tracer logs the operations kept so far
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_setu32(instance, LCB_CNTL_SLOWOP_COUNT, 0));
+    ASSERT_EQ(1, log.messages.size());
+    std::string prefix("Slowest operations: ");
+    ASSERT_EQ(0, log.messages[0].find(prefix));
+    Json::Value root;
+    ASSERT_TRUE(Json::Reader().parse(log.messages[0].substr(prefix.size()), root, false));
+
+    const Json::Value& get = root["get"];
+    ASSERT_EQ(1, get["count"].asInt());
+    ASSERT_EQ(1, get["slowest"].size());
+    const Json::Value& op = get["slowest"][0];
+    char hash[17];
+    sprintf(hash, "%016llx",
+            (unsigned long long)lcb::opcapture::hash_key(key.c_str(), key.size()));
+    ASSERT_EQ(hash, op["key_hash"].asString());
+    ASSERT_EQ(0, op["status"].asInt());
+    ASSERT_EQ(0, op["retries"].asInt());
+    ASSERT_EQ(0, op["decisions"].size());
+    ASSERT_FALSE(op["node"].asString().empty());
+
+    // Each phase was reached, in order, and the callback returned last
+    const Json::Value& phases = op["phases_us"];
+    const char *names[] = { "enqueued", "flushed", "header", "dispatched", "callback" };
+    for (size_t ii = 0; ii < 5; ii++) {
+        ASSERT_TRUE(phases.isMember(names[ii])) << names[ii];
+        if (ii) {
+            ASSERT_LE(phases[names[ii-1]].asUInt64(), phases[names[ii]].asUInt64());
+        }
+    }
+    ASSERT_LE(200000U, phases["callback"].asUInt64() - phases["dispatched"].asUInt64());
+    ASSERT_EQ(op["total_us"].asUInt64(), phases["callback"].asUInt64());
+}
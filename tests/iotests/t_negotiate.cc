@@ -0,0 +1,264 @@
+#include "config.h"
+#include "iotests.h"
+#include "internal.h"
+#include <mcserver/negotiate.h>
+#include <algorithm>
+
+/**
+ * Tests for LCB_CNTL_OPTIMISTIC_NEGOTIATION. The path each negotiation took
+ * is determined from its log messages.
+ */
+
+namespace {
+struct NegotiationLog : lcb_logprocs {
+    std::vector<std::string> messages;
+
+    NegotiationLog() {
+        memset(static_cast<lcb_logprocs*>(this), 0, sizeof(lcb_logprocs));
+    }
+
+    size_t count(const char *s) const {
+        size_t n = 0;
+        for (size_t ii = 0; ii < messages.size(); ii++) {
+            if (messages[ii].find(s) != std::string::npos) {
+                n++;
+            }
+        }
+        return n;
+    }
+
+    /** Index of the first message containing `s`, or -1 */
+    int find(const char *s) const {
+        for (size_t ii = 0; ii < messages.size(); ii++) {
+            if (messages[ii].find(s) != std::string::npos) {
+                return ii;
+            }
+        }
+        return -1;
+    }
+};
+}
+
+extern "C" {
+static void
+negotiation_logger(lcb_logprocs *procs, unsigned int, const char *subsys,
+                   int, const char *, int, const char *fmt, va_list ap)
+{
+    if (strcmp(subsys, "negotiation") != 0) {
+        return;
+    }
+    char buf[2048];
+    vsnprintf(buf, sizeof buf, fmt, ap);
+    static_cast<NegotiationLog*>(procs)->messages.push_back(buf);
+}
+
+static void
+negotiation_store_callback(lcb_t, int, const lcb_RESPBASE *rb)
+{
+    *(lcb_error_t *)rb->cookie = rb->rc;
+}
+}
+
+class NegotiationTest : public MockUnitTest {
+protected:
+    void connect(lcb_t instance, NegotiationLog& log) {
+        log.v.v0.callback = negotiation_logger;
+        ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_LOGGER, &log));
+        ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "optimistic_negotiation", "true"));
+        // Negotiate each connection, rather than reusing pooled ones
+        instance->memd_sockpool->get_options().maxidle = 0;
+        lcb_install_callback3(instance, LCB_CALLBACK_STORE, negotiation_store_callback);
+        ASSERT_EQ(LCB_SUCCESS, lcb_connect(instance));
+        lcb_wait(instance);
+        ASSERT_EQ(LCB_SUCCESS, lcb_get_bootstrap_status(instance));
+    }
+
+    /** Store a key on the first server, which connects it if needed */
+    lcb_error_t store(lcb_t instance) {
+        std::string key;
+        int ii = 0;
+        do {
+            char buf[32];
+            sprintf(buf, "negotiation_%d", ii++);
+            key = buf;
+        } while (instance->map_key(key) != 0);
+        lcb_CMDSTORE cmd = { 0 };
+        cmd.operation = LCB_SET;
+        LCB_CMD_SET_KEY(&cmd, key.c_str(), key.size());
+        LCB_CMD_SET_VALUE(&cmd, "value", 5);
+        lcb_error_t rc = LCB_ERROR;
+        EXPECT_EQ(LCB_SUCCESS, lcb_store3(instance, &rc, &cmd));
+        lcb_wait(instance);
+        return rc;
+    }
+
+    /** Drop the first server's connection, and wait for a new one */
+    lcb_error_t reconnect(lcb_t instance) {
+        lcb_error_t rc = store(instance);
+        if (rc != LCB_SUCCESS) {
+            return rc;
+        }
+        instance->get_server(0)->socket_failed(LCB_NETWORK_ERROR);
+        return store(instance);
+    }
+
+    const lcb::SessionCache::Entry *cached(lcb_t instance) {
+        const lcb_host_t& host = instance->get_server(0)->get_host();
+        std::string key(host.host);
+        key.append(":").append(host.port);
+        if (!instance->settings->sesscache) {
+            return NULL;
+        }
+        return instance->settings->sesscache->find(key);
+    }
+
+    /**
+     * Connect to a bucket with a password, with PLAIN authentication so that
+     * SELECT_BUCKET is pipelined as well. Then make the pipelined SASL_AUTH
+     * fail by changing the password.
+     */
+    void failPipelinedAuth(MockEnvironment *env, NegotiationLog& log);
+};
+
+TEST_F(NegotiationTest, testPipelinedReconnect)
+{
+    SKIP_UNLESS_MOCK();
+    HandleWrap hw;
+    lcb_t instance;
+    NegotiationLog log;
+    MockEnvironment::getInstance()->createConnection(hw, instance);
+    connect(instance, log);
+
+    ASSERT_EQ(LCB_SUCCESS, store(instance));
+    const lcb::SessionCache::Entry *entry = cached(instance);
+    ASSERT_TRUE(entry != NULL);
+    ASSERT_FALSE(entry->mech.empty());
+    std::vector<uint16_t> features = entry->server_features;
+
+    log.messages.clear();
+    ASSERT_EQ(LCB_SUCCESS, reconnect(instance));
+    ASSERT_EQ(1, log.count("Pipelining negotiation using"));
+    ASSERT_EQ(0, log.count("Negotiating step by step"));
+    ASSERT_EQ(0, log.count("Server features changed"));
+    ASSERT_EQ(0, log.count("Error: "));
+
+    entry = cached(instance);
+    ASSERT_TRUE(entry != NULL);
+    ASSERT_EQ(features, entry->server_features);
+
+    // Without the setting, the cache is not used
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "optimistic_negotiation", "false"));
+    log.messages.clear();
+    ASSERT_EQ(LCB_SUCCESS, reconnect(instance));
+    ASSERT_EQ(0, log.count("Pipelining negotiation using"));
+}
+
+TEST_F(NegotiationTest, testFeaturesChanged)
+{
+    SKIP_UNLESS_MOCK();
+    HandleWrap hw;
+    lcb_t instance;
+    NegotiationLog log;
+    MockEnvironment::getInstance()->createConnection(hw, instance);
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "fetch_mutation_tokens", "false"));
+    connect(instance, log);
+
+    ASSERT_EQ(LCB_SUCCESS, store(instance));
+    const lcb::SessionCache::Entry *entry = cached(instance);
+    ASSERT_TRUE(entry != NULL);
+    std::vector<uint16_t> features = entry->server_features;
+    ASSERT_TRUE(std::find(features.begin(), features.end(),
+            PROTOCOL_BINARY_FEATURE_MUTATION_SEQNO) == features.end());
+
+    // The server now acknowledges a feature it did not before. The requests
+    // were pipelined with the old features, and the entry is replaced
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "fetch_mutation_tokens", "true"));
+    log.messages.clear();
+    ASSERT_EQ(LCB_SUCCESS, reconnect(instance));
+    ASSERT_EQ(1, log.count("Pipelining negotiation using"));
+    ASSERT_EQ(1, log.count("Server features changed"));
+    ASSERT_EQ(0, log.count("Error: "));
+
+    entry = cached(instance);
+    ASSERT_TRUE(entry != NULL);
+    ASSERT_NE(features, entry->server_features);
+    ASSERT_FALSE(std::find(entry->server_features.begin(), entry->server_features.end(),
+            PROTOCOL_BINARY_FEATURE_MUTATION_SEQNO) == entry->server_features.end());
+
+    // The next connection matches the new entry
+    log.messages.clear();
+    ASSERT_EQ(LCB_SUCCESS, reconnect(instance));
+    ASSERT_EQ(1, log.count("Pipelining negotiation using"));
+    ASSERT_EQ(0, log.count("Server features changed"));
+}
+
+void
+NegotiationTest::failPipelinedAuth(MockEnvironment *env, NegotiationLog& log)
+{
+    HandleWrap hw;
+    lcb_t instance;
+    lcb_create_st crParams;
+    env->makeConnectParams(crParams, NULL);
+    crParams.v.v2.user = "protected";
+    crParams.v.v2.passwd = "secret";
+    crParams.v.v2.bucket = "protected";
+    env->createConnection(hw, instance, crParams);
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "sasl_mech_force", "PLAIN"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "operation_timeout", "1.0"));
+    connect(instance, log);
+
+    ASSERT_EQ(LCB_SUCCESS, store(instance));
+    ASSERT_TRUE(cached(instance) != NULL);
+    ASSERT_EQ(std::string("PLAIN"), cached(instance)->mech);
+
+    lcbauth_add_pass(instance->settings->auth, "protected", "wrong", LCBAUTH_F_BUCKET);
+    log.messages.clear();
+    ASSERT_NE(LCB_SUCCESS, reconnect(instance));
+
+    // The restarted negotiation does not use the cache, and fails as well
+    ASSERT_TRUE(cached(instance) == NULL);
+
+    // Once the password is restored, negotiation succeeds step by step and
+    // the cache is filled again
+    lcbauth_add_pass(instance->settings->auth, "protected", "secret", LCBAUTH_F_BUCKET);
+    ASSERT_EQ(LCB_SUCCESS, store(instance));
+    ASSERT_TRUE(cached(instance) != NULL);
+}
+
+TEST_F(NegotiationTest, testSaslRestart)
+{
+    SKIP_UNLESS_MOCK();
+    const char *argv[] = { "--buckets", "protected:secret:couchbase", NULL };
+    MockEnvironment env(argv, "protected");
+    NegotiationLog log;
+    failPipelinedAuth(&env, log);
+
+    // The failed pipelined SASL_AUTH restarts with SASL_LIST_MECHS, rather
+    // than failing the connection right away
+    int ixpipelined = log.find("Pipelining negotiation using PLAIN");
+    int ixfailed = log.find("Pipelined SASL_AUTH failed");
+    int ixerror = log.find("SASL AUTH failed");
+    ASSERT_NE(-1, ixpipelined);
+    ASSERT_LT(ixpipelined, ixfailed);
+    ASSERT_LT(ixfailed, ixerror);
+    ASSERT_EQ(1, log.count("Pipelined SASL_AUTH failed"));
+}
+
+TEST_F(NegotiationTest, testStaleSelectBucket)
+{
+    SKIP_UNLESS_MOCK();
+    const char *argv[] = { "--buckets", "protected:secret:couchbase", NULL };
+    MockEnvironment env(argv, "protected");
+    NegotiationLog log;
+    failPipelinedAuth(&env, log);
+
+    // SELECT_BUCKET was pipelined with the SASL_AUTH which failed. Its
+    // response must be ignored: it neither completes nor fails the
+    // negotiation, which instead fails on the restarted SASL_AUTH
+    int ixselect = log.find("Sending SELECT_BUCKET");
+    int ixfailed = log.find("Pipelined SASL_AUTH failed");
+    ASSERT_NE(-1, ixselect);
+    ASSERT_LT(ixselect, ixfailed);
+    ASSERT_EQ(0, log.count("Provided credentials not allowed for bucket"));
+    ASSERT_NE(-1, log.find("SASL AUTH failed"));
+}
@@ -391,6 +391,110 @@ TEST_F(MockUnitTest, testReconfigurationOnNodeFailover)
     ctx.check((int)cmds.size());
 }
 
+struct NodesReady {
+    std::vector<lcb_error_t> errors;
+    /** Servers connected when each callback was invoked */
+    std::vector<size_t> connected;
+};
+
+static size_t
+numConnected(lcb_t instance)
+{
+    size_t n = 0;
+    for (size_t ii = 0; ii < LCBT_NSERVERS(instance); ii++) {
+        const lcb::Server *server = instance->get_server(ii);
+        if (server->connctx != NULL && server->state == lcb::Server::S_CLEAN) {
+            n++;
+        }
+    }
+    return n;
+}
+
+extern "C" {
+static void nodes_ready_callback(lcb_t instance, lcb_error_t err)
+{
+    NodesReady *nr = (NodesReady *)lcb_get_cookie(instance);
+    nr->errors.push_back(err);
+    nr->connected.push_back(numConnected(instance));
+}
+}
+
+TEST_F(MockUnitTest, testKvPreconnect)
+{
+    SKIP_UNLESS_MOCK();
+    lcb_t instance;
+    HandleWrap hw;
+    const char *argv[] = { "--replicas", "0", "--nodes", "4", NULL };
+    MockEnvironment mock_o(argv), *mock = &mock_o;
+    NodesReady nr;
+
+    mock->createConnection(hw, instance);
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "kv_preconnect", "true"));
+    lcb_set_cookie(instance, &nr);
+    lcb_set_nodes_ready_callback(instance, nodes_ready_callback);
+    ASSERT_EQ(LCB_SUCCESS, lcb_connect(instance));
+    lcb_wait(instance);
+    ASSERT_EQ(LCB_SUCCESS, lcb_get_bootstrap_status(instance));
+
+    // No operation was scheduled, yet lcb_wait() only returned once every
+    // node was connected, and the callback was invoked once for all of them
+    size_t numNodes = mock->getNumNodes();
+    ASSERT_EQ(numNodes, numConnected(instance));
+    ASSERT_EQ(1, nr.errors.size());
+    ASSERT_EQ(LCB_SUCCESS, nr.errors[0]);
+    ASSERT_EQ(numNodes, nr.connected[0]);
+
+    // Removing a node does not connect to anything
+    mock->failoverNode(0);
+    SYNC_WITH_NODECOUNT(instance, numNodes-1);
+    ASSERT_EQ(1, nr.errors.size());
+
+    // The node added back is connected to in a new batch
+    mock->respawnNode(0);
+    SYNC_WITH_NODECOUNT(instance, numNodes);
+    lcb_wait(instance);
+    ASSERT_EQ(2, nr.errors.size());
+    ASSERT_EQ(LCB_SUCCESS, nr.errors[1]);
+    ASSERT_EQ(numNodes, nr.connected[1]);
+    ASSERT_EQ(numNodes, numConnected(instance));
+}
+
+TEST_F(MockUnitTest, testKvPreconnectFailure)
+{
+    SKIP_UNLESS_MOCK();
+    const char *argv[] = { "--buckets", "protected:secret:couchbase", NULL };
+
+    lcb_t instance;
+    struct lcb_create_st crParams;
+    MockEnvironment mock_o(argv, "protected"), *protectedEnv = &mock_o;
+    protectedEnv->makeConnectParams(crParams, NULL);
+    // Bootstrap over HTTP, so that only the preconnects negotiate
+    protectedEnv->setCCCP(false);
+
+    crParams.v.v0.user = "protected";
+    crParams.v.v0.passwd = "secret";
+    crParams.v.v0.bucket = "protected";
+    doLcbCreate(&instance, &crParams, protectedEnv);
+
+    NodesReady nr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "kv_preconnect", "true"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET,
+                                    LCB_CNTL_FORCE_SASL_MECH, (void *)"blah"));
+    lcb_set_cookie(instance, &nr);
+    lcb_set_nodes_ready_callback(instance, nodes_ready_callback);
+    ASSERT_EQ(LCB_SUCCESS, lcb_connect(instance));
+    lcb_wait(instance);
+    ASSERT_EQ(LCB_SUCCESS, lcb_get_bootstrap_status(instance));
+
+    // Every node failed, and the batch reports the error once
+    ASSERT_EQ(1, nr.errors.size());
+    ASSERT_EQ(LCB_SASLMECH_UNAVAILABLE, nr.errors[0]);
+    ASSERT_EQ(0, nr.connected[0]);
+    ASSERT_EQ(0, numConnected(instance));
+
+    lcb_destroy(instance);
+}
+
 
 
 struct fo_context_st {
@@ -85,3 +85,215 @@ TEST_F(SchedUnitTests, testSched)
     lcb_wait3(instance, LCB_WAIT_NOCHECK);
     ASSERT_EQ(5, counter);
 }
+
+TEST_F(SchedUnitTests, testWaitCookies)
+{
+    HandleWrap hw;
+    lcb_t instance;
+    lcb_error_t rc;
+    createConnection(hw, instance);
+
+    lcb_install_callback3(instance, LCB_CALLBACK_STORE, opCallback);
+
+    lcb_CMDSTORE scmd = { 0 };
+    LCB_CMD_SET_KEY(&scmd, "key", 3);
+    LCB_CMD_SET_VALUE(&scmd, "val", 3);
+    scmd.operation = LCB_SET;
+
+    size_t counterA = 0, counterB = 0;
+    for (size_t ii = 0; ii < 3; ++ii) {
+        ASSERT_EQ(LCB_SUCCESS, lcb_store3(instance, &counterA, &scmd));
+        ASSERT_EQ(LCB_SUCCESS, lcb_store3(instance, &counterB, &scmd));
+    }
+
+    // Wait only for the operations tagged with counterA
+    const void *cookies[] = { &counterA, &counterA, &counterA };
+    lcb_WAITCOOKIES wc = { 0 };
+    wc.cookies = cookies;
+    wc.ncookies = 3;
+    rc = lcb_wait_cookies(instance, &wc);
+    ASSERT_EQ(LCB_SUCCESS, rc);
+    ASSERT_EQ(3, wc.ncompleted);
+    ASSERT_EQ(3, counterA);
+
+    // Remaining operations are still delivered
+    lcb_wait(instance);
+    ASSERT_EQ(3, counterB);
+    ASSERT_FALSE(hasPendingOps(instance));
+
+    // Return after the first completion of any operation
+    counterA = 0;
+    for (size_t ii = 0; ii < 5; ++ii) {
+        ASSERT_EQ(LCB_SUCCESS, lcb_store3(instance, &counterA, &scmd));
+    }
+    memset(&wc, 0, sizeof wc);
+    wc.threshold = 1;
+    wc.timeout = LCB_MS2US(10000);
+    rc = lcb_wait_cookies(instance, &wc);
+    ASSERT_EQ(LCB_SUCCESS, rc);
+    // Responses read in the same batch may also be counted
+    ASSERT_GE(wc.ncompleted, 1);
+    ASSERT_EQ(wc.ncompleted, counterA);
+    lcb_wait(instance);
+    ASSERT_EQ(5, counterA);
+
+    // Nothing pending: returns immediately
+    rc = lcb_wait_cookies(instance, &wc);
+    ASSERT_EQ(LCB_SUCCESS, rc);
+    ASSERT_EQ(0, wc.ncompleted);
+}
+
+TEST_F(SchedUnitTests, testWaitRepeatedCookie)
+{
+    HandleWrap hw;
+    lcb_t instance;
+    createConnection(hw, instance);
+
+    lcb_install_callback3(instance, LCB_CALLBACK_STORE, opCallback);
+
+    lcb_CMDSTORE scmd = { 0 };
+    LCB_CMD_SET_KEY(&scmd, "key", 3);
+    LCB_CMD_SET_VALUE(&scmd, "val", 3);
+    scmd.operation = LCB_SET;
+
+    // Operations on the same key complete in the order they were scheduled,
+    // so both operations with counterA complete before the one with counterB
+    size_t counterA = 0, counterB = 0;
+    ASSERT_EQ(LCB_SUCCESS, lcb_store3(instance, &counterA, &scmd));
+    ASSERT_EQ(LCB_SUCCESS, lcb_store3(instance, &counterA, &scmd));
+    ASSERT_EQ(LCB_SUCCESS, lcb_store3(instance, &counterB, &scmd));
+
+    // counterA is listed once, so its second completion is not counted and
+    // does not end the wait while counterB is still pending
+    const void *cookies[] = { &counterA, &counterB };
+    lcb_WAITCOOKIES wc = { 0 };
+    wc.cookies = cookies;
+    wc.ncookies = 2;
+    ASSERT_EQ(LCB_SUCCESS, lcb_wait_cookies(instance, &wc));
+    ASSERT_EQ(2, wc.ncompleted);
+    ASSERT_EQ(2, counterA);
+    ASSERT_EQ(1, counterB);
+    ASSERT_FALSE(hasPendingOps(instance));
+
+    // Repeated once per operation, each completion is counted
+    counterA = counterB = 0;
+    ASSERT_EQ(LCB_SUCCESS, lcb_store3(instance, &counterA, &scmd));
+    ASSERT_EQ(LCB_SUCCESS, lcb_store3(instance, &counterA, &scmd));
+    ASSERT_EQ(LCB_SUCCESS, lcb_store3(instance, &counterB, &scmd));
+    const void *repeated[] = { &counterA, &counterA, &counterB };
+    wc.cookies = repeated;
+    wc.ncookies = 3;
+    ASSERT_EQ(LCB_SUCCESS, lcb_wait_cookies(instance, &wc));
+    ASSERT_EQ(3, wc.ncompleted);
+    ASSERT_EQ(1, counterB);
+}
+
+struct CorkInfo {
+    size_t nflushes; /**< Number of times the socket was flushed */
+    size_t nflushed; /**< Number of packets written out */
+    void (*orig_flush_ready)(lcbio_CTX *);
+    CorkInfo() : nflushes(0), nflushed(0), orig_flush_ready(NULL) {
+    }
+};
+
+extern "C" {
+static void corkFlushReady(lcbio_CTX *ctx)
+{
+    CorkInfo *ci = (CorkInfo *)lcb_get_cookie(lcb::Server::get(ctx)->get_instance());
+    ci->nflushes++;
+    ci->orig_flush_ready(ctx);
+}
+
+static void corkTrace(mc_CMDQUEUE *cq, const mc_PACKET *, mcreq_TRACEEVENT event)
+{
+    if (event == MCREQ_TRACE_FLUSHED) {
+        ((CorkInfo *)lcb_get_cookie((lcb_t)cq->cqdata))->nflushed++;
+    }
+}
+}
+
+TEST_F(SchedUnitTests, testAutocork)
+{
+    HandleWrap hw;
+    lcb_t instance;
+    createConnection(hw, instance);
+
+    lcb_install_callback3(instance, LCB_CALLBACK_STORE, opCallback);
+
+    lcb_CMDSTORE scmd = { 0 };
+    LCB_CMD_SET_KEY(&scmd, "key", 3);
+    LCB_CMD_SET_VALUE(&scmd, "val", 3);
+    scmd.operation = LCB_SET;
+
+    // Connect to the server first, so its flushes can be counted
+    size_t counter = 0;
+    ASSERT_EQ(LCB_SUCCESS, lcb_store3(instance, &counter, &scmd));
+    lcb_wait(instance);
+    ASSERT_EQ(1, counter);
+
+    lcb::Server *server = instance->get_server(instance->map_key("key"));
+    ASSERT_TRUE(server->connctx != NULL);
+    CorkInfo ci;
+    ci.orig_flush_ready = server->connctx->procs.cb_flush_ready;
+    server->connctx->procs.cb_flush_ready = corkFlushReady;
+    lcb_set_cookie(instance, &ci);
+    instance->cmdq.trace = corkTrace;
+
+    // The window is long enough for the loop to run between operations
+    // without the timer firing
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "autocork", "true"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_setu32(instance, LCB_CNTL_AUTOCORK_WINDOW, 200000));
+
+    // Each operation in its own scheduling context, as an event driven
+    // application would do
+    counter = 0;
+    for (size_t ii = 0; ii < 10; ++ii) {
+        ASSERT_EQ(LCB_SUCCESS, lcb_store3(instance, &counter, &scmd));
+        lcb_tick_nowait(instance);
+    }
+    ASSERT_TRUE(lcbio_timer_armed(server->cork_timer));
+    ASSERT_EQ(0, ci.nflushes);
+    ASSERT_EQ(0, ci.nflushed);
+    ASSERT_TRUE(hasPendingOps(instance));
+
+    lcb_wait(instance);
+    ASSERT_EQ(10, counter);
+    ASSERT_EQ(1, ci.nflushes);
+    ASSERT_EQ(10, ci.nflushed);
+    ASSERT_FALSE(hasPendingOps(instance));
+
+    // lcb_sched_flush() is deferred to the timer as well
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_setu32(instance, LCB_CNTL_SCHED_IMPLICIT_FLUSH, 0));
+    counter = ci.nflushes = ci.nflushed = 0;
+    lcb_sched_enter(instance);
+    for (size_t ii = 0; ii < 10; ++ii) {
+        ASSERT_EQ(LCB_SUCCESS, lcb_store3(instance, &counter, &scmd));
+    }
+    lcb_sched_leave(instance);
+    lcb_sched_flush(instance);
+    lcb_tick_nowait(instance);
+    ASSERT_TRUE(lcbio_timer_armed(server->cork_timer));
+    ASSERT_EQ(0, ci.nflushes);
+    ASSERT_EQ(0, ci.nflushed);
+
+    lcb_wait(instance);
+    ASSERT_EQ(10, counter);
+    ASSERT_EQ(1, ci.nflushes);
+    ASSERT_EQ(10, ci.nflushed);
+
+    // Without autocork, each scheduling context is flushed on its own
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_setu32(instance, LCB_CNTL_SCHED_IMPLICIT_FLUSH, 1));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "autocork", "false"));
+    counter = ci.nflushes = ci.nflushed = 0;
+    for (size_t ii = 0; ii < 10; ++ii) {
+        ASSERT_EQ(LCB_SUCCESS, lcb_store3(instance, &counter, &scmd));
+        lcb_tick_nowait(instance);
+    }
+    lcb_wait(instance);
+    ASSERT_EQ(10, counter);
+    ASSERT_EQ(10, ci.nflushed);
+    ASSERT_LT(1, ci.nflushes);
+
+    instance->cmdq.trace = NULL;
+    server->connctx->procs.cb_flush_ready = ci.orig_flush_ready;
+}
@@ -4,6 +4,8 @@
 #include <libcouchbase/views.h>
 #include <libcouchbase/pktfwd.h>
 #include "contrib/cJSON/cJSON.h"
+#include "internal.h"
+#include <algorithm>
 
 namespace {
 
@@ -262,6 +264,69 @@ TEST_F(ViewsUnitTest, testIncludeDocs) {
     }
 }
 
+extern "C" {
+/* Keeps the highest number of operations awaiting a response, sampled each
+ * time an operation is written out */
+static void docsWindowTrace(mc_CMDQUEUE *cq, const mc_PACKET *, mcreq_TRACEEVENT event)
+{
+    if (event != MCREQ_TRACE_ENQUEUED) {
+        return;
+    }
+    size_t n = 0;
+    for (unsigned ii = 0; ii < cq->npipelines; ii++) {
+        sllist_node *ll;
+        SLLIST_FOREACH(&cq->pipelines[ii]->requests, ll) {
+            n++;
+        }
+    }
+    size_t *maxInflight = (size_t *)lcb_get_cookie((lcb_t)cq->cqdata);
+    *maxInflight = std::max(*maxInflight, n);
+}
+}
+
+TEST_F(ViewsUnitTest, testIncludeDocsWindow) {
+    HandleWrap hw;
+    lcb_t instance;
+    lcb_error_t rc;
+    connectBeerSample(hw, instance);
+
+    size_t maxInflight = 0;
+    lcb_set_cookie(instance, &maxInflight);
+    instance->cmdq.trace = docsWindowTrace;
+    rc = lcb_cntl_string(instance, "views_docs_window", "4");
+    ASSERT_EQ(LCB_SUCCESS, rc);
+
+    ViewInfo vi;
+    lcb_CMDVIEWQUERY vq = { 0 };
+    lcb_view_query_initcmd(&vq, "beer", "brewery_beers", NULL, viewCallback);
+    vq.cmdflags |= LCB_CMDVIEWQUERY_F_INCLUDE_DOCS;
+    rc = lcb_view_query(instance, &vi, &vq);
+    ASSERT_EQ(LCB_SUCCESS, rc);
+    lcb_wait(instance);
+
+    // However the window was adjusted, it never exceeded the setting
+    ASSERT_EQ(7303, vi.rows.size());
+    for (size_t ii = 0; ii < vi.rows.size(); ii++) {
+        ASSERT_EQ(LCB_SUCCESS, vi.rows[ii].docContents.rc);
+    }
+    ASSERT_GT(maxInflight, 0U);
+    ASSERT_LE(maxInflight, 4U);
+
+    // The per-query limit overrides the setting
+    vi.clear();
+    maxInflight = 0;
+    lcb_view_query_initcmd(&vq, "beer", "brewery_beers", "limit=100", viewCallback);
+    vq.cmdflags |= LCB_CMDVIEWQUERY_F_INCLUDE_DOCS;
+    vq.docs_concurrent_max = 1;
+    rc = lcb_view_query(instance, &vi, &vq);
+    ASSERT_EQ(LCB_SUCCESS, rc);
+    lcb_wait(instance);
+    ASSERT_EQ(100, vi.rows.size());
+    ASSERT_EQ(1U, maxInflight);
+
+    instance->cmdq.trace = NULL;
+}
+
 TEST_F(ViewsUnitTest, testReduce) {
     HandleWrap hw;
     lcb_t instance;
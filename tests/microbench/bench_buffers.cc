@@ -0,0 +1,107 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "microbench.h"
+#include "netbuf/netbuf.h"
+#include "rdb/rope.h"
+#include <string.h>
+
+#define SPAN_SIZE 100
+#define BATCH_SIZE 32
+
+/* One command's worth of buffer: reserved, queued, flushed and released */
+MICROBENCH(netbuf_reserve_flush)
+{
+    nb_MGR mgr;
+    nb_IOV iov[4];
+    netbuf_init(&mgr, NULL);
+    state.setBytesPerOp(SPAN_SIZE);
+
+    for (size_t ii = 0; ii < state.iterations(); ii++) {
+        nb_SPAN span;
+        span.size = SPAN_SIZE;
+        netbuf_mblock_reserve(&mgr, &span);
+        netbuf_enqueue_span(&mgr, &span);
+        nb_SIZE nflush = netbuf_start_flush(&mgr, iov, 4, NULL);
+        netbuf_end_flush(&mgr, nflush);
+        netbuf_mblock_release(&mgr, &span);
+    }
+    netbuf_cleanup(&mgr);
+}
+
+/* A batch of commands, flushed together as a single write */
+MICROBENCH(netbuf_reserve_flush_batch)
+{
+    nb_MGR mgr;
+    nb_SPAN spans[BATCH_SIZE];
+    nb_IOV iov[BATCH_SIZE];
+    netbuf_init(&mgr, NULL);
+    state.setBytesPerOp(SPAN_SIZE * BATCH_SIZE);
+
+    for (size_t ii = 0; ii < state.iterations(); ii++) {
+        for (size_t jj = 0; jj < BATCH_SIZE; jj++) {
+            spans[jj].size = SPAN_SIZE;
+            netbuf_mblock_reserve(&mgr, spans + jj);
+            netbuf_enqueue_span(&mgr, spans + jj);
+        }
+        nb_SIZE nflush = netbuf_start_flush(&mgr, iov, BATCH_SIZE, NULL);
+        netbuf_end_flush(&mgr, nflush);
+        for (size_t jj = 0; jj < BATCH_SIZE; jj++) {
+            netbuf_mblock_release(&mgr, spans + jj);
+        }
+    }
+    netbuf_cleanup(&mgr);
+}
+
+#define READ_SIZE 4096
+#define PACKET_SIZE 128
+
+/* Read READ_SIZE bytes of 128-byte packets from the network and consume
+ * them a packet at a time, as the server read path does */
+MICROBENCH(rdb_read_consume)
+{
+    rdb_IOROPE rope;
+    char src[READ_SIZE];
+    char hdr[24];
+    memset(src, 0x66, sizeof src);
+    rdb_init(&rope, rdb_bigalloc_new());
+    rope.rdsize = READ_SIZE;
+    state.setBytesPerOp(READ_SIZE);
+
+    for (size_t ii = 0; ii < state.iterations(); ii++) {
+        nb_IOV iov[4];
+        unsigned niov = rdb_rdstart(&rope, iov, 4);
+        unsigned nread = 0;
+        for (unsigned jj = 0; jj < niov && nread < READ_SIZE; jj++) {
+            unsigned ncopy = READ_SIZE - nread;
+            if (ncopy > iov[jj].iov_len) {
+                ncopy = iov[jj].iov_len;
+            }
+            memcpy(iov[jj].iov_base, src + nread, ncopy);
+            nread += ncopy;
+        }
+        rdb_rdend(&rope, nread);
+
+        while (rope.recvd.nused >= PACKET_SIZE) {
+            rdb_copyread(&rope, hdr, sizeof hdr);
+            rdb_consolidate(&rope, PACKET_SIZE);
+            microbench::doNotOptimize(rdb_get_consolidated(&rope, PACKET_SIZE));
+            rdb_consumed(&rope, PACKET_SIZE);
+        }
+    }
+    rdb_cleanup(&rope);
+}
@@ -0,0 +1,125 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "microbench.h"
+#include "mc/compress.h"
+#include "strcodecs/strcodecs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+/* A JSON document, which compresses like typical values do */
+static std::string
+make_document(size_t size)
+{
+    std::string doc("{");
+    unsigned ii = 0;
+    while (doc.size() < size) {
+        char field[64];
+        sprintf(field, "%s\"field%u\": \"value of field %u\"", ii ? ", " : "", ii % 20, ii);
+        doc += field;
+        ii++;
+    }
+    doc += "}";
+    return doc;
+}
+
+#ifndef LCB_NO_SNAPPY
+/* Compression of a value into a packet, as done when storing */
+MICROBENCH(snappy_deflate)
+{
+    std::string doc = make_document(4096);
+    lcb_CONTIGBUF vbuf = { doc.data(), doc.size() };
+    mc_PIPELINE pipeline;
+    mc_PACKET pkt;
+    mcreq_pipeline_init(&pipeline);
+    memset(&pkt, 0, sizeof pkt);
+    state.setBytesPerOp(doc.size());
+
+    for (size_t ii = 0; ii < state.iterations(); ii++) {
+        mcreq_compress_value(&pipeline, &pkt, &vbuf);
+        netbuf_mblock_release(&pipeline.nbmgr, &pkt.u_value.single);
+    }
+    mcreq_pipeline_cleanup(&pipeline);
+}
+
+MICROBENCH(snappy_inflate)
+{
+    std::string doc = make_document(4096);
+    lcb_CONTIGBUF vbuf = { doc.data(), doc.size() };
+    mc_PIPELINE pipeline;
+    mc_PACKET pkt;
+    mcreq_pipeline_init(&pipeline);
+    memset(&pkt, 0, sizeof pkt);
+    mcreq_compress_value(&pipeline, &pkt, &vbuf);
+    const void *compressed = SPAN_BUFFER(&pkt.u_value.single);
+    lcb_SIZE ncompressed = pkt.u_value.single.size;
+    state.setBytesPerOp(doc.size());
+
+    for (size_t ii = 0; ii < state.iterations(); ii++) {
+        const void *bytes;
+        lcb_SIZE nbytes;
+        void *freeptr = NULL;
+        mcreq_inflate_value(compressed, ncompressed, &bytes, &nbytes, &freeptr);
+        free(freeptr);
+    }
+    netbuf_mblock_release(&pipeline.nbmgr, &pkt.u_value.single);
+    mcreq_pipeline_cleanup(&pipeline);
+}
+#endif
+
+MICROBENCH(base64_encode)
+{
+    std::string src = make_document(256);
+    char dst[512];
+    state.setBytesPerOp(src.size());
+
+    for (size_t ii = 0; ii < state.iterations(); ii++) {
+        lcb_base64_encode(src.c_str(), dst, sizeof dst);
+        microbench::doNotOptimize(dst);
+    }
+}
+
+/* A view query string, with characters which need escaping */
+MICROBENCH(urlencode)
+{
+    std::string src("startkey=[\"Airline 1\",{\"country\": \"United States\"}]&"
+                    "endkey=[\"Airline 99\",{}]&stale=false&limit=100&reduce=false");
+    state.setBytesPerOp(src.size());
+
+    for (size_t ii = 0; ii < state.iterations(); ii++) {
+        std::string out;
+        lcb::strcodecs::urlencode(src, out);
+        microbench::doNotOptimize(out.data());
+    }
+}
+
+MICROBENCH(urldecode)
+{
+    std::string src;
+    lcb::strcodecs::urlencode(std::string("startkey=[\"Airline 1\",{\"country\": \"United States\"}]"), src);
+    state.setBytesPerOp(src.size());
+
+    char *out = new char[src.size() + 1];
+
+    for (size_t ii = 0; ii < state.iterations(); ii++) {
+        lcb::strcodecs::urldecode(src.c_str(), out);
+        microbench::doNotOptimize(out);
+    }
+    delete[] out;
+}
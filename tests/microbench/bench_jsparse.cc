@@ -0,0 +1,59 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "microbench.h"
+#include "jsparse/parser.h"
+#include <stdio.h>
+#include <string>
+
+using lcb::jsparse::Parser;
+
+namespace {
+struct Counter : Parser::Actions {
+    size_t nrows;
+    Counter() : nrows(0) {}
+    void JSPARSE_on_row(const lcb::jsparse::Row&) { nrows++; }
+    void JSPARSE_on_error(const std::string&) { abort(); }
+    void JSPARSE_on_complete(const std::string&) {}
+};
+}
+
+/* A N1QL response of 100 rows, fed in 1500-byte (MTU-sized) chunks */
+MICROBENCH(jsparse_feed_n1ql)
+{
+    std::string body("{\"requestID\": \"a5a6d9d6-a6a3-4ed9-8e3b-1dd6f6e0d9c5\", \"results\": [");
+    for (unsigned ii = 0; ii < 100; ii++) {
+        char row[256];
+        sprintf(row, "%s{\"id\": %u, \"type\": \"airline\", \"name\": \"Airline %u\", "
+                "\"iata\": \"A%u\", \"country\": \"United States\", \"callsign\": \"CS\"}",
+                ii ? "," : "", ii, ii, ii);
+        body += row;
+    }
+    body += "], \"status\": \"success\", \"metrics\": {\"elapsedTime\": \"1.2ms\", "
+            "\"executionTime\": \"1.1ms\", \"resultCount\": 100, \"resultSize\": 10000}}";
+    state.setBytesPerOp(body.size());
+
+    for (size_t ii = 0; ii < state.iterations(); ii++) {
+        Counter counter;
+        Parser parser(Parser::MODE_N1QL, &counter);
+        for (size_t pos = 0; pos < body.size(); pos += 1500) {
+            size_t n = body.size() - pos < 1500 ? body.size() - pos : 1500;
+            parser.feed(body.data() + pos, n);
+        }
+        microbench::doNotOptimize(&counter.nrows);
+    }
+}
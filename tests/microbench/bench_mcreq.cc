@@ -0,0 +1,97 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "microbench.h"
+#include "mc/mcreq.h"
+#include "mc/mcreq-flush-inl.h"
+#include "sllist-inl.h"
+#include <stdio.h>
+
+#define NUM_PIPELINES 4
+#define NUM_KEYS 1024
+
+extern "C" {
+/* Writes out everything queued on the pipeline and completes it at once,
+ * in place of the socket and the server */
+static void
+flush_and_complete(mc_PIPELINE *pipeline)
+{
+    nb_IOV iov[64];
+    unsigned nflush;
+    while ((nflush = mcreq_flush_iov_fill(pipeline, iov, 64, NULL))) {
+        mcreq_flush_done(pipeline, nflush, nflush);
+    }
+
+    sllist_iterator iter;
+    SLLIST_ITERFOR(&pipeline->requests, &iter) {
+        mc_PACKET *pkt = SLLIST_ITEM(iter.cur, mc_PACKET, slnode);
+        sllist_iter_remove(&pipeline->requests, &iter);
+        mcreq_packet_handled(pipeline, pkt);
+    }
+}
+}
+
+/* Scheduling a GET: key mapping, packet allocation and the flush */
+MICROBENCH(mcreq_basic_packet_sched)
+{
+    mc_CMDQUEUE cq;
+    mc_PIPELINE *pipelines[NUM_PIPELINES];
+    lcbvb_CONFIG *config = lcbvb_create();
+    lcbvb_genconfig(config, NUM_PIPELINES, 1, 1024);
+    for (unsigned ii = 0; ii < NUM_PIPELINES; ii++) {
+        pipelines[ii] = (mc_PIPELINE *)calloc(1, sizeof(mc_PIPELINE));
+        mcreq_pipeline_init(pipelines[ii]);
+        pipelines[ii]->flush_start = flush_and_complete;
+    }
+    mcreq_queue_init(&cq);
+    mcreq_queue_add_pipelines(&cq, pipelines, NUM_PIPELINES, config);
+
+    char keys[NUM_KEYS][16];
+    for (unsigned ii = 0; ii < NUM_KEYS; ii++) {
+        sprintf(keys[ii], "key_%u", ii);
+    }
+    state.setBytesPerOp(24 + strlen(keys[NUM_KEYS - 1]));
+
+    for (size_t ii = 0; ii < state.iterations(); ii++) {
+        const char *key = keys[ii % NUM_KEYS];
+        lcb_CMDBASE cmd = { 0 };
+        protocol_binary_request_header hdr = { { 0 } };
+        mc_PACKET *pkt;
+        mc_PIPELINE *pl;
+
+        LCB_KREQ_SIMPLE(&cmd.key, key, strlen(key));
+        mcreq_sched_enter(&cq);
+        if (mcreq_basic_packet(&cq, &cmd, &hdr, 0, &pkt, &pl, 0) != LCB_SUCCESS) {
+            abort();
+        }
+        hdr.request.magic = PROTOCOL_BINARY_REQ;
+        hdr.request.opcode = PROTOCOL_BINARY_CMD_GET;
+        hdr.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+        hdr.request.bodylen = htonl(ntohs(hdr.request.keylen));
+        hdr.request.opaque = pkt->opaque;
+        memcpy(SPAN_BUFFER(&pkt->kh_span), hdr.bytes, sizeof(hdr.bytes));
+        mcreq_sched_add(pl, pkt);
+        mcreq_sched_leave(&cq, 1);
+    }
+
+    for (unsigned ii = 0; ii < NUM_PIPELINES; ii++) {
+        mcreq_pipeline_cleanup(pipelines[ii]);
+        free(pipelines[ii]);
+    }
+    mcreq_queue_cleanup(&cq);
+    lcbvb_destroy(config);
+}
@@ -0,0 +1,60 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "microbench.h"
+#include <libcouchbase/vbucket.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_KEYS 1024
+
+static void
+map_keys(microbench::State& state, bool ketama)
+{
+    lcbvb_CONFIG *config = lcbvb_create();
+    lcbvb_genconfig(config, 4, 1, 1024);
+    if (ketama) {
+        lcbvb_make_ketama(config);
+    }
+
+    char keys[NUM_KEYS][32];
+    size_t nkeys[NUM_KEYS];
+    for (unsigned ii = 0; ii < NUM_KEYS; ii++) {
+        nkeys[ii] = sprintf(keys[ii], "Pillowfight_%010u", ii);
+    }
+    state.setBytesPerOp(nkeys[0]);
+
+    int vbid, srvix, sum = 0;
+    for (size_t ii = 0; ii < state.iterations(); ii++) {
+        size_t ix = ii % NUM_KEYS;
+        lcbvb_map_key(config, keys[ix], nkeys[ix], &vbid, &srvix);
+        sum += srvix;
+    }
+    microbench::doNotOptimize(&sum);
+    lcbvb_destroy(config);
+}
+
+MICROBENCH(lcbvb_map_key_vbucket)
+{
+    map_keys(state, false);
+}
+
+MICROBENCH(lcbvb_map_key_ketama)
+{
+    map_keys(state, true);
+}
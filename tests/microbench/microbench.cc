@@ -0,0 +1,341 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/**
+ * Runs the component micro-benchmarks (`make microbench`). Build with
+ * optimization (e.g. CMAKE_BUILD_TYPE=RelWithDebInfo) for meaningful numbers.
+ *
+ *   microbench --json current.json
+ *   microbench --baseline saved.json
+ *
+ * With --baseline, each benchmark is compared against the result of the same
+ * name in a file previously written with --json, and the program exits with
+ * a nonzero status if any became slower by more than --threshold percent or
+ * allocates more per operation.
+ */
+
+#include "microbench.h"
+#define CLIOPTS_ENABLE_CXX
+#include "contrib/cliopts/cliopts.h"
+#include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using std::string;
+using std::vector;
+
+static lcb_U64 nallocs = 0;
+
+#if defined(__GLIBC__)
+/* Count heap allocations by interposing the allocator. operator new goes
+ * through malloc() as well. */
+extern "C" {
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+extern void __libc_free(void *);
+
+void *malloc(size_t n) __THROW
+{
+    nallocs++;
+    return __libc_malloc(n);
+}
+
+void *calloc(size_t n, size_t size) __THROW
+{
+    nallocs++;
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t n) __THROW
+{
+    nallocs++;
+    return __libc_realloc(p, n);
+}
+
+void free(void *p) __THROW
+{
+    __libc_free(p);
+}
+}
+#define COUNTS_ALLOCATIONS 1
+#else
+#define COUNTS_ALLOCATIONS 0
+#endif
+
+namespace microbench {
+
+struct Benchmark {
+    const char *name;
+    BenchFunc fn;
+};
+
+static vector<Benchmark>& registry()
+{
+    static vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+Registrar::Registrar(const char *name, BenchFunc fn)
+{
+    Benchmark b = { name, fn };
+    registry().push_back(b);
+}
+
+void doNotOptimize(const void *p)
+{
+    static const void * volatile sink;
+    sink = p;
+}
+
+State::State(size_t niter_)
+: niter(niter_), bytes_per_op(0), running(false), ns(0), nallocs(0),
+  start_ns(0), start_allocs(0)
+{
+}
+
+void State::resumeTiming()
+{
+    if (!running) {
+        running = true;
+        start_allocs = ::nallocs;
+        start_ns = lcb_nstime();
+    }
+}
+
+void State::pauseTiming()
+{
+    if (running) {
+        ns += lcb_nstime() - start_ns;
+        nallocs += ::nallocs - start_allocs;
+        running = false;
+    }
+}
+
+}
+
+using namespace microbench;
+
+struct Result {
+    string name;
+    lcb_U64 iterations;
+    double ns_per_op;
+    double bytes_per_sec;
+    double allocs_per_op;
+};
+
+static State runOnce(const Benchmark& b, size_t niter)
+{
+    State state(niter);
+    state.resumeTiming();
+    b.fn(state);
+    state.pauseTiming();
+    return state;
+}
+
+static Result measure(const Benchmark& b, lcb_U64 min_ns, unsigned repetitions)
+{
+    // Find an iteration count which runs for at least min_ns
+    size_t niter = 1;
+    while (true) {
+        State state = runOnce(b, niter);
+        if (state.elapsed() >= min_ns || niter >= 1000000000) {
+            break;
+        }
+        double scale = state.elapsed() ? 1.2 * min_ns / state.elapsed() : 100;
+        size_t next = (size_t)(niter * std::min(scale, 100.0));
+        niter = std::max(next, niter + 1);
+    }
+
+    vector<double> times;
+    Result res;
+    res.name = b.name;
+    res.iterations = niter;
+    res.allocs_per_op = 0;
+    res.bytes_per_sec = 0;
+    size_t bytes_per_op = 0;
+    for (unsigned ii = 0; ii < repetitions; ii++) {
+        State state = runOnce(b, niter);
+        times.push_back((double)state.elapsed() / niter);
+        res.allocs_per_op = (double)state.allocations() / niter;
+        bytes_per_op = state.bytesPerOp();
+    }
+    std::sort(times.begin(), times.end());
+    res.ns_per_op = times[times.size() / 2];
+    if (bytes_per_op && res.ns_per_op > 0) {
+        res.bytes_per_sec = bytes_per_op * 1e9 / res.ns_per_op;
+    }
+    return res;
+}
+
+static Json::Value toJson(const vector<Result>& results)
+{
+    Json::Value root;
+    root["allocations_counted"] = COUNTS_ALLOCATIONS != 0;
+    Json::Value& arr = root["benchmarks"];
+    arr = Json::Value(Json::arrayValue);
+    for (size_t ii = 0; ii < results.size(); ii++) {
+        Json::Value cur;
+        cur["name"] = results[ii].name;
+        cur["iterations"] = (Json::UInt64)results[ii].iterations;
+        cur["ns_per_op"] = results[ii].ns_per_op;
+        cur["bytes_per_sec"] = results[ii].bytes_per_sec;
+        cur["allocs_per_op"] = results[ii].allocs_per_op;
+        arr.append(cur);
+    }
+    return root;
+}
+
+static bool loadBaseline(const string& path, Json::Value& out)
+{
+    std::ifstream ifs(path.c_str());
+    if (!ifs.is_open()) {
+        fprintf(stderr, "Couldn't open baseline %s\n", path.c_str());
+        return false;
+    }
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    Json::Value root;
+    if (!Json::Reader().parse(ss.str(), root) || !root["benchmarks"].isArray()) {
+        fprintf(stderr, "%s is not a microbench result file\n", path.c_str());
+        return false;
+    }
+    const Json::Value& arr = root["benchmarks"];
+    for (Json::ArrayIndex ii = 0; ii < arr.size(); ii++) {
+        out[arr[ii]["name"].asString()] = arr[ii];
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    cliopts::StringOption o_filter("filter");
+    cliopts::UIntOption o_mintime("min-time");
+    cliopts::UIntOption o_reps("repetitions");
+    cliopts::StringOption o_json("json");
+    cliopts::StringOption o_baseline("baseline");
+    cliopts::UIntOption o_threshold("threshold");
+    cliopts::BoolOption o_list("list");
+
+    o_filter.description("Only run benchmarks whose name contains this string");
+    o_mintime.description("Minimum duration of each timed run, in milliseconds");
+    o_mintime.setDefault(200);
+    o_reps.description("Number of timed runs. The median is reported");
+    o_reps.setDefault(5);
+    o_json.description("Write the results to this file as JSON");
+    o_baseline.description("Compare the results against this file, written by an earlier --json");
+    o_threshold.description("Slowdown, in percent, reported as a regression against the baseline");
+    o_threshold.setDefault(10);
+    o_list.description("List the benchmarks and exit");
+
+    cliopts::Parser parser("microbench");
+    parser.addOption(o_filter);
+    parser.addOption(o_mintime);
+    parser.addOption(o_reps);
+    parser.addOption(o_json);
+    parser.addOption(o_baseline);
+    parser.addOption(o_threshold);
+    parser.addOption(o_list);
+    if (!parser.parse(argc, argv, false)) {
+        return EXIT_FAILURE;
+    }
+
+    const vector<Benchmark>& benchmarks = registry();
+    if (o_list.result()) {
+        for (size_t ii = 0; ii < benchmarks.size(); ii++) {
+            printf("%s\n", benchmarks[ii].name);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    Json::Value baseline(Json::objectValue);
+    bool has_baseline = o_baseline.passed();
+    if (has_baseline && !loadBaseline(o_baseline.result(), baseline)) {
+        return EXIT_FAILURE;
+    }
+
+    unsigned repetitions = std::max(o_reps.result(), 1U);
+    lcb_U64 min_ns = (lcb_U64)o_mintime.result() * 1000000;
+    double threshold = o_threshold.result();
+    unsigned nregressions = 0;
+    vector<Result> results;
+
+    printf("%-28s %12s %10s %10s %10s", "BENCHMARK", "ITERATIONS", "NS/OP", "MB/S", "ALLOCS/OP");
+    if (has_baseline) {
+        printf(" %9s", "VS BASE");
+    }
+    printf("\n");
+
+    for (size_t ii = 0; ii < benchmarks.size(); ii++) {
+        const Benchmark& b = benchmarks[ii];
+        if (!o_filter.result().empty() && string(b.name).find(o_filter.result()) == string::npos) {
+            continue;
+        }
+
+        Result res = measure(b, min_ns, repetitions);
+        results.push_back(res);
+
+        printf("%-28s %12llu %10.1f", res.name.c_str(), (unsigned long long)res.iterations, res.ns_per_op);
+        if (res.bytes_per_sec) {
+            printf(" %10.1f", res.bytes_per_sec / 1e6);
+        } else {
+            printf(" %10s", "-");
+        }
+        if (COUNTS_ALLOCATIONS) {
+            printf(" %10.2f", res.allocs_per_op);
+        } else {
+            printf(" %10s", "-");
+        }
+
+        if (has_baseline && baseline.isMember(res.name)) {
+            const Json::Value& base = baseline[res.name];
+            double base_ns = base["ns_per_op"].asDouble();
+            double change = base_ns > 0 ? (res.ns_per_op - base_ns) * 100 / base_ns : 0;
+            printf(" %+8.1f%%", change);
+            // Allocation counts are deterministic, so any increase is reported
+            if (change > threshold ||
+                    (COUNTS_ALLOCATIONS && res.allocs_per_op > base["allocs_per_op"].asDouble() + 0.005)) {
+                printf(" REGRESSION");
+                nregressions++;
+            }
+        } else if (has_baseline) {
+            printf(" %9s", "new");
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    if (o_json.passed()) {
+        std::ofstream ofs(o_json.result().c_str());
+        if (!ofs.is_open()) {
+            fprintf(stderr, "Couldn't open %s for writing\n", o_json.result().c_str());
+            return EXIT_FAILURE;
+        }
+        ofs << Json::StyledWriter().write(toJson(results));
+    }
+
+    if (nregressions) {
+        printf("%u benchmark(s) regressed against %s\n", nregressions, o_baseline.result().c_str());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,99 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_MICROBENCH_H
+#define LCB_MICROBENCH_H
+
+#include "config.h"
+#include <libcouchbase/couchbase.h>
+#include <stddef.h>
+
+/**
+ * @file
+ * Minimal harness for timing the library's internal components in
+ * isolation. A benchmark is a function which performs its operation
+ * State::iterations() times:
+ *
+ * @code{.cpp}
+ * MICROBENCH(base64_encode)
+ * {
+ *     char out[256];
+ *     state.setBytesPerOp(100);
+ *     for (size_t ii = 0; ii < state.iterations(); ii++) {
+ *         lcb_base64_encode(input, out, sizeof out);
+ *     }
+ * }
+ * @endcode
+ *
+ * The harness calls it with increasing iteration counts until one run lasts
+ * long enough to be timed, then reports the time, bytes and heap
+ * allocations per iteration.
+ */
+
+namespace microbench {
+
+class State {
+public:
+    State(size_t niter);
+
+    size_t iterations() const { return niter; }
+
+    /** Bytes processed by each iteration, used to report a throughput */
+    void setBytesPerOp(size_t n) { bytes_per_op = n; }
+
+    /**
+     * Exclude setup or teardown from the measurement. Timing (and the
+     * counting of allocations) starts when the benchmark is called.
+     */
+    void pauseTiming();
+    void resumeTiming();
+
+    lcb_U64 elapsed() const { return ns; }
+    lcb_U64 allocations() const { return nallocs; }
+    size_t bytesPerOp() const { return bytes_per_op; }
+
+private:
+    size_t niter;
+    size_t bytes_per_op;
+    bool running;
+    lcb_U64 ns;
+    lcb_U64 nallocs;
+    lcb_U64 start_ns;
+    lcb_U64 start_allocs;
+};
+
+typedef void (*BenchFunc)(State&);
+
+/** Adds a benchmark to the list of those run by the program */
+struct Registrar {
+    Registrar(const char *name, BenchFunc fn);
+};
+
+/**
+ * Keeps the compiler from discarding a computation whose result is
+ * otherwise unused
+ */
+void doNotOptimize(const void *p);
+
+}
+
+#define MICROBENCH(name) \
+    static void microbench_##name(microbench::State&); \
+    static microbench::Registrar microbench_reg_##name(#name, microbench_##name); \
+    static void microbench_##name(microbench::State& state)
+
+#endif
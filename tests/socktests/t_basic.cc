@@ -1,4 +1,5 @@
 #include "socktest.h"
+#include <lcbio/resolver.h>
 using namespace LCBTest;
 using std::string;
 using std::vector;
@@ -80,6 +81,113 @@ TEST_F(SockConnTest, testBadDomain)
     ASSERT_TRUE(sock.sock == NULL);
 }
 
+TEST_F(SockConnTest, testResolverCache)
+{
+    lcb_cntl_dnsstats before, after;
+    lcb::io::resolver_clear_cache();
+    lcb::io::resolver_stats(&before);
+
+    // First connection performs the lookup, the second one reuses it
+    for (size_t ii = 0; ii < 2; ii++) {
+        ESocket sock;
+        loop->connect(&sock);
+        ASSERT_FALSE(sock.sock == NULL);
+        sock.close();
+    }
+    lcb::io::resolver_stats(&after);
+    ASSERT_EQ(2, after.lookups - before.lookups);
+    ASSERT_EQ(1, after.misses - before.misses);
+    ASSERT_EQ(1, after.hits - before.hits);
+
+    // With caching disabled, each connection performs its own lookup
+    loop->settings->dns_cache_ttl = 0;
+    {
+        ESocket sock;
+        loop->connect(&sock);
+        ASSERT_FALSE(sock.sock == NULL);
+        sock.close();
+    }
+    loop->settings->dns_cache_ttl = LCB_DEFAULT_DNS_CACHE_TTL;
+    lcb::io::resolver_stats(&before);
+    ASSERT_EQ(1, before.misses - after.misses);
+    ASSERT_EQ(after.hits, before.hits);
+}
+
+#ifndef _WIN32
+/**
+ * Listens on another loopback address, on the same port as the test server.
+ * Its accept queue is filled up front, so any further connection attempt
+ * hangs until it is timed out.
+ */
+class HangingListener {
+public:
+    HangingListener(const char *port) : lsnfd(-1), clifd(-1) {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof addr);
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = inet_addr("127.0.0.2");
+        addr.sin_port = htons(atoi(port));
+
+        lsnfd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (bind(lsnfd, (struct sockaddr *)&addr, sizeof addr) != 0 ||
+                listen(lsnfd, 0) != 0) {
+            return;
+        }
+        clifd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (connect(clifd, (struct sockaddr *)&addr, sizeof addr) != 0) {
+            ::close(clifd);
+            clifd = -1;
+        }
+    }
+    ~HangingListener() {
+        if (clifd != -1) {
+            ::close(clifd);
+        }
+        ::close(lsnfd);
+    }
+    bool isOk() const { return clifd != -1; }
+
+private:
+    int lsnfd;
+    int clifd;
+};
+
+TEST_F(SockConnTest, testRaceConnect)
+{
+    lcb_host_t host;
+    loop->populateHost(&host);
+    HangingListener hanging(host.port);
+    ASSERT_TRUE(hanging.isOk());
+    strcpy(host.host, "race-test.invalid");
+
+    // The first address hangs, the second one accepts
+    const char *addrs[] = { "127.0.0.2", "127.0.0.1" };
+    loop->settings->ipv6 = LCB_IPV6_ALLOW;
+    lcb::io::resolver_seed(loop->settings, &host, addrs, 2);
+
+    hrtime_t begin = gethrtime();
+    ESocket sock;
+    loop->connect(&sock, &host, 5000);
+    hrtime_t elapsed = gethrtime() - begin;
+    ASSERT_FALSE(sock.sock == NULL);
+    sock.close();
+
+    // Attempts are started at least every 250ms
+    ASSERT_LT(elapsed, (hrtime_t)2000000000);
+
+    // Without racing, we're stuck on the first address until the timeout
+    loop->settings->connect_attempt_delay = 0;
+    lcb::io::resolver_seed(loop->settings, &host, addrs, 2);
+    ESocket sock2;
+    loop->connect(&sock2, &host, 500);
+    loop->settings->connect_attempt_delay = LCB_DEFAULT_CONNECT_ATTEMPT_DELAY;
+    loop->settings->ipv6 = LCB_IPV6_DISABLED;
+    lcb::io::resolver_clear_cache();
+    ASSERT_TRUE(sock2.sock == NULL);
+    ASSERT_EQ(LCB_ETIMEDOUT, sock2.lasterr);
+}
+#endif
+
 TEST_F(SockConnTest, testInvalidPort)
 {
     ESocket sock;
@@ -141,3 +249,58 @@ TEST_F(SockConnTest, testImmediateUnref)
     ASSERT_EQ(1, sock.callCount);
     ASSERT_TRUE(sock.sock == NULL);
 }
+
+namespace {
+struct CoalesceInfo {
+    Loop *loop;
+    int callCount;
+    lcb_error_t errs[2];
+};
+}
+
+extern "C" {
+static void
+conncb_coalesce(lcbio_SOCKET *, void *arg, lcb_error_t err, lcbio_OSERR)
+{
+    CoalesceInfo *info = (CoalesceInfo *)arg;
+    info->errs[info->callCount++] = err;
+    if (info->callCount == 2) {
+        info->loop->stop();
+    }
+}
+}
+
+TEST_F(SockConnTest, testResolverCoalesce)
+{
+    if (!loop->iot->is_E()) {
+        // Lookups are only performed in the background for event based IO
+        return;
+    }
+    lcb_cntl_dnsstats before, after;
+    lcb::io::resolver_clear_cache();
+    lcb::io::resolver_stats(&before);
+
+    // Both connections are started before the first lookup can complete
+    CoalesceInfo info;
+    info.loop = loop;
+    info.callCount = 0;
+    lcb_host_t host;
+    loop->populateHost(&host);
+    for (size_t ii = 0; ii < 2; ii++) {
+        ASSERT_FALSE(NULL == lcbio_connect(loop->iot, loop->settings, &host,
+                LCB_MS2US(1000), conncb_coalesce, &info));
+    }
+    loop->start();
+    ASSERT_EQ(2, info.callCount);
+    ASSERT_EQ(LCB_SUCCESS, info.errs[0]);
+    ASSERT_EQ(LCB_SUCCESS, info.errs[1]);
+
+    // The second connection either joins the lookup in progress, or finds its
+    // result in the cache if it already completed. It never performs its own
+    lcb::io::resolver_stats(&after);
+    ASSERT_EQ(2, after.lookups - before.lookups);
+    ASSERT_EQ(1, after.misses - before.misses);
+    ASSERT_EQ(1, after.async - before.async);
+    ASSERT_EQ(1, (after.coalesced - before.coalesced) + (after.hits - before.hits));
+    lcb::io::resolver_clear_cache();
+}
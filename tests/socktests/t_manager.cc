@@ -176,3 +176,87 @@ TEST_F(SockMgrTest, testMaxIdle)
         delete otherSocks[ii];
     }
 }
+
+class StopLoopTimer : public Timer {
+public:
+    StopLoopTimer(Loop *loop_) : Timer(loop_->iot), loop(loop_) {}
+    void expired() { loop->stop(); }
+    Loop *loop;
+};
+
+TEST_F(SockMgrTest, testPreconnect)
+{
+    lcb_host_t host;
+    loop->populateHost(&host);
+    loop->sockpool->preconnect(host, 2, LCB_MS2US(1000));
+
+    // Let the connections complete
+    StopLoopTimer tm(loop);
+    tm.schedule(100);
+    loop->start();
+
+    const lcb::io::Pool::Stats& stats = loop->sockpool->get_stats();
+    ASSERT_EQ(2U, stats.preconnects);
+    ASSERT_EQ(0U, stats.hits);
+
+    ESocket *sock1 = new ESocket();
+    loop->connectPooled(sock1);
+    ESocket *sock2 = new ESocket();
+    loop->connectPooled(sock2);
+    ASSERT_TRUE(sock1->sock != NULL);
+    ASSERT_TRUE(sock2->sock != NULL);
+    ASSERT_NE(sock1->sock, sock2->sock);
+    ASSERT_EQ(2U, stats.hits);
+    ASSERT_EQ(0U, stats.misses);
+
+    // A third request must create a new connection
+    ESocket *sock3 = new ESocket();
+    loop->connectPooled(sock3);
+    ASSERT_TRUE(sock3->sock != NULL);
+    ASSERT_EQ(1U, stats.misses);
+
+    delete sock3;
+    delete sock2;
+    delete sock1;
+}
+
+TEST_F(SockMgrTest, testClearWarm)
+{
+    lcb_host_t host;
+    loop->populateHost(&host);
+    loop->sockpool->get_options().tmoidle = LCB_MS2US(50);
+    loop->sockpool->get_options().tmoprobe = LCB_MS2US(20);
+    loop->sockpool->preconnect(host, 2, LCB_MS2US(1000));
+
+    // Pre-connected connections outlive the idle timeout
+    StopLoopTimer tm(loop);
+    tm.schedule(200);
+    loop->start();
+    ASSERT_EQ(2U, loop->sockpool->get_usage().idle);
+
+    // Once no longer wanted, they expire and are not replaced
+    loop->sockpool->clear_warm(host);
+    tm.schedule(200);
+    loop->start();
+    ASSERT_EQ(0U, loop->sockpool->get_usage().idle);
+    ASSERT_EQ(0U, loop->sockpool->get_usage().pending);
+    ASSERT_EQ(2U, loop->sockpool->get_stats().preconnects);
+}
+
+TEST_F(SockMgrTest, testHostMaxIdle)
+{
+    lcb_host_t host;
+    loop->populateHost(&host);
+    loop->sockpool->set_host_maxidle(host, 0);
+
+    ESocket *sock1 = new ESocket();
+    loop->connectPooled(sock1);
+    delete sock1;
+
+    // Socket was not kept in the pool
+    ESocket *sock2 = new ESocket();
+    loop->connectPooled(sock2);
+    ASSERT_EQ(0U, loop->sockpool->get_stats().hits);
+    ASSERT_EQ(2U, loop->sockpool->get_stats().misses);
+    delete sock2;
+}
@@ -254,3 +254,159 @@ TEST_F(SockPutexTest, testClosed)
 
     ASSERT_TRUE(buflist->bufs.empty());
 }
+
+TEST_F(SockPutexTest, testZerocopy)
+{
+    const size_t nbig = 8, bigsize = 256 * 1024;
+    string expected;
+
+    if (!lcbio_ctx_zerocopy(sock.ctx, 64 * 1024)) {
+        fprintf(stderr, "Zerocopy sends not supported. Skipping\n");
+        return;
+    }
+
+    // Large buffers are sent in place; the small ones between them must
+    // still be reported in order
+    for (size_t ii = 0; ii < nbig; ii++) {
+        string big(bigsize, 'a' + ii);
+        string small(100, 'A' + ii);
+        buflist->append(big);
+        buflist->append(small);
+        expected += big;
+        expected += small;
+    }
+
+    string received;
+    while (received.size() != expected.size() || !buflist->bufs.empty()) {
+        RecvFuture rf(std::min(bigsize, expected.size() - received.size()));
+        FutureBreakCondition fbc(&rf);
+        TClosedBreakCondition tcb(&sock, buflist);
+
+        if (received.size() != expected.size()) {
+            sock.conn->setRecv(&rf);
+            loop->setBreakCondition(&fbc);
+        } else {
+            // Everything was received. Wait for the completions
+            loop->setBreakCondition(&tcb);
+        }
+        lcbio_ctx_wwant(sock.ctx);
+        sock.schedule();
+        loop->start();
+        loop->setBreakCondition(NULL);
+
+        if (received.size() != expected.size()) {
+            rf.wait();
+            ASSERT_TRUE(rf.isOk());
+            received += rf.getString();
+        }
+    }
+
+    ASSERT_EQ(expected, received);
+    ASSERT_EQ(expected.size(), bufActions.totalFlushed);
+    ASSERT_FALSE(lcbio_ctx_zcpending(sock.ctx));
+}
+
+class ZcBlockedCondition : public BreakCondition {
+public:
+    ZcBlockedCondition(ESocket *s) : sock(s) {}
+protected:
+    /** Zerocopy writes are outstanding, and the socket buffer is full */
+    bool shouldBreakImpl() {
+        return lcbio_ctx_zcpending(sock->ctx) && sock->ctx->zc->nrest;
+    }
+    ESocket *sock;
+};
+
+class ZcDrainedCondition : public BreakCondition {
+public:
+    ZcDrainedCondition(ESocket *s) : sock(s) {}
+protected:
+    bool shouldBreakImpl() {
+        return !lcbio_ctx_zcpending(sock->ctx);
+    }
+    ESocket *sock;
+};
+
+TEST_F(SockPutexTest, testZerocopyDrain)
+{
+    const size_t nbig = 16, bigsize = 256 * 1024;
+
+    if (!lcbio_ctx_zerocopy(sock.ctx, 64 * 1024)) {
+        fprintf(stderr, "Zerocopy sends not supported. Skipping\n");
+        return;
+    }
+
+    // The peer does not read, so the kernel keeps the data of the zerocopy
+    // writes queued
+    for (size_t ii = 0; ii < nbig; ii++) {
+        buflist->append(string(bigsize, 'a' + ii));
+    }
+    ZcBlockedCondition zbc(&sock);
+    loop->setBreakCondition(&zbc);
+    lcbio_ctx_wwant(sock.ctx);
+    sock.schedule();
+    loop->start();
+    loop->setBreakCondition(NULL);
+    if (!zbc.didBreak()) {
+        fprintf(stderr, "Kernel completed zerocopy writes early. Skipping\n");
+        return;
+    }
+    unsigned flushed = bufActions.totalFlushed;
+
+    // Queued data must be released by the kernel before it is reported
+    // as flushed. Data not yet written is never reported
+    lcbio_ctx_zcdrain(sock.ctx);
+    ASSERT_TRUE(lcbio_ctx_zcpending(sock.ctx));
+    ASSERT_EQ(flushed, bufActions.totalFlushed);
+
+    ZcDrainedCondition zdc(&sock);
+    loop->setBreakCondition(&zdc);
+    loop->start();
+    loop->setBreakCondition(NULL);
+    ASSERT_TRUE(zdc.didBreak());
+    ASSERT_FALSE(lcbio_ctx_zcpending(sock.ctx));
+    ASSERT_GT(bufActions.totalFlushed, flushed);
+    ASSERT_LT(bufActions.totalFlushed, nbig * bigsize);
+    ASSERT_EQ(0, sock.ctx->evactive);
+}
+
+class ErrorCondition : public BreakCondition {
+public:
+    ErrorCondition(ESocket *s) : sock(s) {}
+protected:
+    bool shouldBreakImpl() {
+        return sock->lasterr != LCB_SUCCESS;
+    }
+    ESocket *sock;
+};
+
+TEST_F(SockPutexTest, testZerocopyPeerClosed)
+{
+    if (!lcbio_ctx_zerocopy(sock.ctx, 64 * 1024)) {
+        fprintf(stderr, "Zerocopy sends not supported. Skipping\n");
+        return;
+    }
+    for (size_t ii = 0; ii < 16; ii++) {
+        buflist->append(string(256 * 1024, 'a' + ii));
+    }
+    ZcBlockedCondition zbc(&sock);
+    loop->setBreakCondition(&zbc);
+    lcbio_ctx_wwant(sock.ctx);
+    sock.schedule();
+    loop->start();
+    loop->setBreakCondition(NULL);
+    if (!zbc.didBreak()) {
+        fprintf(stderr, "Kernel completed zerocopy writes early. Skipping\n");
+        return;
+    }
+
+    // No input is wanted, but the socket is watched for notifications.
+    // The peer closing the connection must be reported
+    ASSERT_EQ(0, sock.ctx->rdwant);
+    sock.conn->close();
+    ErrorCondition ec(&sock);
+    loop->setBreakCondition(&ec);
+    loop->start();
+    loop->setBreakCondition(NULL);
+    ASSERT_NE(LCB_SUCCESS, sock.lasterr);
+}
@@ -71,6 +71,157 @@ TEST_F(SSLTest, testBasic)
     sock.close();
 }
 
+TEST_F(SSLTest, testLargeWrite)
+{
+    // Many writes of assorted sizes, more than the socket buffer can take at
+    // once, must arrive intact and in order
+    ESocket sock;
+    loop->connect(&sock);
+    ASSERT_FALSE(sock.sock == NULL);
+
+    string sendStr;
+    for (size_t ii = 0; sendStr.size() < 4 * 1024 * 1024; ii++) {
+        string chunk((ii * 37) % 20000 + 1, 'a' + (ii % 26));
+        sock.put(chunk);
+        sendStr += chunk;
+    }
+
+    RecvFuture rf(sendStr.size());
+    FutureBreakCondition wbc(&rf);
+    sock.conn->setRecv(&rf);
+    sock.schedule();
+    loop->setBreakCondition(&wbc);
+    loop->start();
+    rf.wait();
+    ASSERT_TRUE(rf.isOk());
+    ASSERT_TRUE(rf.getString() == sendStr);
+    sock.close();
+}
+
+TEST_F(SSLTest, testSessionResumption)
+{
+    lcb_cntl_sslstats stats;
+    string sendStr("Hello World");
+
+    // Establish a session, and make sure the session ticket (which may
+    // arrive after the handshake) has been read
+    for (int ii = 0; ii < 2; ii++) {
+        ESocket sock;
+        loop->connect(&sock);
+        ASSERT_FALSE(sock.sock == NULL);
+
+        RecvFuture rf(sendStr.size());
+        FutureBreakCondition wbc(&rf);
+        sock.conn->setRecv(&rf);
+        sock.put(sendStr);
+        sock.schedule();
+        loop->setBreakCondition(&wbc);
+        loop->start();
+        rf.wait();
+        ASSERT_TRUE(rf.isOk());
+
+        SendFuture sf(sendStr);
+        ReadBreakCondition rbc(&sock, sendStr.size());
+        sock.conn->setSend(&sf);
+        sock.reqrd(sendStr.size());
+        sock.schedule();
+        loop->setBreakCondition(&rbc);
+        loop->start();
+        sf.wait();
+        ASSERT_EQ(sendStr, sock.getReceived());
+        sock.close();
+    }
+
+    lcbio_ssl_get_stats(loop->settings->ssl_ctx, &stats);
+    ASSERT_EQ(1, stats.full_handshakes);
+    ASSERT_EQ(1, stats.resumed_handshakes);
+    ASSERT_EQ(1, stats.cached_sessions);
+}
+
+// Sends data with kernel TLS requested. Where the kernel does not support it
+// the connection falls back to userspace TLS; either way the data must arrive
+// intact. Without the setting nothing may be offloaded.
+TEST_F(SSLTest, testKtlsTransfer)
+{
+    const size_t total = 1024 * 1024;
+    string sendStr;
+    for (size_t ii = 0; sendStr.size() < total; ii++) {
+        sendStr += (char)('a' + (ii % 26));
+    }
+
+    for (int ktls = 0; ktls < 2; ktls++) {
+        lcb_cntl_sslstats before, after;
+        lcbio_ssl_get_stats(loop->settings->ssl_ctx, &before);
+        loop->settings->ssl_ktls = ktls;
+
+        ESocket sock;
+        loop->connect(&sock);
+        ASSERT_FALSE(sock.sock == NULL);
+
+        RecvFuture rf(total);
+        FutureBreakCondition wbc(&rf);
+        sock.conn->setRecv(&rf);
+        sock.put(sendStr);
+        sock.schedule();
+        loop->setBreakCondition(&wbc);
+        loop->start();
+        rf.wait();
+        ASSERT_TRUE(rf.isOk());
+        ASSERT_EQ(sendStr, rf.getString());
+        sock.close();
+
+        lcbio_ssl_get_stats(loop->settings->ssl_ctx, &after);
+        if (!ktls) {
+            ASSERT_EQ(before.ktls_handshakes, after.ktls_handshakes);
+        }
+    }
+    loop->settings->ssl_ktls = 0;
+}
+
+// Sends the same payload over loopback with kernel TLS enabled, then with it
+// disabled, and reports the throughput of each mode. Where the kernel does not
+// support it the first run falls back to userspace TLS, which is reported.
+TEST_F(SSLTest, testKtlsThroughput)
+{
+    const size_t total = 16 * 1024 * 1024;
+    const string chunk(16384, 'x');
+
+    for (int ktls = 1; ktls >= 0; ktls--) {
+        lcb_cntl_sslstats before, after;
+        lcbio_ssl_get_stats(loop->settings->ssl_ctx, &before);
+        loop->settings->ssl_ktls = ktls;
+
+        ESocket sock;
+        loop->connect(&sock);
+        ASSERT_FALSE(sock.sock == NULL);
+
+        RecvFuture rf(total);
+        FutureBreakCondition wbc(&rf);
+        sock.conn->setRecv(&rf);
+        hrtime_t begin = gethrtime();
+        for (size_t nput = 0; nput < total; nput += chunk.size()) {
+            sock.put(chunk);
+        }
+        sock.schedule();
+        loop->setBreakCondition(&wbc);
+        loop->start();
+        rf.wait();
+        hrtime_t elapsed = gethrtime() - begin;
+        ASSERT_TRUE(rf.isOk());
+        ASSERT_EQ(total, rf.getString().size());
+        sock.close();
+
+        lcbio_ssl_get_stats(loop->settings->ssl_ctx, &after);
+        bool offloaded = after.ktls_handshakes > before.ktls_handshakes;
+        const char *mode = offloaded ? "kernel" :
+                (ktls ? "userspace (kTLS unavailable)" : "userspace");
+        double mbps = (total / 1048576.0) / (elapsed / 1000000000.0);
+        fprintf(stderr, "%s TLS: %.1f MB/s\n", mode, mbps);
+        RecordProperty(ktls ? "ktls_mbps" : "userspace_mbps", (int)mbps);
+    }
+    loop->settings->ssl_ktls = 0;
+}
+
 #else
 class SSLTest : public ::testing::Test {};
 TEST_F(SSLTest, DISABLED_testBasic)
@@ -32,12 +32,16 @@
 #include <algorithm> // random_shuffle
 #include <stdexcept>
 #include <sstream>
+#include <signal.h>
 #ifndef WIN32
 #include <pthread.h>
 #include <unistd.h> // isatty()
+#else
+#define usleep(n) Sleep(n/1000)
 #endif
 #include "common/options.h"
 #include "common/histogram.h"
+#include "common/hdrhistogram.h"
 
 using namespace cbc;
 using namespace cliopts;
@@ -167,10 +171,37 @@ private:
 
 Metrics GlobalMetrics;
 
+/** Set when the run should end (on SIGINT, or after --duration) */
+static volatile sig_atomic_t cancelled = 0;
+
+/** Results for one statement. Latencies are in microseconds */
+struct StatementStats {
+    StatementStats() : nqueries(0), nerrors(0), nrows(0), nbytes(0) {}
+
+    void add(const StatementStats& other) {
+        first_row.add(other.first_row);
+        last_row.add(other.last_row);
+        nqueries += other.nqueries;
+        nerrors += other.nerrors;
+        nrows += other.nrows;
+        nbytes += other.nbytes;
+    }
+
+    HdrHistogram first_row; // Time to the first row (or the end, without rows)
+    HdrHistogram last_row; // Time to the end of the response
+    lcb_U64 nqueries;
+    lcb_U64 nerrors;
+    lcb_U64 nrows;
+    lcb_U64 nbytes; // Rows and metadata received
+};
+
 class Configuration
 {
 public:
-    Configuration() : o_file("queryfile"), o_threads("num-threads"), o_errlog("error-log"), m_errlog(NULL) {
+    Configuration()
+    : o_file("queryfile"), o_threads("num-threads"), o_errlog("error-log"),
+      o_concurrency("concurrency"), o_qps("qps"), o_prepared("prepared"),
+      o_duration("duration"), m_errlog(NULL) {
         o_file.mandatory(true);
         o_file.description(
             "Path to a file containing all the queries to execute. "
@@ -185,6 +216,21 @@ public:
             "Path to a file containing failed queries");
         o_errlog.abbrev('e');
         o_errlog.setDefault("");
+
+        o_concurrency.description("Number of queries in flight at once, per thread");
+        o_concurrency.setDefault(1);
+
+        o_qps.description(
+            "Issue queries at this rate (per thread) rather than as fast as "
+            "possible. Latencies are measured from when each query was due");
+        o_qps.setDefault(0);
+
+        o_prepared.description(
+            "Prepare each statement once and execute the prepared form, "
+            "rather than running the statements ad hoc");
+
+        o_duration.description("Number of seconds to run for (0 to run until interrupted)");
+        o_duration.setDefault(0);
     }
 
     ~Configuration() {
@@ -198,6 +244,10 @@ public:
         parser.addOption(o_file);
         parser.addOption(o_threads);
         parser.addOption(o_errlog);
+        parser.addOption(o_concurrency);
+        parser.addOption(o_qps);
+        parser.addOption(o_prepared);
+        parser.addOption(o_duration);
         m_params.addToParser(parser);
     }
 
@@ -212,6 +262,10 @@ public:
             throw std::runtime_error(errstr);
         }
 
+        if (o_concurrency.result() == 0) {
+            throw std::runtime_error("--concurrency must be greater than 0");
+        }
+
         string curline;
         while (std::getline(ifs, curline).good() && !ifs.eof()) {
             if (!curline.empty()) {
@@ -238,6 +292,10 @@ public:
     const vector<string>& queries() const { return m_queries; }
     size_t nthreads() { return o_threads.result(); }
     std::ofstream* errlog() { return m_errlog; }
+    unsigned concurrency() { return o_concurrency.result(); }
+    unsigned qps() { return o_qps.result(); }
+    bool prepared() { return o_prepared.result(); }
+    unsigned duration() { return o_duration.result(); }
 
 private:
     vector<string> m_queries;
@@ -245,6 +303,10 @@ private:
     UIntOption o_threads;
     ConnParams m_params;
     StringOption o_errlog;
+    UIntOption o_concurrency;
+    UIntOption o_qps;
+    BoolOption o_prepared;
+    UIntOption o_duration;
     std::ofstream *m_errlog;
 };
 
@@ -253,23 +315,62 @@ extern "C" { static void* pthrfunc(void*); }
 
 class ThreadContext;
 struct QueryContext {
-    lcb_U64 begin;
-    bool received; // whether any row was received
+    size_t stmt; // Index of the statement in the query list
+    lcb_U64 begin; // When the query was sent (or due, with --qps)
+    lcb_U64 first; // Time to the first row
+    lcb_U64 nrows;
+    lcb_U64 nbytes;
     ThreadContext *ctx; // Parent
 
     QueryContext(ThreadContext *tctx)
-    : begin(lcb_nstime()), received(false), ctx(tctx) {}
+    : stmt(0), begin(0), first(0), nrows(0), nbytes(0), ctx(tctx) {}
 };
 
 class ThreadContext {
 public:
     void run()
     {
-        while (!m_cancelled) {
-            vector<string>::const_iterator ii = m_queries.begin();
-            for (; ii != m_queries.end(); ++ii) {
-                run_one_query(*ii);
+        lcb_U64 interval = m_qps ? 1000000000ULL / m_qps : 0;
+        lcb_U64 due = lcb_nstime();
+        lcb_U64 deadline = m_duration ? due + m_duration * 1000000000ULL : 0;
+        size_t pos = 0;
+
+        while (!cancelled) {
+            lcb_U64 now = lcb_nstime();
+            if (deadline && now >= deadline) {
+                cancelled = 1;
+                break;
+            }
+
+            // Without a rate, keep every slot busy. With one, send whatever
+            // has fallen due; if the slots are all busy, the queries wait
+            // and their wait counts towards their latency.
+            while (!m_free.empty() && (!interval || due <= now)) {
+                bool ok = issue(m_order[pos], interval ? due : now);
+                if (++pos == m_order.size()) {
+                    pos = 0;
+                }
+                due += interval;
+                if (!ok) {
+                    break;
+                }
             }
+
+            if (!interval) {
+                m_blocking = true;
+                lcb_wait(m_instance);
+                m_blocking = false;
+            } else if (m_inflight) {
+                if (lcb_tick_nowait(m_instance) == LCB_CLIENT_FEATURE_UNAVAILABLE) {
+                    lcb_wait(m_instance);
+                }
+            } else if (due > now) {
+                lcb_U64 sleep_us = (due - now) / 1000;
+                usleep(sleep_us > 100000 ? 100000 : sleep_us);
+            }
+        }
+        if (m_inflight) {
+            lcb_wait(m_instance);
         }
     }
 
@@ -306,44 +407,86 @@ public:
 
     void handle_response(const lcb_RESPN1QL *resp, QueryContext *ctx)
     {
-        if (!ctx->received) {
-            lcb_U64 duration = lcb_nstime() - ctx->begin;
+        lcb_U64 now = lcb_nstime();
+        ctx->nbytes += resp->nrow;
+
+        if (!(resp->rflags & LCB_RESP_F_FINAL)) {
+            if (ctx->nrows++ == 0) {
+                ctx->first = now - ctx->begin;
+                m_metrics->lock();
+                m_metrics->update_timings(ctx->first);
+                m_metrics->unlock();
+            }
+            return;
+        }
+
+        lcb_U64 total = now - ctx->begin;
+        if (!ctx->nrows) {
+            ctx->first = total;
             m_metrics->lock();
-            m_metrics->update_timings(duration);
+            m_metrics->update_timings(total);
             m_metrics->unlock();
-
-            ctx->received = true;
         }
 
-        if (resp->rflags & LCB_RESP_F_FINAL) {
-            if (resp->rc != LCB_SUCCESS) {
-                if (m_errlog != NULL) {
-                    std::stringstream ss;
-                    ss.write(m_cmd.query, m_cmd.nquery);
-                    ss << endl;
-                    ss.write(resp->row, resp->nrow);
-                    log_error(resp->rc, ss.str().c_str(), ss.str().size());
-                } else {
-                    log_error(resp->rc, NULL, 0);
-                }
+        StatementStats& stats = m_stats[ctx->stmt];
+        stats.first_row.record(ctx->first / 1000);
+        stats.last_row.record(total / 1000);
+        stats.nqueries++;
+        stats.nrows += ctx->nrows;
+        stats.nbytes += ctx->nbytes;
+
+        if (resp->rc != LCB_SUCCESS) {
+            stats.nerrors++;
+            if (m_errlog != NULL) {
+                const string& txt = m_queries[ctx->stmt];
+                std::stringstream ss;
+                ss << txt << endl;
+                ss.write(resp->row, resp->nrow);
+                log_error(resp->rc, ss.str().c_str(), ss.str().size());
+            } else {
+                log_error(resp->rc, NULL, 0);
             }
-        } else {
-            last_nrow++;
+        }
+
+        m_metrics->lock();
+        m_metrics->update_row(ctx->nrows);
+        m_metrics->update_done(1);
+        m_metrics->unlock();
+
+        m_free.push_back(ctx);
+        m_inflight--;
+        if (m_blocking) {
+            lcb_breakout(m_instance);
         }
     }
 
-    ThreadContext(lcb_t instance, const vector<string>& initial_queries, std::ofstream *errlog)
-    : m_instance(instance), last_nerr(0), last_nrow(0),
-      m_metrics(&GlobalMetrics), m_cancelled(false), m_thr(NULL),
-      m_errlog(errlog)
+    /** Per-statement results, indexed like the query list */
+    const vector<StatementStats>& stats() const { return m_stats; }
+
+    ThreadContext(lcb_t instance, const vector<string>& queries,
+                  std::ofstream *errlog, unsigned concurrency, unsigned qps,
+                  bool prepared, unsigned duration)
+    : m_instance(instance), m_queries(queries), m_stats(queries.size()),
+      m_qps(qps), m_duration(duration), m_inflight(0), m_blocking(false),
+      m_metrics(&GlobalMetrics), m_thr(NULL), m_errlog(errlog)
     {
         memset(&m_cmd, 0, sizeof m_cmd);
         m_cmd.content_type = "application/json";
         m_cmd.callback = n1qlcb;
+        if (prepared) {
+            m_cmd.cmdflags |= LCB_CMDN1QL_F_PREPCACHE;
+        }
 
-        // Shuffle the list
-        m_queries = initial_queries;
-        std::random_shuffle(m_queries.begin(), m_queries.end());
+        // Each thread runs the statements in its own order
+        for (size_t ii = 0; ii < queries.size(); ii++) {
+            m_order.push_back(ii);
+        }
+        std::random_shuffle(m_order.begin(), m_order.end());
+
+        m_slots.resize(concurrency, QueryContext(this));
+        for (size_t ii = 0; ii < m_slots.size(); ii++) {
+            m_free.push_back(&m_slots[ii]);
+        }
     }
 
 private:
@@ -369,37 +512,43 @@ private:
         }
     }
 
-    void run_one_query(const string& txt)
+    bool issue(size_t stmt, lcb_U64 begin)
     {
-        // Reset counters
-        last_nrow = 0;
-        last_nerr = 0;
-
+        QueryContext *qctx = m_free.back();
+        m_free.pop_back();
+        qctx->stmt = stmt;
+        qctx->begin = begin;
+        qctx->first = 0;
+        qctx->nrows = 0;
+        qctx->nbytes = 0;
+
+        const string& txt = m_queries[stmt];
         m_cmd.query = txt.c_str();
         m_cmd.nquery = txt.size();
 
-        // Set up our context
-        QueryContext qctx(this);
-
-        lcb_error_t rc = lcb_n1ql_query(m_instance, &qctx, &m_cmd);
+        lcb_error_t rc = lcb_n1ql_query(m_instance, qctx, &m_cmd);
         if (rc != LCB_SUCCESS) {
+            m_stats[stmt].nerrors++;
             log_error(rc, txt.c_str(), txt.size());
-        } else {
-            lcb_wait(m_instance);
-            m_metrics->lock();
-            m_metrics->update_row(last_nrow);
-            m_metrics->update_done(1);
-            m_metrics->unlock();
+            m_free.push_back(qctx);
+            return false;
         }
+        m_inflight++;
+        return true;
     }
 
     lcb_t m_instance;
-    vector<string> m_queries;
-    size_t last_nerr;
-    size_t last_nrow;
+    const vector<string>& m_queries;
+    vector<size_t> m_order;
+    vector<StatementStats> m_stats;
+    vector<QueryContext> m_slots;
+    vector<QueryContext*> m_free;
+    unsigned m_qps;
+    lcb_U64 m_duration;
+    size_t m_inflight;
+    bool m_blocking;
     lcb_CMDN1QL m_cmd;
     Metrics *m_metrics;
-    volatile bool m_cancelled;
     #ifndef _WIN32
     pthread_t *m_thr;
     #else
@@ -439,6 +588,85 @@ instance_has_n1ql(lcb_t instance) {
     return hix > -1;
 }
 
+extern "C" {
+static void sigint_handler(int)
+{
+    // Let a second Ctrl-C terminate the program immediately
+    cancelled = 1;
+    signal(SIGINT, SIG_DFL);
+}
+}
+
+static void print_report(Configuration& config, const vector<ThreadContext*>& threads, double elapsed)
+{
+    const vector<string>& queries = config.queries();
+    vector<StatementStats> stats(queries.size());
+    StatementStats total;
+    for (size_t ii = 0; ii < threads.size(); ii++) {
+        for (size_t jj = 0; jj < stats.size(); jj++) {
+            stats[jj].add(threads[ii]->stats()[jj]);
+            total.add(threads[ii]->stats()[jj]);
+        }
+    }
+    if (elapsed <= 0) {
+        elapsed = 1;
+    }
+
+    printf("\n\n%s statements, %lu thread(s) x %u in flight",
+           config.prepared() ? "Prepared" : "Ad hoc",
+           (unsigned long)config.nthreads(), config.concurrency());
+    if (config.qps()) {
+        printf(", %u queries/sec per thread", config.qps());
+    }
+    printf(", %.1fs\n\n", elapsed);
+
+    printf("%5s %10s %8s %10s %12s %14s\n", "STMT", "QUERIES", "ERRORS", "QPS", "ROWS/SEC", "BYTES/SEC");
+    for (size_t ii = 0; ii <= stats.size(); ii++) {
+        const StatementStats& st = ii < stats.size() ? stats[ii] : total;
+        char label[32];
+        if (ii < stats.size()) {
+            sprintf(label, "%lu", (unsigned long)ii + 1);
+        } else {
+            strcpy(label, "ALL");
+        }
+        printf("%5s %10llu %8llu %10.1f %12.1f %14.1f\n", label,
+               (unsigned long long)st.nqueries, (unsigned long long)st.nerrors,
+               st.nqueries / elapsed, st.nrows / elapsed, st.nbytes / elapsed);
+    }
+
+    printf("\nLatency in microseconds, to the first row and to the end of the response\n");
+    printf("%5s %10s %10s %10s %10s   %10s %10s %10s %10s\n", "STMT",
+           "FIRST p50", "p99", "p99.9", "max", "LAST p50", "p99", "p99.9", "max");
+    for (size_t ii = 0; ii <= stats.size(); ii++) {
+        const StatementStats& st = ii < stats.size() ? stats[ii] : total;
+        char label[32];
+        if (ii < stats.size()) {
+            sprintf(label, "%lu", (unsigned long)ii + 1);
+        } else {
+            strcpy(label, "ALL");
+        }
+        printf("%5s %10llu %10llu %10llu %10llu   %10llu %10llu %10llu %10llu\n", label,
+               (unsigned long long)st.first_row.percentile(50),
+               (unsigned long long)st.first_row.percentile(99),
+               (unsigned long long)st.first_row.percentile(99.9),
+               (unsigned long long)st.first_row.max(),
+               (unsigned long long)st.last_row.percentile(50),
+               (unsigned long long)st.last_row.percentile(99),
+               (unsigned long long)st.last_row.percentile(99.9),
+               (unsigned long long)st.last_row.max());
+    }
+
+    printf("\n");
+    for (size_t ii = 0; ii < queries.size(); ii++) {
+        string txt = queries[ii];
+        if (txt.size() > 72) {
+            txt = txt.substr(0, 69) + "...";
+        }
+        printf("%5lu %s\n", (unsigned long)ii + 1, txt.c_str());
+    }
+    fflush(stdout);
+}
+
 static void real_main(int argc, char **argv) {
     Configuration config;
     Parser parser;
@@ -463,19 +691,24 @@ static void real_main(int argc, char **argv) {
             throw std::runtime_error("Cluster does not support N1QL!");
         }
 
-        ThreadContext* cx = new ThreadContext(instance, config.queries(), config.errlog());
+        ThreadContext* cx = new ThreadContext(instance, config.queries(),
+            config.errlog(), config.concurrency(), config.qps(),
+            config.prepared(), config.duration());
         threads.push_back(cx);
         instances.push_back(instance);
     }
 
     GlobalMetrics.prepare_screen();
+    signal(SIGINT, sigint_handler);
 
+    lcb_U64 begin = lcb_nstime();
     for (size_t ii = 0; ii < threads.size(); ++ii) {
         threads[ii]->start();
     }
     for (size_t ii = 0; ii < threads.size(); ++ii) {
         threads[ii]->join();
     }
+    print_report(config, threads, (lcb_nstime() - begin) / 1e9);
     for (size_t ii = 0; ii < instances.size(); ++ii) {
         lcb_destroy(instances[ii]);
     }
@@ -38,12 +38,19 @@
 #include <cstdarg>
 #include <exception>
 #include <stdexcept>
+#include <algorithm>
 #include "common/options.h"
 #include "common/histogram.h"
+#include "common/hdrhistogram.h"
 #include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
 
 #include "docgen/seqgen.h"
+#include "docgen/keydist.h"
 #include "docgen/docgen.h"
+#include "docgen/workload.h"
+#include "opcapture.h"
+#include <libcouchbase/vbucket.h>
+#include <memcached/protocol_binary.h>
 
 using namespace std;
 using namespace cbc;
@@ -96,6 +103,74 @@ parseTemplateSpec(const string& input)
     return spec;
 }
 
+/**
+ * @return the type of operation with which a captured operation is
+ * replayed, or OP__MAX if operations with this opcode are not replayed
+ */
+static OpType
+replayType(lcb_U8 opcode)
+{
+    switch (opcode) {
+    case PROTOCOL_BINARY_CMD_GET:
+    case PROTOCOL_BINARY_CMD_GAT:
+    case PROTOCOL_BINARY_CMD_GET_LOCKED:
+        return OP_GET;
+    case PROTOCOL_BINARY_CMD_SET:
+    case PROTOCOL_BINARY_CMD_ADD:
+    case PROTOCOL_BINARY_CMD_REPLACE:
+    case PROTOCOL_BINARY_CMD_APPEND:
+    case PROTOCOL_BINARY_CMD_PREPEND:
+        return OP_UPSERT;
+    case PROTOCOL_BINARY_CMD_DELETE:
+        return OP_DELETE;
+    case PROTOCOL_BINARY_CMD_INCREMENT:
+    case PROTOCOL_BINARY_CMD_DECREMENT:
+        return OP_COUNTER;
+    case PROTOCOL_BINARY_CMD_TOUCH:
+        return OP_TOUCH;
+    default:
+        return OP__MAX;
+    }
+}
+
+/** Summary of the operations in a --replay capture */
+struct CaptureSummary {
+    CaptureSummary() : nops(0), nskipped(0), firstStart(0), lastStart(0) {}
+
+    void load(const string& path) {
+        lcb::opcapture::Reader reader;
+        string err = reader.open(path.c_str());
+        if (!err.empty()) {
+            throw std::runtime_error(err);
+        }
+        lcb::opcapture::Record rec;
+        while (reader.next(rec)) {
+            OpType op = replayType(rec.opcode);
+            if (op == OP__MAX) {
+                nskipped++;
+                continue;
+            }
+            if (!nops || rec.start_ns < firstStart) {
+                firstStart = rec.start_ns;
+            }
+            if (rec.start_ns > lastStart) {
+                lastStart = rec.start_ns;
+            }
+            latency[op].record(rec.latency_us);
+            nops++;
+        }
+        if (!nops) {
+            throw std::runtime_error("The capture contains no operations which can be replayed");
+        }
+    }
+
+    HdrHistogram latency[OP__MAX]; // As captured, in microseconds
+    uint64_t nops;
+    uint64_t nskipped; // Operations of types which are not replayed
+    lcb_U64 firstStart;
+    lcb_U64 lastStart;
+};
+
 class Configuration
 {
 public:
@@ -120,7 +195,16 @@ public:
         o_subdoc("subdoc"),
         o_sdPathCount("pathcount"),
         o_populateOnly("populate-only"),
-        o_exptime("expiry")
+        o_exptime("expiry"),
+        o_distribution("distribution"),
+        o_zipfTheta("zipf-theta"),
+        o_hotspot("hotspot"),
+        o_expKeys("exp-keys"),
+        o_openLoop("open-loop"),
+        o_jsonReport("json-report"),
+        o_workload("workload"),
+        o_replay("replay"),
+        o_replaySpeed("replay-speed")
     {
         o_multiSize.setDefault(100).abbrev('B').description("Number of operations to batch");
         o_numItems.setDefault(1000).abbrev('I').description("Number of items to operate on");
@@ -144,6 +228,15 @@ public:
         o_sdPathCount.description("Number of subdoc paths per command").setDefault(1);
         o_populateOnly.description("Exit after documents have been populated");
         o_exptime.description("Set TTL for items").abbrev('e');
+        o_distribution.setDefault("uniform").description("Key popularity after population: uniform, zipfian, hotspot, latest or exponential");
+        o_zipfTheta.setDefault(0.99).description("Skew of the zipfian and latest distributions");
+        o_hotspot.setDefault("80,20").argdesc("OPS_PCT,KEYS_PCT").description("For the hotspot distribution, OPS_PCT percent of operations access KEYS_PCT percent of the keys");
+        o_expKeys.setDefault(10).description("For the exponential distribution, the percentage of keys receiving 95% of operations");
+        o_openLoop.description("Issue operations at the --rate-limit rate regardless of response times, and measure latency from when each operation was due");
+        o_jsonReport.argdesc("PATH").description("Write the --open-loop or --workload results to this file as JSON");
+        o_workload.argdesc("FILE|ycsb-a..ycsb-f").description("Run the phases of a workload file, or of a built-in YCSB workload");
+        o_replay.argdesc("FILE").description("Re-issue the operations captured with the opcapture_file setting, and compare their latencies");
+        o_replaySpeed.setDefault(1).description("Speed of --replay relative to the capture. 0 replays as fast as possible, with up to --batch-size operations in flight");
     }
 
     void processOptions() {
@@ -235,6 +328,90 @@ public:
         if (o_sdPathCount.passed()) {
             o_subdoc.setDefault(true);
         }
+
+        distribution = o_distribution.result();
+        if (distribution != "uniform") {
+            if (o_sequential.result()) {
+                throw std::runtime_error("--sequential is incompatible with --distribution");
+            }
+            if (sscanf(o_hotspot.result().c_str(), "%u,%u", &hotOps, &hotKeys) != 2) {
+                throw std::runtime_error("invalid hotspot spec: need OPS_PCT,KEYS_PCT");
+            }
+            // Validate the parameters up front
+            delete createDistribution(0);
+        }
+
+        if (o_openLoop.result()) {
+            if (o_rateLimit.result() == 0) {
+                throw std::runtime_error("--open-loop requires --rate-limit");
+            }
+            if (o_populateOnly.result()) {
+                throw std::runtime_error("--open-loop incompatible with --populate-only");
+            }
+        } else if (o_jsonReport.passed() && !o_workload.passed() && !o_replay.passed()) {
+            throw std::runtime_error("--json-report requires --open-loop, --workload or --replay");
+        }
+
+        if (o_replay.passed()) {
+            if (o_openLoop.result() || o_workload.passed() || o_populateOnly.result()) {
+                throw std::runtime_error("--replay incompatible with --open-loop, --workload and --populate-only");
+            }
+            if (o_replaySpeed.result() < 0) {
+                throw std::runtime_error("--replay-speed cannot be negative");
+            }
+            captured.load(o_replay.result());
+            fprintf(stderr, "Replaying %llu operations captured over %.3f seconds",
+                (unsigned long long)captured.nops,
+                (captured.lastStart - captured.firstStart) / 1000000000.0);
+            if (captured.nskipped) {
+                fprintf(stderr, " (skipping %llu of other types)",
+                    (unsigned long long)captured.nskipped);
+            }
+            fprintf(stderr, "\n");
+        }
+
+        if (o_workload.passed()) {
+            if (o_openLoop.result() || o_populateOnly.result()) {
+                throw std::runtime_error("--workload incompatible with --open-loop and --populate-only");
+            }
+            // Options given on the command line are the defaults for each phase
+            Phase defaults;
+            defaults.batchSize = opsPerCycle;
+            defaults.distribution = o_sequential.result() ? "sequential" : distribution;
+            defaults.zipfTheta = o_zipfTheta.result();
+            sscanf(o_hotspot.result().c_str(), "%u,%u", &defaults.hotOps, &defaults.hotKeys);
+            defaults.expKeys = o_expKeys.result();
+            defaults.minSize = o_minSize.result();
+            defaults.maxSize = o_maxSize.result();
+            defaults.json = o_writeJson.result();
+            defaults.expiry = o_exptime.result();
+            defaults.pathCount = sdOpsPerCmd;
+
+            vector<Phase> all = Workload::load(o_workload.result(), defaults);
+            for (size_t ii = 0; ii < all.size(); ii++) {
+                if (shouldPopulate || !all[ii].load) {
+                    phases.push_back(all[ii]);
+                }
+            }
+            if (phases.empty()) {
+                throw std::runtime_error("No workload phases to run");
+            }
+        }
+    }
+
+    /**
+     * Create the key distribution for a thread, or return NULL for uniform
+     * random access
+     */
+    KeyDistribution *createDistribution(int ix) {
+        if (distribution == "uniform") {
+            return NULL;
+        }
+        uint32_t nitems = getNumItems();
+        return KeyDistribution::create(distribution, nitems,
+            (uint64_t)getRandomSeed() << 32 | ix, o_zipfTheta.result(),
+            hotOps, hotKeys, o_expKeys.result(),
+            (nitems / getNumThreads()) * ix);
     }
 
     void addOptions(Parser& parser) {
@@ -259,6 +436,15 @@ public:
         parser.addOption(o_sdPathCount);
         parser.addOption(o_populateOnly);
         parser.addOption(o_exptime);
+        parser.addOption(o_distribution);
+        parser.addOption(o_zipfTheta);
+        parser.addOption(o_hotspot);
+        parser.addOption(o_expKeys);
+        parser.addOption(o_openLoop);
+        parser.addOption(o_jsonReport);
+        parser.addOption(o_workload);
+        parser.addOption(o_replay);
+        parser.addOption(o_replaySpeed);
         params.addToParser(parser);
         depr.addOptions(parser);
     }
@@ -282,6 +468,13 @@ public:
     uint32_t getNumItems() { return o_numItems; }
     uint32_t getRateLimit() { return o_rateLimit; }
     unsigned getExptime() { return o_exptime; }
+    bool isOpenLoop() { return o_openLoop; }
+    const string& getJsonReport() { return o_jsonReport.const_result(); }
+    bool isWorkload() { return !phases.empty(); }
+    const string& getWorkload() { return o_workload.const_result(); }
+    bool isReplay() { return o_replay.passed(); }
+    const string& getReplay() { return o_replay.const_result(); }
+    double getReplaySpeed() { return o_replaySpeed.result(); }
 
     uint32_t opsPerCycle;
     uint32_t sdOpsPerCmd;
@@ -292,6 +485,11 @@ public:
     bool hasTemplates;
     ConnParams params;
     const DocGeneratorBase *docgen;
+    string distribution;
+    unsigned hotOps;
+    unsigned hotKeys;
+    vector<Phase> phases;
+    CaptureSummary captured;
 
 private:
     UIntOption o_multiSize;
@@ -326,6 +524,18 @@ private:
 
     UIntOption o_exptime;
 
+    // Key popularity
+    StringOption o_distribution;
+    FloatOption o_zipfTheta;
+    StringOption o_hotspot;
+    UIntOption o_expKeys;
+
+    BoolOption o_openLoop;
+    StringOption o_jsonReport;
+    StringOption o_workload;
+    StringOption o_replay;
+    FloatOption o_replaySpeed;
+
     DeprecatedOptions depr;
 } config;
 
@@ -347,6 +557,7 @@ void log(const char *format, ...)
 
 extern "C" {
 static void operationCallback(lcb_t, int, const lcb_RESPBASE*);
+static void openLoopCallback(lcb_t, int, const lcb_RESPBASE*);
 }
 
 class InstanceCookie {
@@ -423,6 +634,7 @@ public:
             m_force_sequential = config.sequentialAccess();
         }
 
+        m_dist = config.createDistribution(ix);
         m_id = ix;
         m_local_genstate = config.docgen->createState(config.getNumThreads(), ix);
         if (config.isSubdoc()) {
@@ -452,10 +664,19 @@ public:
             }
         }
 
-        if (m_force_sequential) {
-            op.m_seqno = m_gensequence->next();
+        bool is_store;
+        if (m_dist && !store_override) {
+            // Choose the operation first, so that popular keys are not
+            // always read or always written
+            is_store = m_dist->chance(config.setprc);
+            op.m_seqno = config.firstKeyOffset() + m_dist->next(is_store);
         } else {
-            op.m_seqno = m_genrandom->next();
+            if (m_force_sequential) {
+                op.m_seqno = m_gensequence->next();
+            } else {
+                op.m_seqno = m_genrandom->next();
+            }
+            is_store = shouldStore(op.m_seqno);
         }
 
         if (store_override) {
@@ -463,7 +684,7 @@ public:
             op.m_mode = NextOp::STORE;
             m_local_genstate->populateIov(op.m_seqno, op.m_valuefrags);
 
-        } else if (shouldStore(op.m_seqno)) {
+        } else if (is_store) {
             op.m_mode = m_mode_write;
             if (op.m_mode == NextOp::STORE) {
                 m_local_genstate->populateIov(op.m_seqno, op.m_valuefrags);
@@ -502,6 +723,8 @@ public:
         op.m_key.assign(config.getKeyPrefix() + buffer);
     }
 
+    bool inPopulation() const { return m_in_population; }
+
     const char *getStageString() const {
         if (m_in_population) {
             return "Populate";
@@ -513,6 +736,7 @@ public:
 private:
     SeqGenerator *m_genrandom;
     SeqGenerator *m_gensequence;
+    KeyDistribution *m_dist;
     size_t m_gencount;
     int m_id;
 
@@ -524,60 +748,436 @@ private:
     SubdocGeneratorState *m_sdgenstate;
 };
 
-class ThreadContext
+/** Latencies and errors of one workload phase on one thread */
+struct PhaseStats {
+    PhaseStats() : latency(OP__MAX), errors(OP__MAX), start(0), end(0) {}
+    vector<HdrHistogram> latency; // microseconds
+    vector<uint64_t> errors;
+    lcb_U64 start;
+    lcb_U64 end;
+};
+
+/** Keys added by a thread's insert operations, kept between phases */
+struct InsertedKeys {
+    InsertedKeys(int ix)
+    : next(config.getNumItems() + ix), newest(config.getNumItems() - 1) {}
+    uint32_t next;
+    uint32_t newest;
+};
+
+class PhaseRunner;
+struct WorkloadOp {
+    PhaseRunner *runner;
+    OpType type;
+    lcb_U64 start;
+    uint32_t seqno;
+    unsigned remaining; // Responses still expected
+    bool failed;
+};
+
+extern "C" {
+static void workloadCallback(lcb_t, int, const lcb_RESPBASE*);
+}
+
+/** Runs one phase of a workload (see docgen/workload.h) on a thread */
+class PhaseRunner {
+public:
+    PhaseRunner(lcb_t instance_, const Phase& phase_, size_t phaseIx, int ix,
+                InsertedKeys& inserted_, PhaseStats& stats_)
+    : instance(instance_), phase(phase_), threadIx(ix), inserted(inserted_),
+      stats(stats_), rnd((uint64_t)config.getRandomSeed() << 32 | phaseIx << 16 | ix),
+      dist(NULL), latest(NULL), sizes(NULL), sdgenstate(NULL), seqNext(ix),
+      opsLimit(0), nissued(0), ops(phase_.batchSize) {
+
+        uint32_t nitems = config.getNumItems();
+        uint64_t seed = rnd.next();
+        if (phase.distribution == "latest") {
+            latest = new ZipfianDistribution(nitems, seed, phase.zipfTheta);
+        } else if (phase.distribution != "uniform" && phase.distribution != "sequential") {
+            dist = KeyDistribution::create(phase.distribution, nitems, seed,
+                phase.zipfTheta, phase.hotOps, phase.hotKeys, phase.expKeys, 0);
+        }
+        if (phase.zipfSizes) {
+            sizes = new ZipfianDistribution(NUM_SIZES, seed + 1, 0.99);
+        }
+        if (phase.json) {
+            docgen = new JsonDocGenerator(phase.minSize, phase.maxSize);
+        } else {
+            docgen = new RawDocGenerator(phase.minSize, phase.maxSize);
+        }
+        genstate = docgen->createState(config.getNumThreads(), ix);
+        sdgenstate = docgen->createSubdocState(config.getNumThreads(), ix);
+        if (phase.ops) {
+            opsLimit = phase.ops / config.getNumThreads();
+            if ((uint64_t)ix < phase.ops % config.getNumThreads()) {
+                opsLimit++;
+            }
+        }
+    }
+
+    ~PhaseRunner() {
+        delete dist;
+        delete latest;
+        delete sizes;
+        delete sdgenstate;
+        delete genstate;
+        delete docgen;
+    }
+
+    void run() {
+        lcb_U64 deadline = 0;
+        size_t nbatches = 0;
+        stats.start = lcb_nstime();
+        if (phase.duration > 0) {
+            deadline = stats.start + (lcb_U64)(phase.duration * 1e9);
+        }
+
+        while (!isDone(deadline, nbatches++)) {
+            size_t nsched = 0;
+            lcb_sched_enter(instance);
+            for (size_t ii = 0; ii < phase.batchSize && !limitReached(); ii++) {
+                if (schedule(ops[ii])) {
+                    nsched++;
+                }
+                nissued++;
+            }
+            if (nsched) {
+                lcb_sched_leave(instance);
+                lcb_wait(instance);
+            } else {
+                lcb_sched_fail(instance);
+            }
+        }
+        stats.end = lcb_nstime();
+    }
+
+    void opDone(WorkloadOp *op, int cbtype, const lcb_RESPBASE *resp) {
+        if (resp->rc != LCB_SUCCESS) {
+            op->failed = true;
+        } else if (op->type == OP_RMW && cbtype == LCB_CALLBACK_GET) {
+            lcb_sched_enter(instance);
+            if (store(*op, LCB_REPLACE, op->seqno, resp->cas) == LCB_SUCCESS) {
+                lcb_sched_leave(instance);
+                return;
+            }
+            lcb_sched_fail(instance);
+            op->failed = true;
+        }
+        if (--op->remaining) {
+            return;
+        }
+        if (op->failed) {
+            stats.errors[op->type]++;
+        }
+        stats.latency[op->type].record((lcb_nstime() - op->start) / 1000);
+    }
+
+private:
+    // Number of sizes produced by RawDocGenerator::gen_graded_sizes()
+    static const unsigned NUM_SIZES = 11;
+
+    bool limitReached() const {
+        if (phase.ops) {
+            return nissued >= opsLimit;
+        }
+        if (phase.distribution == "sequential" && phase.duration <= 0) {
+            return seqNext >= config.getNumItems();
+        }
+        return false;
+    }
+
+    bool isDone(lcb_U64 deadline, size_t nbatches) const {
+        if (config.maxCycles == 0) {
+            // Interrupted
+            return true;
+        } else if (limitReached()) {
+            return true;
+        } else if (deadline) {
+            return lcb_nstime() >= deadline;
+        } else if (phase.ops || phase.distribution == "sequential") {
+            return false;
+        }
+        return config.isLoopDone(nbatches);
+    }
+
+    uint32_t nextKey() {
+        uint32_t nitems = config.getNumItems();
+        if (phase.distribution == "sequential") {
+            if (seqNext >= nitems) {
+                seqNext = threadIx;
+            }
+            uint32_t ret = seqNext;
+            seqNext += config.getNumThreads();
+            return ret;
+        } else if (latest) {
+            // Ages relative to the newest key inserted by this thread
+            uint32_t age = latest->rank(rnd);
+            return age > inserted.newest ? inserted.newest : inserted.newest - age;
+        } else if (dist) {
+            return dist->next(false);
+        }
+        return rnd.nextInt(nitems);
+    }
+
+    uint32_t nextSize() {
+        return sizes ? sizes->rank(rnd) : rnd.nextInt(NUM_SIZES);
+    }
+
+    void setKey(uint32_t seqno, const char *suffix = "") {
+        char buffer[21];
+        snprintf(buffer, sizeof(buffer), "%020d", seqno);
+        key.assign(config.getKeyPrefix() + buffer + suffix);
+    }
+
+    lcb_error_t store(WorkloadOp& op, lcb_storage_t operation, uint32_t seqno, lcb_CAS cas = 0) {
+        setKey(seqno);
+        genstate->populateIov(nextSize(), valuefrags);
+        if (op.type == OP_DURABLE_UPSERT) {
+            lcb_CMDSTOREDUR dcmd = { 0 };
+            dcmd.operation = operation;
+            dcmd.exptime = phase.expiry;
+            dcmd.persist_to = phase.persistTo;
+            dcmd.replicate_to = phase.replicateTo;
+            LCB_CMD_SET_KEY(&dcmd, key.c_str(), key.size());
+            LCB_CMD_SET_VALUEIOV(&dcmd, &valuefrags[0], valuefrags.size());
+            return lcb_storedur3(instance, &op, &dcmd);
+        }
+        lcb_CMDSTORE scmd = { 0 };
+        scmd.operation = operation;
+        scmd.exptime = phase.expiry;
+        scmd.cas = cas;
+        LCB_CMD_SET_KEY(&scmd, key.c_str(), key.size());
+        LCB_CMD_SET_VALUEIOV(&scmd, &valuefrags[0], valuefrags.size());
+        return lcb_store3(instance, &op, &scmd);
+    }
+
+    lcb_error_t get(WorkloadOp& op, uint32_t seqno) {
+        lcb_CMDGET gcmd = { 0 };
+        setKey(seqno);
+        LCB_CMD_SET_KEY(&gcmd, key.c_str(), key.size());
+        return lcb_get3(instance, &op, &gcmd);
+    }
+
+    /** @return whether a response is expected for the operation */
+    bool schedule(WorkloadOp& op) {
+        lcb_error_t rc = LCB_SUCCESS;
+        op.runner = this;
+        op.type = phase.pick(rnd);
+        op.start = lcb_nstime();
+        op.remaining = 1;
+        op.failed = false;
+
+        switch (op.type) {
+        case OP_INSERT:
+            op.seqno = inserted.next;
+            inserted.next += config.getNumThreads();
+            inserted.newest = op.seqno;
+            rc = store(op, LCB_ADD, op.seqno);
+            break;
+        case OP_GET:
+        case OP_RMW:
+            op.seqno = nextKey();
+            rc = get(op, op.seqno);
+            break;
+        case OP_UPSERT:
+        case OP_DURABLE_UPSERT:
+            rc = store(op, LCB_SET, nextKey());
+            break;
+        case OP_REPLACE:
+            rc = store(op, LCB_REPLACE, nextKey());
+            break;
+        case OP_DELETE: {
+            lcb_CMDREMOVE rcmd = { 0 };
+            setKey(nextKey());
+            LCB_CMD_SET_KEY(&rcmd, key.c_str(), key.size());
+            rc = lcb_remove3(instance, &op, &rcmd);
+            break;
+        }
+        case OP_COUNTER: {
+            lcb_CMDCOUNTER ccmd = { 0 };
+            setKey(nextKey(), "_counter");
+            LCB_CMD_SET_KEY(&ccmd, key.c_str(), key.size());
+            ccmd.delta = 1;
+            ccmd.create = 1;
+            ccmd.exptime = phase.expiry;
+            rc = lcb_counter3(instance, &op, &ccmd);
+            break;
+        }
+        case OP_TOUCH: {
+            lcb_CMDTOUCH tcmd = { 0 };
+            setKey(nextKey());
+            LCB_CMD_SET_KEY(&tcmd, key.c_str(), key.size());
+            tcmd.exptime = phase.expiry;
+            rc = lcb_touch3(instance, &op, &tcmd);
+            break;
+        }
+        case OP_SDLOOKUP:
+        case OP_SDMUTATE: {
+            lcb_CMDSUBDOC sdcmd = { 0 };
+            specs.resize(phase.pathCount);
+            if (op.type == OP_SDMUTATE) {
+                sdgenstate->populateMutate(nextSize(), specs);
+                sdcmd.exptime = phase.expiry;
+            } else {
+                sdgenstate->populateLookup(nextSize(), specs);
+            }
+            setKey(nextKey());
+            LCB_CMD_SET_KEY(&sdcmd, key.c_str(), key.size());
+            sdcmd.specs = &specs[0];
+            sdcmd.nspecs = specs.size();
+            rc = lcb_subdoc3(instance, &op, &sdcmd);
+            break;
+        }
+        case OP_REPLICA_GET: {
+            lcb_CMDGETREPLICA rcmd = { 0 };
+            setKey(nextKey());
+            LCB_CMD_SET_KEY(&rcmd, key.c_str(), key.size());
+            rcmd.strategy = LCB_REPLICA_FIRST;
+            rc = lcb_rget3(instance, &op, &rcmd);
+            break;
+        }
+        case OP_SCAN: {
+            uint32_t nitems = config.getNumItems();
+            uint32_t first = nextKey();
+            unsigned n = 1 + rnd.nextInt(phase.scanLength);
+            op.remaining = 0;
+            for (unsigned ii = 0; ii < n; ii++) {
+                rc = get(op, (first + ii) % nitems);
+                if (rc != LCB_SUCCESS) {
+                    break;
+                }
+                op.remaining++;
+            }
+            if (op.remaining) {
+                // Report the error, if any, with the response
+                op.failed = rc != LCB_SUCCESS;
+                rc = LCB_SUCCESS;
+            }
+            break;
+        }
+        default:
+            rc = LCB_EINVAL;
+            break;
+        }
+
+        if (rc != LCB_SUCCESS) {
+            log("Failed to schedule %s operation: [0x%x] %s",
+                opTypeNames[op.type], rc, lcb_strerror(instance, rc));
+            stats.errors[op.type]++;
+            return false;
+        }
+        return true;
+    }
+
+    lcb_t instance;
+    const Phase& phase;
+    int threadIx;
+    InsertedKeys& inserted;
+    PhaseStats& stats;
+    Random rnd;
+    KeyDistribution *dist;
+    ZipfianDistribution *latest;
+    ZipfianDistribution *sizes;
+    DocGeneratorBase *docgen;
+    GeneratorState *genstate;
+    SubdocGeneratorState *sdgenstate;
+    uint32_t seqNext; // For sequential access
+    uint64_t opsLimit;
+    uint64_t nissued;
+    vector<WorkloadOp> ops;
+    string key;
+    vector<lcb_IOV> valuefrags;
+    vector<lcb_SDSPEC> specs;
+};
+
+static void workloadCallback(lcb_t, int cbtype, const lcb_RESPBASE *resp)
 {
+    WorkloadOp *op = reinterpret_cast<WorkloadOp *>(const_cast<void *>(resp->cookie));
+    op->runner->opDone(op, cbtype, resp);
+}
+
+/** Makes the threads wait for each other between workload phases */
+class PhaseBarrier {
 public:
-    ThreadContext(lcb_t handle, int ix) : kgen(ix), niter(0), instance(handle) {
+    PhaseBarrier() : nthreads(1), narrived(0), generation(0) {
+#ifndef WIN32
+        pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init(&cond, NULL);
+#endif
+    }
+
+    void setThreads(unsigned n) { nthreads = n; }
+
+    /**
+     * Wait for all the threads to arrive. The last one calls `fn` before
+     * the others continue.
+     */
+    void wait(void (*fn)(size_t), size_t arg) {
+#ifndef WIN32
+        pthread_mutex_lock(&mutex);
+        unsigned cur = generation;
+        if (++narrived == nthreads) {
+            fn(arg);
+            narrived = 0;
+            generation++;
+            pthread_cond_broadcast(&cond);
+        } else {
+            while (cur == generation) {
+                pthread_cond_wait(&cond, &mutex);
+            }
+        }
+        pthread_mutex_unlock(&mutex);
+#else
+        fn(arg);
+#endif
+    }
 
+private:
+    unsigned nthreads;
+    unsigned narrived;
+    unsigned generation;
+#ifndef WIN32
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+#endif
+} phaseBarrier;
+
+/** Set by the last thread to finish a phase, when the workload was interrupted */
+static bool workloadStopped = false;
+static void reportPhase(size_t ix);
+
+class ThreadContext
+{
+public:
+    ThreadContext(lcb_t handle, int ix)
+    : runStart(0), runEnd(0), kgen(ix), niter(0), instance(handle),
+      threadIx(ix), outstanding(0), nerrors(0), finished(false) {
+#ifndef WIN32
+        pthread_mutex_init(&mutex, NULL);
+#endif
     }
 
     void singleLoop() {
         bool hasItems = false;
         lcb_sched_enter(instance);
         NextOp opinfo;
-        unsigned exptime = config.getExptime();
+        lcbvb_CONFIG *vbc = NULL;
+        lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_VBCONFIG, &vbc);
+        vector<uint64_t> nsched(vbc ? lcbvb_get_nservers(vbc) : 0);
 
         for (size_t ii = 0; ii < config.opsPerCycle; ++ii) {
             kgen.setNextOp(opinfo);
-
-            switch (opinfo.m_mode) {
-            case NextOp::STORE: {
-                lcb_CMDSTORE scmd = { 0 };
-                scmd.operation = LCB_SET;
-                scmd.exptime = exptime;
-                LCB_CMD_SET_KEY(&scmd, opinfo.m_key.c_str(), opinfo.m_key.size());
-                LCB_CMD_SET_VALUEIOV(&scmd, &opinfo.m_valuefrags[0], opinfo.m_valuefrags.size());
-                error = lcb_store3(instance, this, &scmd);
-                break;
-            }
-            case NextOp::GET: {
-                lcb_CMDGET gcmd = { 0 };
-                LCB_CMD_SET_KEY(&gcmd, opinfo.m_key.c_str(), opinfo.m_key.size());
-                gcmd.exptime = exptime;
-                error = lcb_get3(instance, this, &gcmd);
-                break;
-            }
-            case NextOp::SDSTORE:
-            case NextOp::SDGET: {
-                lcb_CMDSUBDOC sdcmd = { 0 };
-                if (opinfo.m_mode == NextOp::SDSTORE) {
-                    sdcmd.exptime = exptime;
-                }
-                LCB_CMD_SET_KEY(&sdcmd, opinfo.m_key.c_str(), opinfo.m_key.size());
-                sdcmd.specs = &opinfo.m_specs[0];
-                sdcmd.nspecs = opinfo.m_specs.size();
-                error = lcb_subdoc3(instance, this, &sdcmd);
-                break;
-            }
-            }
+            error = scheduleOp(opinfo, this);
 
             if (error != LCB_SUCCESS) {
                 hasItems = false;
                 log("Failed to schedule operation: [0x%x] %s", error, lcb_strerror(instance, error));
             } else {
                 hasItems = true;
+                countNode(vbc, opinfo.m_key, nsched);
             }
         }
+        addNodeOps(vbc, nsched);
         if (hasItems) {
             lcb_sched_leave(instance);
             lcb_wait(instance);
@@ -590,6 +1190,16 @@ public:
     }
 
     bool run() {
+        if (config.isOpenLoop()) {
+            runOpenLoop();
+            return true;
+        } else if (config.isReplay()) {
+            runReplay();
+            return true;
+        } else if (config.isWorkload()) {
+            runWorkload();
+            return true;
+        }
         do {
             singleLoop();
 
@@ -611,19 +1221,422 @@ public:
         return true;
     }
 
+    /**
+     * Move the latencies recorded since the previous call into the
+     * given histograms.
+     * @return whether the thread has finished its open-loop run
+     */
+    bool collect(HdrHistogram& response, HdrHistogram& service, uint64_t& errors) {
+        lock();
+        response.add(responseTimes);
+        service.add(serviceTimes);
+        errors += nerrors;
+        responseTimes.reset();
+        serviceTimes.reset();
+        nerrors = 0;
+        bool ret = finished;
+        unlock();
+        return ret;
+    }
+
 #ifndef WIN32
     pthread_t thr;
 #endif
 
+    /** Operations scheduled, by node */
+    map<string, uint64_t> nodeOps;
+
+    /** Start and end of the open-loop run, in lcb_nstime() */
+    lcb_U64 runStart;
+    lcb_U64 runEnd;
+
+    /** Service times of replayed operations, by type. Read once the thread
+     * has finished */
+    HdrHistogram replayTimes[OP__MAX];
+
+    /** Results of each workload phase */
+    vector<PhaseStats> phaseStats;
+
 protected:
     // the callback methods needs to be able to set the error handler..
     friend void operationCallback(lcb_t, int, const lcb_RESPBASE*);
+    friend void openLoopCallback(lcb_t, int, const lcb_RESPBASE*);
     Histogram histogram;
 
     void setError(lcb_error_t e) { error = e; }
 
+    /** Cookie for an operation issued in open-loop or replay mode */
+    struct TimedOp {
+        ThreadContext *ctx;
+        lcb_U64 intended; // When the operation was due
+        lcb_U64 sent; // When it was actually scheduled
+        OpType type; // Type of a replayed operation, or OP__MAX
+    };
+
+    TimedOp *newTimedOp(lcb_U64 intended, lcb_U64 sent) {
+        TimedOp *op;
+        if (freeOps.empty()) {
+            op = new TimedOp();
+            op->ctx = this;
+        } else {
+            op = freeOps.back();
+            freeOps.pop_back();
+        }
+        op->intended = intended;
+        op->sent = sent;
+        op->type = OP__MAX;
+        return op;
+    }
+
+    void opDone(TimedOp *op, lcb_error_t rc) {
+        lcb_U64 now = lcb_nstime();
+        lock();
+        responseTimes.record((now - op->intended) / 1000);
+        serviceTimes.record((now - op->sent) / 1000);
+        if (rc != LCB_SUCCESS) {
+            nerrors++;
+        }
+        unlock();
+        if (op->type != OP__MAX) {
+            replayTimes[op->type].record((now - op->sent) / 1000);
+        }
+        freeOps.push_back(op);
+        outstanding--;
+    }
+
 private:
 
+    lcb_error_t scheduleOp(const NextOp& opinfo, const void *cookie) {
+        unsigned exptime = config.getExptime();
+
+        switch (opinfo.m_mode) {
+        case NextOp::STORE: {
+            lcb_CMDSTORE scmd = { 0 };
+            scmd.operation = LCB_SET;
+            scmd.exptime = exptime;
+            LCB_CMD_SET_KEY(&scmd, opinfo.m_key.c_str(), opinfo.m_key.size());
+            LCB_CMD_SET_VALUEIOV(&scmd, const_cast<lcb_IOV *>(&opinfo.m_valuefrags[0]), opinfo.m_valuefrags.size());
+            return lcb_store3(instance, cookie, &scmd);
+        }
+        case NextOp::GET: {
+            lcb_CMDGET gcmd = { 0 };
+            LCB_CMD_SET_KEY(&gcmd, opinfo.m_key.c_str(), opinfo.m_key.size());
+            gcmd.exptime = exptime;
+            return lcb_get3(instance, cookie, &gcmd);
+        }
+        case NextOp::SDSTORE:
+        case NextOp::SDGET: {
+            lcb_CMDSUBDOC sdcmd = { 0 };
+            if (opinfo.m_mode == NextOp::SDSTORE) {
+                sdcmd.exptime = exptime;
+            }
+            LCB_CMD_SET_KEY(&sdcmd, opinfo.m_key.c_str(), opinfo.m_key.size());
+            sdcmd.specs = &opinfo.m_specs[0];
+            sdcmd.nspecs = opinfo.m_specs.size();
+            return lcb_subdoc3(instance, cookie, &sdcmd);
+        }
+        }
+        return LCB_EINVAL;
+    }
+
+    /**
+     * Issue operations at a fixed rate, each one at the time it is due
+     * regardless of how long earlier operations take. Latencies are measured
+     * from when an operation was due rather than from when it could be sent,
+     * so that stalls in the client or the server are not hidden by the
+     * client issuing fewer operations during them (coordinated omission).
+     */
+    void runOpenLoop() {
+        // Population is a bulk load: run it closed-loop and don't time it
+        while (kgen.inPopulation() && config.maxCycles != 0) {
+            singleLoop();
+        }
+
+        lcb_install_callback3(instance, LCB_CALLBACK_STORE, openLoopCallback);
+        lcb_install_callback3(instance, LCB_CALLBACK_GET, openLoopCallback);
+        lcb_install_callback3(instance, LCB_CALLBACK_SDMUTATE, openLoopCallback);
+        lcb_install_callback3(instance, LCB_CALLBACK_SDLOOKUP, openLoopCallback);
+
+        const lcb_U64 interval = 1000000000ULL / config.getRateLimit();
+        lcb_U64 next = runStart = lcb_nstime();
+        size_t nissued = 0;
+
+        while (true) {
+            // Never schedule more than a batch at once, so that responses
+            // are still read if the client falls behind
+            size_t limit = config.opsPerCycle;
+            if (config.maxCycles != -1) {
+                size_t total = (size_t)config.maxCycles * config.opsPerCycle;
+                if (nissued >= total) {
+                    break;
+                }
+                limit = std::min(limit, total - nissued);
+            }
+
+            lcb_U64 now = lcb_nstime();
+            if (next <= now) {
+                nissued += scheduleDue(next, interval, now, limit);
+            }
+
+            now = lcb_nstime();
+            if (outstanding) {
+                // Return on the first response, or once the next operation is due
+                lcb_WAITCOOKIES wc = { 0 };
+                wc.threshold = 1;
+                wc.timeout = next > now ? (lcb_U32)std::min((next - now) / 1000 + 1, (lcb_U64)1000000) : 1;
+                lcb_wait_cookies(instance, &wc);
+            } else if (next > now + 200000) {
+                // Nothing to read until the next operation is due. Wake up
+                // a little early, since sleeping is not precise
+                usleep((next - now - 100000) / 1000);
+            }
+        }
+        lcb_wait(instance);
+
+        lock();
+        runEnd = lcb_nstime();
+        finished = true;
+        unlock();
+    }
+
+    void runWorkload() {
+        static const lcb_CALLBACKTYPE cbtypes[] = {
+            LCB_CALLBACK_GET, LCB_CALLBACK_STORE, LCB_CALLBACK_COUNTER,
+            LCB_CALLBACK_TOUCH, LCB_CALLBACK_REMOVE, LCB_CALLBACK_GETREPLICA,
+            LCB_CALLBACK_STOREDUR, LCB_CALLBACK_SDLOOKUP, LCB_CALLBACK_SDMUTATE
+        };
+        for (size_t ii = 0; ii < sizeof(cbtypes) / sizeof(cbtypes[0]); ii++) {
+            lcb_install_callback3(instance, cbtypes[ii], workloadCallback);
+        }
+        InsertedKeys inserted(threadIx);
+        phaseStats.resize(config.phases.size());
+
+        for (size_t ii = 0; ii < config.phases.size(); ii++) {
+            PhaseRunner runner(instance, config.phases[ii], ii, threadIx,
+                inserted, phaseStats[ii]);
+            runner.run();
+            phaseBarrier.wait(reportPhase, ii);
+            if (workloadStopped) {
+                break;
+            }
+        }
+    }
+
+    /**
+     * Schedule the operations which are due, advancing `next`
+     * @return the number of operations issued
+     */
+    size_t scheduleDue(lcb_U64& next, lcb_U64 interval, lcb_U64 now, size_t limit) {
+        size_t nissued = 0;
+        NextOp opinfo;
+        lcbvb_CONFIG *vbc = NULL;
+        lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_VBCONFIG, &vbc);
+        vector<uint64_t> nsched(vbc ? lcbvb_get_nservers(vbc) : 0);
+
+        lcb_sched_enter(instance);
+        for (; next <= now && nissued < limit; next += interval, nissued++) {
+            TimedOp *op = newTimedOp(next, now);
+            kgen.setNextOp(opinfo);
+            lcb_error_t rc = scheduleOp(opinfo, op);
+            if (rc != LCB_SUCCESS) {
+                log("Failed to schedule operation: [0x%x] %s", rc, lcb_strerror(instance, rc));
+                freeOps.push_back(op);
+                lock();
+                nerrors++;
+                unlock();
+            } else {
+                outstanding++;
+                countNode(vbc, opinfo.m_key, nsched);
+            }
+        }
+        addNodeOps(vbc, nsched);
+        lcb_sched_leave(instance);
+        return nissued;
+    }
+
+    /**
+     * Re-issue the operations of a capture (see LCB_CNTL_OPCAPTURE_FILE)
+     * whose key hashes belong to this thread, each at its captured time
+     * divided by --replay-speed. Like runOpenLoop(), latencies are also
+     * measured from when each operation was due. The capture is in completion
+     * order, so the operations are sorted by scheduling time first.
+     */
+    void runReplay() {
+        static const lcb_CALLBACKTYPE cbtypes[] = {
+            LCB_CALLBACK_GET, LCB_CALLBACK_STORE, LCB_CALLBACK_REMOVE,
+            LCB_CALLBACK_COUNTER, LCB_CALLBACK_TOUCH
+        };
+        for (size_t ii = 0; ii < sizeof(cbtypes) / sizeof(cbtypes[0]); ii++) {
+            lcb_install_callback3(instance, cbtypes[ii], openLoopCallback);
+        }
+
+        vector<lcb::opcapture::Record> records;
+        loadReplayed(records);
+        const double speed = config.getReplaySpeed();
+        const lcb_U64 first = config.captured.firstStart;
+        size_t ix = 0;
+        runStart = lcb_nstime();
+
+        while (ix < records.size() && config.maxCycles != 0) {
+            lcb_U64 now = lcb_nstime();
+            lcb_U64 due = speed > 0 ? runStart + (lcb_U64)((records[ix].start_ns - first) / speed) : now;
+            size_t nissued = 0;
+            if (due <= now) {
+                lcb_sched_enter(instance);
+                // Never schedule more than a batch at once, and at full speed
+                // never have more than a batch in flight
+                while (ix < records.size() && due <= now && nissued < config.opsPerCycle &&
+                        (speed > 0 || outstanding < config.opsPerCycle)) {
+                    scheduleReplayed(records[ix++], due, now);
+                    nissued++;
+                    if (ix < records.size() && speed > 0) {
+                        due = runStart + (lcb_U64)((records[ix].start_ns - first) / speed);
+                    }
+                }
+                lcb_sched_leave(instance);
+            }
+            if (ix == records.size()) {
+                break;
+            }
+
+            now = lcb_nstime();
+            if (outstanding) {
+                // Return on the first response, or once the next operation is due
+                lcb_WAITCOOKIES wc = { 0 };
+                wc.threshold = 1;
+                if (speed > 0) {
+                    wc.timeout = due > now ? (lcb_U32)std::min((due - now) / 1000 + 1, (lcb_U64)1000000) : 1;
+                }
+                lcb_wait_cookies(instance, &wc);
+            } else if (due > now + 200000) {
+                usleep((due - now - 100000) / 1000);
+            }
+        }
+        lcb_wait(instance);
+
+        lock();
+        runEnd = lcb_nstime();
+        finished = true;
+        unlock();
+    }
+
+    static bool scheduledBefore(const lcb::opcapture::Record& a,
+                                const lcb::opcapture::Record& b) {
+        return a.start_ns < b.start_ns;
+    }
+
+    /** Read the records which this thread replays, in scheduling order */
+    void loadReplayed(vector<lcb::opcapture::Record>& records) {
+        lcb::opcapture::Reader reader;
+        reader.open(config.getReplay().c_str());
+        lcb::opcapture::Record rec;
+        while (reader.next(rec)) {
+            if (rec.key_hash % config.getNumThreads() == (lcb_U64)threadIx &&
+                    replayType(rec.opcode) != OP__MAX) {
+                records.push_back(rec);
+            }
+        }
+        std::stable_sort(records.begin(), records.end(), scheduledBefore);
+    }
+
+    void scheduleReplayed(const lcb::opcapture::Record& rec, lcb_U64 due, lcb_U64 now) {
+        string key = rec.key;
+        if (key.empty()) {
+            // Keys which were not captured are replaced by their hashes
+            char buf[17];
+            sprintf(buf, "%016llx", (unsigned long long)rec.key_hash);
+            key = config.getKeyPrefix() + buf;
+        }
+
+        TimedOp *op = newTimedOp(due, now);
+        op->type = replayType(rec.opcode);
+        lcb_error_t rc = LCB_SUCCESS;
+        switch (op->type) {
+        case OP_GET: {
+            lcb_CMDGET cmd = { 0 };
+            LCB_CMD_SET_KEY(&cmd, key.c_str(), key.size());
+            rc = lcb_get3(instance, op, &cmd);
+            break;
+        }
+        case OP_UPSERT: {
+            if (replayValue.size() < rec.value_size) {
+                replayValue.resize(rec.value_size, '*');
+            }
+            lcb_CMDSTORE cmd = { 0 };
+            cmd.operation = LCB_SET;
+            cmd.exptime = config.getExptime();
+            LCB_CMD_SET_KEY(&cmd, key.c_str(), key.size());
+            LCB_CMD_SET_VALUE(&cmd, replayValue.c_str(), rec.value_size);
+            rc = lcb_store3(instance, op, &cmd);
+            break;
+        }
+        case OP_DELETE: {
+            lcb_CMDREMOVE cmd = { 0 };
+            LCB_CMD_SET_KEY(&cmd, key.c_str(), key.size());
+            rc = lcb_remove3(instance, op, &cmd);
+            break;
+        }
+        case OP_COUNTER: {
+            lcb_CMDCOUNTER cmd = { 0 };
+            LCB_CMD_SET_KEY(&cmd, key.c_str(), key.size());
+            cmd.delta = 1;
+            cmd.create = 1;
+            rc = lcb_counter3(instance, op, &cmd);
+            break;
+        }
+        default: {
+            lcb_CMDTOUCH cmd = { 0 };
+            LCB_CMD_SET_KEY(&cmd, key.c_str(), key.size());
+            cmd.exptime = config.getExptime();
+            rc = lcb_touch3(instance, op, &cmd);
+            break;
+        }
+        }
+
+        if (rc != LCB_SUCCESS) {
+            log("Failed to schedule operation: [0x%x] %s", rc, lcb_strerror(instance, rc));
+            freeOps.push_back(op);
+            lock();
+            nerrors++;
+            unlock();
+        } else {
+            outstanding++;
+        }
+    }
+
+    static void countNode(lcbvb_CONFIG *vbc, const string& key, vector<uint64_t>& counts) {
+        int vbid, srvix;
+        if (!vbc) {
+            return;
+        }
+        lcbvb_map_key(vbc, key.c_str(), key.size(), &vbid, &srvix);
+        if (srvix >= 0 && (size_t)srvix < counts.size()) {
+            counts[srvix]++;
+        }
+    }
+
+    /** Add the counts from countNode(). The configuration may change once
+     * the event loop runs, so this must be called before that */
+    void addNodeOps(lcbvb_CONFIG *vbc, const vector<uint64_t>& counts) {
+        for (size_t ii = 0; ii < counts.size(); ii++) {
+            if (counts[ii]) {
+                nodeOps[lcbvb_get_hostport(vbc, ii,
+                    LCBVB_SVCTYPE_DATA, LCBVB_SVCMODE_PLAIN)] += counts[ii];
+            }
+        }
+    }
+
+    void lock() {
+#ifndef WIN32
+        pthread_mutex_lock(&mutex);
+#endif
+    }
+    void unlock() {
+#ifndef WIN32
+        pthread_mutex_unlock(&mutex);
+#endif
+    }
+
     void rateLimitThrottle() {
         lcb_U64 now = lcb_nstime();
         static lcb_U64 previous_time = now;
@@ -649,6 +1662,22 @@ private:
     size_t niter;
     lcb_error_t error;
     lcb_t instance;
+    int threadIx;
+
+    // Open-loop state
+    vector<TimedOp *> freeOps;
+    size_t outstanding;
+    string replayValue; // Values of replayed stores
+
+    // Latencies (in microseconds) recorded since the last collect(),
+    // guarded by `mutex`
+    HdrHistogram responseTimes;
+    HdrHistogram serviceTimes;
+    uint64_t nerrors;
+    bool finished;
+#ifndef WIN32
+    pthread_mutex_t mutex;
+#endif
 };
 
 static void operationCallback(lcb_t, int, const lcb_RESPBASE *resp)
@@ -675,6 +1704,12 @@ static void operationCallback(lcb_t, int, const lcb_RESPBASE *resp)
 #endif
 }
 
+static void openLoopCallback(lcb_t, int, const lcb_RESPBASE *resp)
+{
+    ThreadContext::TimedOp *op = reinterpret_cast<ThreadContext::TimedOp *>(
+        const_cast<void *>(resp->cookie));
+    op->ctx->opDone(op, resp->rc);
+}
 
 std::list<ThreadContext *> contexts;
 
@@ -743,6 +1778,290 @@ static void start_worker(ThreadContext *ctx) { ctx->run(); }
 static void join_worker(ThreadContext *ctx) { (void)ctx; }
 #endif
 
+/** Show how the operations were spread over the nodes */
+static void printNodeOps()
+{
+    map<string, uint64_t> totals;
+    uint64_t total = 0;
+    for (std::list<ThreadContext *>::iterator it = contexts.begin();
+            it != contexts.end(); ++it) {
+        map<string, uint64_t>& cur = (*it)->nodeOps;
+        for (map<string, uint64_t>::iterator ii = cur.begin(); ii != cur.end(); ++ii) {
+            totals[ii->first] += ii->second;
+            total += ii->second;
+        }
+    }
+    if (!total) {
+        return;
+    }
+    fprintf(stderr, "Operations per node:\n");
+    for (map<string, uint64_t>::iterator ii = totals.begin(); ii != totals.end(); ++ii) {
+        fprintf(stderr, "  %-40s %12llu (%5.1f%%)\n", ii->first.c_str(),
+            (unsigned long long)ii->second, ii->second * 100.0 / total);
+    }
+}
+
+static Json::Value latencySummary(const HdrHistogram& h)
+{
+    Json::Value ret;
+    ret["count"] = (Json::UInt64)h.count();
+    ret["min"] = (Json::UInt64)h.min();
+    ret["mean"] = h.mean();
+    ret["p50"] = (Json::UInt64)h.percentile(50);
+    ret["p90"] = (Json::UInt64)h.percentile(90);
+    ret["p99"] = (Json::UInt64)h.percentile(99);
+    ret["p99.9"] = (Json::UInt64)h.percentile(99.9);
+    ret["p99.99"] = (Json::UInt64)h.percentile(99.99);
+    ret["max"] = (Json::UInt64)h.max();
+    return ret;
+}
+
+/** Results of the workload phases, for --json-report */
+static Json::Value workloadReport(Json::arrayValue);
+
+/** Print the results of a workload phase, once all threads have run it */
+static void reportPhase(size_t ix)
+{
+    const Phase& phase = config.phases[ix];
+    PhaseStats total;
+    for (std::list<ThreadContext *>::iterator it = contexts.begin();
+            it != contexts.end(); ++it) {
+        const PhaseStats& cur = (*it)->phaseStats[ix];
+        for (size_t op = 0; op < OP__MAX; op++) {
+            total.latency[op].add(cur.latency[op]);
+            total.errors[op] += cur.errors[op];
+        }
+        if (!total.start || cur.start < total.start) {
+            total.start = cur.start;
+        }
+        if (cur.end > total.end) {
+            total.end = cur.end;
+        }
+    }
+
+    double duration = (total.end - total.start) / 1000000000.0;
+    uint64_t nops = 0, nerrors = 0;
+    for (size_t op = 0; op < OP__MAX; op++) {
+        nops += total.latency[op].count();
+        nerrors += total.errors[op];
+    }
+    printf("Phase '%s': %llu operations (%llu errors) in %.3f seconds: %.1f ops/sec\n",
+        phase.name.c_str(), (unsigned long long)nops, (unsigned long long)nerrors,
+        duration, duration > 0 ? nops / duration : 0);
+    printf("  %-16s %10s %8s %10s %8s %8s %8s %8s %8s (us)\n", "Operation",
+        "count", "errors", "ops/sec", "mean", "p50", "p99", "p99.9", "max");
+
+    Json::Value result;
+    result["name"] = phase.name;
+    result["duration"] = duration;
+    result["ops"] = (Json::UInt64)nops;
+    result["errors"] = (Json::UInt64)nerrors;
+    for (size_t op = 0; op < OP__MAX; op++) {
+        const HdrHistogram& h = total.latency[op];
+        if (!h.count() && !total.errors[op]) {
+            continue;
+        }
+        printf("  %-16s %10llu %8llu %10.1f %8.0f %8llu %8llu %8llu %8llu\n",
+            opTypeNames[op], (unsigned long long)h.count(),
+            (unsigned long long)total.errors[op],
+            duration > 0 ? h.count() / duration : 0, h.mean(),
+            (unsigned long long)h.percentile(50),
+            (unsigned long long)h.percentile(99),
+            (unsigned long long)h.percentile(99.9),
+            (unsigned long long)h.max());
+        Json::Value& cur = result["operations"][opTypeNames[op]];
+        cur["errors"] = (Json::UInt64)total.errors[op];
+        cur["latency_us"] = latencySummary(h);
+    }
+    fflush(stdout);
+    workloadReport.append(result);
+
+    workloadStopped = config.maxCycles == 0;
+}
+
+static void writeWorkloadReport(const string& path)
+{
+    Json::Value root;
+    root["version"] = lcb_get_version(NULL);
+    root["workload"] = config.getWorkload();
+    root["config"]["threads"] = config.getNumThreads();
+    root["config"]["num_items"] = config.getNumItems();
+    root["phases"] = workloadReport;
+
+    std::ofstream ofs(path.c_str());
+    if (!ofs.is_open()) {
+        perror(path.c_str());
+        return;
+    }
+    ofs << Json::StyledWriter().write(root);
+}
+
+/** Collects the latencies of all threads in open-loop mode */
+class LatencyReport {
+public:
+    LatencyReport() : start(lcb_nstime()), errors(0), intervals(Json::arrayValue) {}
+
+    /**
+     * Collect the latencies recorded since the previous call
+     * @param print whether to print a line for this interval
+     * @return whether all threads have finished
+     */
+    bool collect(bool print) {
+        HdrHistogram response, service;
+        uint64_t nerrors = 0;
+        bool done = true;
+        for (std::list<ThreadContext *>::iterator it = contexts.begin();
+                it != contexts.end(); ++it) {
+            done = (*it)->collect(response, service, nerrors) && done;
+        }
+        responseTotal.add(response);
+        serviceTotal.add(service);
+        errors += nerrors;
+        if (response.count() == 0 && nerrors == 0) {
+            return done;
+        }
+
+        double elapsed = (lcb_nstime() - start) / 1000000000.0;
+        Json::Value interval(latencySummary(response));
+        interval["time"] = elapsed;
+        interval["errors"] = (Json::UInt64)nerrors;
+        intervals.append(interval);
+        if (print) {
+            printf("[%10.3f] %10llu ops  %6llu errors  p50 %8llu  p99 %8llu  p99.9 %8llu  max %8llu (us)\n",
+                elapsed, (unsigned long long)response.count(),
+                (unsigned long long)nerrors,
+                (unsigned long long)response.percentile(50),
+                (unsigned long long)response.percentile(99),
+                (unsigned long long)response.percentile(99.9),
+                (unsigned long long)response.max());
+            fflush(stdout);
+        }
+        return done;
+    }
+
+    void printSummary() {
+        double duration = getDuration();
+        printf("Completed %llu operations (%llu errors) in %.3f seconds: %.1f ops/sec",
+            (unsigned long long)responseTotal.count(), (unsigned long long)errors,
+            duration, duration > 0 ? responseTotal.count() / duration : 0);
+        if (config.isOpenLoop()) {
+            printf(" (target %llu)", (unsigned long long)config.getRateLimit() * config.getNumThreads());
+        }
+        printf("\n");
+        printf("%-32s %8s %8s %8s %8s %8s %8s %8s %8s\n", "Latency (us)",
+            "min", "mean", "p50", "p90", "p99", "p99.9", "p99.99", "max");
+        printRow("Response (from intended start)", responseTotal);
+        printRow("Service (from send)", serviceTotal);
+    }
+
+    /**
+     * Compare the latencies of the replayed operations with those in the
+     * capture. Both are measured from when the operation was scheduled.
+     */
+    void printReplayComparison() {
+        HdrHistogram replayed[OP__MAX];
+        for (std::list<ThreadContext *>::iterator it = contexts.begin();
+                it != contexts.end(); ++it) {
+            for (size_t op = 0; op < OP__MAX; op++) {
+                replayed[op].add((*it)->replayTimes[op]);
+            }
+        }
+        printf("%-22s %10s %8s %8s %8s %8s %8s %8s\n", "Replay latency (us)",
+            "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+        for (size_t op = 0; op < OP__MAX; op++) {
+            const HdrHistogram& orig = config.captured.latency[op];
+            if (!orig.count()) {
+                continue;
+            }
+            string name(opTypeNames[op]);
+            printComparisonRow((name + " captured").c_str(), orig);
+            printComparisonRow((name + " replayed").c_str(), replayed[op]);
+            Json::Value& cur = replayReport[opTypeNames[op]];
+            cur["captured_us"] = latencySummary(orig);
+            cur["replayed_us"] = latencySummary(replayed[op]);
+        }
+    }
+
+    void writeJson(const string& path) {
+        Json::Value root;
+        root["version"] = lcb_get_version(NULL);
+        Json::Value& cfg = root["config"];
+        cfg["threads"] = config.getNumThreads();
+        cfg["rate_per_thread"] = config.getRateLimit();
+        cfg["batch_size"] = config.opsPerCycle;
+        cfg["set_pct"] = config.setprc;
+        cfg["num_items"] = config.getNumItems();
+        cfg["distribution"] = config.distribution;
+        cfg["subdoc"] = config.isSubdoc();
+        root["duration"] = getDuration();
+        root["ops"] = (Json::UInt64)responseTotal.count();
+        root["errors"] = (Json::UInt64)errors;
+        root["response_time_us"] = latencySummary(responseTotal);
+        root["service_time_us"] = latencySummary(serviceTotal);
+        root["intervals"] = intervals;
+        if (config.isReplay()) {
+            cfg["replay"] = config.getReplay();
+            cfg["replay_speed"] = config.getReplaySpeed();
+            root["replay"] = replayReport;
+        }
+
+        std::ofstream ofs(path.c_str());
+        if (!ofs.is_open()) {
+            perror(path.c_str());
+            return;
+        }
+        ofs << Json::StyledWriter().write(root);
+    }
+
+private:
+    static void printRow(const char *name, const HdrHistogram& h) {
+        printf("%-32s %8llu %8.0f %8llu %8llu %8llu %8llu %8llu %8llu\n", name,
+            (unsigned long long)h.min(), h.mean(),
+            (unsigned long long)h.percentile(50),
+            (unsigned long long)h.percentile(90),
+            (unsigned long long)h.percentile(99),
+            (unsigned long long)h.percentile(99.9),
+            (unsigned long long)h.percentile(99.99),
+            (unsigned long long)h.max());
+    }
+
+    static void printComparisonRow(const char *name, const HdrHistogram& h) {
+        printf("%-22s %10llu %8.0f %8llu %8llu %8llu %8llu %8llu\n", name,
+            (unsigned long long)h.count(), h.mean(),
+            (unsigned long long)h.percentile(50),
+            (unsigned long long)h.percentile(90),
+            (unsigned long long)h.percentile(99),
+            (unsigned long long)h.percentile(99.9),
+            (unsigned long long)h.max());
+    }
+
+    /** Time from the first thread starting its run to the last one ending */
+    double getDuration() {
+        lcb_U64 first = 0, last = 0;
+        for (std::list<ThreadContext *>::iterator it = contexts.begin();
+                it != contexts.end(); ++it) {
+            ThreadContext *ctx = *it;
+            if (!ctx->runStart) {
+                continue;
+            }
+            if (!first || ctx->runStart < first) {
+                first = ctx->runStart;
+            }
+            if (ctx->runEnd > last) {
+                last = ctx->runEnd;
+            }
+        }
+        return last > first ? (last - first) / 1000000000.0 : 0;
+    }
+
+    lcb_U64 start;
+    HdrHistogram responseTotal;
+    HdrHistogram serviceTotal;
+    uint64_t errors;
+    Json::Value intervals;
+    Json::Value replayReport; // Captured and replayed latencies, by type
+};
+
 extern "C" {
 static void *thread_worker(void *arg)
 {
@@ -783,6 +2102,7 @@ int main(int argc, char **argv)
     ConnParams& cp = config.params;
     lcb_error_t error;
 
+    phaseBarrier.setThreads(nthreads);
     for (uint32_t ii = 0; ii < nthreads; ++ii) {
         cp.fillCropts(options);
         lcb_t instance = NULL;
@@ -814,9 +2134,35 @@ int main(int argc, char **argv)
         start_worker(ctx);
     }
 
+    LatencyReport report;
+    if (config.isOpenLoop() || config.isReplay()) {
+        // Report once per second until all threads are done
+        lcb_U64 next = lcb_nstime();
+        while (!report.collect(true)) {
+            next += 1000000000ULL;
+            lcb_U64 now = lcb_nstime();
+            if (next > now) {
+                usleep((next - now) / 1000);
+            }
+        }
+    }
+
     for (std::list<ThreadContext *>::iterator it = contexts.begin();
             it != contexts.end(); ++it) {
         join_worker(*it);
     }
+    printNodeOps();
+    if (config.isOpenLoop() || config.isReplay()) {
+        report.collect(true);
+        report.printSummary();
+        if (config.isReplay()) {
+            report.printReplayComparison();
+        }
+        if (!config.getJsonReport().empty()) {
+            report.writeJson(config.getJsonReport());
+        }
+    } else if (config.isWorkload() && !config.getJsonReport().empty()) {
+        writeWorkloadReport(config.getJsonReport());
+    }
     return exit_code;
 }
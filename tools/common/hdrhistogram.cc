@@ -0,0 +1,127 @@
+#include "hdrhistogram.h"
+#include <math.h>
+using namespace cbc;
+
+// Bucket N covers [1024, 2048) << N in 1024 steps, so each value is kept to
+// within 1/1024 of itself (three significant digits). Bucket 0 also covers
+// [0, 1024) exactly.
+#define SUB_BUCKET_HALF_MAGNITUDE 10
+#define SUB_BUCKET_HALF_COUNT (1U << SUB_BUCKET_HALF_MAGNITUDE)
+#define SUB_BUCKET_MASK ((lcb_U64)SUB_BUCKET_HALF_COUNT * 2 - 1)
+
+static unsigned
+bitLength(lcb_U64 value)
+{
+    unsigned ret = 0;
+    while (value) {
+        value >>= 1;
+        ret++;
+    }
+    return ret;
+}
+
+HdrHistogram::HdrHistogram(lcb_U64 highest_)
+: highest(highest_), total(0), sum(0), minval(0), maxval(0)
+{
+    if (highest < SUB_BUCKET_MASK) {
+        highest = SUB_BUCKET_MASK;
+    }
+    unsigned nbuckets = bitLength(highest) - SUB_BUCKET_HALF_MAGNITUDE;
+    counts.resize((nbuckets + 1) * SUB_BUCKET_HALF_COUNT);
+}
+
+size_t
+HdrHistogram::indexOf(lcb_U64 value) const
+{
+    unsigned bucket = bitLength(value | SUB_BUCKET_MASK) - (SUB_BUCKET_HALF_MAGNITUDE + 1);
+    size_t sub = (size_t)(value >> bucket);
+    return ((size_t)(bucket + 1) << SUB_BUCKET_HALF_MAGNITUDE) + (sub - SUB_BUCKET_HALF_COUNT);
+}
+
+lcb_U64
+HdrHistogram::valueAt(size_t index) const
+{
+    if (index < SUB_BUCKET_HALF_COUNT * 2) {
+        return index;
+    }
+    unsigned bucket = (unsigned)(index >> SUB_BUCKET_HALF_MAGNITUDE) - 1;
+    lcb_U64 sub = (index & (SUB_BUCKET_HALF_COUNT - 1)) + SUB_BUCKET_HALF_COUNT;
+    return sub << bucket;
+}
+
+lcb_U64
+HdrHistogram::highestEquivalent(size_t index) const
+{
+    if (index < SUB_BUCKET_HALF_COUNT * 2) {
+        return index;
+    }
+    unsigned bucket = (unsigned)(index >> SUB_BUCKET_HALF_MAGNITUDE) - 1;
+    return valueAt(index) + ((lcb_U64)1 << bucket) - 1;
+}
+
+void
+HdrHistogram::record(lcb_U64 value, lcb_U64 n)
+{
+    if (value > highest) {
+        value = highest;
+    }
+    counts[indexOf(value)] += n;
+    if (!total || value < minval) {
+        minval = value;
+    }
+    if (value > maxval) {
+        maxval = value;
+    }
+    total += n;
+    sum += value * n;
+}
+
+void
+HdrHistogram::add(const HdrHistogram& other)
+{
+    if (!other.total) {
+        return;
+    }
+    for (size_t ii = 0; ii < counts.size() && ii < other.counts.size(); ii++) {
+        counts[ii] += other.counts[ii];
+    }
+    if (!total || other.minval < minval) {
+        minval = other.minval;
+    }
+    if (other.maxval > maxval) {
+        maxval = other.maxval;
+    }
+    total += other.total;
+    sum += other.sum;
+}
+
+void
+HdrHistogram::reset()
+{
+    counts.assign(counts.size(), 0);
+    total = sum = minval = maxval = 0;
+}
+
+lcb_U64
+HdrHistogram::percentile(double pct) const
+{
+    if (!total) {
+        return 0;
+    }
+    lcb_U64 target = (lcb_U64)ceil(pct / 100.0 * total);
+    if (target == 0) {
+        return minval;
+    } else if (target > total) {
+        target = total;
+    }
+
+    lcb_U64 seen = 0;
+    for (size_t ii = 0; ii < counts.size(); ii++) {
+        seen += counts[ii];
+        if (seen >= target) {
+            lcb_U64 ret = highestEquivalent(ii);
+            return ret > maxval ? maxval : ret;
+        }
+    }
+    return maxval;
+}
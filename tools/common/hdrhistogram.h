@@ -0,0 +1,45 @@
+#ifndef CBC_HDRHISTOGRAM_H
+#define CBC_HDRHISTOGRAM_H
+#include <libcouchbase/couchbase.h>
+#include <vector>
+
+namespace cbc {
+
+/**
+ * High dynamic range histogram (after HdrHistogram) with a fixed relative
+ * precision of three significant digits. Values are unitless; the tools
+ * record latencies in microseconds. Values above the highest trackable value
+ * are clamped to it.
+ */
+class HdrHistogram {
+public:
+    HdrHistogram(lcb_U64 highest = 3600ULL * 1000000);
+
+    void record(lcb_U64 value, lcb_U64 count = 1);
+    /** Add the counts of another histogram with the same range */
+    void add(const HdrHistogram& other);
+    void reset();
+
+    lcb_U64 count() const { return total; }
+    lcb_U64 min() const { return total ? minval : 0; }
+    lcb_U64 max() const { return maxval; }
+    double mean() const { return total ? (double)sum / total : 0; }
+    /** @param pct percentile, in [0, 100] */
+    lcb_U64 percentile(double pct) const;
+
+private:
+    size_t indexOf(lcb_U64 value) const;
+    lcb_U64 valueAt(size_t index) const;
+    lcb_U64 highestEquivalent(size_t index) const;
+
+    lcb_U64 highest;
+    std::vector<lcb_U64> counts;
+    lcb_U64 total;
+    lcb_U64 sum;
+    lcb_U64 minval;
+    lcb_U64 maxval;
+};
+
+}
+
+#endif
@@ -0,0 +1,253 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef CBC_PILLOWFIGHT_KEYDIST_H
+#define CBC_PILLOWFIGHT_KEYDIST_H
+
+#include <math.h>
+#include <string>
+#include <stdexcept>
+
+namespace Pillowfight {
+
+/** Small per-thread random number generator (splitmix64) */
+class Random {
+public:
+    Random(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    /** @return a number in [0, 1) */
+    double nextDouble() {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    /** @return a number in [0, n) */
+    uint32_t nextInt(uint32_t n) {
+        return static_cast<uint32_t>(nextDouble() * n);
+    }
+
+private:
+    uint64_t state;
+};
+
+/**
+ * Chooses which of `n` items the next operation accesses. Lower indexes are
+ * the more popular ones; since keys are hashed to vBuckets, popular keys are
+ * still spread over all the nodes.
+ */
+class KeyDistribution {
+public:
+    KeyDistribution(uint32_t n, uint64_t seed) : nitems(n), rnd(seed) {}
+    virtual ~KeyDistribution() {}
+
+    /**
+     * @param is_write whether the item will be modified
+     * @return the index of the item, in [0, n)
+     */
+    virtual uint32_t next(bool is_write) = 0;
+
+    /** Decide whether an operation is a mutation, with `pct` percent chance */
+    bool chance(unsigned pct) {
+        return rnd.nextInt(100) < pct;
+    }
+
+    static KeyDistribution *create(const std::string& name, uint32_t n,
+                                   uint64_t seed, double theta,
+                                   unsigned hot_ops, unsigned hot_keys,
+                                   unsigned exp_keys, uint32_t first_write);
+
+protected:
+    uint32_t nitems;
+    Random rnd;
+};
+
+/**
+ * Zipfian distribution: the item of rank k is accessed with a probability
+ * proportional to 1/k^theta. Uses rejection-inversion sampling (Hormann and
+ * Derflinger), so any theta > 0 may be used and no per-item table is needed.
+ */
+class ZipfianDistribution : public KeyDistribution {
+public:
+    ZipfianDistribution(uint32_t n, uint64_t seed, double theta_)
+    : KeyDistribution(n, seed), theta(theta_) {
+        if (theta <= 0) {
+            throw std::runtime_error("Zipfian theta must be greater than 0");
+        }
+        h_x1 = H(1.5) - 1.0;
+        h_n = H(n + 0.5);
+        s = 2.0 - Hinv(H(2.5) - h(2.0));
+    }
+
+    uint32_t next(bool) {
+        return rank(rnd);
+    }
+
+    /** @return an index in [0, n) */
+    uint32_t rank(Random& r) {
+        while (true) {
+            double u = h_n + r.nextDouble() * (h_x1 - h_n);
+            double x = Hinv(u);
+            double k = floor(x + 0.5);
+            if (k < 1) {
+                k = 1;
+            } else if (k > nitems) {
+                k = nitems;
+            }
+            if (k - x <= s || u >= H(k + 0.5) - h(k)) {
+                return static_cast<uint32_t>(k) - 1;
+            }
+        }
+    }
+
+private:
+    double h(double x) const {
+        return exp(-theta * log(x));
+    }
+    double H(double x) const {
+        double logx = log(x);
+        return helper2((1.0 - theta) * logx) * logx;
+    }
+    double Hinv(double x) const {
+        double t = x * (1.0 - theta);
+        if (t < -1.0) {
+            t = -1.0;
+        }
+        return exp(helper1(t) * x);
+    }
+    /** log(1+x)/x, accurate near 0 */
+    static double helper1(double x) {
+        if (fabs(x) > 1e-8) {
+            return log1p(x) / x;
+        }
+        return 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+    }
+    /** (exp(x)-1)/x, accurate near 0 */
+    static double helper2(double x) {
+        if (fabs(x) > 1e-8) {
+            return expm1(x) / x;
+        }
+        return 1.0 + x * 0.5 * (1.0 + x * 1.0 / 3.0 * (1.0 + 0.25 * x));
+    }
+
+    double theta;
+    double h_x1;
+    double h_n;
+    double s;
+};
+
+/** `hot_ops` percent of the operations access the first `hot_keys` percent */
+class HotspotDistribution : public KeyDistribution {
+public:
+    HotspotDistribution(uint32_t n, uint64_t seed, unsigned hot_ops, unsigned hot_keys)
+    : KeyDistribution(n, seed), ops_pct(hot_ops) {
+        if (hot_ops > 100 || hot_keys > 100) {
+            throw std::runtime_error("Hotspot percentages must be at most 100");
+        }
+        nhot = static_cast<uint32_t>((double)n * hot_keys / 100);
+        if (nhot == 0) {
+            nhot = 1;
+        }
+    }
+
+    uint32_t next(bool) {
+        if (nhot >= nitems || chance(ops_pct)) {
+            return rnd.nextInt(nhot < nitems ? nhot : nitems);
+        }
+        return nhot + rnd.nextInt(nitems - nhot);
+    }
+
+private:
+    unsigned ops_pct;
+    uint32_t nhot;
+};
+
+/**
+ * Writes go to the items in turn, as if each one inserted a new item, and
+ * reads favour the most recently written ones (Zipfian by age).
+ */
+class LatestDistribution : public KeyDistribution {
+public:
+    LatestDistribution(uint32_t n, uint64_t seed, double theta, uint32_t first)
+    : KeyDistribution(n, seed), zipf(n, seed, theta), latest(first % n) {}
+
+    uint32_t next(bool is_write) {
+        if (is_write) {
+            latest = (latest + 1) % nitems;
+            return latest;
+        }
+        uint32_t age = zipf.rank(rnd);
+        return (latest + nitems - age) % nitems;
+    }
+
+private:
+    ZipfianDistribution zipf;
+    uint32_t latest;
+};
+
+/** Exponential distribution: 95% of operations access the first `keys_pct`
+ * percent of the items */
+class ExponentialDistribution : public KeyDistribution {
+public:
+    ExponentialDistribution(uint32_t n, uint64_t seed, unsigned keys_pct)
+    : KeyDistribution(n, seed) {
+        if (keys_pct == 0 || keys_pct > 100) {
+            throw std::runtime_error("Exponential key percentage must be between 1 and 100");
+        }
+        double span = (double)n * keys_pct / 100;
+        lambda = -log(0.05) / (span < 1 ? 1 : span);
+    }
+
+    uint32_t next(bool) {
+        double x;
+        do {
+            x = -log(1.0 - rnd.nextDouble()) / lambda;
+        } while (x >= nitems);
+        return static_cast<uint32_t>(x);
+    }
+
+private:
+    double lambda;
+};
+
+inline KeyDistribution *
+KeyDistribution::create(const std::string& name, uint32_t n, uint64_t seed,
+                        double theta, unsigned hot_ops, unsigned hot_keys,
+                        unsigned exp_keys, uint32_t first_write)
+{
+    if (n == 0) {
+        throw std::runtime_error("Need at least one item");
+    }
+    if (name == "zipfian") {
+        return new ZipfianDistribution(n, seed, theta);
+    } else if (name == "hotspot") {
+        return new HotspotDistribution(n, seed, hot_ops, hot_keys);
+    } else if (name == "latest") {
+        return new LatestDistribution(n, seed, theta, first_write);
+    } else if (name == "exponential") {
+        return new ExponentialDistribution(n, seed, exp_keys);
+    }
+    throw std::runtime_error("Unknown key distribution: " + name);
+}
+
+}
+#endif
@@ -0,0 +1,305 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef CBC_PILLOWFIGHT_WORKLOAD_H
+#define CBC_PILLOWFIGHT_WORKLOAD_H
+
+#include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
+#include "keydist.h"
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+/**
+ * @file
+ * Workload files describe a sequence of phases, run one after the other.
+ * A workload file is a JSON object with a `phases` array; each phase is an
+ * object with the following fields, all of which except `mix` are optional:
+ *
+ * - `name`: shown in the report
+ * - `load`: if true, the phase is skipped with --no-population
+ * - `ops`: total number of operations (over all threads)
+ * - `duration`: number of seconds to run for
+ * - `batch_size`: operations scheduled before waiting for them
+ * - `distribution`: which keys are accessed: sequential, uniform, zipfian,
+ *   hotspot, latest or exponential. A sequential phase without `ops` or
+ *   `duration` accesses each key once. Other phases without either run for
+ *   --num-cycles batches.
+ * - `zipf_theta`, `hotspot`, `exp_keys`: parameters of the distribution
+ * - `mix`: the relative weight of each operation type, e.g.
+ *   `{"get": 95, "replace": 5}`. See opTypeNames for the types.
+ * - `value_size`: `{"min": 50, "max": 5120, "distribution": "uniform"}`.
+ *   Values are one of 11 evenly spaced sizes between min and max (see
+ *   RawDocGenerator::gen_graded_sizes). The distribution may also be
+ *   "zipfian", favouring the smaller sizes.
+ * - `json`: store JSON documents (implied by subdoc operations)
+ * - `expiry`: expiry of stored and touched documents
+ * - `pathcount`: number of paths per subdoc operation
+ * - `scan_length`: the most keys read by a scan
+ * - `persist_to`, `replicate_to`: durability of durable_upsert operations
+ */
+
+namespace Pillowfight {
+
+enum OpType {
+    OP_GET,
+    OP_UPSERT,
+    OP_REPLACE,
+    OP_INSERT, /**< Adds a new key, after those already in the key space */
+    OP_DELETE,
+    OP_COUNTER, /**< Increments a counter (stored under a separate key) */
+    OP_TOUCH,
+    OP_SDLOOKUP,
+    OP_SDMUTATE,
+    OP_REPLICA_GET,
+    OP_DURABLE_UPSERT,
+    OP_SCAN, /**< Reads a range of consecutive keys */
+    OP_RMW, /**< Reads a document, then replaces it using its CAS */
+    OP__MAX
+};
+
+static const char * const opTypeNames[OP__MAX] = {
+    "get", "upsert", "replace", "insert", "delete", "counter", "touch",
+    "sdlookup", "sdmutate", "replica_get", "durable_upsert", "scan", "rmw"
+};
+
+struct Phase {
+    Phase()
+    : load(false), ops(0), duration(0), batchSize(100),
+      distribution("uniform"), zipfTheta(0.99), hotOps(80), hotKeys(20),
+      expKeys(10), totalWeight(0), minSize(50), maxSize(5120),
+      zipfSizes(false), json(false), expiry(0), pathCount(1), scanLength(100),
+      persistTo(1), replicateTo(0) {
+        for (size_t ii = 0; ii < OP__MAX; ii++) {
+            weights[ii] = 0;
+        }
+    }
+
+    /** @return the type of the next operation, according to the mix */
+    OpType pick(Random& rnd) const {
+        unsigned n = rnd.nextInt(totalWeight);
+        for (size_t ii = 0; ii < OP__MAX; ii++) {
+            if (n < weights[ii]) {
+                return static_cast<OpType>(ii);
+            }
+            n -= weights[ii];
+        }
+        return OP_GET;
+    }
+
+    bool hasOp(OpType op) const { return weights[op] != 0; }
+
+    std::string name;
+    bool load;
+    uint64_t ops;
+    double duration;
+    unsigned batchSize;
+    std::string distribution;
+    double zipfTheta;
+    unsigned hotOps;
+    unsigned hotKeys;
+    unsigned expKeys;
+    unsigned weights[OP__MAX];
+    unsigned totalWeight;
+    uint32_t minSize;
+    uint32_t maxSize;
+    bool zipfSizes;
+    bool json;
+    unsigned expiry;
+    unsigned pathCount;
+    unsigned scanLength;
+    int persistTo;
+    int replicateTo;
+};
+
+class Workload {
+public:
+    /**
+     * Load a built-in workload (see builtin()) or a workload file
+     * @param defaults phase settings from the command line
+     */
+    static std::vector<Phase> load(const std::string& name, const Phase& defaults) {
+        const char *text = builtin(name);
+        if (text) {
+            return parse(text, defaults);
+        }
+        std::ifstream ifs(name.c_str());
+        if (!ifs.is_open()) {
+            throw std::runtime_error("Couldn't open workload file " + name);
+        }
+        std::stringstream ss;
+        ss << ifs.rdbuf();
+        return parse(ss.str(), defaults);
+    }
+
+    static std::vector<Phase> parse(const std::string& text, const Phase& defaults) {
+        Json::Value root;
+        if (!Json::Reader().parse(text, root) || !root.isObject() ||
+                !root["phases"].isArray() || root["phases"].empty()) {
+            throw std::runtime_error("Workload must be a JSON object with a non-empty 'phases' array");
+        }
+        std::vector<Phase> ret;
+        const Json::Value& phases = root["phases"];
+        for (Json::ArrayIndex ii = 0; ii < phases.size(); ii++) {
+            ret.push_back(parsePhase(phases[ii], defaults, ii));
+        }
+        return ret;
+    }
+
+    /**
+     * The YCSB core workloads A to F, over --num-items records. Each first
+     * loads the records, then runs:
+     *
+     * - A: 50% reads, 50% updates
+     * - B: 95% reads, 5% updates
+     * - C: reads only
+     * - D: 95% reads of recently inserted records, 5% inserts
+     * - E: 95% short scans, 5% inserts. Scans are performed as reads of
+     *   consecutive keys
+     * - F: 50% reads, 50% read-modify-writes
+     *
+     * @return the workload definition, or NULL if `name` is not built in
+     */
+    static const char *builtin(const std::string& name) {
+#define YCSB_LOAD "{\"name\": \"load\", \"load\": true, \"distribution\": \"sequential\", " \
+    "\"json\": true, \"value_size\": {\"min\": 1000, \"max\": 1000}, \"mix\": {\"upsert\": 1}}, "
+#define YCSB_RUN(dist, mix) "{\"name\": \"run\", \"distribution\": \"" dist "\", " \
+    "\"json\": true, \"value_size\": {\"min\": 1000, \"max\": 1000}, \"mix\": " mix "}"
+        if (name == "ycsb-a") {
+            return "{\"phases\": [" YCSB_LOAD YCSB_RUN("zipfian", "{\"get\": 50, \"replace\": 50}") "]}";
+        } else if (name == "ycsb-b") {
+            return "{\"phases\": [" YCSB_LOAD YCSB_RUN("zipfian", "{\"get\": 95, \"replace\": 5}") "]}";
+        } else if (name == "ycsb-c") {
+            return "{\"phases\": [" YCSB_LOAD YCSB_RUN("zipfian", "{\"get\": 100}") "]}";
+        } else if (name == "ycsb-d") {
+            return "{\"phases\": [" YCSB_LOAD YCSB_RUN("latest", "{\"get\": 95, \"insert\": 5}") "]}";
+        } else if (name == "ycsb-e") {
+            return "{\"phases\": [" YCSB_LOAD YCSB_RUN("zipfian", "{\"scan\": 95, \"insert\": 5}") "]}";
+        } else if (name == "ycsb-f") {
+            return "{\"phases\": [" YCSB_LOAD YCSB_RUN("zipfian", "{\"get\": 50, \"rmw\": 50}") "]}";
+        }
+        return NULL;
+#undef YCSB_LOAD
+#undef YCSB_RUN
+    }
+
+private:
+    static Phase parsePhase(const Json::Value& obj, const Phase& defaults, unsigned ix) {
+        if (!obj.isObject()) {
+            throw std::runtime_error("Each phase must be a JSON object");
+        }
+        Phase ph(defaults);
+        char buf[32];
+        sprintf(buf, "phase %u", ix + 1);
+        ph.name = buf;
+
+        Json::Value::Members keys = obj.getMemberNames();
+        for (size_t ii = 0; ii < keys.size(); ii++) {
+            const std::string& k = keys[ii];
+            const Json::Value& v = obj[k];
+            if (k == "name") {
+                ph.name = v.asString();
+            } else if (k == "load") {
+                ph.load = v.asBool();
+            } else if (k == "ops") {
+                ph.ops = v.asUInt64();
+            } else if (k == "duration") {
+                ph.duration = v.asDouble();
+            } else if (k == "batch_size") {
+                ph.batchSize = v.asUInt();
+            } else if (k == "distribution") {
+                ph.distribution = v.asString();
+            } else if (k == "zipf_theta") {
+                ph.zipfTheta = v.asDouble();
+            } else if (k == "hotspot") {
+                if (sscanf(v.asCString(), "%u,%u", &ph.hotOps, &ph.hotKeys) != 2) {
+                    throw std::runtime_error("invalid hotspot spec: need OPS_PCT,KEYS_PCT");
+                }
+            } else if (k == "exp_keys") {
+                ph.expKeys = v.asUInt();
+            } else if (k == "mix") {
+                parseMix(v, ph);
+            } else if (k == "value_size") {
+                ph.minSize = v.get("min", ph.minSize).asUInt();
+                ph.maxSize = v.get("max", ph.maxSize).asUInt();
+                std::string dist = v.get("distribution", "uniform").asString();
+                if (dist != "uniform" && dist != "zipfian") {
+                    throw std::runtime_error("Unknown value size distribution: " + dist);
+                }
+                ph.zipfSizes = dist == "zipfian";
+            } else if (k == "json") {
+                ph.json = v.asBool();
+            } else if (k == "expiry") {
+                ph.expiry = v.asUInt();
+            } else if (k == "pathcount") {
+                ph.pathCount = v.asUInt();
+            } else if (k == "scan_length") {
+                ph.scanLength = v.asUInt();
+            } else if (k == "persist_to") {
+                ph.persistTo = v.asInt();
+            } else if (k == "replicate_to") {
+                ph.replicateTo = v.asInt();
+            } else {
+                throw std::runtime_error("Unknown phase field: " + k);
+            }
+        }
+
+        if (!ph.totalWeight) {
+            throw std::runtime_error("Phase '" + ph.name + "' has no operations in its mix");
+        }
+        if (ph.minSize > ph.maxSize) {
+            throw std::runtime_error("min cannot be higher than max");
+        }
+        if (ph.batchSize == 0 || ph.scanLength == 0) {
+            throw std::runtime_error("batch_size and scan_length must be greater than 0");
+        }
+        if (ph.hasOp(OP_SDLOOKUP) || ph.hasOp(OP_SDMUTATE)) {
+            ph.json = true;
+        }
+        if (ph.distribution != "sequential" && ph.distribution != "uniform") {
+            // Validate the parameters up front
+            delete KeyDistribution::create(ph.distribution, 1, 0, ph.zipfTheta,
+                ph.hotOps, ph.hotKeys, ph.expKeys, 0);
+        }
+        return ph;
+    }
+
+    static void parseMix(const Json::Value& mix, Phase& ph) {
+        if (!mix.isObject()) {
+            throw std::runtime_error("The mix must be a JSON object");
+        }
+        Json::Value::Members keys = mix.getMemberNames();
+        for (size_t ii = 0; ii < keys.size(); ii++) {
+            size_t op;
+            for (op = 0; op < OP__MAX; op++) {
+                if (keys[ii] == opTypeNames[op]) {
+                    break;
+                }
+            }
+            if (op == OP__MAX) {
+                throw std::runtime_error("Unknown operation type: " + keys[ii]);
+            }
+            ph.weights[op] = mix[keys[ii]].asUInt();
+            ph.totalWeight += ph.weights[op];
+        }
+    }
+};
+
+}
+#endif